@@ -20,8 +20,16 @@
 #pragma once
 
 #include <assert.h>
+#include <math.h>
+#include <type_traits>
 #include "DShowUtil.h"
 
+// Number of passes over the window after which the running sum is recomputed from the samples
+#define FLOATING_AVERAGE_RESYNC_WRAPS 16
+
+// Floating average, minimum and maximum over a window of the last samples
+// All statistics are updated incrementally, so their cost does not depend on the size of the window.
+// The running sum is recomputed every FLOATING_AVERAGE_RESYNC_WRAPS passes, so rounding errors can not accumulate.
 template <class T> class FloatingAverage
 {
   public:
@@ -34,89 +42,196 @@ template <class T> class FloatingAverage
         if (iNumSamples > m_NumSamplesAlloc)
         {
             m_Samples = (T *)realloc(m_Samples, iNumSamples * sizeof(T));
+            m_Min.Alloc(iNumSamples);
+            m_Max.Alloc(iNumSamples);
+            m_AbsMin.Alloc(iNumSamples);
+            m_AbsMax.Alloc(iNumSamples);
             m_NumSamplesAlloc = iNumSamples;
         }
         if (iNumSamples > m_NumSamples)
             memset(m_Samples + m_NumSamples, 0, sizeof(T) * (iNumSamples - m_NumSamples));
         m_NumSamples = iNumSamples;
+        if (m_CurrentSample >= m_NumSamples)
+            m_CurrentSample = 0;
+
+        Rebuild();
     }
 
     void Sample(T fSample)
     {
+        const T fOldest = m_Samples[m_CurrentSample];
         m_Samples[m_CurrentSample] = fSample;
+
+        bool bResync = false;
         if (++m_CurrentSample >= m_NumSamples)
         {
             m_CurrentSample = 0;
+            bResync = (++m_Wraps % FLOATING_AVERAGE_RESYNC_WRAPS) == 0;
         }
-    }
 
-    T Average() const
-    {
-        T fAverage = 0;
-        for (unsigned int i = 0; i < m_NumSamples; ++i)
+        // an infinite or NaN sample can not be subtracted from the sum again once it leaves the window
+        if (bResync || !IsFinite(fOldest))
         {
-            fAverage += m_Samples[i] / m_NumSamples;
+            Rebuild();
+            return;
         }
-        return fAverage;
+
+        m_Sum += (SumType)fSample - (SumType)fOldest;
+
+        m_Sequence++;
+        m_Min.Push(m_Sequence, fSample, m_NumSamples);
+        m_Max.Push(m_Sequence, fSample, m_NumSamples);
+        m_AbsMin.Push(m_Sequence, fSample, m_NumSamples);
+        m_AbsMax.Push(m_Sequence, fSample, m_NumSamples);
     }
 
-    T Minimum() const
+    T Average() const { return (T)(m_Sum / (SumType)m_NumSamples); }
+
+    T Minimum() const { return m_Min.Front(); }
+
+    // Of several samples with the same magnitude, the most recent one is returned
+    T AbsMinimum() const { return m_AbsMin.Front(); }
+
+    T Maximum() const { return m_Max.Front(); }
+
+    T AbsMaximum() const { return m_AbsMax.Front(); }
+
+    void OffsetValues(T value)
     {
-        T min = m_Samples[0];
-        for (unsigned int i = 1; i < m_NumSamples; ++i)
+        for (unsigned int i = 0; i < m_NumSamples; ++i)
         {
-            if (m_Samples[i] < min)
-                min = m_Samples[i];
+            m_Samples[i] += value;
         }
-        return min;
+
+        // the order by magnitude changes, so start over
+        Rebuild();
     }
 
-    T AbsMinimum() const
+    // Count the samples into nBins bins of fBinWidth, centered around zero
+    // Samples beyond the range are counted in the outermost bins
+    void Histogram(T fBinWidth, unsigned int *pBins, unsigned int nBins) const
     {
-        T min = m_Samples[0];
-        for (unsigned int i = 1; i < m_NumSamples; ++i)
+        assert(fBinWidth > 0 && nBins > 0);
+        memset(pBins, 0, sizeof(unsigned int) * nBins);
+        for (unsigned int i = 0; i < m_NumSamples; ++i)
         {
-            if (abs(m_Samples[i]) < abs(min))
-                min = m_Samples[i];
+            double bin = floor((double)m_Samples[i] / (double)fBinWidth + nBins / 2.0);
+            pBins[(unsigned int)max(0.0, min(bin, (double)(nBins - 1)))]++;
         }
-        return min;
     }
 
-    T Maximum() const
+    unsigned int CurrentSample() const { return m_CurrentSample; }
+
+  private:
+    // Recompute all statistics from the samples in the window, oldest first
+    void Rebuild()
     {
-        T max = m_Samples[0];
-        for (unsigned int i = 1; i < m_NumSamples; ++i)
+        m_Sum = 0;
+        m_Min.Clear();
+        m_Max.Clear();
+        m_AbsMin.Clear();
+        m_AbsMax.Clear();
+
+        for (unsigned int i = 0; i < m_NumSamples; ++i)
         {
-            if (m_Samples[i] > max)
-                max = m_Samples[i];
+            const T fSample = m_Samples[(m_CurrentSample + i) % m_NumSamples];
+            m_Sum += (SumType)fSample;
+
+            m_Sequence++;
+            m_Min.Push(m_Sequence, fSample, m_NumSamples);
+            m_Max.Push(m_Sequence, fSample, m_NumSamples);
+            m_AbsMin.Push(m_Sequence, fSample, m_NumSamples);
+            m_AbsMax.Push(m_Sequence, fSample, m_NumSamples);
         }
-        return max;
     }
 
-    T AbsMaximum() const
+    static T Abs(T value) { return value < 0 ? -value : value; }
+
+    static bool IsFinite(T value) { return !std::is_floating_point<T>::value || isfinite((double)value); }
+
+    struct Less
+    {
+        bool operator()(T a, T b) const { return a < b; }
+    };
+    struct Greater
+    {
+        bool operator()(T a, T b) const { return a > b; }
+    };
+    struct AbsLess
+    {
+        bool operator()(T a, T b) const { return Abs(a) < Abs(b); }
+    };
+    struct AbsGreater
+    {
+        bool operator()(T a, T b) const { return Abs(a) > Abs(b); }
+    };
+
+    // Extreme of a sliding window, as a queue of the samples that are more extreme than all samples after them
+    // The front is the extreme of the window, and every sample is added and removed at most once.
+    template <class Better> class SlidingExtreme
     {
-        T max = m_Samples[0];
-        for (unsigned int i = 1; i < m_NumSamples; ++i)
+      public:
+        ~SlidingExtreme() { free(m_Entries); }
+
+        void Alloc(unsigned int nCapacity)
         {
-            if (abs(m_Samples[i]) > abs(max))
-                max = m_Samples[i];
+            m_Entries = (Entry *)realloc(m_Entries, nCapacity * sizeof(Entry));
+            m_nCapacity = nCapacity;
+            Clear();
         }
-        return max;
-    }
 
-    void OffsetValues(T value) const
-    {
-        for (unsigned int i = 0; i < m_NumSamples; ++i)
+        void Clear() { m_nHead = m_nCount = 0; }
+
+        // Add the sample with the given sequence number to a window of nWindow samples
+        void Push(unsigned int nSequence, T value, unsigned int nWindow)
         {
-            m_Samples[i] += value;
+            // drop the sample that left the window
+            if (m_nCount > 0 && nSequence - m_Entries[m_nHead].nSequence >= nWindow)
+            {
+                m_nHead = Wrap(m_nHead + 1);
+                m_nCount--;
+            }
+
+            // samples that are not more extreme than the new one can never become the extreme again
+            while (m_nCount > 0 && !Better()(m_Entries[Wrap(m_nHead + m_nCount - 1)].value, value))
+                m_nCount--;
+
+            Entry &entry = m_Entries[Wrap(m_nHead + m_nCount)];
+            entry.nSequence = nSequence;
+            entry.value = value;
+            m_nCount++;
         }
-    }
 
-    unsigned int CurrentSample() const { return m_CurrentSample; }
+        T Front() const { return m_Entries[m_nHead].value; }
+
+      private:
+        unsigned int Wrap(unsigned int nIndex) const { return nIndex >= m_nCapacity ? nIndex - m_nCapacity : nIndex; }
+
+        struct Entry
+        {
+            unsigned int nSequence;
+            T value;
+        };
+        Entry *m_Entries = nullptr;
+        unsigned int m_nCapacity = 0;
+        unsigned int m_nHead = 0;
+        unsigned int m_nCount = 0;
+    };
+
+    // Sum in double precision for floating point samples, exact for integers
+    typedef typename std::conditional<std::is_floating_point<T>::value, double, T>::type SumType;
 
   private:
     T *m_Samples = nullptr;
     unsigned int m_NumSamples = 0;
     unsigned int m_NumSamplesAlloc = 0;
     unsigned int m_CurrentSample = 0;
+    unsigned int m_Wraps = 0; // passes over the window, wraps around
+
+    SumType m_Sum = 0;
+    unsigned int m_Sequence = 0; // number of the last sample, wraps around
+    SlidingExtreme<Less> m_Min;
+    SlidingExtreme<Greater> m_Max;
+    SlidingExtreme<AbsLess> m_AbsMin;
+    SlidingExtreme<AbsGreater> m_AbsMax;
 };
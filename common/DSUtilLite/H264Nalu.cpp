@@ -21,6 +21,7 @@
 
 #include "stdafx.h"
 #include "H264Nalu.h"
+#include "StartCode.h"
 
 void CH264Nalu::SetBuffer(const BYTE *pBuffer, size_t nSize, int nNALSize)
 {
@@ -40,22 +41,19 @@ void CH264Nalu::SetBuffer(const BYTE *pBuffer, size_t nSize, int nNALSize)
 
 bool CH264Nalu::MoveToNextAnnexBStartcode()
 {
-    if (m_nSize < 4)
-        goto notfound;
-
-    size_t nBuffEnd = m_nSize - 4;
-
-    for (size_t i = m_nCurPos; i <= nBuffEnd; i++)
+    if (m_nSize >= 4 && m_nCurPos < m_nSize)
     {
-        if ((*((DWORD *)(m_pBuffer + i)) & 0x00FFFFFF) == 0x00010000)
+        // The start code has to be followed by at least one byte of the NAL
+        const BYTE *pEnd = m_pBuffer + m_nSize - 1;
+        const BYTE *pStartCode = find_start_code(m_pBuffer + m_nCurPos, pEnd);
+        if (pStartCode != pEnd)
         {
             // Found next AnnexB NAL
-            m_nCurPos = i;
+            m_nCurPos = pStartCode - m_pBuffer;
             return true;
         }
     }
 
-notfound:
     m_nCurPos = m_nSize;
     return false;
 }
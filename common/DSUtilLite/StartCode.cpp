@@ -0,0 +1,169 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "StartCode.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+};
+
+static const bool g_bStartCodeAVX2 = (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) != 0;
+
+static inline unsigned long first_bit(unsigned int mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+}
+
+static const uint8_t *find_start_code_sse2(const uint8_t *p, const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+
+    // Compare 16 candidate positions at once, the loads of the following bytes overlap
+    for (; end - p >= 18; p += 16)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+
+        // Zero bytes are rare in compressed data, skip the full check when there are none
+        int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(b0, zero));
+        if (!zeros)
+            continue;
+
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+        int mask = zeros & _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(b1, zero), _mm_cmpeq_epi8(b2, one)));
+        if (mask)
+            return p + first_bit(mask);
+    }
+
+    return p;
+}
+
+static const uint8_t *find_start_code_avx2(const uint8_t *p, const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+
+    for (; end - p >= 34; p += 32)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+
+        unsigned int zeros = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b0, zero));
+        if (!zeros)
+            continue;
+
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+        __m256i tail = _mm256_and_si256(_mm256_cmpeq_epi8(b1, zero), _mm256_cmpeq_epi8(b2, one));
+        unsigned int mask = zeros & (unsigned int)_mm256_movemask_epi8(tail);
+        if (mask)
+            return p + first_bit(mask);
+    }
+
+    return p;
+}
+
+const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end)
+{
+    // The vector loops return the position where the scalar search has to continue
+    p = g_bStartCodeAVX2 ? find_start_code_avx2(p, end) : find_start_code_sse2(p, end);
+
+    for (; end - p >= 3; p++)
+    {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    return end;
+}
+
+static const uint8_t *find_sync_word_sse2(const uint8_t *p, const uint8_t *end, uint32_t sync, uint32_t mask)
+{
+    __m128i m[4], s[4];
+    for (int i = 0; i < 4; i++)
+    {
+        m[i] = _mm_set1_epi8((char)(mask >> (24 - 8 * i)));
+        s[i] = _mm_set1_epi8((char)(sync >> (24 - 8 * i)));
+    }
+
+    for (; end - p >= 19; p += 16)
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)p), m[0]), s[0]);
+        for (int i = 1; i < 4; i++)
+        {
+            __m128i b = _mm_loadu_si128((const __m128i *)(p + i));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(_mm_and_si128(b, m[i]), s[i]));
+        }
+
+        int match = _mm_movemask_epi8(eq);
+        if (match)
+            return p + first_bit(match);
+    }
+
+    return p;
+}
+
+static const uint8_t *find_sync_word_avx2(const uint8_t *p, const uint8_t *end, uint32_t sync, uint32_t mask)
+{
+    __m256i m[4], s[4];
+    for (int i = 0; i < 4; i++)
+    {
+        m[i] = _mm256_set1_epi8((char)(mask >> (24 - 8 * i)));
+        s[i] = _mm256_set1_epi8((char)(sync >> (24 - 8 * i)));
+    }
+
+    for (; end - p >= 35; p += 32)
+    {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)p), m[0]), s[0]);
+        for (int i = 1; i < 4; i++)
+        {
+            __m256i b = _mm256_loadu_si256((const __m256i *)(p + i));
+            eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(_mm256_and_si256(b, m[i]), s[i]));
+        }
+
+        unsigned int match = (unsigned int)_mm256_movemask_epi8(eq);
+        if (match)
+            return p + first_bit(match);
+    }
+
+    return p;
+}
+
+const uint8_t *find_sync_word(const uint8_t *p, const uint8_t *end, uint32_t sync, uint32_t mask)
+{
+    sync &= mask;
+
+    p = g_bStartCodeAVX2 ? find_sync_word_avx2(p, end, sync, mask) : find_sync_word_sse2(p, end, sync, mask);
+
+    for (; end - p >= 4; p++)
+    {
+        uint32_t word = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        if ((word & mask) == sync)
+            return p;
+    }
+
+    return end;
+}
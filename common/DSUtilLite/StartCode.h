@@ -0,0 +1,33 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Vectorized scanners for start codes and sync words in bitstreams
+// All functions only report matches that lie completely within [p, end), and return end if there is none.
+
+// Find the first MPEG-style 00 00 01 start code
+// Returns a pointer to the first zero byte of the start code
+const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end);
+
+// Find the first big-endian 32-bit word w with (w & mask) == (sync & mask)
+// Returns a pointer to the first byte of the word
+const uint8_t *find_sync_word(const uint8_t *p, const uint8_t *end, uint32_t sync, uint32_t mask = 0xFFFFFFFF);
@@ -3,7 +3,7 @@
 
 #include <emmintrin.h>
 
-__declspec(align(16)) static __m128i cur_seed;
+alignas(16) static __m128i cur_seed;
 
 void srand_sse(unsigned int seed)
 {
@@ -12,16 +12,16 @@ void srand_sse(unsigned int seed)
 
 inline void rand_sse(int *result)
 {
-    __declspec(align(16)) __m128i cur_seed_split;
-    __declspec(align(16)) __m128i multiplier;
-    __declspec(align(16)) __m128i adder;
-    __declspec(align(16)) __m128i mod_mask;
-    __declspec(align(16)) __m128i sra_mask;
-    __declspec(align(16)) __m128i sseresult;
-    __declspec(align(16)) static const unsigned int mult[4] = {214013, 17405, 214013, 69069};
-    __declspec(align(16)) static const unsigned int gadd[4] = {2531011, 10395331, 13737667, 1};
-    __declspec(align(16)) static const unsigned int mask[4] = {0xFFFFFFFF, 0, 0xFFFFFFFF, 0};
-    __declspec(align(16)) static const unsigned int masklo[4] = {0x00007FFF, 0x00007FFF, 0x00007FFF, 0x00007FFF};
+    alignas(16) __m128i cur_seed_split;
+    alignas(16) __m128i multiplier;
+    alignas(16) __m128i adder;
+    alignas(16) __m128i mod_mask;
+    alignas(16) __m128i sra_mask;
+    alignas(16) __m128i sseresult;
+    alignas(16) static const unsigned int mult[4] = {214013, 17405, 214013, 69069};
+    alignas(16) static const unsigned int gadd[4] = {2531011, 10395331, 13737667, 1};
+    alignas(16) static const unsigned int mask[4] = {0xFFFFFFFF, 0, 0xFFFFFFFF, 0};
+    alignas(16) static const unsigned int masklo[4] = {0x00007FFF, 0x00007FFF, 0x00007FFF, 0x00007FFF};
 
     adder = _mm_load_si128((__m128i *)gadd);
     multiplier = _mm_load_si128((__m128i *)mult);
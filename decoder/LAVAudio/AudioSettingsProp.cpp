@@ -26,6 +26,10 @@
 #include "resource.h"
 #include "version.h"
 
+// Batch decoding latency range offered on the settings page (in ms), the filter accepts up to 500 ms
+#define BATCH_LATENCY_MAX 500
+#define BATCH_LATENCY_DEFAULT 100
+
 CLAVAudioSettingsProp::CLAVAudioSettingsProp(LPUNKNOWN pUnk, HRESULT *phr)
     : CBaseDSPropPage(NAME("LAVCAudioProp"), pUnk, IDD_PROPPAGE_AUDIO_SETTINGS, IDS_SETTINGS)
 {
@@ -127,6 +131,11 @@ HRESULT CLAVAudioSettingsProp::OnApplyChanges()
     int delay = _wtoi(buffer);
     m_pAudioSettings->SetAudioDelay(bFlag, delay);
 
+    bFlag = (BOOL)SendDlgItemMessage(m_Dlg, IDC_BATCH_ENABLED, BM_GETCHECK, 0, 0);
+    SendDlgItemMessage(m_Dlg, IDC_BATCH_LATENCY, WM_GETTEXT, 100, (LPARAM)&buffer);
+    int latency = min(max(_wtoi(buffer), 1), BATCH_LATENCY_MAX);
+    m_pAudioSettings->SetBatchDecoding(bFlag ? latency : 0);
+
     bFlag = (BOOL)SendDlgItemMessage(m_Dlg, IDC_TRAYICON, BM_GETCHECK, 0, 0);
     m_pAudioSettings->SetTrayIcon(bFlag);
 
@@ -220,6 +229,18 @@ HRESULT CLAVAudioSettingsProp::OnActivate()
         swprintf_s(stringBuffer, L"%d", m_iAudioDelay);
         SendDlgItemMessage(m_Dlg, IDC_DELAY, WM_SETTEXT, 0, (LPARAM)stringBuffer);
 
+        SendDlgItemMessage(m_Dlg, IDC_BATCH_ENABLED, BM_SETCHECK, m_bBatchDecoding, 0);
+        addHint(IDC_BATCH_ENABLED, L"Collect input packets up to the given latency, and decode and deliver them in one "
+                                   L"go.\nThis reduces the CPU overhead for codecs with small packets, at the cost of "
+                                   L"added latency.");
+        EnableWindow(GetDlgItem(m_Dlg, IDC_BATCH_LATENCYSPIN), m_bBatchDecoding);
+        EnableWindow(GetDlgItem(m_Dlg, IDC_BATCH_LATENCY), m_bBatchDecoding);
+
+        SendDlgItemMessage(m_Dlg, IDC_BATCH_LATENCYSPIN, UDM_SETRANGE32, 1, BATCH_LATENCY_MAX);
+
+        swprintf_s(stringBuffer, L"%u", m_dwBatchLatency);
+        SendDlgItemMessage(m_Dlg, IDC_BATCH_LATENCY, WM_SETTEXT, 0, (LPARAM)stringBuffer);
+
         SendDlgItemMessage(m_Dlg, IDC_TRAYICON, BM_SETCHECK, m_TrayIcon, 0);
     }
 
@@ -246,6 +267,11 @@ HRESULT CLAVAudioSettingsProp::LoadData()
 
     m_pAudioSettings->GetAudioDelay(&m_bAudioDelay, &m_iAudioDelay);
 
+    // a disabled batch mode still shows a sensible latency to start from
+    DWORD dwBatchLatency = m_pAudioSettings->GetBatchDecoding();
+    m_bBatchDecoding = dwBatchLatency > 0;
+    m_dwBatchLatency = m_bBatchDecoding ? dwBatchLatency : BATCH_LATENCY_DEFAULT;
+
     m_TrayIcon = m_pAudioSettings->GetTrayIcon();
 
     return hr;
@@ -403,6 +429,33 @@ INT_PTR CLAVAudioSettingsProp::OnReceiveMessage(HWND hwnd, UINT uMsg, WPARAM wPa
                     SetDirty();
             }
         }
+        else if (LOWORD(wParam) == IDC_BATCH_ENABLED && HIWORD(wParam) == BN_CLICKED)
+        {
+            BOOL bFlag = (BOOL)SendDlgItemMessage(m_Dlg, LOWORD(wParam), BM_GETCHECK, 0, 0);
+            if (bFlag != m_bBatchDecoding)
+                SetDirty();
+            EnableWindow(GetDlgItem(m_Dlg, IDC_BATCH_LATENCYSPIN), bFlag);
+            EnableWindow(GetDlgItem(m_Dlg, IDC_BATCH_LATENCY), bFlag);
+        }
+        else if (LOWORD(wParam) == IDC_BATCH_LATENCY && HIWORD(wParam) == EN_CHANGE)
+        {
+            WCHAR buffer[100];
+            SendDlgItemMessage(m_Dlg, LOWORD(wParam), WM_GETTEXT, 100, (LPARAM)&buffer);
+            int latency = _wtoi(buffer);
+            size_t len = wcslen(buffer);
+            if (latency < 0 || latency > BATCH_LATENCY_MAX || (latency == 0 && (buffer[0] != L'0' || len > 1)))
+            {
+                SendDlgItemMessage(m_Dlg, LOWORD(wParam), EM_UNDO, 0, 0);
+            }
+            else
+            {
+                swprintf_s(buffer, L"%d", latency);
+                if (wcslen(buffer) != len)
+                    SendDlgItemMessage(m_Dlg, IDC_BATCH_LATENCY, WM_SETTEXT, 0, (LPARAM)buffer);
+                if ((DWORD)latency != m_dwBatchLatency)
+                    SetDirty();
+            }
+        }
         else if (LOWORD(wParam) == IDC_TRAYICON && HIWORD(wParam) == BN_CLICKED)
         {
             BOOL bFlag = (BOOL)SendDlgItemMessage(m_Dlg, LOWORD(wParam), BM_GETCHECK, 0, 0) != 0;
@@ -77,6 +77,8 @@ class CLAVAudioSettingsProp : public CBaseDSPropPage
     BOOL m_bDither;
     BOOL m_bAudioDelay;
     int m_iAudioDelay;
+    BOOL m_bBatchDecoding;
+    DWORD m_dwBatchLatency;
     BOOL m_TrayIcon;
 };
 
@@ -23,7 +23,7 @@
 #include <MMReg.h>
 #include "moreuuids.h"
 
-#define LAV_BITSTREAM_BUFFER_SIZE 4096
+#define LAV_BITSTREAM_BUFFER_SIZE 65536 // large enough to hold any burst, so it reaches BSWriteBuffer in one piece
 #define LAV_BITSTREAM_DTS_HD_HR_RATE 192000
 #define LAV_BITSTREAM_DTS_HD_MA_RATE 768000
 
@@ -82,10 +82,20 @@ HRESULT CLAVAudio::ShutdownBitstreaming()
 }
 
 // Static function for the AVIO context that writes the buffer into our own output buffer
+// The AVIO buffer is only flushed early when it's full, a smaller write is the end of the packet. If that is the only
+// write, the burst is delivered straight from the AVIO buffer, which stays untouched until the next packet is muxed.
+// The AVIO copy and the copy into the sample remain, tests/bitstream_copy_bench puts them below 0.05% of real time.
 int CLAVAudio::BSWriteBuffer(void *opaque, const uint8_t *buf, int buf_size)
 {
     CLAVAudio *filter = (CLAVAudio *)opaque;
-    filter->m_bsOutput.Append(buf, buf_size);
+    ASSERT(filter->m_pBSBurst == nullptr);
+    if (buf_size < LAV_BITSTREAM_BUFFER_SIZE && filter->m_bsOutput.GetCount() == 0)
+    {
+        filter->m_pBSBurst = buf;
+        filter->m_nBSBurstSize = buf_size;
+    }
+    else
+        filter->m_bsOutput.Append(buf, buf_size);
     return buf_size;
 }
 
@@ -207,9 +217,11 @@ HRESULT CLAVAudio::FreeBitstreamContext()
 
     // Dump any remaining data
     m_bsOutput.SetSize(0);
+    m_pBSBurst = nullptr;
 
     // reset TrueHD MAT state
-    memset(&m_TrueHDMATState, 0, sizeof(m_TrueHDMATState));
+    m_MATFramer.Reset();
+    MATReleaseBuffer();
 
     return S_OK;
 }
@@ -408,6 +420,7 @@ HRESULT CLAVAudio::Bitstream(const BYTE *pDataBuffer, int buffsize, int &consume
                 {
                     DbgLog((LOG_ERROR, 20, "::Bitstream(): av_write_frame returned error code (%d)", -ret));
                     m_bsOutput.SetSize(0);
+                    m_pBSBurst = nullptr;
                     continue;
                 }
 
@@ -420,7 +433,13 @@ HRESULT CLAVAudio::Bitstream(const BYTE *pDataBuffer, int buffsize, int &consume
                     m_rtBitstreamCache = m_rtStartInputCache != AV_NOPTS_VALUE ? m_rtStartInputCache : m_rtStart;
 
                 // Deliver frame
-                if (m_bsOutput.GetCount() > 0)
+                if (m_pBSBurst)
+                {
+                    *hrDeliver = DeliverBitstream(m_nCodecId, m_pBSBurst, m_nBSBurstSize, m_rtStartInputCache,
+                                                  m_rtStopInputCache);
+                    m_pBSBurst = nullptr;
+                }
+                else if (m_bsOutput.GetCount() > 0)
                 {
                     *hrDeliver = DeliverBitstream(m_nCodecId, m_bsOutput.Ptr(), m_bsOutput.GetCount(),
                                                   m_rtStartInputCache, m_rtStopInputCache);
@@ -459,6 +478,32 @@ HRESULT CLAVAudio::DeliverBitstream(AVCodecID codec, const BYTE *buffer, DWORD d
         return E_FAIL;
     }
 
+    // byte-swap if needed
+    if (bSwap)
+    {
+        lav_spdif_bswap_buf16((uint16_t *)pDataOut, (uint16_t *)buffer, dwSize >> 1);
+    }
+    else
+    {
+        memcpy(pDataOut, buffer, dwSize);
+    }
+
+    return DeliverBitstreamSample(pOut, mt, hr, dwSize, rtStartInput, nSamplesOffset);
+}
+
+// Timestamp and deliver a sample that already holds the bitstream frame, taking over its reference
+// hrReconnect is the result of ReconnectOutput for the media type, S_OK signals a type change
+HRESULT CLAVAudio::DeliverBitstreamSample(IMediaSample *pOut, CMediaType &mt, HRESULT hrReconnect, DWORD dwSize,
+                                          REFERENCE_TIME rtStartInput, int nSamplesOffset)
+{
+    HRESULT hr = hrReconnect;
+
+    if (m_bFlushing)
+    {
+        SafeRelease(&pOut);
+        return S_FALSE;
+    }
+
     if (m_bResyncTimestamp && (rtStartInput != AV_NOPTS_VALUE || m_rtBitstreamCache != AV_NOPTS_VALUE))
     {
         if (m_rtBitstreamCache != AV_NOPTS_VALUE)
@@ -529,16 +574,6 @@ HRESULT CLAVAudio::DeliverBitstream(AVCodecID codec, const BYTE *buffer, DWORD d
 
     pOut->SetActualDataLength(dwSize);
 
-    // byte-swap if needed
-    if (bSwap)
-    {
-        lav_spdif_bswap_buf16((uint16_t *)pDataOut, (uint16_t *)buffer, dwSize >> 1);
-    }
-    else
-    {
-        memcpy(pDataOut, buffer, dwSize);
-    }
-
     if (hr == S_OK)
     {
         hr = m_pOutput->GetConnected()->QueryAccept(&mt);
@@ -22,408 +22,88 @@
 #include "stdafx.h"
 #include "LAVAudio.h"
 
-#pragma warning(push)
-#pragma warning(disable : 4101)
-#pragma warning(disable : 5033)
-extern "C"
+uint8_t *CLAVAudio::AllocFrame()
 {
-#include "libavformat/spdif.h"
-#define AVCODEC_X86_MATHOPS_H
-#include "libavcodec/get_bits.h"
-}
-#pragma warning(pop)
-
-#define MAT_BUFFER_SIZE (61440)
-#define MAT_BUFFER_LIMIT (MAT_BUFFER_SIZE - 24 /* MAT end code size */)
-#define MAT_POS_MIDDLE (30708 /* middle point*/ + 8 /* IEC header in front */)
-
-static const BYTE mat_start_code[20] = {0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
-                                        0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0};
-static const BYTE mat_middle_code[12] = {0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80, 0x77, 0xE0};
-static const BYTE mat_end_code[24] = {0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                      0x00, 0x00, 0x97, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-void CLAVAudio::MATWriteHeader()
-{
-    ASSERT(m_bsOutput.GetCount() == 0);
-
-    DWORD dwSize = BURST_HEADER_SIZE + sizeof(mat_start_code);
-
-    // reserve size for the IEC header and the MAT start code
-    m_bsOutput.SetSize(dwSize);
-
-    BYTE *p = m_bsOutput.Ptr();
-
-    // IEC burst header
-    AV_WB16(p + 0, SYNCWORD1);
-    AV_WB16(p + 2, SYNCWORD2);
-    AV_WB16(p + 4, IEC61937_TRUEHD);
-    AV_WB16(p + 6, 61424);
-
-    // MAT start code
-    memcpy(p + BURST_HEADER_SIZE, mat_start_code, sizeof(mat_start_code));
-
-    // unless the start code falls into the padding,  its considered part of the current MAT frame
-    // Note that audio frames are not always aligned with MAT frames, so we might already have a partial frame at this
-    // point
-    m_TrueHDMATState.mat_framesize += dwSize;
-
-    // The MAT metadata counts as padding, if we're scheduled to write any, which mean the start bytes should reduce any
-    // further padding.
-    if (m_TrueHDMATState.padding > 0)
-    {
-        // if the header fits into the padding of the last frame, just reduce the amount of needed padding
-        if (m_TrueHDMATState.padding > dwSize)
-        {
-            m_TrueHDMATState.padding -= dwSize;
-            m_TrueHDMATState.mat_framesize = 0;
-        }
-        else // otherwise, consume all padding and set the size of the next MAT frame to the remaining data
-        {
-            m_TrueHDMATState.mat_framesize = (dwSize - m_TrueHDMATState.padding);
-            m_TrueHDMATState.padding = 0;
-        }
-    }
-}
+    ASSERT(m_MATBuffer.pData == nullptr);
 
-void CLAVAudio::MATWritePadding()
-{
-    if (m_TrueHDMATState.padding > 0)
+    // Assemble the frame right in the output sample, so its data is only copied once
+    // After a fallback to PCM the output is no longer touched, the frame will be dropped anyway.
+    if (m_avBSContext && !m_bFlushing)
     {
-        int remaining = MATFillDataBuffer(nullptr, m_TrueHDMATState.padding, true);
+        CMediaType mt = CreateBitstreamMediaType(m_nCodecId, m_bsParser.m_dwSampleRate);
+        HRESULT hr = ReconnectOutput(MAT_FRAME_SIZE, mt);
 
-        // not all padding could be written to the buffer, write it later
-        if (remaining >= 0)
-        {
-            m_TrueHDMATState.padding = remaining;
-            m_TrueHDMATState.mat_framesize = 0;
-        }
-        else // more padding then requested was written, eg. there was a MAT middle/end marker that needed to be written
+        IMediaSample *pOut = nullptr;
+        BYTE *pDataOut = nullptr;
+        if (SUCCEEDED(hr) && SUCCEEDED(GetDeliveryBuffer(&pOut, &pDataOut)) && pOut->GetSize() >= MAT_FRAME_SIZE)
         {
-            m_TrueHDMATState.padding = 0;
-            m_TrueHDMATState.mat_framesize = -remaining;
+            m_MATBuffer.pSample = pOut;
+            m_MATBuffer.pData = pDataOut;
+            m_MATBuffer.mt = mt;
+            m_MATBuffer.hrReconnect = hr;
+            return pDataOut;
         }
+        SafeRelease(&pOut);
     }
-}
 
-void CLAVAudio::MATAppendData(const BYTE * const p, int size)
-{
-    if (p)
-        m_bsOutput.Append(p, size);
-    else
-        m_bsOutput.AppendZero(size);
+    // Otherwise stage the frame, and copy it on delivery
+    if (FAILED(m_bsOutput.SetSize(MAT_FRAME_SIZE)))
+        return nullptr;
 
-    m_TrueHDMATState.mat_framesize += size;
+    m_MATBuffer.pData = m_bsOutput.Ptr();
+    return m_MATBuffer.pData;
 }
 
-int CLAVAudio::MATFillDataBuffer(const BYTE *const p, int size, bool padding)
+void CLAVAudio::DeliverFrame(uint8_t *pFrame, int nSamplesOffset)
 {
-    ASSERT(p || padding);
+    ASSERT(pFrame == m_MATBuffer.pData);
 
-    if (m_bsOutput.GetCount() >= MAT_BUFFER_LIMIT)
-        return size;
-
-    int remaining = size;
-
-    // Write MAT middle marker, if needed
-    // The MAT middle marker always needs to be in the exact same spot, any audio data will be split.
-    // If we're currently writing padding, then the marker will be considered as padding data and reduce the amount of
-    // padding still required.
-    if (m_bsOutput.GetCount() <= MAT_POS_MIDDLE && m_bsOutput.GetCount() + size > MAT_POS_MIDDLE)
+    // Deliver MAT packet to the audio renderer
+    HRESULT hr = S_OK;
+    if (m_MATBuffer.pSample)
     {
-        // write as much data before the middle code as we can
-        int nBytesBefore = MAT_POS_MIDDLE - m_bsOutput.GetCount();
-        MATAppendData(p, nBytesBefore);
-        remaining -= nBytesBefore;
-
-        // write the MAT middle code
-        MATAppendData(mat_middle_code, sizeof(mat_middle_code));
+        // the delivery takes over the sample
+        IMediaSample *pOut = m_MATBuffer.pSample;
+        CMediaType mt = m_MATBuffer.mt;
+        m_MATBuffer.pSample = nullptr;
 
-        // if we're writing padding, deduct the size of the code from it
-        if (padding)
-            remaining -= sizeof(mat_middle_code);
-
-        // write remaining data after the MAT marker
-        if (remaining > 0)
-        {
-            return MATFillDataBuffer(p ? p + nBytesBefore : nullptr, remaining, padding);
-        }
-
-        return remaining;
+        hr = DeliverBitstreamSample(pOut, mt, m_MATBuffer.hrReconnect, MAT_FRAME_SIZE, m_rtStartInputCache,
+                                    nSamplesOffset);
     }
-
-    // not enough room in the buffer to write all the data, write as much as we can and add the MAT footer
-    if (m_bsOutput.GetCount() + size >= MAT_BUFFER_LIMIT)
+    else
     {
-        // write as much data before the middle code as we can
-        int nBytesBefore = MAT_BUFFER_LIMIT - m_bsOutput.GetCount();
-        MATAppendData(p, nBytesBefore);
-        remaining -= nBytesBefore;
-
-        // write the MAT end code
-        MATAppendData(mat_end_code, sizeof(mat_end_code));
-
-        ASSERT(m_bsOutput.GetCount() == MAT_BUFFER_SIZE);
-
-        // MAT markers don't displace padding, so reduce the amount of padding
-        if (padding)
-            remaining -= sizeof(mat_end_code);
-
-        // any remaining data will be written in future calls
-        return remaining;
+        hr = DeliverBitstream(m_nCodecId, pFrame, MAT_FRAME_SIZE, m_rtStartInputCache, m_rtStopInputCache, false,
+                              nSamplesOffset);
     }
 
-    MATAppendData(p, size);
+    if (m_MATBuffer.phrDeliver)
+        *m_MATBuffer.phrDeliver = hr;
 
-    return 0;
+    MATReleaseBuffer();
 }
 
-void CLAVAudio::MATFlushPacket(HRESULT *hrDeliver)
+void CLAVAudio::MATReleaseBuffer()
 {
-    if (m_bsOutput.GetCount() > 0)
-    {
-        ASSERT(m_bsOutput.GetCount() == 61440);
-
-        // normal number of samples per frame
-        uint16_t frame_samples = 40 << (m_TrueHDMATState.ratebits & 7);
-        int nMATSamples = (frame_samples * 24);
-
-        // Deliver MAT packet to the audio renderer
-        *hrDeliver = DeliverBitstream(m_nCodecId, m_bsOutput.Ptr(), m_bsOutput.GetCount(), m_rtStartInputCache,
-                                      m_rtStopInputCache, true, m_TrueHDMATState.nSamplesOffset);
-
-        // we expect 24 frames per MAT frame, so calculate an offset from that
-        // this is done after delivery, because it modifies the duration of the frame, eg. the start of the next frame
-        if (nMATSamples != m_TrueHDMATState.nSamples)
-            m_TrueHDMATState.nSamplesOffset += m_TrueHDMATState.nSamples - nMATSamples;
-
-        m_bsOutput.SetSize(0);
-        m_TrueHDMATState.nSamples = 0;
-    }
-}
-
-static bool ParseTrueHDMajorSyncHeaders(const BYTE *p, int buffsize, int &ratebits, uint16_t &output_timing,
-                                        bool &output_timing_present)
-{
-    ASSERT(AV_RB32(p + 4) == 0xf8726fba);
-
-    int length = (AV_RB16(p) & 0xfff) * 2;
-    if (buffsize < 32)
-        return false;
-
-    // parse major sync and look for a restart header
-    int major_sync_size = 28;
-    if (p[29] & 1)
-    {
-        int extension_size = p[30] >> 4;
-        major_sync_size += 2 + extension_size * 2;
-    }
-
-    GetBitContext gb;
-    init_get_bits8(&gb, p + 4, buffsize - 4);
-    skip_bits_long(&gb, 32); // format_sync
-
-    // v(32) format_info
-    ratebits = get_bits(&gb, 4); // ratebits
-    skip_bits1(&gb);             // 6ch_multichannel_type
-    skip_bits1(&gb);             // 8ch_multichannel_type
-    skip_bits(&gb, 2);           // reserved
-
-    skip_bits(&gb, 2);  // 2ch_presentation_channel_modifier
-    skip_bits(&gb, 2);  // 6ch_presentation_channel_modifier
-    skip_bits(&gb, 5);  // 6ch_presentation_channel_assignment
-    skip_bits(&gb, 2);  // 8ch_presentation_channel_modifier
-    skip_bits(&gb, 13); // 8ch_presentation_channel_assignment
-
-    skip_bits(&gb, 16); // signature
-    skip_bits(&gb, 16); // flags
-    skip_bits(&gb, 16); // reserved
-
-    skip_bits1(&gb);    // variable_rate
-    skip_bits(&gb, 15); // peak_data_rate
-
-    int num_substreams = get_bits(&gb, 4);
-    skip_bits_long(&gb, 4 + (major_sync_size - 17) * 8);
-
-    // substream directory
-    for (int i = 0; i < num_substreams; i++)
-    {
-        int extra_substream_word = get_bits1(&gb);
-        skip_bits1(&gb);    // restart_nonexistent
-        skip_bits1(&gb);    // crc_present
-        skip_bits1(&gb);    // reserved
-        skip_bits(&gb, 12); // substream_end_ptr
-        if (extra_substream_word)
-            skip_bits(&gb, 16); // drc_gain_update, drc_time_update, reserved
-    }
-
-    // substream segments
-    for (int i = 0; i < num_substreams; i++)
-    {
-        if (get_bits1(&gb))
-        { // block_header_exists
-            if (get_bits1(&gb))
-            {                       // restart_header_exists
-                skip_bits(&gb, 14); // restart_sync_word
-                output_timing = get_bits(&gb, 16);
-                output_timing_present = true;
-                // XXX: restart header
-            }
-            // XXX: Block header
-        }
-        // XXX: All blocks, all substreams?
-        break;
-    }
-
-    return true;
+    SafeRelease(&m_MATBuffer.pSample);
+    m_MATBuffer.pData = nullptr;
+    m_bsOutput.SetSize(0);
 }
 
 HRESULT CLAVAudio::BitstreamTrueHD(const BYTE *p, int buffsize, HRESULT *hrDeliver)
 {
-    // On a high level, a MAT frame consists of a sequence of padded TrueHD frames
-    // The size of the padded frame can be determined from the frame time/sequence code in the frame header,
-    // since it varies to accommodate spikes in bitrate.
-    // In average all frames are always padded to 2560 bytes, so that 24 frames fit in one MAT frame, however
-    // due to bitrate spikes single sync frames have been observed to use up to twice that size, in which
-    // case they'll be preceded by smaller frames to keep the average bitrate constant.
-    // A constant padding to 2560 bytes can work (this is how the ffmpeg spdifenc module works), however
-    // high-bitrate streams can overshoot this size and therefor require proper handling of dynamic padding.
+    m_MATBuffer.phrDeliver = hrDeliver;
+    int ret = m_MATFramer.AddFrame(p, buffsize);
+    m_MATBuffer.phrDeliver = nullptr;
 
-    uint16_t output_timing = 0;
-    bool bOutputTimingPresent = false;
+    if (ret < 0)
+        return E_FAIL;
 
-    // get the ratebits and output timing from the sync frame
-    if (AV_RB32(p + 4) == 0xf8726fba)
-    {
-        if (ParseTrueHDMajorSyncHeaders(p, buffsize, m_TrueHDMATState.ratebits, output_timing, bOutputTimingPresent) ==
-            false)
-            return E_FAIL;
-    }
-    else if (m_TrueHDMATState.prev_frametime_valid == false)
+    if (ret > 0)
     {
-        // only start streaming on a major sync frame
+        // no major sync yet, the first delivery should not use the timestamps of the skipped frames
         m_rtBitstreamCache = AV_NOPTS_VALUE;
-        m_TrueHDMATState.nSamplesOffset = 0;
         return S_FALSE;
     }
 
-    uint16_t frame_time = AV_RB16(p + 2);
-    uint32_t space_size = 0;
-
-    uint16_t frame_samples = 40 << (m_TrueHDMATState.ratebits & 7);
-    m_TrueHDMATState.output_timing += frame_samples;
-    if (bOutputTimingPresent)
-    {
-        if (m_TrueHDMATState.output_timing_valid && (output_timing != m_TrueHDMATState.output_timing))
-        {
-            DbgLog((LOG_TRACE, 10, _T("BitstreamTrueHD(): Detected a stream discontinuity, reseting framesize cache")));
-            m_TrueHDMATState.prev_frametime_valid = false;
-            space_size = frame_samples * (64 >> (m_TrueHDMATState.ratebits & 7));
-
-            // the output timing is always one frame ahead for buffering reasons, so deduct one frame worth
-            uint32_t prev_output = (uint16_t)(output_timing - frame_samples);
-            if (prev_output < frame_time) // wrap around, output is always in front of frame time
-                prev_output += 0x10000;   // unwrap 16-bit value
-
-            // get the offset of this frame, so we can compare to the previous frame, and determine the amount of padding that needs to be inserted
-            int currentFrameOutputOffset = (prev_output - frame_time);
-
-            // the previous offset should never be smaller then the incoming offset, or we will lack the reserved space
-            ASSERT(m_TrueHDMATState.nOutputTimeOffset >= currentFrameOutputOffset);
-            if (m_TrueHDMATState.nOutputTimeOffset >= currentFrameOutputOffset)
-                m_TrueHDMATState.padding += (m_TrueHDMATState.nOutputTimeOffset - currentFrameOutputOffset) * (64 >> (m_TrueHDMATState.ratebits & 7));
-
-            DbgLog((LOG_TRACE, 10, _T("BitstreamTrueHD(): Carrying forward %d padding (offset %d - %d)"),
-                    m_TrueHDMATState.padding, m_TrueHDMATState.nOutputTimeOffset, currentFrameOutputOffset));
-        }
-        m_TrueHDMATState.output_timing = output_timing;
-        m_TrueHDMATState.output_timing_valid = true;
-    }
-
-    // compute final padded size for the previous frame, if any
-    if (m_TrueHDMATState.prev_frametime_valid)
-        space_size = uint16_t(frame_time - m_TrueHDMATState.prev_frametime) * (64 >> (m_TrueHDMATState.ratebits & 7));
-
-    // compute padding (ie. difference to the size of the previous frame)
-    ASSERT(!m_TrueHDMATState.prev_frametime_valid || space_size >= m_TrueHDMATState.prev_mat_framesize);
-
-    // if for some reason the space_size fails, align the actual frame size
-    if (space_size < m_TrueHDMATState.prev_mat_framesize)
-        space_size = FFALIGN(m_TrueHDMATState.prev_mat_framesize, (64 >> (m_TrueHDMATState.ratebits & 7)));
-
-    m_TrueHDMATState.padding += (space_size - m_TrueHDMATState.prev_mat_framesize);
-
-    // record the offset of frame time to output time, which is used to verify the size of the padding on discontinuities
-    if (m_TrueHDMATState.output_timing_valid)
-    {
-        uint32_t prev_output = (uint16_t)(m_TrueHDMATState.output_timing - frame_samples);
-        if (prev_output < frame_time) // wrap around, output is always in front of frame time
-            prev_output += 0x10000;   // unwrap 16-bit value
-
-        m_TrueHDMATState.nOutputTimeOffset = (prev_output - frame_time);
-    }
-
-    // store frame time of the previous frame
-    m_TrueHDMATState.prev_frametime = frame_time;
-    m_TrueHDMATState.prev_frametime_valid = true;
-
-    // Write the MAT header into the fresh buffer
-    if (m_bsOutput.GetCount() == 0)
-    {
-        MATWriteHeader();
-
-        // initial header, don't count it for the frame size
-        if (m_TrueHDMATState.init == false)
-        {
-            m_TrueHDMATState.init = true;
-            m_TrueHDMATState.mat_framesize = 0;
-        }
-    }
-
-    // write padding of the previous frame (if any)
-    while (m_TrueHDMATState.padding > 0)
-    {
-        MATWritePadding();
-
-        ASSERT(m_TrueHDMATState.padding == 0 || m_bsOutput.GetCount() == MAT_BUFFER_SIZE);
-
-        // Buffer is full, submit it
-        if (m_bsOutput.GetCount() == MAT_BUFFER_SIZE)
-        {
-            MATFlushPacket(hrDeliver);
-
-            // and setup a new buffer
-            MATWriteHeader();
-        }
-    }
-
-    // count the number of samples in this frame
-    m_TrueHDMATState.nSamples += frame_samples;
-
-    // write actual audio data to the buffer
-    int remaining = MATFillDataBuffer(p, buffsize);
-
-    // not all data could be written, or the buffer is full
-    if (remaining || m_bsOutput.GetCount() == MAT_BUFFER_SIZE)
-    {
-        // flush out old data
-        MATFlushPacket(hrDeliver);
-
-        if (remaining)
-        {
-            // .. setup a new buffer
-            MATWriteHeader();
-
-            // and write the remaining data
-            remaining = MATFillDataBuffer(p + (buffsize - remaining), remaining);
-
-            ASSERT(remaining == 0);
-        }
-    }
-
-    // store the size of the current MAT frame, so we can add padding later
-    m_TrueHDMATState.prev_mat_framesize = m_TrueHDMATState.mat_framesize;
-    m_TrueHDMATState.mat_framesize = 0;
-
     return S_OK;
 }
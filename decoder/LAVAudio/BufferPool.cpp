@@ -0,0 +1,99 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "BufferPool.h"
+
+// Maximum number of idle buffers kept in the pool
+#define PCM_POOL_MAX_IDLE 8
+
+CPCMBufferPool::CPCMBufferPool()
+{
+    m_Free.reserve(PCM_POOL_MAX_IDLE);
+}
+
+CPCMBufferPool::~CPCMBufferPool()
+{
+    ASSERT(m_InUse.empty());
+    for (GrowableArray<BYTE> *pBuffer : m_Free)
+        delete pBuffer;
+}
+
+GrowableArray<BYTE> *CPCMBufferPool::Acquire(DWORD dwSize)
+{
+    CAutoLock lock(&m_csPool);
+
+    GrowableArray<BYTE> *pBuffer = nullptr;
+    if (!m_Free.empty())
+    {
+        pBuffer = m_Free.back();
+        m_Free.pop_back();
+    }
+    else
+    {
+        pBuffer = new GrowableArray<BYTE>();
+        m_llAllocations++;
+    }
+
+    if (dwSize > pBuffer->GetAllocated())
+    {
+        m_llAllocations++;
+        if (FAILED(pBuffer->Allocate(dwSize)))
+        {
+            m_Free.push_back(pBuffer);
+            return nullptr;
+        }
+    }
+
+    pBuffer->SetSize(0);
+    m_InUse.push_back(std::make_pair(pBuffer, pBuffer->GetAllocated()));
+    return pBuffer;
+}
+
+void CPCMBufferPool::Release(GrowableArray<BYTE> *pBuffer)
+{
+    if (!pBuffer)
+        return;
+
+    CAutoLock lock(&m_csPool);
+
+    // Growing a buffer while it was in use allocated memory as well
+    for (size_t i = 0; i < m_InUse.size(); i++)
+    {
+        if (m_InUse[i].first == pBuffer)
+        {
+            if (pBuffer->GetAllocated() > m_InUse[i].second)
+                m_llAllocations++;
+            m_InUse[i] = m_InUse.back();
+            m_InUse.pop_back();
+            break;
+        }
+    }
+
+    if (m_Free.size() < PCM_POOL_MAX_IDLE)
+        m_Free.push_back(pBuffer);
+    else
+        delete pBuffer;
+}
+
+LONGLONG CPCMBufferPool::GetAllocations()
+{
+    CAutoLock lock(&m_csPool);
+    return m_llAllocations;
+}
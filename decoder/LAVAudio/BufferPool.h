@@ -0,0 +1,52 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <vector>
+
+// Pool of PCM buffers
+//
+// The buffers are passed between the decoding and the post-processing stages and returned here once a stage
+// replaced them. They are only grown when a buffer needs more space than it had before, so once the audio
+// format settled, the processing chain runs without any heap allocations.
+class CPCMBufferPool
+{
+  public:
+    CPCMBufferPool();
+    ~CPCMBufferPool();
+
+    // Get a buffer with at least dwSize bytes allocated and a count of zero, or nullptr if out of memory
+    GrowableArray<BYTE> *Acquire(DWORD dwSize = 0);
+
+    // Return a buffer to the pool
+    void Release(GrowableArray<BYTE> *pBuffer);
+
+    // Number of heap allocations done for PCM buffers, including buffers that had to grow
+    LONGLONG GetAllocations();
+
+  private:
+    CCritSec m_csPool;
+    std::vector<GrowableArray<BYTE> *> m_Free;
+
+    // Buffers currently in use, with their allocated size when they left the pool
+    std::vector<std::pair<GrowableArray<BYTE> *, DWORD>> m_InUse;
+
+    LONGLONG m_llAllocations = 0;
+};
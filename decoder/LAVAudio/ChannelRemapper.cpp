@@ -0,0 +1,357 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "ChannelRemapper.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tmmintrin.h>
+
+extern "C"
+{
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/intreadwrite.h"
+};
+
+// The shuffle is only used when the CPU supports SSSE3
+#ifdef _MSC_VER
+#define REMAP_TARGET_SSSE3
+#else
+#define REMAP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+#define INT24_MAX 8388607
+#define INT24_MIN (-8388607 - 1)
+
+// PCM Volume Adjustment Factors, both for integer and float math
+// entries start at 2 channel mixing, half volume
+static int pcm_volume_adjust_integer[7] = {362, 443, 512, 572, 627, 677, 724};
+
+static float pcm_volume_adjust_float[7] = {1.41421356f, 1.73205081f, 2.00000000f, 2.23606798f,
+                                           2.44948974f, 2.64575131f, 2.82842712f};
+
+// SCALE_CA helper macro for SampleCopyAdjust
+#define SCALE_CA(sample, iFactor, factor) \
+    {                                     \
+        if (iFactor > 0)                  \
+        {                                 \
+            sample *= factor;             \
+            sample >>= 8;                 \
+        }                                 \
+        else                              \
+        {                                 \
+            sample <<= 8;                 \
+            sample /= factor;             \
+        }                                 \
+    }
+
+//
+// Helper Function that reads one sample from pIn, applys the scale specified by iFactor, and writes it to pOut
+//
+template <RemapSampleFormat sfSampleFormat>
+static inline void SampleCopyAdjust(uint8_t *pOut, const uint8_t *pIn, int iFactor)
+{
+    assert(abs(iFactor) > 1 && abs(iFactor) <= 8);
+    const int factorIndex = abs(iFactor) - 2;
+
+    switch (sfSampleFormat)
+    {
+    case RemapSample_U8: {
+        uint8_t *pOutSample = pOut;
+        int32_t sample = *pIn + INT8_MIN;
+        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clip_uint8(sample - INT8_MIN);
+    }
+    break;
+    case RemapSample_16: {
+        int16_t *pOutSample = (int16_t *)pOut;
+        int32_t sample = *((int16_t *)pIn);
+        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clip_int16(sample);
+    }
+    break;
+    case RemapSample_24: {
+        int32_t sample = (pIn[0] << 8) + (pIn[1] << 16) + (pIn[2] << 24);
+        sample >>= 8;
+        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
+        sample = av_clip(sample, INT24_MIN, INT24_MAX);
+        pOut[0] = sample & 0xff;
+        pOut[1] = (sample >> 8) & 0xff;
+        pOut[2] = (sample >> 16) & 0xff;
+    }
+    break;
+    case RemapSample_32: {
+        int32_t *pOutSample = (int32_t *)pOut;
+        int64_t sample = *((int32_t *)pIn);
+        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clipl_int32(sample);
+    }
+    break;
+    case RemapSample_FP32: {
+        float *pOutSample = (float *)pOut;
+        float sample = *((float *)pIn);
+        if (iFactor > 0)
+        {
+            sample *= pcm_volume_adjust_float[factorIndex];
+        }
+        else
+        {
+            sample /= pcm_volume_adjust_float[factorIndex];
+        }
+        *pOutSample = av_clipf(sample, -1.0f, 1.0f);
+    }
+    break;
+    default: assert(0); break;
+    }
+}
+
+//
+// Scales one channel of interleaved samples in place
+//
+template <RemapSampleFormat sfSampleFormat>
+static void ChannelAdjust(uint8_t *pBuffer, size_t stride, size_t nSamples, int iFactor)
+{
+    for (size_t i = 0; i < nSamples; i++, pBuffer += stride)
+        SampleCopyAdjust<sfSampleFormat>(pBuffer, pBuffer, iFactor);
+}
+
+//
+// Stores the lower bytes of a vector, without touching any memory past them
+//
+static inline void store_partial(uint8_t *p, __m128i v, unsigned bytes)
+{
+    if (bytes == 16)
+    {
+        _mm_storeu_si128((__m128i *)p, v);
+        return;
+    }
+    if (bytes & 8)
+    {
+        _mm_storel_epi64((__m128i *)p, v);
+        v = _mm_srli_si128(v, 8);
+        p += 8;
+    }
+    if (bytes & 4)
+    {
+        AV_WN32(p, _mm_cvtsi128_si32(v));
+        v = _mm_srli_si128(v, 4);
+        p += 4;
+    }
+    if (bytes & 2)
+    {
+        AV_WN16(p, _mm_cvtsi128_si32(v));
+        v = _mm_srli_si128(v, 2);
+        p += 2;
+    }
+    if (bytes & 1)
+        *p = (uint8_t)_mm_cvtsi128_si32(v);
+}
+
+void CChannelRemapPlan::Compile(unsigned uInChannels, unsigned uOutChannels, const ExtendedChannelMap extMap,
+                                RemapSampleFormat sfFormat)
+{
+    memcpy(m_Map, extMap, sizeof(m_Map));
+    m_uInChannels = uInChannels;
+    m_uOutChannels = uOutChannels;
+    m_sfFormat = sfFormat;
+    m_bValid = true;
+
+    const unsigned S = m_uSampleSize = remap_sample_size(sfFormat);
+    const unsigned uInFrame = S * uInChannels;
+    const unsigned uOutFrame = S * uOutChannels;
+
+    // Working in place needs a copy of the input frame for the scalar path
+    m_bInPlace = (uOutFrame <= uInFrame && uInFrame <= 32);
+
+    memset(m_Silence, sfFormat == RemapSample_U8 ? 0x80 : 0, sizeof(m_Silence));
+
+    m_nFactors = 0;
+    for (unsigned ch = 0; ch < uOutChannels; ch++)
+    {
+        m_iSource[ch] = extMap[ch].idx >= 0 ? extMap[ch].idx * S : -1;
+        if (extMap[ch].idx >= 0 && extMap[ch].factor && abs(extMap[ch].factor) != 1)
+        {
+            m_Factors[m_nFactors].ch = ch;
+            m_Factors[m_nFactors].factor = extMap[ch].factor;
+            m_nFactors++;
+        }
+    }
+
+    // Build the byte shuffles, for as many whole frames as fit into one vector
+    // Frames larger than one vector are split over two input windows and/or two output chunks
+    m_bShuffle = (av_get_cpu_flags() & AV_CPU_FLAG_SSSE3) && uInFrame <= 32 && uOutFrame <= 32;
+    if (!m_bShuffle)
+        return;
+
+    m_nGroup = FFMAX(1u, 16u / FFMAX(uInFrame, uOutFrame));
+    m_nWindows = (m_nGroup * uInFrame + 15) / 16;
+    m_nChunks = (m_nGroup * uOutFrame + 15) / 16;
+
+    memset(m_ShuffleMask, 0x80, sizeof(m_ShuffleMask));
+    memset(m_SilenceMask, 0, sizeof(m_SilenceMask));
+    for (unsigned o = 0; o < m_nGroup * uOutFrame; o++)
+    {
+        const unsigned frame = o / uOutFrame;
+        const unsigned ch = (o % uOutFrame) / S;
+        if (m_iSource[ch] >= 0)
+        {
+            const unsigned src = frame * uInFrame + m_iSource[ch] + (o % S);
+            m_ShuffleMask[o / 16][src / 16][o % 16] = src % 16;
+        }
+        else
+            m_SilenceMask[o / 16][o % 16] = m_Silence[0];
+    }
+}
+
+//
+// SSSE3 shuffle of whole groups of frames, returns the number of samples processed
+//
+REMAP_TARGET_SSSE3 size_t CChannelRemapPlan::RemapShuffle(const uint8_t *pIn, uint8_t *pOut, size_t nSamples) const
+{
+    const size_t uInGroup = m_nGroup * m_uSampleSize * m_uInChannels;
+    const size_t uOutGroup = m_nGroup * m_uSampleSize * m_uOutChannels;
+    const size_t uInSize = nSamples * m_uSampleSize * m_uInChannels;
+    const unsigned uLastChunk = (unsigned)(uOutGroup - (m_nChunks - 1) * 16);
+
+    const __m128i mask00 = _mm_loadu_si128((const __m128i *)m_ShuffleMask[0][0]);
+    const __m128i mask01 = _mm_loadu_si128((const __m128i *)m_ShuffleMask[0][1]);
+    const __m128i mask10 = _mm_loadu_si128((const __m128i *)m_ShuffleMask[1][0]);
+    const __m128i mask11 = _mm_loadu_si128((const __m128i *)m_ShuffleMask[1][1]);
+    const __m128i silence0 = _mm_loadu_si128((const __m128i *)m_SilenceMask[0]);
+    const __m128i silence1 = _mm_loadu_si128((const __m128i *)m_SilenceMask[1]);
+
+    // The input windows may extend past the group, but never past the buffer
+    // When working in place, the output of one group never reaches into the input of the next group
+    size_t nGroups = 0;
+    if (uInSize >= m_nWindows * 16)
+        nGroups = (uInSize - m_nWindows * 16) / uInGroup + 1;
+    nGroups = FFMIN(nGroups, nSamples / m_nGroup);
+
+    for (size_t g = 0; g < nGroups; g++, pIn += uInGroup, pOut += uOutGroup)
+    {
+        const __m128i in0 = _mm_loadu_si128((const __m128i *)pIn);
+        const __m128i in1 = m_nWindows > 1 ? _mm_loadu_si128((const __m128i *)(pIn + 16)) : _mm_setzero_si128();
+
+        __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(in0, mask00), _mm_shuffle_epi8(in1, mask01));
+        out0 = _mm_or_si128(out0, silence0);
+        if (m_nChunks > 1)
+        {
+            __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(in0, mask10), _mm_shuffle_epi8(in1, mask11));
+            out1 = _mm_or_si128(out1, silence1);
+            _mm_storeu_si128((__m128i *)pOut, out0);
+            store_partial(pOut + 16, out1, uLastChunk);
+        }
+        else
+            store_partial(pOut, out0, uLastChunk);
+    }
+
+    return nGroups * m_nGroup;
+}
+
+//
+// Scalar remap of single frames, with the sample size known at compile time
+//
+template <unsigned S>
+static void remap_frames(const uint8_t *pIn, uint8_t *pOut, size_t nFrames, unsigned uInChannels, unsigned uOutChannels,
+                         const int *iSource, const uint8_t *pSilence, bool bInPlace)
+{
+    const size_t uInFrame = S * uInChannels;
+    const size_t uOutFrame = S * uOutChannels;
+    uint8_t frame[32];
+
+    for (size_t i = 0; i < nFrames; i++, pIn += uInFrame, pOut += uOutFrame)
+    {
+        const uint8_t *pSrc = pIn;
+        if (bInPlace)
+        {
+            memcpy(frame, pIn, uInFrame);
+            pSrc = frame;
+        }
+
+        for (unsigned ch = 0; ch < uOutChannels; ch++)
+            memcpy(pOut + ch * S, iSource[ch] >= 0 ? pSrc + iSource[ch] : pSilence, S);
+    }
+}
+
+void CChannelRemapPlan::RemapScalar(const uint8_t *pIn, uint8_t *pOut, size_t nStart, size_t nSamples) const
+{
+    pIn += nStart * m_uSampleSize * m_uInChannels;
+    pOut += nStart * m_uSampleSize * m_uOutChannels;
+
+    const size_t nFrames = nSamples - nStart;
+    switch (m_uSampleSize)
+    {
+    case 1: remap_frames<1>(pIn, pOut, nFrames, m_uInChannels, m_uOutChannels, m_iSource, m_Silence, m_bInPlace); break;
+    case 2: remap_frames<2>(pIn, pOut, nFrames, m_uInChannels, m_uOutChannels, m_iSource, m_Silence, m_bInPlace); break;
+    case 3: remap_frames<3>(pIn, pOut, nFrames, m_uInChannels, m_uOutChannels, m_iSource, m_Silence, m_bInPlace); break;
+    case 4: remap_frames<4>(pIn, pOut, nFrames, m_uInChannels, m_uOutChannels, m_iSource, m_Silence, m_bInPlace); break;
+    default: assert(0); break;
+    }
+}
+
+void CChannelRemapPlan::ApplyFactors(uint8_t *pOut, size_t nSamples) const
+{
+    const size_t stride = m_uSampleSize * m_uOutChannels;
+    for (unsigned i = 0; i < m_nFactors; i++)
+    {
+        uint8_t *pChannel = pOut + m_Factors[i].ch * m_uSampleSize;
+        const int iFactor = m_Factors[i].factor;
+        switch (m_sfFormat)
+        {
+        case RemapSample_U8: ChannelAdjust<RemapSample_U8>(pChannel, stride, nSamples, iFactor); break;
+        case RemapSample_16: ChannelAdjust<RemapSample_16>(pChannel, stride, nSamples, iFactor); break;
+        case RemapSample_24: ChannelAdjust<RemapSample_24>(pChannel, stride, nSamples, iFactor); break;
+        case RemapSample_32: ChannelAdjust<RemapSample_32>(pChannel, stride, nSamples, iFactor); break;
+        case RemapSample_FP32: ChannelAdjust<RemapSample_FP32>(pChannel, stride, nSamples, iFactor); break;
+        default: assert(0); break;
+        }
+    }
+}
+
+unsigned remap_sample_size(RemapSampleFormat sfFormat)
+{
+    switch (sfFormat)
+    {
+    case RemapSample_U8: return 1;
+    case RemapSample_16: return 2;
+    case RemapSample_24: return 3;
+    case RemapSample_32:
+    case RemapSample_FP32: return 4;
+    }
+    return 0;
+}
+
+bool CChannelRemapPlan::Matches(unsigned uInChannels, unsigned uOutChannels, const ExtendedChannelMap extMap,
+                                RemapSampleFormat sfFormat) const
+{
+    return m_bValid && uInChannels == m_uInChannels && uOutChannels == m_uOutChannels && sfFormat == m_sfFormat &&
+           memcmp(extMap, m_Map, sizeof(ExtendedChannelMap_s) * uOutChannels) == 0;
+}
+
+void CChannelRemapPlan::Remap(const uint8_t *pIn, uint8_t *pOut, size_t nSamples) const
+{
+    assert(m_bValid);
+
+    const size_t nDone = m_bShuffle ? RemapShuffle(pIn, pOut, nSamples) : 0;
+    RemapScalar(pIn, pOut, nDone, nSamples);
+    ApplyFactors(pOut, nSamples);
+}
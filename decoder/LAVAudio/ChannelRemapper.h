@@ -0,0 +1,144 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ExtendedChannelMap_s
+{
+    int idx;
+    int factor;
+} ExtendedChannelMap[8];
+
+inline void ExtChMapSet(ExtendedChannelMap *map, int ch, int idx, int factor)
+{
+    (*map)[ch].idx = idx;
+    (*map)[ch].factor = factor;
+}
+
+inline void ExtChMapClear(ExtendedChannelMap *map)
+{
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        (*map)[i].idx = -1;
+        (*map)[i].factor = 0;
+    }
+}
+
+// Sample formats of the remapper, the same samples as the LAVAudioSampleFormat of the same name
+enum RemapSampleFormat
+{
+    RemapSample_U8,
+    RemapSample_16,
+    RemapSample_24,
+    RemapSample_32,
+    RemapSample_FP32,
+};
+
+unsigned remap_sample_size(RemapSampleFormat sfFormat);
+
+//
+// Compiled Extended Channel Map
+//
+// Remaps the channels of interleaved PCM samples of any sample format into any arbitrary layout and channel count.
+// The map is compiled into a shuffle plan for the sample format and channel counts, which is re-used for every
+// following buffer until one of those changes.
+//
+// The samples are copied byte-by-byte, without any conversion or loss.
+//
+// The ExtendedChannelMap is assumed to always have at least uOutChannels valid entries.
+// Its layout is in output format:
+//      Map[0] is the first output channel, and should contain the index in the source stream (or -1 for silence)
+//      Map[1] is the second output channel
+//
+// Source channels can be applied multiple times to the Destination, but multiple Source channels cannot be merged
+// into one channel. Note that when copying one source channel into multiple destinations, you always want to
+// reduce its volume. You can either do this in a second step, or use the factor documented below
+//
+// Examples:
+// 5.1 Input Buffer, following map will extract the Center channel, and return it as Mono:
+// uOutChannels == 1; map = {2}
+//
+// Mono Input Buffer, Convert to Stereo
+// uOutChannels == 2; map = {0, 0}
+//
+// Additionally, a factor can be applied to all PCM samples
+//
+// For optimization, the factor cannot be freely specified.
+// Factors -1, 0, 1 are ignored.
+// A Factor of 2 doubles the volume, 3 trippled, etc.
+// A Factor of -2 will produce half volume, -3 one third, etc.
+// The limit is a factor of 8/-8
+//
+// The plan uses no DirectShow types and no precompiled header, CChannelRemapper in PostProcessor.h applies it to the
+// filter's buffers.
+//
+class CChannelRemapPlan
+{
+  public:
+    // Check if the plan was compiled for these parameters
+    bool Matches(unsigned uInChannels, unsigned uOutChannels, const ExtendedChannelMap extMap,
+                 RemapSampleFormat sfFormat) const;
+    void Compile(unsigned uInChannels, unsigned uOutChannels, const ExtendedChannelMap extMap,
+                 RemapSampleFormat sfFormat);
+
+    // Output frames fit into the input frames, so the output can overwrite the input buffer
+    bool IsInPlace() const { return m_bInPlace; }
+
+    // Remap nSamples frames from pIn to pOut, which is either pIn or a separate buffer
+    void Remap(const uint8_t *pIn, uint8_t *pOut, size_t nSamples) const;
+
+  private:
+    size_t RemapShuffle(const uint8_t *pIn, uint8_t *pOut, size_t nSamples) const;
+    void RemapScalar(const uint8_t *pIn, uint8_t *pOut, size_t nStart, size_t nSamples) const;
+    void ApplyFactors(uint8_t *pOut, size_t nSamples) const;
+
+  private:
+    // Parameters the plan was compiled for
+    bool m_bValid = false;
+    ExtendedChannelMap m_Map;
+    unsigned m_uInChannels = 0;
+    unsigned m_uOutChannels = 0;
+    RemapSampleFormat m_sfFormat = RemapSample_U8;
+
+    unsigned m_uSampleSize = 0;
+    bool m_bInPlace = false; // output frames fit into the input frames
+
+    // Scalar plan, byte offset of the source sample in the input frame, or -1 for silence
+    int m_iSource[8];
+    uint8_t m_Silence[4];
+
+    // Channels with a volume factor
+    unsigned m_nFactors = 0;
+    struct
+    {
+        unsigned ch;
+        int factor;
+    } m_Factors[8];
+
+    // Shuffle plan, processing m_nGroup frames per iteration with up to two 16-byte input windows and output chunks
+    bool m_bShuffle = false;
+    unsigned m_nGroup = 0;
+    unsigned m_nWindows = 0;
+    unsigned m_nChunks = 0;
+    uint8_t m_ShuffleMask[2][2][16]; // [chunk][window]
+    uint8_t m_SilenceMask[2][16];    // [chunk]
+};
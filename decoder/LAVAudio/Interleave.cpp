@@ -0,0 +1,336 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Interleave.h"
+
+#include <assert.h>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+};
+
+// The AVX conversion is only called when the CPU supports it
+#ifdef _MSC_VER
+#define INTERLEAVE_TARGET_AVX
+#else
+#define INTERLEAVE_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+// The SIMD kernels handle stereo, 5.1 and 7.1, which covers nearly all multi-channel audio.
+// Everything else, and the remaining samples at the end of a frame, is interleaved by the generic code.
+
+template <typename TOut, typename TIn>
+static void interleave_generic(TOut *dst, const TIn *const *src, int nChannels, size_t start, size_t end)
+{
+    for (int ch = 0; ch < nChannels; ch++)
+    {
+        const TIn *pIn = src[ch];
+        TOut *pOut = dst + ch;
+        for (size_t i = start; i < end; i++)
+            pOut[i * nChannels] = (TOut)pIn[i];
+    }
+}
+
+// Loaders for four 32-bit samples of one channel
+struct LoadInt32
+{
+    const int32_t *const *src;
+    __m128i operator()(int ch, size_t i) const { return _mm_loadu_si128((const __m128i *)(src[ch] + i)); }
+};
+
+struct LoadDouble
+{
+    const double *const *src;
+    __m128i operator()(int ch, size_t i) const
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src[ch] + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src[ch] + i + 2));
+        return _mm_castps_si128(_mm_movelh_ps(lo, hi));
+    }
+};
+
+#define TRANSPOSE_4X4_EPI32(a, b, c, d)        \
+    {                                          \
+        __m128i t0 = _mm_unpacklo_epi32(a, b); \
+        __m128i t1 = _mm_unpacklo_epi32(c, d); \
+        __m128i t2 = _mm_unpackhi_epi32(a, b); \
+        __m128i t3 = _mm_unpackhi_epi32(c, d); \
+        a = _mm_unpacklo_epi64(t0, t1);        \
+        b = _mm_unpackhi_epi64(t0, t1);        \
+        c = _mm_unpacklo_epi64(t2, t3);        \
+        d = _mm_unpackhi_epi64(t2, t3);        \
+    }
+
+// The kernels return the number of samples they processed
+
+template <class Load> static size_t interleave32_2ch(__m128i *dst, const Load &load, size_t nSamples)
+{
+    size_t i = 0;
+    for (; i + 4 <= nSamples; i += 4)
+    {
+        __m128i a = load(0, i), b = load(1, i);
+        _mm_storeu_si128(dst++, _mm_unpacklo_epi32(a, b));
+        _mm_storeu_si128(dst++, _mm_unpackhi_epi32(a, b));
+    }
+    return i;
+}
+
+template <class Load> static size_t interleave32_6ch(__m128i *dst, const Load &load, size_t nSamples)
+{
+    uint8_t *pOut = (uint8_t *)dst;
+    size_t i = 0;
+    for (; i + 4 <= nSamples; i += 4)
+    {
+        __m128i a = load(0, i), b = load(1, i), c = load(2, i), d = load(3, i);
+        __m128i e = load(4, i), f = load(5, i);
+        TRANSPOSE_4X4_EPI32(a, b, c, d);
+        __m128i ef0 = _mm_unpacklo_epi32(e, f);
+        __m128i ef1 = _mm_unpackhi_epi32(e, f);
+
+        // Each sample is written as 16 bytes for the first four channels, and 8 bytes for the last two
+        _mm_storeu_si128((__m128i *)(pOut + 0), a);
+        _mm_storel_epi64((__m128i *)(pOut + 16), ef0);
+        _mm_storeu_si128((__m128i *)(pOut + 24), b);
+        _mm_storel_epi64((__m128i *)(pOut + 40), _mm_unpackhi_epi64(ef0, ef0));
+        _mm_storeu_si128((__m128i *)(pOut + 48), c);
+        _mm_storel_epi64((__m128i *)(pOut + 64), ef1);
+        _mm_storeu_si128((__m128i *)(pOut + 72), d);
+        _mm_storel_epi64((__m128i *)(pOut + 88), _mm_unpackhi_epi64(ef1, ef1));
+        pOut += 96;
+    }
+    return i;
+}
+
+template <class Load> static size_t interleave32_8ch(__m128i *dst, const Load &load, size_t nSamples)
+{
+    size_t i = 0;
+    for (; i + 4 <= nSamples; i += 4)
+    {
+        __m128i a = load(0, i), b = load(1, i), c = load(2, i), d = load(3, i);
+        __m128i e = load(4, i), f = load(5, i), g = load(6, i), h = load(7, i);
+        TRANSPOSE_4X4_EPI32(a, b, c, d);
+        TRANSPOSE_4X4_EPI32(e, f, g, h);
+        _mm_storeu_si128(dst++, a);
+        _mm_storeu_si128(dst++, e);
+        _mm_storeu_si128(dst++, b);
+        _mm_storeu_si128(dst++, f);
+        _mm_storeu_si128(dst++, c);
+        _mm_storeu_si128(dst++, g);
+        _mm_storeu_si128(dst++, d);
+        _mm_storeu_si128(dst++, h);
+    }
+    return i;
+}
+
+template <class Load> static size_t interleave32(int32_t *dst, const Load &load, int nChannels, size_t nSamples)
+{
+    switch (nChannels)
+    {
+    case 2: return interleave32_2ch((__m128i *)dst, load, nSamples);
+    case 6: return interleave32_6ch((__m128i *)dst, load, nSamples);
+    case 8: return interleave32_8ch((__m128i *)dst, load, nSamples);
+    }
+    return 0;
+}
+
+// Transpose 8 rows of 8 16-bit values, the result is one sample of all 8 channels per register
+static inline void transpose_8x8_epi16(__m128i r[8])
+{
+    __m128i t[8], u[8];
+    for (int k = 0; k < 4; k++)
+    {
+        t[2 * k + 0] = _mm_unpacklo_epi16(r[2 * k], r[2 * k + 1]);
+        t[2 * k + 1] = _mm_unpackhi_epi16(r[2 * k], r[2 * k + 1]);
+    }
+    // t: ab_lo, ab_hi, cd_lo, cd_hi, ef_lo, ef_hi, gh_lo, gh_hi
+    for (int k = 0; k < 2; k++)
+    {
+        u[4 * k + 0] = _mm_unpacklo_epi32(t[4 * k + 0], t[4 * k + 2]);
+        u[4 * k + 1] = _mm_unpackhi_epi32(t[4 * k + 0], t[4 * k + 2]);
+        u[4 * k + 2] = _mm_unpacklo_epi32(t[4 * k + 1], t[4 * k + 3]);
+        u[4 * k + 3] = _mm_unpackhi_epi32(t[4 * k + 1], t[4 * k + 3]);
+    }
+    // u: abcd for samples 0-1, 2-3, 4-5, 6-7, followed by efgh for the same samples
+    for (int k = 0; k < 4; k++)
+    {
+        r[2 * k + 0] = _mm_unpacklo_epi64(u[k], u[k + 4]);
+        r[2 * k + 1] = _mm_unpackhi_epi64(u[k], u[k + 4]);
+    }
+}
+
+// 6 channels are transposed as 8, with the last two channels empty
+template <int nChannels> static size_t interleave16_multi(int16_t *dst, const int16_t *const *src, size_t nSamples)
+{
+    uint8_t *pOut = (uint8_t *)dst;
+    size_t i = 0;
+    for (; i + 8 <= nSamples; i += 8)
+    {
+        __m128i r[8];
+        for (int ch = 0; ch < 8; ch++)
+            r[ch] = ch < nChannels ? _mm_loadu_si128((const __m128i *)(src[ch] + i)) : _mm_setzero_si128();
+
+        transpose_8x8_epi16(r);
+
+        if (nChannels == 8)
+        {
+            for (int s = 0; s < 8; s++)
+                _mm_storeu_si128((__m128i *)(pOut + 16 * s), r[s]);
+        }
+        else
+        {
+            // Only the first 12 bytes of each register are valid
+            for (int s = 0; s < 8; s++)
+            {
+                _mm_storel_epi64((__m128i *)(pOut + 12 * s), r[s]);
+                *(int32_t *)(pOut + 12 * s + 8) = _mm_cvtsi128_si32(_mm_srli_si128(r[s], 8));
+            }
+        }
+        pOut += 16 * nChannels;
+    }
+    return i;
+}
+
+static size_t interleave16(int16_t *dst, const int16_t *const *src, int nChannels, size_t nSamples)
+{
+    size_t i = 0;
+    switch (nChannels)
+    {
+    case 2: {
+        __m128i *pOut = (__m128i *)dst;
+        for (; i + 8 <= nSamples; i += 8)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i));
+            _mm_storeu_si128(pOut++, _mm_unpacklo_epi16(a, b));
+            _mm_storeu_si128(pOut++, _mm_unpackhi_epi16(a, b));
+        }
+    }
+    break;
+    case 6: i = interleave16_multi<6>(dst, src, nSamples); break;
+    case 8: i = interleave16_multi<8>(dst, src, nSamples); break;
+    }
+    return i;
+}
+
+static size_t interleave8(uint8_t *dst, const uint8_t *const *src, int nChannels, size_t nSamples)
+{
+    size_t i = 0;
+    __m128i *pOut = (__m128i *)dst;
+    if (nChannels == 2)
+    {
+        for (; i + 16 <= nSamples; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i));
+            _mm_storeu_si128(pOut++, _mm_unpacklo_epi8(a, b));
+            _mm_storeu_si128(pOut++, _mm_unpackhi_epi8(a, b));
+        }
+    }
+    else if (nChannels == 8)
+    {
+        for (; i + 16 <= nSamples; i += 16)
+        {
+            __m128i t[8], u[8];
+            for (int k = 0; k < 4; k++)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)(src[2 * k] + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(src[2 * k + 1] + i));
+                t[2 * k + 0] = _mm_unpacklo_epi8(a, b);
+                t[2 * k + 1] = _mm_unpackhi_epi8(a, b);
+            }
+            for (int k = 0; k < 2; k++)
+            {
+                u[4 * k + 0] = _mm_unpacklo_epi16(t[4 * k + 0], t[4 * k + 2]);
+                u[4 * k + 1] = _mm_unpackhi_epi16(t[4 * k + 0], t[4 * k + 2]);
+                u[4 * k + 2] = _mm_unpacklo_epi16(t[4 * k + 1], t[4 * k + 3]);
+                u[4 * k + 3] = _mm_unpackhi_epi16(t[4 * k + 1], t[4 * k + 3]);
+            }
+            // Every register holds two samples of all 8 channels
+            for (int k = 0; k < 4; k++)
+            {
+                _mm_storeu_si128(pOut++, _mm_unpacklo_epi32(u[k], u[k + 4]));
+                _mm_storeu_si128(pOut++, _mm_unpackhi_epi32(u[k], u[k + 4]));
+            }
+        }
+    }
+    return i;
+}
+
+void interleave_samples(uint8_t *dst, const uint8_t *const *src, int nChannels, size_t nSamples, int bytesPerSample)
+{
+    size_t done = 0;
+    switch (bytesPerSample)
+    {
+    case 1:
+        done = interleave8(dst, src, nChannels, nSamples);
+        interleave_generic(dst, src, nChannels, done, nSamples);
+        break;
+    case 2:
+        done = interleave16((int16_t *)dst, (const int16_t *const *)src, nChannels, nSamples);
+        interleave_generic((int16_t *)dst, (const int16_t *const *)src, nChannels, done, nSamples);
+        break;
+    case 4:
+        done = interleave32((int32_t *)dst, LoadInt32{(const int32_t *const *)src}, nChannels, nSamples);
+        interleave_generic((int32_t *)dst, (const int32_t *const *)src, nChannels, done, nSamples);
+        break;
+    default: assert(0); break;
+    }
+}
+
+void interleave_samples_dbl(float *dst, const double *const *src, int nChannels, size_t nSamples)
+{
+    size_t done = interleave32((int32_t *)dst, LoadDouble{src}, nChannels, nSamples);
+    interleave_generic(dst, src, nChannels, done, nSamples);
+}
+
+INTERLEAVE_TARGET_AVX static size_t convert_dbl_to_flt_avx(float *dst, const double *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_ps(dst + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+        _mm_storeu_ps(dst + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)));
+    }
+    return i;
+}
+
+static size_t convert_dbl_to_flt_sse2(float *dst, const double *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+    return i;
+}
+
+void convert_dbl_to_flt(float *dst, const double *src, size_t count)
+{
+    const bool bAVX = (av_get_cpu_flags() & AV_CPU_FLAG_AVX) != 0;
+
+    size_t i = bAVX ? convert_dbl_to_flt_avx(dst, src, count) : convert_dbl_to_flt_sse2(dst, src, count);
+    for (; i < count; i++)
+        dst[i] = (float)src[i];
+}
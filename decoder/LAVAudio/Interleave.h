@@ -0,0 +1,35 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interleaving of the planar decoder output, without any DirectShow types, so it can be tested on its own
+
+// Interleave nSamples samples of nChannels planar channels into dst
+// bytesPerSample can be 1, 2 or 4, the samples are copied unchanged
+void interleave_samples(uint8_t *dst, const uint8_t *const *src, int nChannels, size_t nSamples, int bytesPerSample);
+
+// Interleave nSamples samples of nChannels planar double channels into dst, converting them to float
+void interleave_samples_dbl(float *dst, const double *const *src, int nChannels, size_t nSamples);
+
+// Convert count double samples to float
+void convert_dbl_to_flt(float *dst, const double *src, size_t count);
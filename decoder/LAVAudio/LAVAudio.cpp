@@ -20,12 +20,14 @@
 #include "stdafx.h"
 #include "LAVAudio.h"
 #include "PostProcessor.h"
+#include "Interleave.h"
 
 #include <MMReg.h>
 #include <assert.h>
 
 #include "moreuuids.h"
 #include "DShowUtil.h"
+#include "StartCode.h"
 #include "IMediaSideData.h"
 #include "IMediaSideDataFFmpeg.h"
 
@@ -185,6 +187,7 @@ HRESULT CLAVAudio::LoadDefaults()
     m_settings.MixingLFELevel = 0;
 
     m_settings.SuppressFormatChanges = FALSE;
+    m_settings.BatchLatency = 0;
 
     return S_OK;
 }
@@ -316,6 +319,10 @@ HRESULT CLAVAudio::ReadSettings(HKEY rootKey)
         if (SUCCEEDED(hr))
             m_settings.AudioDelay = (int)dwVal;
 
+        dwVal = reg.ReadDWORD(L"BatchLatency", hr);
+        if (SUCCEEDED(hr))
+            m_settings.BatchLatency = min(dwVal, (DWORD)BATCH_MAX_LATENCY);
+
         for (int i = 0; i < Bitstream_NB; ++i)
         {
             std::wstring key = std::wstring(L"Bitstreaming_") + std::wstring(bitstreamingCodecs[i]);
@@ -375,6 +382,7 @@ HRESULT CLAVAudio::SaveSettings()
         reg.WriteBOOL(L"Output51Legacy", m_settings.Output51Legacy);
         reg.WriteBOOL(L"AudioDelayEnabled", m_settings.AudioDelayEnabled);
         reg.WriteDWORD(L"AudioDelay", m_settings.AudioDelay);
+        reg.WriteDWORD(L"BatchLatency", m_settings.BatchLatency);
 
         reg.WriteBOOL(L"Mixing", m_settings.MixingEnabled);
         reg.WriteDWORD(L"MixingLayout", m_settings.MixingLayout);
@@ -434,6 +442,7 @@ void CLAVAudio::ffmpeg_shutdown()
     {
         swr_free(&m_swrContext);
     }
+    m_MatrixMixer.Reset();
 
     FreeBitstreamContext();
 
@@ -854,6 +863,22 @@ STDMETHODIMP_(BOOL) CLAVAudio::GetOutput51LegacyLayout()
     return m_settings.Output51Legacy;
 }
 
+STDMETHODIMP CLAVAudio::SetBatchDecoding(DWORD dwMaxLatency)
+{
+    if (dwMaxLatency > BATCH_MAX_LATENCY)
+        return E_INVALIDARG;
+
+    m_settings.BatchLatency = dwMaxLatency;
+    SaveSettings();
+
+    return S_OK;
+}
+
+STDMETHODIMP_(DWORD) CLAVAudio::GetBatchDecoding()
+{
+    return m_settings.BatchLatency;
+}
+
 // ILAVAudioStatus
 BOOL CLAVAudio::IsSampleFormatSupported(LAVAudioSampleFormat sfCheck)
 {
@@ -976,6 +1001,11 @@ HRESULT CLAVAudio::GetOutputDetails(const char **pOutputFormat, int *pnChannels,
 HRESULT CLAVAudio::EnableVolumeStats()
 {
     DbgLog((LOG_TRACE, 1, L"Volume Statistics Enabled"));
+    {
+        CAutoLock lock(&m_csVolumePeak);
+        for (int ch = 0; ch < MAX_VOLUME_STAT_CHANNEL; ch++)
+            m_fVolumePeak[ch] = 0.0f;
+    }
     m_bVolumeStats = TRUE;
     return S_OK;
 }
@@ -1002,6 +1032,45 @@ HRESULT CLAVAudio::GetChannelVolumeAverage(WORD nChannel, float *pfDb)
     return S_OK;
 }
 
+HRESULT CLAVAudio::GetChannelVolumePeak(WORD nChannel, float *pfDb)
+{
+    CheckPointer(pfDb, E_POINTER);
+    if (!m_pOutput || m_pOutput->IsConnected() == FALSE || !m_bVolumeStats || m_avBSContext)
+    {
+        return E_UNEXPECTED;
+    }
+    if (nChannel >= m_OutputQueue.layout.nb_channels || nChannel >= MAX_VOLUME_STAT_CHANNEL)
+    {
+        return E_INVALIDARG;
+    }
+    float fPeak = 0.0f;
+    {
+        CAutoLock lock(&m_csVolumePeak);
+        fPeak = m_fVolumePeak[nChannel];
+        m_fVolumePeak[nChannel] = 0.0f;
+    }
+    *pfDb = fPeak > FLT_EPSILON ? 20.0f * log10f(fPeak) : -100.0f;
+    return S_OK;
+}
+
+HRESULT CLAVAudio::GetBufferAllocations(LONGLONG *pllAllocations)
+{
+    CheckPointer(pllAllocations, E_POINTER);
+    *pllAllocations = m_PCMPool.GetAllocations();
+    return S_OK;
+}
+
+HRESULT CLAVAudio::GetJitterHistogram(LONGLONG rtBinWidth, DWORD *pBins, DWORD nBins)
+{
+    CheckPointer(pBins, E_POINTER);
+    if (rtBinWidth <= 0 || nBins == 0)
+    {
+        return E_INVALIDARG;
+    }
+    m_faJitter.Histogram(rtBinWidth, (unsigned int *)pBins, nBins);
+    return S_OK;
+}
+
 // CTransformFilter
 HRESULT CLAVAudio::CheckInputType(const CMediaType *mtIn)
 {
@@ -1722,6 +1791,8 @@ HRESULT CLAVAudio::EndOfStream()
     DbgLog((LOG_TRACE, 10, L"CLAVAudio::EndOfStream()"));
     CAutoLock cAutoLock(&m_csReceive);
 
+    DecodeBatch();
+
     // Flush the last data out of the parser
     ProcessBuffer(nullptr);
     ProcessBuffer(nullptr, TRUE);
@@ -1735,10 +1806,15 @@ HRESULT CLAVAudio::PerformFlush()
     CAutoLock cAutoLock(&m_csReceive);
 
     m_buff.Clear();
+    m_BatchPackets.clear();
+    m_BatchData.SetSize(0);
     FlushOutput(FALSE);
     FlushDecoder();
 
     m_bsOutput.SetSize(0);
+    m_pBSBurst = nullptr;
+    m_MATFramer.Reset();
+    MATReleaseBuffer();
 
     m_rtStart = 0;
     m_bQueueResync = TRUE;
@@ -1746,7 +1822,6 @@ HRESULT CLAVAudio::PerformFlush()
     av_channel_layout_uninit(&m_SuppressLayout);
     m_bMPEGAudioResync = (m_pInput->CurrentMediaType().subtype == MEDIASUBTYPE_MPEG1AudioPayload);
 
-    memset(&m_TrueHDMATState, 0, sizeof(m_TrueHDMATState));
     m_rtBitstreamCache = AV_NOPTS_VALUE;
 
     return S_OK;
@@ -1820,6 +1895,14 @@ HRESULT CLAVAudio::Receive(IMediaSample *pIn)
         return m_pOutput->Deliver(pIn);
     }
 
+    // Samples which can't be added to the batch need the pending batch decoded first
+    BOOL bBatch = m_settings.BatchLatency > 0 && CanBatchSample(pIn);
+    if (!bBatch && !m_BatchPackets.empty())
+    {
+        if (FAILED(hr = DecodeBatch()))
+            return hr;
+    }
+
     AM_MEDIA_TYPE *pmt;
     if (SUCCEEDED(pIn->GetMediaType(&pmt)) && pmt)
     {
@@ -1866,6 +1949,26 @@ HRESULT CLAVAudio::Receive(IMediaSample *pIn)
     REFERENCE_TIME rtStart = _I64_MIN, rtStop = _I64_MIN;
     hr = pIn->GetTime(&rtStart, &rtStop);
 
+    if (bBatch)
+    {
+        DWORD dwOffset = m_BatchData.GetCount();
+        if (FAILED(m_BatchData.SetSize(dwOffset + len)))
+        {
+            m_BatchPackets.clear();
+            return E_OUTOFMEMORY;
+        }
+        memcpy(m_BatchData.Ptr() + dwOffset, pDataIn, len);
+        m_BatchPackets.push_back({dwOffset, len, rtStart, rtStop, hr});
+
+        // Decode the batch once it covers the configured latency
+        REFERENCE_TIME rtEnd = (hr == S_OK) ? rtStop : rtStart;
+        if (rtEnd - m_BatchPackets.front().rtStart < m_settings.BatchLatency * 10000i64 &&
+            m_BatchPackets.size() < BATCH_MAX_SAMPLES)
+            return S_OK;
+
+        return DecodeBatch();
+    }
+
     if ((pIn->IsDiscontinuity() == S_OK || (m_bNeedSyncpoint && pIn->IsSyncPoint() == S_OK)))
     {
         DbgLog((LOG_ERROR, 10, L"::Receive(): Discontinuity, flushing decoder.."));
@@ -1886,7 +1989,69 @@ HRESULT CLAVAudio::Receive(IMediaSample *pIn)
         }
     }
 
-    if (m_bQueueResync && SUCCEEDED(hr))
+    return ProcessInput(pDataIn, len, rtStart, rtStop, hr, pIn);
+}
+
+BOOL CLAVAudio::CanBatchSample(IMediaSample *pIn)
+{
+    // Anything that changes the decoder state is handled on the regular path
+    if (!m_pAVCtx || m_avBSContext || m_bQueueResync || m_bNeedSyncpoint || m_bBitStreamingSettingsChanged)
+        return FALSE;
+
+    AM_SAMPLE2_PROPERTIES const *pProps = m_pInput->SampleProps();
+    if ((pProps->dwSampleFlags & (AM_SAMPLE_TYPECHANGED | AM_SAMPLE_DATADISCONTINUITY)) ||
+        !(pProps->dwSampleFlags & AM_SAMPLE_TIMEVALID))
+        return FALSE;
+
+    // Side data is only valid as long as the sample is
+    IMediaSideData *pSideData = nullptr;
+    if (SUCCEEDED(pIn->QueryInterface(&pSideData)))
+    {
+        const BYTE *pData = nullptr;
+        size_t nSize = 0;
+        HRESULT hr = pSideData->GetSideData(IID_MediaSideDataFFMpeg, &pData, &nSize);
+        SafeRelease(&pSideData);
+
+        if (SUCCEEDED(hr))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+HRESULT CLAVAudio::DecodeBatch()
+{
+    HRESULT hr = S_OK;
+
+    if (m_BatchPackets.empty())
+        return S_OK;
+
+    // Decode all packets of the batch, and deliver the output once at the end
+    m_bBatchPass = TRUE;
+    for (const BatchPacket &packet : m_BatchPackets)
+    {
+        hr = ProcessInput(m_BatchData.Ptr() + packet.dwOffset, packet.len, packet.rtStart, packet.rtStop,
+                          packet.hrTime, nullptr);
+        if (FAILED(hr))
+            break;
+    }
+    m_bBatchPass = FALSE;
+
+    m_BatchPackets.clear();
+    m_BatchData.SetSize(0);
+
+    if (FAILED(hr))
+        return hr;
+
+    return FlushOutput();
+}
+
+HRESULT CLAVAudio::ProcessInput(const BYTE *pData, long len, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop,
+                                HRESULT hrTime, IMediaSample *pMediaSample)
+{
+    HRESULT hr;
+
+    if (m_bQueueResync && SUCCEEDED(hrTime))
     {
         DbgLog((LOG_TRACE, 10, L"Resync Request; old: %I64d; new: %I64d; buffer: %d", m_rtStart, rtStart,
                 m_buff.GetCount()));
@@ -1904,13 +2069,13 @@ HRESULT CLAVAudio::Receive(IMediaSample *pIn)
 
     m_bJustFlushed = FALSE;
 
-    m_rtStartInput = SUCCEEDED(hr) ? rtStart : AV_NOPTS_VALUE;
-    m_rtStopInput = (hr == S_OK) ? rtStop : AV_NOPTS_VALUE;
+    m_rtStartInput = SUCCEEDED(hrTime) ? rtStart : AV_NOPTS_VALUE;
+    m_rtStopInput = (hrTime == S_OK) ? rtStop : AV_NOPTS_VALUE;
 
     DWORD bufflen = m_buff.GetCount();
 
     // Hack to re-create the BD LPCM header because in the MPC-HC format its stripped off.
-    CMediaType inMt(m_pInput->CurrentMediaType());
+    const CMediaType &inMt = m_pInput->CurrentMediaType();
     if (inMt.subtype == MEDIASUBTYPE_HDMV_LPCM_AUDIO && inMt.formattype == FORMAT_WaveFormatEx)
     {
         m_buff.SetSize(bufflen + 4);
@@ -1936,9 +2101,9 @@ HRESULT CLAVAudio::Receive(IMediaSample *pIn)
     }
 
     m_buff.Allocate(bufflen + len + AV_INPUT_BUFFER_PADDING_SIZE);
-    m_buff.Append(pDataIn, len);
+    m_buff.Append(pData, len);
 
-    hr = ProcessBuffer(pIn);
+    hr = ProcessBuffer(pMediaSample);
 
     if (FAILED(hr))
         return hr;
@@ -1996,6 +2161,29 @@ HRESULT CLAVAudio::ResyncMPEGAudio()
     return S_FALSE;
 }
 
+static int count_dts_sync_words(const uint8_t *buf, int size)
+{
+    static const uint32_t markers[] = {DCA_MARKER_RAW_BE, DCA_MARKER_RAW_LE, DCA_MARKER_14B_BE, DCA_MARKER_14B_LE};
+
+    const uint8_t *end = buf + size;
+    int count = 0;
+    for (uint32_t marker : markers)
+    {
+        for (const uint8_t *sync = find_sync_word(buf, end, marker); sync != end;
+             sync = find_sync_word(sync + 1, end, marker))
+        {
+            // The 14-bit sync words extend into the next two bytes
+            if (marker == DCA_MARKER_14B_BE && (end - sync < 6 || sync[4] != 0x07 || (sync[5] & 0xF0) != 0xF0))
+                continue;
+            if (marker == DCA_MARKER_14B_LE && (end - sync < 6 || (sync[4] & 0xF0) != 0xF0 || sync[5] != 0x07))
+                continue;
+            count++;
+        }
+    }
+
+    return count;
+}
+
 HRESULT CLAVAudio::ProcessBuffer(IMediaSample *pMediaSample, BOOL bEOF)
 {
     HRESULT hr = S_OK, hr2 = S_OK;
@@ -2009,20 +2197,7 @@ HRESULT CLAVAudio::ProcessBuffer(IMediaSample *pMediaSample, BOOL bEOF)
     {
         if (m_bFindDTSInPCM)
         {
-            int i = 0, count = 0;
-            uint32_t state = -1;
-            for (i = 0; i < buffer_size; ++i)
-            {
-                state = (state << 8) | p[i];
-                if ((state == DCA_MARKER_14B_LE && (i < buffer_size - 2) && (p[i + 1] & 0xF0) == 0xF0 &&
-                     p[i + 2] == 0x07) ||
-                    (state == DCA_MARKER_14B_BE && (i < buffer_size - 2) && p[i + 1] == 0x07 &&
-                     (p[i + 2] & 0xF0) == 0xF0) ||
-                    state == DCA_MARKER_RAW_LE || state == DCA_MARKER_RAW_BE)
-                {
-                    count++;
-                }
-            }
+            int count = count_dts_sync_words(p, buffer_size);
             if (count >= 4)
             {
                 DbgLog((LOG_TRACE, 10,
@@ -2408,7 +2583,7 @@ fail:
 
 HRESULT CLAVAudio::DecodeReceive(HRESULT *hrDeliver)
 {
-    BufferDetails out;
+    BufferDetails out(&m_PCMPool);
 
     while (1)
     {
@@ -2471,97 +2646,44 @@ HRESULT CLAVAudio::DecodeReceive(HRESULT *hrDeliver)
             out.bBuffer->Append(m_pFrame->data[0], dwPCMSize);
             out.sfFormat = SampleFormat_FP32;
             break;
-        case AV_SAMPLE_FMT_DBL: {
+        case AV_SAMPLE_FMT_DBL:
             out.bBuffer->Allocate(dwPCMSizeAligned / 2);
             out.bBuffer->SetSize(dwPCMSize / 2);
-            float *pDataOut = (float *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pDataOut = (float)((double *)m_pFrame->data[0])[ch + i * m_pAVCtx->ch_layout.nb_channels];
-                    pDataOut++;
-                }
-            }
-        }
+            convert_dbl_to_flt((float *)out.bBuffer->Ptr(), (const double *)m_pFrame->data[0],
+                               out.nSamples * out.layout.nb_channels);
             out.sfFormat = SampleFormat_FP32;
             break;
         // Planar Formats
-        case AV_SAMPLE_FMT_U8P: {
+        case AV_SAMPLE_FMT_U8P:
             out.bBuffer->Allocate(dwPCMSizeAligned);
             out.bBuffer->SetSize(dwPCMSize);
-            uint8_t *pOut = (uint8_t *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pOut++ = ((uint8_t *)m_pFrame->extended_data[ch])[i];
-                }
-            }
-        }
+            interleave_samples(out.bBuffer->Ptr(), m_pFrame->extended_data, out.layout.nb_channels, out.nSamples, 1);
             out.sfFormat = SampleFormat_U8;
             break;
-        case AV_SAMPLE_FMT_S16P: {
+        case AV_SAMPLE_FMT_S16P:
             out.bBuffer->Allocate(dwPCMSizeAligned);
             out.bBuffer->SetSize(dwPCMSize);
-            int16_t *pOut = (int16_t *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pOut++ = ((int16_t *)m_pFrame->extended_data[ch])[i];
-                }
-            }
-        }
+            interleave_samples(out.bBuffer->Ptr(), m_pFrame->extended_data, out.layout.nb_channels, out.nSamples, 2);
             out.sfFormat = SampleFormat_16;
             break;
-        case AV_SAMPLE_FMT_S32P: {
+        case AV_SAMPLE_FMT_S32P:
             out.bBuffer->Allocate(dwPCMSizeAligned);
             out.bBuffer->SetSize(dwPCMSize);
-            int32_t *pOut = (int32_t *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pOut++ = ((int32_t *)m_pFrame->extended_data[ch])[i];
-                }
-            }
-        }
+            interleave_samples(out.bBuffer->Ptr(), m_pFrame->extended_data, out.layout.nb_channels, out.nSamples, 4);
             out.sfFormat = SampleFormat_32;
             out.wBitsPerSample = m_pAVCtx->bits_per_raw_sample;
             break;
-        case AV_SAMPLE_FMT_FLTP: {
+        case AV_SAMPLE_FMT_FLTP:
             out.bBuffer->Allocate(dwPCMSizeAligned);
             out.bBuffer->SetSize(dwPCMSize);
-            float *pOut = (float *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pOut++ = ((float *)m_pFrame->extended_data[ch])[i];
-                }
-            }
-        }
+            interleave_samples(out.bBuffer->Ptr(), m_pFrame->extended_data, out.layout.nb_channels, out.nSamples, 4);
             out.sfFormat = SampleFormat_FP32;
             break;
-        case AV_SAMPLE_FMT_DBLP: {
+        case AV_SAMPLE_FMT_DBLP:
             out.bBuffer->Allocate(dwPCMSizeAligned / 2);
             out.bBuffer->SetSize(dwPCMSize / 2);
-            float *pOut = (float *)(out.bBuffer->Ptr());
-
-            for (size_t i = 0; i < out.nSamples; ++i)
-            {
-                for (int ch = 0; ch < out.layout.nb_channels; ++ch)
-                {
-                    *pOut++ = (float)((double *)m_pFrame->extended_data[ch])[i];
-                }
-            }
-        }
+            interleave_samples_dbl((float *)out.bBuffer->Ptr(), (const double *const *)m_pFrame->extended_data,
+                                   out.layout.nb_channels, out.nSamples);
             out.sfFormat = SampleFormat_FP32;
             break;
         default: assert(FALSE); break;
@@ -2650,8 +2772,14 @@ HRESULT CLAVAudio::QueueOutput(BufferDetails &buffer)
     double dDuration = (double)m_OutputQueue.nSamples / m_OutputQueue.dwSamplesPerSec * 10000000.0;
     double dOffset = fmod(dDuration, 1.0);
 
+    // Batches are delivered as a whole once they are decoded, unless the decoder produced far more than expected
+    if (m_bBatchPass)
+    {
+        if (dDuration >= BATCH_MAX_LATENCY * 10000.0 + PCM_BUFFER_MAX_DURATION)
+            hr = FlushOutput();
+    }
     // Don't exceed the buffer
-    if (dDuration >= PCM_BUFFER_MAX_DURATION || (dDuration >= PCM_BUFFER_MIN_DURATION && dOffset <= FLT_EPSILON))
+    else if (dDuration >= PCM_BUFFER_MAX_DURATION || (dDuration >= PCM_BUFFER_MIN_DURATION && dOffset <= FLT_EPSILON))
     {
         hr = FlushOutput();
     }
@@ -2893,6 +3021,14 @@ HRESULT CLAVAudio::BreakConnect(PIN_DIRECTION dir)
     if (dir == PINDIR_INPUT)
     {
         ffmpeg_shutdown();
+        m_BatchPackets.clear();
+        m_BatchData.SetSize(0);
+    }
+    else
+    {
+        // a partial MAT frame can hold a sample of the output allocator
+        m_MATFramer.Reset();
+        MATReleaseBuffer();
     }
     return __super::BreakConnect(dir);
 }
@@ -23,6 +23,9 @@
 #include "FloatingAverage.h"
 #include "Media.h"
 #include "BitstreamParser.h"
+#include "parser/iec61937.h"
+#include "BufferPool.h"
+#include "MatrixMixer.h"
 #include "PostProcessor.h"
 
 #include "ISpecifyPropertyPages2.h"
@@ -40,6 +43,11 @@
 // 6ms
 #define PCM_BUFFER_MIN_DURATION 60000
 
+// Upper limit of the batch decoding latency (in ms)
+#define BATCH_MAX_LATENCY 500
+// Maximum number of input samples in one batch, in case the timestamps don't advance
+#define BATCH_MAX_SAMPLES 256
+
 // Maximum desync that we attribute to jitter before re-syncing (10ms)
 #define MAX_JITTER_DESYNC 100000i64
 
@@ -70,10 +78,19 @@ struct BufferDetails
     REFERENCE_TIME rtStart = AV_NOPTS_VALUE; // Start Time of the buffer
     BOOL bPlanar = FALSE;                    // Planar (not used)
 
-    BufferDetails() { bBuffer = new GrowableArray<BYTE>(); };
+    CPCMBufferPool *pPool = nullptr; // Pool the PCM Buffer is returned to
+
+    BufferDetails(CPCMBufferPool *pool = nullptr)
+        : pPool(pool)
+    {
+        bBuffer = pPool ? pPool->Acquire() : new GrowableArray<BYTE>();
+    };
     ~BufferDetails()
     {
-        delete bBuffer;
+        if (pPool)
+            pPool->Release(bBuffer);
+        else
+            delete bBuffer;
         av_channel_layout_uninit(&layout);
     }
 };
@@ -83,6 +100,7 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     , public ISpecifyPropertyPages2
     , public ILAVAudioSettings
     , public ILAVAudioStatus
+    , protected CMATFramer::Output
 {
   public:
     CLAVAudio(LPUNKNOWN pUnk, HRESULT *phr);
@@ -140,6 +158,8 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     STDMETHODIMP_(BOOL) GetSuppressFormatChanges();
     STDMETHODIMP SetOutput51LegacyLayout(BOOL b51Legacy);
     STDMETHODIMP_(BOOL) GetOutput51LegacyLayout();
+    STDMETHODIMP SetBatchDecoding(DWORD dwMaxLatency);
+    STDMETHODIMP_(DWORD) GetBatchDecoding();
 
     // ILAVAudioStatus
     STDMETHODIMP_(BOOL) IsSampleFormatSupported(LAVAudioSampleFormat sfCheck);
@@ -149,6 +169,9 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     STDMETHODIMP EnableVolumeStats();
     STDMETHODIMP DisableVolumeStats();
     STDMETHODIMP GetChannelVolumeAverage(WORD nChannel, float *pfDb);
+    STDMETHODIMP GetChannelVolumePeak(WORD nChannel, float *pfDb);
+    STDMETHODIMP GetJitterHistogram(LONGLONG rtBinWidth, DWORD *pBins, DWORD nBins);
+    STDMETHODIMP GetBufferAllocations(LONGLONG *pllAllocations);
 
     // CTransformFilter
     HRESULT CheckInputType(const CMediaType *mtIn);
@@ -200,6 +223,10 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     CMediaType CreateMediaType(LAVAudioSampleFormat outputFormat, DWORD nSamplesPerSec, WORD nChannels,
                                DWORD dwChannelMask, WORD wBitsPerSample = 0) const;
     HRESULT ReconnectOutput(long cbBuffer, CMediaType &mt);
+    BOOL CanBatchSample(IMediaSample *pIn);
+    HRESULT DecodeBatch();
+    HRESULT ProcessInput(const BYTE *pData, long len, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, HRESULT hrTime,
+                         IMediaSample *pMediaSample);
     HRESULT ProcessBuffer(IMediaSample *pMediaSample, BOOL bEOF = FALSE);
     HRESULT Decode(const BYTE *p, int buffsize, int &consumed, HRESULT *hrDeliver, IMediaSample *pMediaSample);
     HRESULT DecodeReceive(HRESULT *hrDeliver);
@@ -233,13 +260,15 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     HRESULT Bitstream(const BYTE *p, int buffsize, int &consumed, HRESULT *hrDeliver);
     HRESULT DeliverBitstream(AVCodecID codec, const BYTE *buffer, DWORD dwSize, REFERENCE_TIME rtStartInput,
                              REFERENCE_TIME rtStopInput, BOOL bSwap = false, int nSamplesOffset = 0);
+    HRESULT DeliverBitstreamSample(IMediaSample *pOut, CMediaType &mt, HRESULT hrReconnect, DWORD dwSize,
+                                   REFERENCE_TIME rtStartInput, int nSamplesOffset);
 
     HRESULT BitstreamTrueHD(const BYTE *p, int buffsize, HRESULT *hrDeliver);
-    void MATWriteHeader();
-    void MATWritePadding();
-    void MATAppendData(const BYTE * const p, int size);
-    int MATFillDataBuffer(const BYTE * const p, int size, bool padding = false);
-    void MATFlushPacket(HRESULT *hrDeliver);
+    void MATReleaseBuffer();
+
+    // CMATFramer::Output
+    uint8_t *AllocFrame();
+    void DeliverFrame(uint8_t *pFrame, int nSamplesOffset);
 
     CMediaType CreateBitstreamMediaType(AVCodecID codec, DWORD dwSampleRate, BOOL bDTSHDOverride = FALSE);
     void ActivateDTSHDMuxing();
@@ -284,6 +313,8 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     AVChannelLayout m_chOverrideMixer{};
 
     SwrContext *m_swrContext = nullptr;
+    CMatrixMixer m_MatrixMixer;
+    BOOL m_bNativeMixing = FALSE;
     LAVAudioSampleFormat m_sfRemixFormat = SampleFormat_None;
     AVChannelLayout m_chRemixLayout{};
     BOOL m_bAVResampleFailed = FALSE;
@@ -319,21 +350,41 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
         DWORD MixingLFELevel;
 
         BOOL SuppressFormatChanges;
+        DWORD BatchLatency;
     } m_settings;
     BOOL m_bRuntimeConfig = FALSE;
 
     BOOL m_bVolumeStats = FALSE;          // Volume Stats gathering enabled
     FloatingAverage<float> m_faVolume[MAX_VOLUME_STAT_CHANNEL]; // Floating Average for volume (8 channels)
+    float m_fVolumePeak[MAX_VOLUME_STAT_CHANNEL] = {0};          // Peak magnitude since the last query
+    CCritSec m_csVolumePeak; // the peaks are written while decoding and read and reset by the status queries
 
     BOOL m_bQueueResync = FALSE;
     BOOL m_bResyncTimestamp = FALSE;
     BOOL m_bNeedSyncpoint = FALSE;
     BOOL m_bJustFlushed = TRUE;
-    BufferDetails m_OutputQueue;
+
+    CPCMBufferPool m_PCMPool;
+    BufferDetails m_OutputQueue{&m_PCMPool};
+
+    // Batch decoding
+    struct BatchPacket
+    {
+        DWORD dwOffset; // offset of the data in m_BatchData
+        long len;
+        REFERENCE_TIME rtStart;
+        REFERENCE_TIME rtStop;
+        HRESULT hrTime; // result of IMediaSample::GetTime
+    };
+    std::vector<BatchPacket> m_BatchPackets;
+    GrowableArray<BYTE> m_BatchData;
+    BOOL m_bBatchPass = FALSE; // decoding a batch, the output is delivered once the batch is done
 
     AVIOContext *m_avioBitstream = nullptr;
     AVFormatContext *m_avBSContext = nullptr;
     GrowableArray<BYTE> m_bsOutput;
+    const BYTE *m_pBSBurst = nullptr; // complete burst still in the AVIO buffer, delivered without staging
+    int m_nBSBurstSize = 0;
     BOOL m_bBitStreamingSettingsChanged = FALSE;
     BOOL m_bBitstreamOverride[Bitstream_NB] = {FALSE};
 
@@ -357,29 +408,26 @@ class __declspec(uuid("E8E73B6B-4CB3-44A4-BE99-4F7BCB96E491")) CLAVAudio
     ExtendedChannelMap m_ChannelMap;
     AVChannelLayout m_ChannelMapOutputLayout{};
 
+    CChannelRemapper m_ConformityRemapper{&m_PCMPool};
+    CChannelRemapper m_MonoRemapper{&m_PCMPool};
+    CChannelRemapper m_Expand61Remapper{&m_PCMPool};
+
     AVPacket *m_pDecodePacket = nullptr;
     AVPacket *m_pBitstreamPacket = nullptr;
 
     // TrueHD Bitstreaming
+    CMATFramer m_MATFramer{this};
+
+    // MAT frame under construction, stored byte-swapped in the output sample (or in m_bsOutput, if none was available)
     struct
     {
-        bool init = false;
-        int ratebits = 0;
-        uint16_t output_timing = 0;
-        BOOL output_timing_valid = FALSE;
-
-        uint16_t prev_frametime = 0;
-        BOOL prev_frametime_valid = FALSE;
-
-        uint32_t mat_framesize = 0;
-        uint32_t prev_mat_framesize = 0;
-
-        DWORD padding = 0;
-        DWORD nSamples = 0;
-        int nSamplesOffset = 0;
+        IMediaSample *pSample = nullptr;
+        BYTE *pData = nullptr;
 
-        int nOutputTimeOffset = 0;
-    } m_TrueHDMATState;
+        CMediaType mt;
+        HRESULT hrReconnect = S_FALSE;
+        HRESULT *phrDeliver = nullptr; // result of the last delivery, while adding a frame
+    } m_MATBuffer;
 
     struct
     {
@@ -0,0 +1,308 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "MatrixMixer.h"
+
+extern "C"
+{
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libswresample/swresample.h"
+}
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include <emmintrin.h>
+
+// Sample scaling, identical to the conversions in swresample
+#define S16_SCALE 32768.0f
+#define S32_SCALE 2147483648.0f
+
+// swr_build_matrix2 normalizes SWR_CH_MAX (64) rows and columns of the matrix, no matter how many channels are used,
+// so it needs a full size matrix with that stride
+#define SWR_MATRIX_SIZE 64
+
+bool CMatrixMixer::IsSupported(const AVChannelLayout *inLayout, AVSampleFormat sfIn,
+                               const AVChannelLayout *outLayout, AVSampleFormat sfOut)
+{
+    if (inLayout->order != AV_CHANNEL_ORDER_NATIVE || outLayout->order != AV_CHANNEL_ORDER_NATIVE)
+        return false;
+    if (inLayout->nb_channels < 1 || inLayout->nb_channels > MATRIX_MIXER_MAX_CHANNELS ||
+        outLayout->nb_channels < 1 || outLayout->nb_channels > MATRIX_MIXER_MAX_CHANNELS)
+        return false;
+
+    const auto is_supported_format = [](AVSampleFormat sf) {
+        return sf == AV_SAMPLE_FMT_S16 || sf == AV_SAMPLE_FMT_S32 || sf == AV_SAMPLE_FMT_FLT;
+    };
+    return is_supported_format(sfIn) && is_supported_format(sfOut);
+}
+
+// swresample mixes 5.1 and 7.1 down to stereo with dedicated functions (mix6to2/mix8to2), when the center and LFE go
+// to both sides with the same level and the sides don't cross over. Those add center and LFE first, then the left or
+// right channels, so the mixer has to add them in that order for the same rounding.
+static bool swr_mixes_center_first(const AVChannelLayout *inLayout, const AVChannelLayout *outLayout,
+                                   const double *matrix)
+{
+    if (outLayout->u.mask != AV_CH_LAYOUT_STEREO)
+        return false;
+
+    const double *left = matrix;
+    const double *right = matrix + SWR_MATRIX_SIZE;
+    const bool bCommon = left[2] == right[2] && left[3] == right[3] && !left[1] && !left[5] && !right[0] && !right[4];
+
+    if (inLayout->u.mask == AV_CH_LAYOUT_5POINT1 || inLayout->u.mask == AV_CH_LAYOUT_5POINT1_BACK)
+        return bCommon;
+    if (inLayout->u.mask == AV_CH_LAYOUT_7POINT1)
+        return bCommon && !left[7] && !right[6];
+    return false;
+}
+
+int CMatrixMixer::Init(const AVChannelLayout *inLayout, AVSampleFormat sfIn, const AVChannelLayout *outLayout,
+                       AVSampleFormat sfOut, double dCenterMixLevel, double dSurroundMixLevel, double dLFEMixLevel,
+                       double dMaxVal, bool bClipProtection, AVMatrixEncoding matrixEncoding)
+{
+    m_bInitialized = false;
+    if (!IsSupported(inLayout, sfIn, outLayout, sfOut))
+        return AVERROR(EINVAL);
+
+    // Same choice as swresample: integer output needs a normalized matrix
+    if (dMaxVal <= 0.0)
+        dMaxVal = (sfOut == AV_SAMPLE_FMT_FLT) ? INT_MAX : 1.0;
+
+    // swresample keeps the levels and the limit in float options, round them the same way so the matrix matches
+    dCenterMixLevel = (float)dCenterMixLevel;
+    dSurroundMixLevel = (float)dSurroundMixLevel;
+    dLFEMixLevel = (float)dLFEMixLevel;
+    dMaxVal = (float)dMaxVal;
+
+    double *matrix = (double *)av_mallocz(SWR_MATRIX_SIZE * SWR_MATRIX_SIZE * sizeof(double));
+    if (!matrix)
+        return AVERROR(ENOMEM);
+
+    int ret = swr_build_matrix2(inLayout, outLayout, dCenterMixLevel, dSurroundMixLevel, dLFEMixLevel, dMaxVal, 1.0,
+                                matrix, SWR_MATRIX_SIZE, matrixEncoding, nullptr);
+    if (ret < 0)
+    {
+        av_log(nullptr, AV_LOG_ERROR, "CMatrixMixer::Init(): swr_build_matrix2 failed\n");
+        av_free(matrix);
+        return ret;
+    }
+
+    m_sfIn = sfIn;
+    m_sfOut = sfOut;
+    m_nInChannels = inLayout->nb_channels;
+    m_nOutChannels = outLayout->nb_channels;
+    m_bClipProtection = bClipProtection;
+
+    // The columns are stored in the order the input channels are added up
+    const bool bCenterFirst = swr_mixes_center_first(inLayout, outLayout, matrix);
+    memset(m_Columns, 0, sizeof(m_Columns));
+    for (int i = 0; i < m_nInChannels; i++)
+    {
+        const int in = (bCenterFirst && i < 4) ? i ^ 2 : i;
+        m_InOrder[i] = in;
+        for (int out = 0; out < m_nOutChannels; out++)
+            m_Columns[i][out] = (float)matrix[out * SWR_MATRIX_SIZE + in];
+    }
+    av_free(matrix);
+
+    m_bInitialized = true;
+    return 0;
+}
+
+//
+// Sample conversion into and out of the float blocks
+//
+
+static void convert_to_float(float *pDst, const uint8_t *pSrc, AVSampleFormat sfFormat, size_t nCount)
+{
+    size_t i = 0;
+    switch (sfFormat)
+    {
+    case AV_SAMPLE_FMT_S16: {
+        const int16_t *pIn = (const int16_t *)pSrc;
+        const __m128 scale = _mm_set1_ps(1.0f / S16_SCALE);
+        for (; i + 8 <= nCount; i += 8)
+        {
+            const __m128i x = _mm_loadu_si128((const __m128i *)(pIn + i));
+            const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+            _mm_storeu_ps(pDst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(pDst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+        for (; i < nCount; i++)
+            pDst[i] = pIn[i] * (1.0f / S16_SCALE);
+    }
+    break;
+    case AV_SAMPLE_FMT_S32: {
+        const int32_t *pIn = (const int32_t *)pSrc;
+        const __m128 scale = _mm_set1_ps(1.0f / S32_SCALE);
+        for (; i + 4 <= nCount; i += 4)
+        {
+            const __m128i x = _mm_loadu_si128((const __m128i *)(pIn + i));
+            _mm_storeu_ps(pDst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+        }
+        for (; i < nCount; i++)
+            pDst[i] = pIn[i] * (1.0f / S32_SCALE);
+    }
+    break;
+    case AV_SAMPLE_FMT_FLT: memcpy(pDst, pSrc, nCount * sizeof(float)); break;
+    default: assert(0); break;
+    }
+}
+
+static void convert_from_float(uint8_t *pDst, const float *pSrc, AVSampleFormat sfFormat, size_t nCount)
+{
+    size_t i = 0;
+    switch (sfFormat)
+    {
+    case AV_SAMPLE_FMT_S16: {
+        // Round to nearest, and saturate with the pack
+        int16_t *pOut = (int16_t *)pDst;
+        const __m128 scale = _mm_set1_ps(S16_SCALE);
+        for (; i + 8 <= nCount; i += 8)
+        {
+            const __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(pSrc + i), scale));
+            const __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(pSrc + i + 4), scale));
+            _mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(lo, hi));
+        }
+        for (; i < nCount; i++)
+            pOut[i] = av_clip_int16(lrintf(pSrc[i] * S16_SCALE));
+    }
+    break;
+    case AV_SAMPLE_FMT_S32: {
+        // Out of range values convert to INT32_MIN, flip the positive ones to INT32_MAX
+        int32_t *pOut = (int32_t *)pDst;
+        const __m128 scale = _mm_set1_ps(S32_SCALE);
+        for (; i + 4 <= nCount; i += 4)
+        {
+            const __m128 x = _mm_mul_ps(_mm_loadu_ps(pSrc + i), scale);
+            const __m128i overflow = _mm_castps_si128(_mm_cmpge_ps(x, scale));
+            _mm_storeu_si128((__m128i *)(pOut + i), _mm_xor_si128(_mm_cvtps_epi32(x), overflow));
+        }
+        for (; i < nCount; i++)
+            pOut[i] = av_clipl_int32(llrintf(pSrc[i] * S32_SCALE));
+    }
+    break;
+    case AV_SAMPLE_FMT_FLT: memcpy(pDst, pSrc, nCount * sizeof(float)); break;
+    default: assert(0); break;
+    }
+}
+
+//
+// Matrix multiplication of one block, nOutVectors holds the output channels of one sample
+//
+template <int nOutVectors>
+static void mix_block(float *pOut, const float *pIn, const float (*pColumns)[MATRIX_MIXER_MAX_CHANNELS],
+                      const int *pInOrder, int nInChannels, int nOutChannels, size_t nSamples)
+{
+    __m128 col[MATRIX_MIXER_MAX_CHANNELS][nOutVectors];
+    for (int in = 0; in < nInChannels; in++)
+        for (int v = 0; v < nOutVectors; v++)
+            col[in][v] = _mm_loadu_ps(&pColumns[in][v * 4]);
+
+    // The stores write up to a full vector per sample, the next sample overwrites the excess
+    for (size_t i = 0; i < nSamples; i++, pIn += nInChannels, pOut += nOutChannels)
+    {
+        __m128 acc[nOutVectors];
+        for (int v = 0; v < nOutVectors; v++)
+            acc[v] = _mm_setzero_ps();
+
+        for (int in = 0; in < nInChannels; in++)
+        {
+            const __m128 x = _mm_set1_ps(pIn[pInOrder[in]]);
+            for (int v = 0; v < nOutVectors; v++)
+                acc[v] = _mm_add_ps(acc[v], _mm_mul_ps(x, col[in][v]));
+        }
+
+        for (int v = 0; v < nOutVectors; v++)
+            _mm_storeu_ps(pOut + v * 4, acc[v]);
+    }
+}
+
+void CMatrixMixer::ApplyClipProtection(float *pBlock, size_t nCount)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= nCount; i += 4)
+        peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(pBlock + i), abs_mask));
+
+    float fPeaks[4];
+    _mm_storeu_ps(fPeaks, peak);
+    float fPeak = FFMAX(FFMAX(fPeaks[0], fPeaks[1]), FFMAX(fPeaks[2], fPeaks[3]));
+    for (; i < nCount; i++)
+        fPeak = FFMAX(fPeak, fabsf(pBlock[i]));
+
+    if (fPeak <= 1.0f)
+        return;
+
+    // Lower the volume of the matrix permanently, so the mix no longer clips
+    const float fGain = 1.0f / fPeak;
+    av_log(nullptr, AV_LOG_DEBUG, "CMatrixMixer: Clipping detected, reducing volume by %f\n", fGain);
+    for (int in = 0; in < m_nInChannels; in++)
+        for (int out = 0; out < m_nOutChannels; out++)
+            m_Columns[in][out] *= fGain;
+
+    const __m128 gain = _mm_set1_ps(fGain);
+    const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    for (i = 0; i + 4 <= nCount; i += 4)
+    {
+        const __m128 x = _mm_mul_ps(_mm_loadu_ps(pBlock + i), gain);
+        _mm_storeu_ps(pBlock + i, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+    for (; i < nCount; i++)
+        pBlock[i] = av_clipf(pBlock[i] * fGain, -1.0f, 1.0f);
+}
+
+void CMatrixMixer::Mix(uint8_t *pOut, const uint8_t *pIn, size_t nSamples)
+{
+    assert(m_bInitialized);
+
+    const size_t inSampleSize = av_get_bytes_per_sample(m_sfIn) * m_nInChannels;
+    const size_t outSampleSize = av_get_bytes_per_sample(m_sfOut) * m_nOutChannels;
+
+    for (size_t done = 0; done < nSamples; done += MATRIX_MIXER_BLOCK)
+    {
+        const size_t nBlock = FFMIN(nSamples - done, (size_t)MATRIX_MIXER_BLOCK);
+        const size_t nOutCount = nBlock * m_nOutChannels;
+
+        // Float input can be mixed directly from the source
+        const float *pBlockIn = m_InBlock;
+        if (m_sfIn == AV_SAMPLE_FMT_FLT)
+            pBlockIn = (const float *)(pIn + done * inSampleSize);
+        else
+            convert_to_float(m_InBlock, pIn + done * inSampleSize, m_sfIn, nBlock * m_nInChannels);
+
+        if (m_nOutChannels > 4)
+            mix_block<2>(m_OutBlock, pBlockIn, m_Columns, m_InOrder, m_nInChannels, m_nOutChannels, nBlock);
+        else
+            mix_block<1>(m_OutBlock, pBlockIn, m_Columns, m_InOrder, m_nInChannels, m_nOutChannels, nBlock);
+
+        if (m_bClipProtection)
+            ApplyClipProtection(m_OutBlock, nOutCount);
+
+        convert_from_float(pOut + done * outSampleSize, m_OutBlock, m_sfOut, nOutCount);
+    }
+}
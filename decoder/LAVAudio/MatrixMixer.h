@@ -0,0 +1,81 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C"
+{
+#include "libavutil/channel_layout.h"
+#include "libavutil/samplefmt.h"
+}
+
+#define MATRIX_MIXER_MAX_CHANNELS 8
+#define MATRIX_MIXER_BLOCK 256 // Number of samples processed per block
+
+// Native matrix mixer for interleaved PCM
+//
+// Mixes between two native channel layouts with the same matrix swresample would build from the mixing settings, but
+// works directly on interleaved 16-bit, 32-bit and float samples, without any planar intermediate steps.
+// Anything else (resampling, dithering, other sample formats or layouts) is left to swresample.
+//
+// The mixer uses no DirectShow types and no precompiled header, so tests/ can build it against swresample.
+class CMatrixMixer
+{
+  public:
+    CMatrixMixer() {}
+    ~CMatrixMixer() {}
+
+    // Check if the native mixer can handle the conversion (interleaved S16, S32 or FLT)
+    static bool IsSupported(const AVChannelLayout *inLayout, AVSampleFormat sfIn, const AVChannelLayout *outLayout,
+                            AVSampleFormat sfOut);
+
+    // Build the mixing matrix, returns 0 on success or a negative AVERROR code
+    // dMaxVal is the normalization limit for the matrix coefficients, 0 to choose like swresample
+    int Init(const AVChannelLayout *inLayout, AVSampleFormat sfIn, const AVChannelLayout *outLayout,
+             AVSampleFormat sfOut, double dCenterMixLevel, double dSurroundMixLevel, double dLFEMixLevel,
+             double dMaxVal, bool bClipProtection, AVMatrixEncoding matrixEncoding);
+    void Reset() { m_bInitialized = false; }
+    bool IsInitialized() const { return m_bInitialized; }
+
+    // Mix nSamples samples from pIn into pOut
+    void Mix(uint8_t *pOut, const uint8_t *pIn, size_t nSamples);
+
+  private:
+    void ApplyClipProtection(float *pBlock, size_t nCount);
+
+  private:
+    bool m_bInitialized = false;
+    AVSampleFormat m_sfIn = AV_SAMPLE_FMT_NONE;
+    AVSampleFormat m_sfOut = AV_SAMPLE_FMT_NONE;
+    int m_nInChannels = 0;
+    int m_nOutChannels = 0;
+    bool m_bClipProtection = false;
+
+    // Matrix columns, one per input channel, holding the coefficients of all output channels
+    // They are in mixing order, m_InOrder holds the input channel of each column
+    float m_Columns[MATRIX_MIXER_MAX_CHANNELS][MATRIX_MIXER_MAX_CHANNELS];
+    int m_InOrder[MATRIX_MIXER_MAX_CHANNELS];
+
+    // Conversion buffers for one block, with room for a vector store past the last sample
+    float m_InBlock[MATRIX_MIXER_BLOCK * MATRIX_MIXER_MAX_CHANNELS + MATRIX_MIXER_MAX_CHANNELS];
+    float m_OutBlock[MATRIX_MIXER_BLOCK * MATRIX_MIXER_MAX_CHANNELS + MATRIX_MIXER_MAX_CHANNELS];
+};
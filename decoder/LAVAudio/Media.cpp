@@ -26,9 +26,12 @@
 
 #include "moreuuids.h"
 
+#include <tmmintrin.h>
+
 extern "C"
 {
 #include "libavutil/intreadwrite.h"
+#include "libavutil/cpu.h"
 };
 
 typedef struct
@@ -575,25 +578,140 @@ template <class T> T get_sample_from_buffer(const BYTE *const pBuffer, LAVAudioS
     return fSample;
 }
 
-// This function calculates the Root mean square (RMS) of all samples in the buffer,
-// converts the result into a reference dB value, and adds it to the volume floating average
-void CLAVAudio::UpdateVolumeStats(const BufferDetails &buffer)
+static const bool g_bMeterSSSE3 = !!(av_get_cpu_flags() & AV_CPU_FLAG_SSSE3);
+
+// Loads 4 consecutive samples, normalized the same way as get_sample_from_buffer
+// Only the bytes of the 4 samples are read
+template <LAVAudioSampleFormat sfFormat> static inline __m128 load_samples_ps(const BYTE *pBuffer)
 {
-    const BYTE bSampleSize = get_byte_per_sample(buffer.sfFormat);
-    const DWORD dwSamplesPerChannel = buffer.nSamples;
-    const BYTE *pBuffer = buffer.bBuffer->Ptr();
-    float *const fChAvg = (float *)calloc(buffer.layout.nb_channels, sizeof(float));
-    for (DWORD i = 0; i < dwSamplesPerChannel; ++i)
+    switch (sfFormat)
+    {
+    case SampleFormat_U8: {
+        __m128i x = _mm_cvtsi32_si128(AV_RN32(pBuffer));
+        x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(x, _mm_setzero_si128()), _mm_setzero_si128());
+        x = _mm_add_epi32(x, _mm_set1_epi32(INT8_MIN));
+        return _mm_div_ps(_mm_cvtepi32_ps(x), _mm_set1_ps((float)INT8_MAX));
+    }
+    case SampleFormat_16: {
+        __m128i x = _mm_loadl_epi64((const __m128i *)pBuffer);
+        x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        return _mm_div_ps(_mm_cvtepi32_ps(x), _mm_set1_ps((float)INT16_MAX));
+    }
+    case SampleFormat_24: {
+        __m128i x = _mm_loadl_epi64((const __m128i *)pBuffer);
+        x = _mm_unpacklo_epi64(x, _mm_cvtsi32_si128(AV_RN32(pBuffer + 8)));
+        x = _mm_shuffle_epi8(x, _mm_setr_epi8(-128, 0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11));
+        return _mm_div_ps(_mm_cvtepi32_ps(x), _mm_set1_ps((float)INT32_MAX));
+    }
+    case SampleFormat_32:
+        return _mm_div_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)pBuffer)), _mm_set1_ps((float)INT32_MAX));
+    case SampleFormat_FP32: return _mm_loadu_ps((const float *)pBuffer);
+    }
+    return _mm_setzero_ps();
+}
+
+template <LAVAudioSampleFormat sfFormat>
+static void measure_channel_levels_tmpl(const BYTE *pBuffer, int nChannels, int nMeasure, size_t nSamples,
+                                        float *pSumSquares, float *pPeak)
+{
+    const int nSampleSize = get_byte_per_sample(sfFormat);
+    for (int ch = 0; ch < nMeasure; ch++)
+        pSumSquares[ch] = pPeak[ch] = 0.0f;
+
+    size_t i = 0;
+    if (nChannels <= 8 && (sfFormat != SampleFormat_24 || g_bMeterSSSE3))
+    {
+        // The channel pattern of the vector lanes repeats every lcm(nChannels, 4) samples
+        const int nLanes = (nChannels % 4 == 0) ? nChannels : (nChannels % 2 == 0) ? nChannels * 2 : nChannels * 4;
+        const int nVectors = nLanes / 4;
+        const size_t nFrames = nLanes / nChannels;
+
+        __m128 sum[7], peak[7];
+        for (int v = 0; v < nVectors; v++)
+            sum[v] = peak[v] = _mm_setzero_ps();
+
+        const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for (; i + nFrames <= nSamples; i += nFrames)
+        {
+            const BYTE *p = pBuffer + i * nChannels * nSampleSize;
+            for (int v = 0; v < nVectors; v++)
+            {
+                const __m128 x = load_samples_ps<sfFormat>(p + v * 4 * nSampleSize);
+                sum[v] = _mm_add_ps(sum[v], _mm_mul_ps(x, x));
+                peak[v] = _mm_max_ps(peak[v], _mm_and_ps(x, abs_mask));
+            }
+        }
+
+        float fLaneSum[28], fLanePeak[28];
+        for (int v = 0; v < nVectors; v++)
+        {
+            _mm_storeu_ps(fLaneSum + v * 4, sum[v]);
+            _mm_storeu_ps(fLanePeak + v * 4, peak[v]);
+        }
+        for (int lane = 0; lane < nLanes; lane++)
+        {
+            const int ch = lane % nChannels;
+            if (ch < nMeasure)
+            {
+                pSumSquares[ch] += fLaneSum[lane];
+                pPeak[ch] = max(pPeak[ch], fLanePeak[lane]);
+            }
+        }
+    }
+
+    for (; i < nSamples; i++)
     {
-        for (WORD ch = 0; ch < buffer.layout.nb_channels; ++ch)
+        const BYTE *p = pBuffer + i * nChannels * nSampleSize;
+        for (int ch = 0; ch < nMeasure; ch++)
         {
-            const float fSample = get_sample_from_buffer<float>(pBuffer, buffer.sfFormat);
-            fChAvg[ch] += fSample * fSample;
-            pBuffer += bSampleSize;
+            const float fSample = get_sample_from_buffer<float>(p + ch * nSampleSize, sfFormat);
+            pSumSquares[ch] += fSample * fSample;
+            pPeak[ch] = max(pPeak[ch], fabsf(fSample));
         }
     }
+}
 
-    for (int ch = 0; ch < min(buffer.layout.nb_channels, MAX_VOLUME_STAT_CHANNEL); ++ch)
+// Samples are normalized to [-1, 1] like get_sample_from_buffer does, all channels are measured in one pass
+void measure_channel_levels(const BYTE *pBuffer, LAVAudioSampleFormat sfFormat, int nChannels, int nMeasure,
+                            size_t nSamples, float *pSumSquares, float *pPeak)
+{
+    switch (sfFormat)
+    {
+    case SampleFormat_U8:
+        measure_channel_levels_tmpl<SampleFormat_U8>(pBuffer, nChannels, nMeasure, nSamples, pSumSquares, pPeak);
+        break;
+    case SampleFormat_16:
+        measure_channel_levels_tmpl<SampleFormat_16>(pBuffer, nChannels, nMeasure, nSamples, pSumSquares, pPeak);
+        break;
+    case SampleFormat_24:
+        measure_channel_levels_tmpl<SampleFormat_24>(pBuffer, nChannels, nMeasure, nSamples, pSumSquares, pPeak);
+        break;
+    case SampleFormat_32:
+        measure_channel_levels_tmpl<SampleFormat_32>(pBuffer, nChannels, nMeasure, nSamples, pSumSquares, pPeak);
+        break;
+    case SampleFormat_FP32:
+        measure_channel_levels_tmpl<SampleFormat_FP32>(pBuffer, nChannels, nMeasure, nSamples, pSumSquares, pPeak);
+        break;
+    default:
+        for (int ch = 0; ch < nMeasure; ch++)
+            pSumSquares[ch] = pPeak[ch] = 0.0f;
+        break;
+    }
+}
+
+// This function calculates the Root mean square (RMS) of all samples in the buffer,
+// converts the result into a reference dB value, and adds it to the volume floating average
+void CLAVAudio::UpdateVolumeStats(const BufferDetails &buffer)
+{
+    const DWORD dwSamplesPerChannel = buffer.nSamples;
+    const int nChannels = min(buffer.layout.nb_channels, MAX_VOLUME_STAT_CHANNEL);
+
+    // Only the channels that are reported are measured
+    float fChAvg[MAX_VOLUME_STAT_CHANNEL], fChPeak[MAX_VOLUME_STAT_CHANNEL];
+    measure_channel_levels(buffer.bBuffer->Ptr(), buffer.sfFormat, buffer.layout.nb_channels, nChannels,
+                           dwSamplesPerChannel, fChAvg, fChPeak);
+
+    for (int ch = 0; ch < nChannels; ++ch)
     {
         if (fChAvg[ch] > FLT_EPSILON)
         {
@@ -606,7 +724,10 @@ void CLAVAudio::UpdateVolumeStats(const BufferDetails &buffer)
             m_faVolume[ch].Sample(-100.0f);
         }
     }
-    free(fChAvg);
+
+    CAutoLock lock(&m_csVolumePeak);
+    for (int ch = 0; ch < nChannels; ++ch)
+        m_fVolumePeak[ch] = max(m_fVolumePeak[ch], fChPeak[ch]);
 }
 
 #define MAX_SPEAKER_LAYOUT 18
@@ -754,22 +875,75 @@ LAVAudioSampleFormat CLAVAudio::GetBestAvailableSampleFormat(LAVAudioSampleForma
     return outFormat;
 }
 
-// Copy of ff_spdif_bswap_buf16, which sadly is a private symbol
-void lav_spdif_bswap_buf16(uint16_t *dst, const uint16_t *src, int w)
+static const bool g_bRepackSSSE3 = !!(av_get_cpu_flags() & AV_CPU_FLAG_SSSE3);
+
+void unpack_s24_to_s32(BYTE *dst, const BYTE *src, size_t count)
 {
-    int i;
+    // Work backwards, so the wider output never overwrites input that was not read yet
+    const size_t nVector = g_bRepackSSSE3 ? (count & ~(size_t)15) : 0;
+    size_t i = count;
+    while (i > nVector)
+    {
+        i--;
+        AV_WL32(dst + i * 4, AV_RL24(src + i * 3) << 8);
+    }
 
-    for (i = 0; i + 8 <= w; i += 8)
+    // 16 samples per iteration, 48 bytes in, 64 bytes out
+    const __m128i mask = _mm_setr_epi8(-128, 0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11);
+    while (i > 0)
     {
-        dst[i + 0] = av_bswap16(src[i + 0]);
-        dst[i + 1] = av_bswap16(src[i + 1]);
-        dst[i + 2] = av_bswap16(src[i + 2]);
-        dst[i + 3] = av_bswap16(src[i + 3]);
-        dst[i + 4] = av_bswap16(src[i + 4]);
-        dst[i + 5] = av_bswap16(src[i + 5]);
-        dst[i + 6] = av_bswap16(src[i + 6]);
-        dst[i + 7] = av_bswap16(src[i + 7]);
-    }
-    for (; i < w; i++)
-        dst[i + 0] = av_bswap16(src[i + 0]);
+        i -= 16;
+        const __m128i in0 = _mm_loadu_si128((const __m128i *)(src + i * 3));
+        const __m128i in1 = _mm_loadu_si128((const __m128i *)(src + i * 3 + 16));
+        const __m128i in2 = _mm_loadu_si128((const __m128i *)(src + i * 3 + 32));
+
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_shuffle_epi8(in0, mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 16), _mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 32), _mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 48), _mm_shuffle_epi8(_mm_srli_si128(in2, 4), mask));
+    }
+}
+
+void pack_s32_to_s24(BYTE *dst, const BYTE *src, size_t count)
+{
+    size_t i = 0;
+    if (g_bRepackSSSE3)
+    {
+        // 16 samples per iteration, 64 bytes in, 48 bytes out
+        const __m128i mask = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -128, -128, -128, -128);
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * 4)), mask);
+            const __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * 4 + 16)), mask);
+            const __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * 4 + 32)), mask);
+            const __m128i s3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * 4 + 48)), mask);
+
+            _mm_storeu_si128((__m128i *)(dst + i * 3), _mm_or_si128(s0, _mm_slli_si128(s1, 12)));
+            _mm_storeu_si128((__m128i *)(dst + i * 3 + 16), _mm_or_si128(_mm_srli_si128(s1, 4), _mm_slli_si128(s2, 8)));
+            _mm_storeu_si128((__m128i *)(dst + i * 3 + 32), _mm_or_si128(_mm_srli_si128(s2, 8), _mm_slli_si128(s3, 4)));
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        dst[i * 3 + 0] = src[i * 4 + 1];
+        dst[i * 3 + 1] = src[i * 4 + 2];
+        dst[i * 3 + 2] = src[i * 4 + 3];
+    }
+}
+
+void pack_s32_to_s16(BYTE *dst, const BYTE *src, size_t count)
+{
+    size_t i = 0;
+
+    // The arithmetic shift leaves values in the 16-bit range, so the saturating pack does not alter them
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i in0 = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i * 4)), 16);
+        const __m128i in1 = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i * 4 + 16)), 16);
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_packs_epi32(in0, in1));
+    }
+
+    for (; i < count; i++)
+        AV_WL16(dst + i * 2, AV_RL32(src + i * 4) >> 16);
 }
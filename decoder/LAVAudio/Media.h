@@ -71,4 +71,12 @@ const char *get_channel_desc(DWORD dwFlag);
 // DO NOT USE WITH AN INTEGER TYPE - only double and float are allowed
 template <class T> T get_sample_from_buffer(const BYTE *pBuffer, LAVAudioSampleFormat sfFormat);
 
-void lav_spdif_bswap_buf16(uint16_t *dst, const uint16_t *src, int w);
+// Measures the sum of squares and the peak magnitude of the first nMeasure channels of an interleaved buffer
+void measure_channel_levels(const BYTE *pBuffer, LAVAudioSampleFormat sfFormat, int nChannels, int nMeasure,
+                            size_t nSamples, float *pSumSquares, float *pPeak);
+
+// Repack count integer samples between the 16, 24 and 32-bit sample formats
+// dst may be equal to src to convert in place, in which case the buffer has to fit the larger of the two formats
+void unpack_s24_to_s32(BYTE *dst, const BYTE *src, size_t count); // zero-pads the low byte
+void pack_s32_to_s24(BYTE *dst, const BYTE *src, size_t count);   // keeps the upper three bytes
+void pack_s32_to_s16(BYTE *dst, const BYTE *src, size_t count);   // keeps the upper two bytes
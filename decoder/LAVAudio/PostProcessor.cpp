@@ -22,142 +22,21 @@
 #include "LAVAudio.h"
 #include "Media.h"
 
-extern "C"
+static RemapSampleFormat get_remap_sample_fmt(LAVAudioSampleFormat sfFormat)
 {
-#include "libavutil/intreadwrite.h"
-};
-
-// PCM Volume Adjustment Factors, both for integer and float math
-// entries start at 2 channel mixing, half volume
-static int pcm_volume_adjust_integer[7] = {362, 443, 512, 572, 627, 677, 724};
-
-static float pcm_volume_adjust_float[7] = {1.41421356f, 1.73205081f, 2.00000000f, 2.23606798f,
-                                           2.44948974f, 2.64575131f, 2.82842712f};
-
-// SCALE_CA helper macro for SampleCopyAdjust
-#define SCALE_CA(sample, iFactor, factor) \
-    {                                     \
-        if (iFactor > 0)                  \
-        {                                 \
-            sample *= factor;             \
-            sample >>= 8;                 \
-        }                                 \
-        else                              \
-        {                                 \
-            sample <<= 8;                 \
-            sample /= factor;             \
-        }                                 \
-    }
-
-//
-// Helper Function that reads one sample from pIn, applys the scale specified by iFactor, and writes it to pOut
-//
-static inline void SampleCopyAdjust(BYTE *pOut, const BYTE *pIn, int iFactor, LAVAudioSampleFormat sfSampleFormat)
-{
-    ASSERT(abs(iFactor) > 1 && abs(iFactor) <= 8);
-    const int factorIndex = abs(iFactor) - 2;
-
-    switch (sfSampleFormat)
-    {
-    case SampleFormat_U8: {
-        uint8_t *pOutSample = pOut;
-        int32_t sample = *pIn + INT8_MIN;
-        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
-        *pOutSample = av_clip_uint8(sample - INT8_MIN);
-    }
-    break;
-    case SampleFormat_16: {
-        int16_t *pOutSample = (int16_t *)pOut;
-        int32_t sample = *((int16_t *)pIn);
-        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
-        *pOutSample = av_clip_int16(sample);
-    }
-    break;
-    case SampleFormat_24: {
-        int32_t sample = (pIn[0] << 8) + (pIn[1] << 16) + (pIn[2] << 24);
-        sample >>= 8;
-        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
-        sample = av_clip(sample, INT24_MIN, INT24_MAX);
-        pOut[0] = sample & 0xff;
-        pOut[1] = (sample >> 8) & 0xff;
-        pOut[2] = (sample >> 16) & 0xff;
-    }
-    break;
-    case SampleFormat_32: {
-        int32_t *pOutSample = (int32_t *)pOut;
-        int64_t sample = *((int32_t *)pIn);
-        SCALE_CA(sample, iFactor, pcm_volume_adjust_integer[factorIndex]);
-        *pOutSample = av_clipl_int32(sample);
-    }
-    break;
-    case SampleFormat_FP32: {
-        float *pOutSample = (float *)pOut;
-        float sample = *((float *)pIn);
-        if (iFactor > 0)
-        {
-            sample *= pcm_volume_adjust_float[factorIndex];
-        }
-        else
-        {
-            sample /= pcm_volume_adjust_float[factorIndex];
-        }
-        *pOutSample = av_clipf(sample, -1.0f, 1.0f);
-    }
-    break;
-    default: ASSERT(0); break;
-    }
-}
-
-//
-// Writes one sample of silence into the buffer
-//
-static inline void Silence(BYTE *pBuffer, LAVAudioSampleFormat sfSampleFormat)
-{
-    switch (sfSampleFormat)
+    switch (sfFormat)
     {
-    case SampleFormat_16:
-    case SampleFormat_24:
-    case SampleFormat_32:
-    case SampleFormat_FP32: memset(pBuffer, 0, get_byte_per_sample(sfSampleFormat)); break;
-    case SampleFormat_U8: *pBuffer = 128U; break;
-    default: ASSERT(0);
+    case SampleFormat_U8: return RemapSample_U8;
+    case SampleFormat_16: return RemapSample_16;
+    case SampleFormat_24: return RemapSample_24;
+    case SampleFormat_32: return RemapSample_32;
+    case SampleFormat_FP32: return RemapSample_FP32;
     }
+    ASSERT(0);
+    return RemapSample_16;
 }
 
-//
-// Extended Channel Remapping Processor
-//
-// This function can process a PCM buffer of any sample format, and remap the channels
-// into any arbitrary layout and channel count.
-//
-// The samples are copied byte-by-byte, without any conversion or loss.
-//
-// The ExtendedChannelMap is assumed to always have at least uOutChannels valid entries.
-// Its layout is in output format:
-//      Map[0] is the first output channel, and should contain the index in the source stream (or -1 for silence)
-//      Map[1] is the second output channel
-//
-// Source channels can be applied multiple times to the Destination, but multiple Source channels cannot be merged into one channel.
-// Note that when copying one source channel into multiple destinations, you always want to reduce its volume.
-// You can either do this in a second step, or use the factor documented below
-//
-// Examples:
-// 5.1 Input Buffer, following map will extract the Center channel, and return it as Mono:
-// uOutChannels == 1; map = {2}
-//
-// Mono Input Buffer, Convert to Stereo
-// uOutChannels == 2; map = {0, 0}
-//
-// Additionally, a factor can be applied to all PCM samples
-//
-// For optimization, the factor cannot be freely specified.
-// Factors -1, 0, 1 are ignored.
-// A Factor of 2 doubles the volume, 3 trippled, etc.
-// A Factor of -2 will produce half volume, -3 one third, etc.
-// The limit is a factor of 8/-8
-//
-// Otherwise, see ChannelMapping
-HRESULT ExtendedChannelMapping(BufferDetails *pcm, const unsigned uOutChannels, const ExtendedChannelMap extMap)
+HRESULT CChannelRemapper::Remap(BufferDetails *pcm, const unsigned uOutChannels, const ExtendedChannelMap extMap)
 {
 #ifdef DEBUG
     ASSERT(pcm && pcm->bBuffer);
@@ -167,37 +46,31 @@ HRESULT ExtendedChannelMapping(BufferDetails *pcm, const unsigned uOutChannels,
         ASSERT(extMap[idx].idx >= -1 && extMap[idx].idx < pcm->layout.nb_channels);
     }
 #endif
-    // Sample Size
-    const unsigned uSampleSize = get_byte_per_sample(pcm->sfFormat);
-
-    // New Output Buffer
-    GrowableArray<BYTE> *out = new GrowableArray<BYTE>();
-    out->SetSize(uOutChannels * pcm->nSamples * uSampleSize);
+    const unsigned uInChannels = pcm->layout.nb_channels;
+    const RemapSampleFormat sfFormat = get_remap_sample_fmt(pcm->sfFormat);
+    if (!m_Plan.Matches(uInChannels, uOutChannels, extMap, sfFormat))
+        m_Plan.Compile(uInChannels, uOutChannels, extMap, sfFormat);
 
-    const BYTE *pIn = pcm->bBuffer->Ptr();
-    BYTE *pOut = out->Ptr();
+    const size_t nSamples = pcm->nSamples;
+    const DWORD dwOutSize = (DWORD)(nSamples * get_byte_per_sample(pcm->sfFormat) * uOutChannels);
 
-    for (unsigned i = 0; i < pcm->nSamples; ++i)
+    GrowableArray<BYTE> *pOutBuffer = pcm->bBuffer;
+    if (!m_Plan.IsInPlace())
     {
-        for (unsigned ch = 0; ch < uOutChannels; ++ch)
-        {
-            if (extMap[ch].idx >= 0)
-            {
-                if (!extMap[ch].factor || abs(extMap[ch].factor) == 1)
-                    memcpy(pOut, pIn + (extMap[ch].idx * uSampleSize), uSampleSize);
-                else
-                    SampleCopyAdjust(pOut, pIn + (extMap[ch].idx * uSampleSize), extMap[ch].factor, pcm->sfFormat);
-            }
-            else
-                Silence(pOut, pcm->sfFormat);
-            pOut += uSampleSize;
-        }
-        pIn += uSampleSize * pcm->layout.nb_channels;
+        pOutBuffer = m_pPool->Acquire(dwOutSize);
+        if (!pOutBuffer)
+            return E_OUTOFMEMORY;
     }
+    pOutBuffer->SetSize(dwOutSize);
+
+    m_Plan.Remap(pcm->bBuffer->Ptr(), pOutBuffer->Ptr(), nSamples);
 
     // Apply changes to buffer
-    delete pcm->bBuffer;
-    pcm->bBuffer = out;
+    if (pOutBuffer != pcm->bBuffer)
+    {
+        m_pPool->Release(pcm->bBuffer);
+        pcm->bBuffer = pOutBuffer;
+    }
     av_channel_layout_uninit(&pcm->layout);
     pcm->layout.order = AV_CHANNEL_ORDER_UNSPEC;
     pcm->layout.nb_channels = uOutChannels;
@@ -417,24 +290,13 @@ HRESULT CLAVAudio::PadTo32(BufferDetails *buffer)
 {
     ASSERT(buffer->sfFormat == SampleFormat_24);
 
-    const DWORD size = (buffer->nSamples * buffer->layout.nb_channels) * 4;
-    GrowableArray<BYTE> *pcmOut = new GrowableArray<BYTE>();
-    pcmOut->SetSize(size);
+    // Grow the buffer and expand the samples in place
+    const size_t count = (size_t)buffer->nSamples * buffer->layout.nb_channels;
+    HRESULT hr = buffer->bBuffer->SetSize((DWORD)(count * 4));
+    if (FAILED(hr))
+        return hr;
 
-    const BYTE *pDataIn = buffer->bBuffer->Ptr();
-    BYTE *pDataOut = pcmOut->Ptr();
-
-    for (unsigned int i = 0; i < buffer->nSamples; ++i)
-    {
-        for (int ch = 0; ch < buffer->layout.nb_channels; ++ch)
-        {
-            AV_WL32(pDataOut, AV_RL24(pDataIn) << 8);
-            pDataOut += 4;
-            pDataIn += 3;
-        }
-    }
-    delete buffer->bBuffer;
-    buffer->bBuffer = pcmOut;
+    unpack_s24_to_s32(buffer->bBuffer->Ptr(), buffer->bBuffer->Ptr(), count);
     buffer->sfFormat = SampleFormat_32;
     buffer->wBitsPerSample = 24;
 
@@ -450,27 +312,14 @@ HRESULT CLAVAudio::Truncate32Buffer(BufferDetails *buffer)
     if (bytes_per_sample == 3 && !GetSampleFormat(SampleFormat_24))
         return S_FALSE;
 
-    const int skip = 4 - bytes_per_sample;
-    const DWORD size = (buffer->nSamples * buffer->layout.nb_channels) * bytes_per_sample;
-    GrowableArray<BYTE> *pcmOut = new GrowableArray<BYTE>();
-    pcmOut->SetSize(size);
-
-    const BYTE *pDataIn = buffer->bBuffer->Ptr();
-    BYTE *pDataOut = pcmOut->Ptr();
-
-    pDataIn += skip;
-    for (unsigned int i = 0; i < buffer->nSamples; ++i)
-    {
-        for (int ch = 0; ch < buffer->layout.nb_channels; ++ch)
-        {
-            memcpy(pDataOut, pDataIn, bytes_per_sample);
-            pDataOut += bytes_per_sample;
-            pDataIn += 4;
-        }
-    }
-
-    delete buffer->bBuffer;
-    buffer->bBuffer = pcmOut;
+    // The samples shrink, so they can be packed in place
+    const size_t count = (size_t)buffer->nSamples * buffer->layout.nb_channels;
+    BYTE *pData = buffer->bBuffer->Ptr();
+    if (bytes_per_sample == 3)
+        pack_s32_to_s24(pData, pData, count);
+    else
+        pack_s32_to_s16(pData, pData, count);
+    buffer->bBuffer->SetSize((DWORD)(count * bytes_per_sample));
     buffer->sfFormat = bytes_per_sample == 3 ? SampleFormat_24 : SampleFormat_16;
 
     return S_OK;
@@ -527,9 +376,21 @@ HRESULT CLAVAudio::PerformAVRProcessing(BufferDetails *buffer)
         PadTo32(buffer);
     }
 
-    if (av_channel_layout_compare(&buffer->layout, &m_MixingInputLayout) != 0 || (!m_swrContext && !m_bAVResampleFailed) || m_bMixingSettingsChanged ||
+    LAVAudioSampleFormat bufferFormat =
+        (outputFormat == SampleFormat_24) ? SampleFormat_32 : outputFormat; // avresample always outputs 32-bit
+
+    // Plain matrix mixing of interleaved samples is done natively, swresample handles everything else
+    // Integer output is left to swresample as well when dithering is requested
+    const BOOL bNativeMixing =
+        av_channel_layout_compare(&buffer->layout, &chMixingLayout) != 0 && !buffer->bPlanar &&
+        (bufferFormat == SampleFormat_FP32 || !m_settings.SampleConvertDither) &&
+        CMatrixMixer::IsSupported(&buffer->layout, get_ff_sample_fmt(buffer->sfFormat), &chMixingLayout,
+                                  get_ff_sample_fmt(bufferFormat));
+
+    if (av_channel_layout_compare(&buffer->layout, &m_MixingInputLayout) != 0 ||
+        (!m_swrContext && !m_MatrixMixer.IsInitialized() && !m_bAVResampleFailed) || m_bMixingSettingsChanged ||
         av_channel_layout_compare(&m_chRemixLayout, &chMixingLayout) != 0 || outputFormat != m_sfRemixFormat ||
-        buffer->sfFormat != m_MixingInputFormat)
+        buffer->sfFormat != m_MixingInputFormat || bNativeMixing != m_bNativeMixing)
     {
         m_bAVResampleFailed = FALSE;
         m_bMixingSettingsChanged = FALSE;
@@ -537,52 +398,66 @@ HRESULT CLAVAudio::PerformAVRProcessing(BufferDetails *buffer)
         {
             swr_free(&m_swrContext);
         }
+        m_MatrixMixer.Reset();
 
         av_channel_layout_copy(&m_MixingInputLayout, &buffer->layout);
         av_channel_layout_copy(&m_chRemixLayout, &chMixingLayout);
 
         m_MixingInputFormat = buffer->sfFormat;
         m_sfRemixFormat = outputFormat;
+        m_bNativeMixing = bNativeMixing;
+
+        // setup matrix parameters
+        const BOOL bNormalize = !!(m_settings.MixingFlags & LAV_MIXING_FLAG_NORMALIZE_MATRIX);
+        const BOOL bClipProtection = !!(m_settings.MixingFlags & LAV_MIXING_FLAG_CLIP_PROTECTION);
+        const double center_mix_level = (double)m_settings.MixingCenterLevel / 10000.0;
+        const double surround_mix_level = (double)m_settings.MixingSurroundLevel / 10000.0;
+        const double lfe_mix_level = (double)m_settings.MixingLFELevel / 10000.0 /
+                                     (chMixingLayout.u.mask == AV_CH_LAYOUT_MONO ? 1.0 : M_SQRT1_2);
+
+        if (bNativeMixing &&
+            m_MatrixMixer.Init(&buffer->layout, get_ff_sample_fmt(buffer->sfFormat), &chMixingLayout,
+                               get_ff_sample_fmt(bufferFormat), center_mix_level, surround_mix_level, lfe_mix_level,
+                               bNormalize ? 1.0 : 0.0, !bNormalize && bClipProtection,
+                               (AVMatrixEncoding)m_settings.MixingMode) >= 0)
+        {
+            DbgLog((LOG_TRACE, 10, L"Using the native matrix mixer"));
+        }
+        else
+        {
+            swr_alloc_set_opts2(&m_swrContext, &chMixingLayout, get_ff_sample_fmt(m_sfRemixFormat),
+                                buffer->dwSamplesPerSec, &buffer->layout, get_ff_sample_fmt(buffer->sfFormat),
+                                buffer->dwSamplesPerSec, 0, NULL);
 
-        swr_alloc_set_opts2(&m_swrContext, &chMixingLayout, get_ff_sample_fmt(m_sfRemixFormat), buffer->dwSamplesPerSec,
-                               &buffer->layout, get_ff_sample_fmt(buffer->sfFormat), buffer->dwSamplesPerSec, 0, NULL);
+            av_opt_set_int(m_swrContext, "dither_method",
+                           m_settings.SampleConvertDither ? SWR_DITHER_TRIANGULAR_HIGHPASS : SWR_DITHER_NONE, 0);
 
-        av_opt_set_int(m_swrContext, "dither_method",
-                       m_settings.SampleConvertDither ? SWR_DITHER_TRIANGULAR_HIGHPASS : SWR_DITHER_NONE, 0);
+            // Setup mixing properties, if needed
+            if (av_channel_layout_compare(&buffer->layout, &chMixingLayout) != 0)
+            {
+                ASSERT(chMixingLayout.order == AV_CHANNEL_ORDER_NATIVE);
 
-        // Setup mixing properties, if needed
-        if (av_channel_layout_compare(&buffer->layout, &chMixingLayout) != 0)
-        {
-            ASSERT(chMixingLayout.order == AV_CHANNEL_ORDER_NATIVE);
-
-            BOOL bNormalize = !!(m_settings.MixingFlags & LAV_MIXING_FLAG_NORMALIZE_MATRIX);
-            BOOL bClipProtection = !!(m_settings.MixingFlags & LAV_MIXING_FLAG_CLIP_PROTECTION);
-            av_opt_set_int(m_swrContext, "clip_protection", !bNormalize && bClipProtection, 0);
-            av_opt_set_int(m_swrContext, "internal_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
-
-            // setup matrix parameters
-            const double center_mix_level = (double)m_settings.MixingCenterLevel / 10000.0;
-            const double surround_mix_level = (double)m_settings.MixingSurroundLevel / 10000.0;
-            const double lfe_mix_level =
-                (double)m_settings.MixingLFELevel / 10000.0 / (chMixingLayout.u.mask == AV_CH_LAYOUT_MONO ? 1.0 : M_SQRT1_2);
-
-            av_opt_set_double(m_swrContext, "center_mix_level", center_mix_level, 0);
-            av_opt_set_double(m_swrContext, "surround_mix_level", surround_mix_level, 0);
-            av_opt_set_double(m_swrContext, "lfe_mix_level", lfe_mix_level, 0);
-            av_opt_set_double(m_swrContext, "rematrix_maxval", bNormalize ? 1.0 : 0.0, 0);
-            av_opt_set_int(m_swrContext, "matrix_encoding", (AVMatrixEncoding)m_settings.MixingMode, 0);
-        }
+                av_opt_set_int(m_swrContext, "clip_protection", !bNormalize && bClipProtection, 0);
+                av_opt_set_int(m_swrContext, "internal_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
 
-        // Open Resample Context
-        ret = swr_init(m_swrContext);
-        if (ret < 0)
-        {
-            DbgLog((LOG_ERROR, 10, L"swr_init failed"));
-            goto setuperr;
+                av_opt_set_double(m_swrContext, "center_mix_level", center_mix_level, 0);
+                av_opt_set_double(m_swrContext, "surround_mix_level", surround_mix_level, 0);
+                av_opt_set_double(m_swrContext, "lfe_mix_level", lfe_mix_level, 0);
+                av_opt_set_double(m_swrContext, "rematrix_maxval", bNormalize ? 1.0 : 0.0, 0);
+                av_opt_set_int(m_swrContext, "matrix_encoding", (AVMatrixEncoding)m_settings.MixingMode, 0);
+            }
+
+            // Open Resample Context
+            ret = swr_init(m_swrContext);
+            if (ret < 0)
+            {
+                DbgLog((LOG_ERROR, 10, L"swr_init failed"));
+                goto setuperr;
+            }
         }
     }
 
-    if (!m_swrContext)
+    if (!m_swrContext && !m_MatrixMixer.IsInitialized())
     {
         DbgLog((LOG_ERROR, 10, L"swresample context missing?"));
         goto setuperr;
@@ -590,24 +465,30 @@ HRESULT CLAVAudio::PerformAVRProcessing(BufferDetails *buffer)
 
     av_channel_layout_uninit(&chMixingLayout);
 
-    LAVAudioSampleFormat bufferFormat =
-        (m_sfRemixFormat == SampleFormat_24) ? SampleFormat_32 : m_sfRemixFormat; // avresample always outputs 32-bit
-
-    GrowableArray<BYTE> *pcmOut = new GrowableArray<BYTE>();
-    pcmOut->Allocate(FFALIGN(buffer->nSamples, 32) * m_chRemixLayout.nb_channels *
-                     get_byte_per_sample(bufferFormat));
+    const int outFrameSize = m_chRemixLayout.nb_channels * get_byte_per_sample(bufferFormat);
+    GrowableArray<BYTE> *pcmOut = m_PCMPool.Acquire(FFALIGN(buffer->nSamples, 32) * outFrameSize);
+    if (!pcmOut)
+        return E_OUTOFMEMORY;
     BYTE *pOut = pcmOut->Ptr();
 
     BYTE *pIn = buffer->bBuffer->Ptr();
-    ret = swr_convert(m_swrContext, &pOut, pcmOut->GetAllocated(), (const uint8_t **)&pIn, buffer->nSamples);
-    if (ret < 0)
+    if (m_MatrixMixer.IsInitialized())
     {
-        DbgLog((LOG_ERROR, 10, L"swr_convert failed"));
-        delete pcmOut;
-        return S_FALSE;
+        m_MatrixMixer.Mix(pOut, pIn, buffer->nSamples);
+    }
+    else
+    {
+        ret = swr_convert(m_swrContext, &pOut, pcmOut->GetAllocated() / outFrameSize, (const uint8_t **)&pIn,
+                          buffer->nSamples);
+        if (ret < 0)
+        {
+            DbgLog((LOG_ERROR, 10, L"swr_convert failed"));
+            m_PCMPool.Release(pcmOut);
+            return S_FALSE;
+        }
     }
 
-    delete buffer->bBuffer;
+    m_PCMPool.Release(buffer->bBuffer);
     buffer->bBuffer = pcmOut;
     av_channel_layout_copy(&buffer->layout, &m_chRemixLayout);
     buffer->sfFormat = bufferFormat;
@@ -617,6 +498,7 @@ HRESULT CLAVAudio::PerformAVRProcessing(BufferDetails *buffer)
     return S_OK;
 setuperr:
     swr_free(&m_swrContext);
+    m_MatrixMixer.Reset();
     m_bAVResampleFailed = TRUE;
     av_channel_layout_uninit(&chMixingLayout);
     return E_FAIL;
@@ -698,7 +580,7 @@ HRESULT CLAVAudio::PostProcess(BufferDetails *buffer)
         }
         if (m_bChannelMappingRequired)
         {
-            ExtendedChannelMapping(buffer, m_ChannelMapOutputLayout.nb_channels, m_ChannelMap);
+            m_ConformityRemapper.Remap(buffer, m_ChannelMapOutputLayout.nb_channels, m_ChannelMap);
             av_channel_layout_copy(&buffer->layout, &m_ChannelMapOutputLayout);
         }
     }
@@ -725,7 +607,7 @@ HRESULT CLAVAudio::PostProcess(BufferDetails *buffer)
     if (buffer->layout.nb_channels == 1 && m_settings.ExpandMono)
     {
         ExtendedChannelMap map = {{0, -2}, {0, -2}};
-        ExtendedChannelMapping(buffer, 2, map);
+        m_MonoRemapper.Remap(buffer, 2, map);
         av_channel_layout_uninit(&buffer->layout);
         av_channel_layout_default(&buffer->layout, 2);
     }
@@ -736,13 +618,13 @@ HRESULT CLAVAudio::PostProcess(BufferDetails *buffer)
         if (buffer->layout.u.mask == AV_CH_LAYOUT_6POINT1_BACK)
         {
             ExtendedChannelMap map = {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {6, -2}, {6, -2}, {4, 0}, {5, 0}};
-            ExtendedChannelMapping(buffer, 8, map);
+            m_Expand61Remapper.Remap(buffer, 8, map);
             buffer->layout.u.mask = AV_CH_LAYOUT_7POINT1;
         }
         else if (buffer->layout.u.mask == AV_CH_LAYOUT_6POINT1)
         {
             ExtendedChannelMap map = {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, -2}, {4, -2}, {5, 0}, {6, 0}};
-            ExtendedChannelMapping(buffer, 8, map);
+            m_Expand61Remapper.Remap(buffer, 8, map);
             buffer->layout.u.mask = AV_CH_LAYOUT_7POINT1;
         }
     }
@@ -19,27 +19,32 @@
 
 #pragma once
 
-struct BufferDetails;
-
-typedef struct ExtendedChannelMap_s
-{
-    int idx;
-    int factor;
-} ExtendedChannelMap[8];
+#include "LAVAudioSettings.h"
+#include "ChannelRemapper.h"
 
-inline void ExtChMapSet(ExtendedChannelMap *map, int ch, int idx, int factor)
-{
-    (*map)[ch].idx = idx;
-    (*map)[ch].factor = factor;
-}
+struct BufferDetails;
+class CPCMBufferPool;
 
-inline void ExtChMapClear(ExtendedChannelMap *map)
+//
+// Extended Channel Remapping Processor
+//
+// Remaps the channels of a PCM buffer with a CChannelRemapPlan, see ChannelRemapper.h for the map and its factors.
+//
+// The plan is re-used for every following buffer until the map, the sample format or the channel counts change, so
+// keep one instance per map in use. Output buffers are taken from the given pool, and the input buffer is returned
+// to it.
+//
+class CChannelRemapper
 {
-    for (unsigned i = 0; i < 8; ++i)
+  public:
+    CChannelRemapper(CPCMBufferPool *pPool)
+        : m_pPool(pPool)
     {
-        (*map)[i].idx = -1;
-        (*map)[i].factor = 0;
     }
-}
 
-HRESULT ExtendedChannelMapping(BufferDetails *pcm, unsigned uOutChannels, const ExtendedChannelMap extMap);
+    HRESULT Remap(BufferDetails *pcm, unsigned uOutChannels, const ExtendedChannelMap extMap);
+
+  private:
+    CChannelRemapPlan m_Plan;
+    CPCMBufferPool *m_pPool = nullptr;
+};
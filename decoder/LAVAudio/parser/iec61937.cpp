@@ -0,0 +1,534 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * This code was inspired by the ffdshow-tryouts TaudioCodecBitstream module, licensed under GPL 2.0
+ */
+
+extern "C"
+{
+#include "libavutil/bswap.h"
+#include "libavutil/error.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/log.h"
+};
+
+#include "iec61937.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IEC61937_SSE2 1
+#endif
+
+// IEC 61937 burst header, see libavformat/spdif.h, which is not public
+#define BURST_HEADER_SIZE 0x8
+#define SYNCWORD1 0xF872
+#define SYNCWORD2 0x4E1F
+#define IEC61937_TRUEHD 0x16
+
+#define MAT_BUFFER_LIMIT (MAT_FRAME_SIZE - 24 /* MAT end code size */)
+#define MAT_POS_MIDDLE (30708 /* middle point*/ + 8 /* IEC header in front */)
+
+static const uint8_t mat_start_code[20] = {0x07, 0x9E, 0x00, 0x03, 0x84, 0x01, 0x01, 0x01, 0x80, 0x00,
+                                           0x56, 0xA5, 0x3B, 0xF4, 0x81, 0x83, 0x49, 0x80, 0x77, 0xE0};
+static const uint8_t mat_middle_code[12] = {0xC3, 0xC1, 0x42, 0x49, 0x3B, 0xFA, 0x82, 0x83, 0x49, 0x80, 0x77, 0xE0};
+static const uint8_t mat_end_code[24] = {0xC3, 0xC2, 0xC0, 0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x97, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+// Copy of ff_spdif_bswap_buf16, which sadly is a private symbol
+// Vectorized, since it doubles as the copy of bitstream data into the output sample.
+void lav_spdif_bswap_buf16(uint16_t *dst, const uint16_t *src, int w)
+{
+    int i = 0;
+
+#ifdef IEC61937_SSE2
+    for (; i + 16 <= w; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 8), b);
+    }
+#endif
+    for (; i < w; i++)
+        AV_WN16(dst + i, av_bswap16(AV_RN16(src + i)));
+}
+
+// Write data into the byte-swapped MAT frame, at any byte position
+static void mat_write_swapped(uint8_t *pFrame, uint32_t pos, const uint8_t *p, int size)
+{
+    // a byte at an odd position goes into the low half of the 16-bit word
+    if (size > 0 && (pos & 1))
+    {
+        pFrame[pos - 1] = p ? *p++ : 0;
+        pos++;
+        size--;
+    }
+
+    if (size <= 0)
+        return;
+
+    if (p)
+        lav_spdif_bswap_buf16((uint16_t *)(pFrame + pos), (const uint16_t *)p, size >> 1);
+    else
+        memset(pFrame + pos, 0, size & ~1);
+
+    // and a trailing byte into the high half
+    if (size & 1)
+        pFrame[pos + size] = p ? p[size - 1] : 0;
+}
+
+// MSB-first bit reader for the TrueHD headers, reads past the end of the buffer return zero bits
+class CBitReader
+{
+  public:
+    CBitReader(const uint8_t *p, int size) : m_pData(p), m_nSize(size * 8) {}
+
+    unsigned Read(int n)
+    {
+        unsigned v = 0;
+        for (int i = 0; i < n; i++, m_nPos++)
+        {
+            v <<= 1;
+            if (m_nPos < m_nSize)
+                v |= (m_pData[m_nPos >> 3] >> (7 - (m_nPos & 7))) & 1;
+        }
+        return v;
+    }
+
+    void Skip(int n) { m_nPos += n; }
+
+  private:
+    const uint8_t *m_pData = nullptr;
+    int m_nSize = 0;
+    int m_nPos = 0;
+};
+
+static bool parse_truehd_major_sync(const uint8_t *p, int buffsize, int &ratebits, uint16_t &output_timing,
+                                    bool &output_timing_present)
+{
+    assert(AV_RB32(p + 4) == 0xf8726fba);
+
+    if (buffsize < 32)
+        return false;
+
+    // parse major sync and look for a restart header
+    int major_sync_size = 28;
+    if (p[29] & 1)
+    {
+        int extension_size = p[30] >> 4;
+        major_sync_size += 2 + extension_size * 2;
+    }
+
+    CBitReader gb(p + 4, buffsize - 4);
+    gb.Skip(32); // format_sync
+
+    // v(32) format_info
+    ratebits = gb.Read(4); // ratebits
+    gb.Skip(1);            // 6ch_multichannel_type
+    gb.Skip(1);            // 8ch_multichannel_type
+    gb.Skip(2);            // reserved
+
+    gb.Skip(2);  // 2ch_presentation_channel_modifier
+    gb.Skip(2);  // 6ch_presentation_channel_modifier
+    gb.Skip(5);  // 6ch_presentation_channel_assignment
+    gb.Skip(2);  // 8ch_presentation_channel_modifier
+    gb.Skip(13); // 8ch_presentation_channel_assignment
+
+    gb.Skip(16); // signature
+    gb.Skip(16); // flags
+    gb.Skip(16); // reserved
+
+    gb.Skip(1);  // variable_rate
+    gb.Skip(15); // peak_data_rate
+
+    int num_substreams = gb.Read(4);
+    gb.Skip(4 + (major_sync_size - 17) * 8);
+
+    // substream directory
+    for (int i = 0; i < num_substreams; i++)
+    {
+        int extra_substream_word = gb.Read(1);
+        gb.Skip(1);  // restart_nonexistent
+        gb.Skip(1);  // crc_present
+        gb.Skip(1);  // reserved
+        gb.Skip(12); // substream_end_ptr
+        if (extra_substream_word)
+            gb.Skip(16); // drc_gain_update, drc_time_update, reserved
+    }
+
+    // substream segments
+    for (int i = 0; i < num_substreams; i++)
+    {
+        if (gb.Read(1))
+        { // block_header_exists
+            if (gb.Read(1))
+            {                // restart_header_exists
+                gb.Skip(14); // restart_sync_word
+                output_timing = gb.Read(16);
+                output_timing_present = true;
+                // XXX: restart header
+            }
+            // XXX: Block header
+        }
+        // XXX: All blocks, all substreams?
+        break;
+    }
+
+    return true;
+}
+
+void CMATFramer::Reset()
+{
+    m_pFrame = nullptr;
+    m_FramePos = 0;
+    memset(&m_State, 0, sizeof(m_State));
+}
+
+bool CMATFramer::WriteHeader()
+{
+    assert(m_pFrame == nullptr);
+
+    m_pFrame = m_pOutput->AllocFrame();
+    if (m_pFrame == nullptr)
+    {
+        Reset();
+        return false;
+    }
+
+    uint8_t header[BURST_HEADER_SIZE + sizeof(mat_start_code)];
+    uint32_t size = sizeof(header);
+
+    // IEC burst header
+    AV_WB16(header + 0, SYNCWORD1);
+    AV_WB16(header + 2, SYNCWORD2);
+    AV_WB16(header + 4, IEC61937_TRUEHD);
+    AV_WB16(header + 6, 61424);
+
+    // MAT start code
+    memcpy(header + BURST_HEADER_SIZE, mat_start_code, sizeof(mat_start_code));
+
+    mat_write_swapped(m_pFrame, 0, header, size);
+    m_FramePos = size;
+
+    // unless the start code falls into the padding,  its considered part of the current MAT frame
+    // Note that audio frames are not always aligned with MAT frames, so we might already have a partial frame at this
+    // point
+    m_State.mat_framesize += size;
+
+    // The MAT metadata counts as padding, if we're scheduled to write any, which mean the start bytes should reduce any
+    // further padding.
+    if (m_State.padding > 0)
+    {
+        // if the header fits into the padding of the last frame, just reduce the amount of needed padding
+        if (m_State.padding > size)
+        {
+            m_State.padding -= size;
+            m_State.mat_framesize = 0;
+        }
+        else // otherwise, consume all padding and set the size of the next MAT frame to the remaining data
+        {
+            m_State.mat_framesize = (size - m_State.padding);
+            m_State.padding = 0;
+        }
+    }
+
+    return true;
+}
+
+void CMATFramer::WritePadding()
+{
+    if (m_State.padding > 0)
+    {
+        int remaining = FillDataBuffer(nullptr, m_State.padding, true);
+
+        // not all padding could be written to the buffer, write it later
+        if (remaining >= 0)
+        {
+            m_State.padding = remaining;
+            m_State.mat_framesize = 0;
+        }
+        else // more padding then requested was written, eg. there was a MAT middle/end marker that needed to be written
+        {
+            m_State.padding = 0;
+            m_State.mat_framesize = -remaining;
+        }
+    }
+}
+
+void CMATFramer::AppendData(const uint8_t *p, int size)
+{
+    assert(m_FramePos + size <= MAT_FRAME_SIZE);
+    mat_write_swapped(m_pFrame, m_FramePos, p, size);
+    m_FramePos += size;
+
+    m_State.mat_framesize += size;
+}
+
+int CMATFramer::FillDataBuffer(const uint8_t *p, int size, bool padding)
+{
+    assert(p || padding);
+
+    if (m_FramePos >= MAT_BUFFER_LIMIT)
+        return size;
+
+    int remaining = size;
+
+    // Write MAT middle marker, if needed
+    // The MAT middle marker always needs to be in the exact same spot, any audio data will be split.
+    // If we're currently writing padding, then the marker will be considered as padding data and reduce the amount of
+    // padding still required.
+    if (m_FramePos <= MAT_POS_MIDDLE && m_FramePos + size > MAT_POS_MIDDLE)
+    {
+        // write as much data before the middle code as we can
+        int nBytesBefore = MAT_POS_MIDDLE - m_FramePos;
+        AppendData(p, nBytesBefore);
+        remaining -= nBytesBefore;
+
+        // write the MAT middle code
+        AppendData(mat_middle_code, sizeof(mat_middle_code));
+
+        // if we're writing padding, deduct the size of the code from it
+        if (padding)
+            remaining -= sizeof(mat_middle_code);
+
+        // write remaining data after the MAT marker
+        if (remaining > 0)
+        {
+            return FillDataBuffer(p ? p + nBytesBefore : nullptr, remaining, padding);
+        }
+
+        return remaining;
+    }
+
+    // not enough room in the buffer to write all the data, write as much as we can and add the MAT footer
+    if (m_FramePos + size >= MAT_BUFFER_LIMIT)
+    {
+        // write as much data before the middle code as we can
+        int nBytesBefore = MAT_BUFFER_LIMIT - m_FramePos;
+        AppendData(p, nBytesBefore);
+        remaining -= nBytesBefore;
+
+        // write the MAT end code
+        AppendData(mat_end_code, sizeof(mat_end_code));
+
+        assert(m_FramePos == MAT_FRAME_SIZE);
+
+        // MAT markers don't displace padding, so reduce the amount of padding
+        if (padding)
+            remaining -= sizeof(mat_end_code);
+
+        // any remaining data will be written in future calls
+        return remaining;
+    }
+
+    AppendData(p, size);
+
+    return 0;
+}
+
+void CMATFramer::FlushFrame()
+{
+    if (m_pFrame)
+    {
+        assert(m_FramePos == MAT_FRAME_SIZE);
+
+        // normal number of samples per frame
+        uint16_t frame_samples = 40 << (m_State.ratebits & 7);
+        int nMATSamples = (frame_samples * 24);
+
+        // we expect 24 frames per MAT frame, so calculate an offset from that
+        // the frame is still delivered with the previous offset, since it modifies the duration of the frame, eg. the
+        // start of the next frame
+        int nSamplesOffset = m_State.nSamplesOffset;
+        if (nMATSamples != m_State.nSamples)
+            m_State.nSamplesOffset += m_State.nSamples - nMATSamples;
+        m_State.nSamples = 0;
+
+        // the output takes over the buffer, and may reset the framer while delivering it
+        uint8_t *pFrame = m_pFrame;
+        m_pFrame = nullptr;
+        m_FramePos = 0;
+
+        m_pOutput->DeliverFrame(pFrame, nSamplesOffset);
+    }
+}
+
+int CMATFramer::AddFrame(const uint8_t *p, int buffsize)
+{
+    // On a high level, a MAT frame consists of a sequence of padded TrueHD frames
+    // The size of the padded frame can be determined from the frame time/sequence code in the frame header,
+    // since it varies to accommodate spikes in bitrate.
+    // In average all frames are always padded to 2560 bytes, so that 24 frames fit in one MAT frame, however
+    // due to bitrate spikes single sync frames have been observed to use up to twice that size, in which
+    // case they'll be preceded by smaller frames to keep the average bitrate constant.
+    // A constant padding to 2560 bytes can work (this is how the ffmpeg spdifenc module works), however
+    // high-bitrate streams can overshoot this size and therefor require proper handling of dynamic padding.
+
+    uint16_t output_timing = 0;
+    bool bOutputTimingPresent = false;
+
+    if (buffsize < 8)
+        return AVERROR_INVALIDDATA;
+
+    // get the ratebits and output timing from the sync frame
+    if (AV_RB32(p + 4) == 0xf8726fba)
+    {
+        if (parse_truehd_major_sync(p, buffsize, m_State.ratebits, output_timing, bOutputTimingPresent) == false)
+            return AVERROR_INVALIDDATA;
+    }
+    else if (m_State.prev_frametime_valid == false)
+    {
+        // only start streaming on a major sync frame
+        m_State.nSamplesOffset = 0;
+        return 1;
+    }
+
+    uint16_t frame_time = AV_RB16(p + 2);
+    uint32_t space_size = 0;
+
+    uint16_t frame_samples = 40 << (m_State.ratebits & 7);
+    m_State.output_timing += frame_samples;
+    if (bOutputTimingPresent)
+    {
+        if (m_State.output_timing_valid && (output_timing != m_State.output_timing))
+        {
+            av_log(nullptr, AV_LOG_VERBOSE, "CMATFramer: Detected a stream discontinuity, reseting framesize cache\n");
+            m_State.prev_frametime_valid = false;
+            space_size = frame_samples * (64 >> (m_State.ratebits & 7));
+
+            // the output timing is always one frame ahead for buffering reasons, so deduct one frame worth
+            uint32_t prev_output = (uint16_t)(output_timing - frame_samples);
+            if (prev_output < frame_time) // wrap around, output is always in front of frame time
+                prev_output += 0x10000;   // unwrap 16-bit value
+
+            // get the offset of this frame, so we can compare to the previous frame, and determine the amount of
+            // padding that needs to be inserted
+            int currentFrameOutputOffset = (prev_output - frame_time);
+
+            // the previous offset should never be smaller then the incoming offset, or we will lack the reserved space
+            assert(m_State.nOutputTimeOffset >= currentFrameOutputOffset);
+            if (m_State.nOutputTimeOffset >= currentFrameOutputOffset)
+                m_State.padding +=
+                    (m_State.nOutputTimeOffset - currentFrameOutputOffset) * (64 >> (m_State.ratebits & 7));
+
+            av_log(nullptr, AV_LOG_VERBOSE, "CMATFramer: Carrying forward %u padding (offset %d - %d)\n",
+                   m_State.padding, m_State.nOutputTimeOffset, currentFrameOutputOffset);
+        }
+        m_State.output_timing = output_timing;
+        m_State.output_timing_valid = true;
+    }
+
+    // compute final padded size for the previous frame, if any
+    if (m_State.prev_frametime_valid)
+        space_size = uint16_t(frame_time - m_State.prev_frametime) * (64 >> (m_State.ratebits & 7));
+
+    // compute padding (ie. difference to the size of the previous frame)
+    assert(!m_State.prev_frametime_valid || space_size >= m_State.prev_mat_framesize);
+
+    // if for some reason the space_size fails, align the actual frame size
+    if (space_size < m_State.prev_mat_framesize)
+    {
+        uint32_t align = 64 >> (m_State.ratebits & 7);
+        space_size = (m_State.prev_mat_framesize + align - 1) & ~(align - 1);
+    }
+
+    m_State.padding += (space_size - m_State.prev_mat_framesize);
+
+    // record the offset of frame time to output time, which is used to verify the size of the padding on
+    // discontinuities
+    if (m_State.output_timing_valid)
+    {
+        uint32_t prev_output = (uint16_t)(m_State.output_timing - frame_samples);
+        if (prev_output < frame_time) // wrap around, output is always in front of frame time
+            prev_output += 0x10000;   // unwrap 16-bit value
+
+        m_State.nOutputTimeOffset = (prev_output - frame_time);
+    }
+
+    // store frame time of the previous frame
+    m_State.prev_frametime = frame_time;
+    m_State.prev_frametime_valid = true;
+
+    // Write the MAT header into the fresh buffer
+    if (m_pFrame == nullptr)
+    {
+        if (!WriteHeader())
+            return AVERROR(ENOMEM);
+
+        // initial header, don't count it for the frame size
+        if (m_State.init == false)
+        {
+            m_State.init = true;
+            m_State.mat_framesize = 0;
+        }
+    }
+
+    // write padding of the previous frame (if any)
+    while (m_State.padding > 0)
+    {
+        WritePadding();
+
+        assert(m_State.padding == 0 || m_FramePos == MAT_FRAME_SIZE);
+
+        // Buffer is full, submit it
+        if (m_FramePos == MAT_FRAME_SIZE)
+        {
+            FlushFrame();
+
+            // and setup a new buffer
+            if (!WriteHeader())
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    // count the number of samples in this frame
+    m_State.nSamples += frame_samples;
+
+    // write actual audio data to the buffer
+    int remaining = FillDataBuffer(p, buffsize);
+
+    // not all data could be written, or the buffer is full
+    if (remaining || m_FramePos == MAT_FRAME_SIZE)
+    {
+        // flush out old data
+        FlushFrame();
+
+        if (remaining)
+        {
+            // .. setup a new buffer
+            if (!WriteHeader())
+                return AVERROR(ENOMEM);
+
+            // and write the remaining data
+            remaining = FillDataBuffer(p + (buffsize - remaining), remaining);
+
+            assert(remaining == 0);
+        }
+    }
+
+    // store the size of the current MAT frame, so we can add padding later
+    m_State.prev_mat_framesize = m_State.mat_framesize;
+    m_State.mat_framesize = 0;
+
+    return 0;
+}
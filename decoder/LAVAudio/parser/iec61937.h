@@ -0,0 +1,92 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// IEC 61937 framing helpers for S/PDIF and HDMI bitstreaming
+// Only depends on public libavutil headers and the C++ runtime, so the framing can be exercised outside of a DirectShow
+// graph.
+
+#define MAT_FRAME_SIZE 61440
+
+// Byte-swap w 16-bit words from src into dst, dst may be equal to src
+void lav_spdif_bswap_buf16(uint16_t *dst, const uint16_t *src, int w);
+
+// Packs TrueHD frames into MAT frames, as they are sent over HDMI
+//
+// A MAT frame consists of 24 TrueHD frames, each padded to a size derived from its frame time, and some fixed markers.
+// The frames are written byte-swapped, ready for the audio device.
+class CMATFramer
+{
+  public:
+    class Output
+    {
+      public:
+        // Return the buffer for the next MAT frame, MAT_FRAME_SIZE bytes, or nullptr on failure
+        virtual uint8_t *AllocFrame() = 0;
+
+        // The MAT frame in pFrame is complete. nSamplesOffset is the amount of samples all previously delivered frames
+        // deviated from their nominal duration, and should be applied to the timestamp of this frame.
+        virtual void DeliverFrame(uint8_t *pFrame, int nSamplesOffset) = 0;
+    };
+
+    CMATFramer(Output *pOutput) : m_pOutput(pOutput) {}
+
+    // Add one TrueHD frame, which can complete any number of MAT frames
+    // Returns 0 on success, 1 if the frame was skipped while waiting for a major sync, or a negative AVERROR
+    int AddFrame(const uint8_t *p, int size);
+
+    // Drop the MAT frame under construction and all timing state, ie. on a seek
+    void Reset();
+
+  private:
+    bool WriteHeader();
+    void WritePadding();
+    void AppendData(const uint8_t *p, int size);
+    int FillDataBuffer(const uint8_t *p, int size, bool padding = false);
+    void FlushFrame();
+
+  private:
+    Output *m_pOutput = nullptr;
+
+    uint8_t *m_pFrame = nullptr;
+    uint32_t m_FramePos = 0;
+
+    struct
+    {
+        bool init;
+        int ratebits;
+        uint16_t output_timing;
+        bool output_timing_valid;
+
+        uint16_t prev_frametime;
+        bool prev_frametime_valid;
+
+        uint32_t mat_framesize;
+        uint32_t prev_mat_framesize;
+
+        uint32_t padding;
+        uint32_t nSamples;
+        int nSamplesOffset;
+
+        int nOutputTimeOffset;
+    } m_State = {};
+};
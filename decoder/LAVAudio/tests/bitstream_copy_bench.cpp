@@ -0,0 +1,257 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Cost of the copies on the avformat spdif muxer path (AC3, E-AC3, DTS)
+//
+//   bitstream_copy_bench <ac3|eac3|dts|dtshd> <elementary stream> [passes]
+//
+// Muxes the stream the same way LAVAudio does: an AVIO context with a 64 KB buffer, flushed after every packet, into
+// a write callback like CLAVAudio::BSWriteBuffer, followed by the copy into the output sample as in DeliverBitstream.
+// The muxer byte-swaps the payload into its own buffer (E-AC3 gathers the frames in one more buffer first), the AVIO
+// write copies it into the AVIO buffer, and the delivery copies it into the sample.
+//
+// Routing the bursts into the sample could only save the AVIO and delivery copies, so those are timed on their own
+// and compared to the total and to the duration of the audio. Between two bursts the decoder and renderer run, so the
+// copies are also timed with the caches flushed before every burst.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+}
+
+#include "test_utils.h"
+
+#define LAV_BITSTREAM_BUFFER_SIZE 65536
+#define LAV_BITSTREAM_DTS_HD_MA_RATE 768000
+
+#define COLD_BURSTS 500
+#define COLD_FLUSH_SIZE (32 << 20)
+
+struct BurstSink
+{
+    const uint8_t *pBurst = nullptr;
+    int nBurstSize = 0;
+    std::vector<uint8_t> staging;
+};
+
+// Same as CLAVAudio::BSWriteBuffer
+static int write_burst(void *opaque, const uint8_t *buf, int buf_size)
+{
+    BurstSink *sink = (BurstSink *)opaque;
+    if (buf_size < LAV_BITSTREAM_BUFFER_SIZE && sink->staging.empty())
+    {
+        sink->pBurst = buf;
+        sink->nBurstSize = buf_size;
+    }
+    else
+        sink->staging.insert(sink->staging.end(), buf, buf + buf_size);
+    return buf_size;
+}
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s <ac3|eac3|dts|dtshd> <elementary stream> [passes]\n", argv[0]);
+        return 2;
+    }
+
+    AVCodecID codec = AV_CODEC_ID_NONE;
+    int nLinkRate = 48000; // IEC 61937 bursts fill a 2 channel 16-bit link at this rate
+    if (strcmp(argv[1], "ac3") == 0)
+        codec = AV_CODEC_ID_AC3;
+    else if (strcmp(argv[1], "eac3") == 0)
+        codec = AV_CODEC_ID_EAC3, nLinkRate = 192000;
+    else if (strcmp(argv[1], "dts") == 0)
+        codec = AV_CODEC_ID_DTS;
+    else if (strcmp(argv[1], "dtshd") == 0)
+        codec = AV_CODEC_ID_DTS, nLinkRate = LAV_BITSTREAM_DTS_HD_MA_RATE;
+    else
+    {
+        printf("Unknown codec %s\n", argv[1]);
+        return 2;
+    }
+    const int nPasses = argc > 3 ? atoi(argv[3]) : 20;
+
+    // the muxer complains about the missing timestamps
+    av_log_set_level(AV_LOG_ERROR);
+
+    std::vector<uint8_t> es;
+    if (!read_file(argv[2], es))
+    {
+        printf("Can't read %s\n", argv[2]);
+        return 1;
+    }
+
+    // split the stream into frames, like the demuxer would
+    std::vector<std::vector<uint8_t>> frames;
+    AVCodecParserContext *parser = av_parser_init(codec);
+    AVCodecContext *avctx = avcodec_alloc_context3(nullptr);
+    for (size_t pos = 0; pos <= es.size();)
+    {
+        uint8_t *pOut = nullptr;
+        int nOut = 0;
+        const int nIn = (int)(es.size() - pos);
+        int used = av_parser_parse2(parser, avctx, &pOut, &nOut, nIn ? es.data() + pos : nullptr, nIn, AV_NOPTS_VALUE,
+                                    AV_NOPTS_VALUE, 0);
+        if (nOut > 0)
+        {
+            frames.emplace_back(pOut, pOut + nOut);
+        }
+        if (nIn == 0)
+            break;
+        pos += used;
+    }
+    av_parser_close(parser);
+    avcodec_free_context(&avctx);
+
+    BurstSink sink;
+    uint8_t *buffer = (uint8_t *)av_malloc(LAV_BITSTREAM_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
+    AVIOContext *avio = avio_alloc_context(buffer, LAV_BITSTREAM_BUFFER_SIZE, 1, &sink, nullptr, write_burst, nullptr);
+
+    AVFormatContext *ctx = nullptr;
+    if (avformat_alloc_output_context2(&ctx, nullptr, "spdif", nullptr) < 0)
+    {
+        printf("No spdif muxer\n");
+        return 1;
+    }
+    ctx->pb = avio;
+    ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+    av_opt_set_int(ctx->priv_data, "dtshd_rate", nLinkRate == LAV_BITSTREAM_DTS_HD_MA_RATE ? nLinkRate : 0, 0);
+    av_opt_set_int(ctx->priv_data, "dtshd_fallback_time", -1, 0);
+
+    AVStream *st = avformat_new_stream(ctx, nullptr);
+    st->codecpar->codec_id = codec;
+    st->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+    st->codecpar->ch_layout.order = AV_CHANNEL_ORDER_UNSPEC;
+    st->codecpar->ch_layout.nb_channels = 2;
+    st->codecpar->sample_rate = 48000;
+    if (avformat_write_header(ctx, nullptr) < 0)
+    {
+        printf("Failed to start the spdif muxer\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> sample(LAV_BITSTREAM_BUFFER_SIZE * 2);
+    std::vector<int> bursts;
+    unsigned check = 0; // read back from the sample, so no copy can be optimized out
+    AVPacket *pkt = av_packet_alloc();
+
+    // mux and deliver
+    double start = now();
+    for (int pass = 0; pass < nPasses; pass++)
+    {
+        for (std::vector<uint8_t> &frame : frames)
+        {
+            pkt->data = frame.data();
+            pkt->size = (int)frame.size();
+            if (av_write_frame(ctx, pkt) < 0)
+            {
+                printf("av_write_frame failed\n");
+                return 1;
+            }
+
+            const uint8_t *pBurst = sink.pBurst ? sink.pBurst : sink.staging.data();
+            const int nBurstSize = sink.pBurst ? sink.nBurstSize : (int)sink.staging.size();
+            if (nBurstSize > 0)
+            {
+                memcpy(sample.data(), pBurst, nBurstSize);
+                check += sample[nBurstSize - 1];
+                bursts.push_back(nBurstSize);
+            }
+            sink.pBurst = nullptr;
+            sink.staging.clear();
+        }
+    }
+    const double total = now() - start;
+
+    // the AVIO copy and the delivery copy of the same bursts
+    std::vector<uint8_t> source(sample.size());
+    memset(source.data(), 0x55, source.size());
+    start = now();
+    for (int nBurstSize : bursts)
+    {
+        memcpy(buffer, source.data(), nBurstSize);
+        memcpy(sample.data(), buffer, nBurstSize);
+        check += sample[nBurstSize - 1];
+    }
+    const double copies = now() - start;
+
+    // the same copies from cold caches, each burst timed on its own
+    std::vector<uint8_t> flush(COLD_FLUSH_SIZE);
+    double cold = 0.0;
+    const size_t nColdBursts = bursts.size() < COLD_BURSTS ? bursts.size() : COLD_BURSTS;
+    for (size_t i = 0; i < nColdBursts; i++)
+    {
+        memset(flush.data(), (int)i, flush.size());
+        check += flush[i];
+
+        start = now();
+        memcpy(buffer, source.data(), bursts[i]);
+        memcpy(sample.data(), buffer, bursts[i]);
+        check += sample[bursts[i] - 1];
+        cold += now() - start;
+    }
+
+    av_write_trailer(ctx);
+    av_packet_free(&pkt);
+    avformat_free_context(ctx);
+    av_free(avio->buffer);
+    avio_context_free(&avio);
+
+    if (bursts.empty())
+    {
+        printf("No bursts were produced\n");
+        return 1;
+    }
+
+    double bytes = 0;
+    for (int nBurstSize : bursts)
+        bytes += nBurstSize;
+    const double duration = bytes / (nLinkRate * 4.0);
+    const double n = (double)bursts.size();
+
+    printf("%s: %zu frames x %d passes, %.0f bursts of %.0f bytes, %.1f s of audio\n", argv[1], frames.size(), nPasses,
+           n, bytes / n, duration);
+    printf("  mux + deliver:                %7.3f us per burst, %.4f%% of real time\n", total / n * 1e6,
+           total / duration * 100.0);
+    printf("  AVIO + delivery:              %7.3f us per burst, %.4f%% of real time, %.0f%% of the total\n",
+           copies / n * 1e6, copies / duration * 100.0, copies / total * 100.0);
+    printf("  AVIO + delivery, cold caches: %7.3f us per burst, %.4f%% of real time\n", cold / nColdBursts * 1e6,
+           cold / nColdBursts * n / duration * 100.0);
+    printf("  (checksum %u)\n", check);
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Speed of CChannelRemapPlan against the old ExtendedChannelMapping routine
+//
+//   channel_remap_bench [runs]
+//
+// Remaps 65536 frames per case and prints the best time of all runs, for the old routine and for the plan with
+// SSSE3 disabled and enabled. The plan is compiled once before timing, as the filter re-uses it for every buffer.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+}
+
+#include "ChannelRemapper.h"
+#include "channel_remap_ref.h"
+
+#define BENCH_SAMPLES 65536
+
+struct BenchCase
+{
+    const char *pszName;
+    RemapSampleFormat sfFormat;
+    unsigned uInChannels;
+    unsigned uOutChannels;
+    ExtendedChannelMap map;
+};
+
+// idx/factor per output channel, unused entries are silent
+static const BenchCase g_Cases[] = {
+    {"mono->stereo s16", RemapSample_16, 1, 2, {{0, -2}, {0, -2}}},
+    {"6.1->7.1 flt", RemapSample_FP32, 7, 8, {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0}, {6, -2}, {6, -2}}},
+    {"5.1 swap s32", RemapSample_32, 6, 6, {{0, 0}, {1, 0}, {3, 0}, {2, 0}, {4, 0}, {5, 0}}},
+    {"7.1 reorder s16", RemapSample_16, 8, 8, {{0, 0}, {1, 0}, {2, 0}, {3, 0}, {6, 0}, {7, 0}, {4, 0}, {5, 0}}},
+};
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best time in ms of all runs, with the plan or, without one, the old routine
+// An in place plan gets a fresh copy of the input before every run, outside of the timing
+static double bench(const BenchCase &c, const CChannelRemapPlan *pPlan, const std::vector<uint8_t> &in,
+                    std::vector<uint8_t> &out, int nRuns)
+{
+    double best = 1e9;
+    for (int i = 0; i < nRuns; i++)
+    {
+        const uint8_t *pIn = in.data();
+        if (pPlan && pPlan->IsInPlace())
+        {
+            memcpy(out.data(), in.data(), in.size());
+            pIn = out.data();
+        }
+
+        const double start = now_ms();
+        if (pPlan)
+            pPlan->Remap(pIn, out.data(), BENCH_SAMPLES);
+        else
+            ref_extended_channel_mapping(in.data(), out.data(), BENCH_SAMPLES, c.uInChannels, c.uOutChannels, c.map,
+                                         c.sfFormat);
+        const double t = now_ms() - start;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const int nRuns = argc > 1 ? atoi(argv[1]) : 50;
+    if (nRuns < 1)
+    {
+        printf("Usage: %s [runs]\n", argv[0]);
+        return 2;
+    }
+
+    const int cpuFlags = av_get_cpu_flags();
+    const int noSSSE3Flags =
+        cpuFlags & ~(AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 | AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2);
+    const bool bSSSE3 = (cpuFlags & AV_CPU_FLAG_SSSE3) != 0;
+
+    printf("%-18s %10s %18s %18s\n", "case", "old", "without SSSE3", "with SSSE3");
+    for (const BenchCase &c : g_Cases)
+    {
+        ExtendedChannelMap map;
+        ExtChMapClear(&map);
+        for (unsigned ch = 0; ch < c.uOutChannels; ch++)
+            ExtChMapSet(&map, ch, c.map[ch].idx, c.map[ch].factor);
+
+        const unsigned S = remap_sample_size(c.sfFormat);
+        std::vector<uint8_t> in((size_t)BENCH_SAMPLES * S * c.uInChannels);
+        for (size_t i = 0; i < in.size(); i++)
+            in[i] = (uint8_t)(i * 7);
+        std::vector<uint8_t> out((size_t)BENCH_SAMPLES * S * FFMAX(c.uInChannels, c.uOutChannels));
+
+        const double refTime = bench(c, nullptr, in, out, nRuns);
+
+        CChannelRemapPlan plan;
+        av_force_cpu_flags(noSSSE3Flags);
+        plan.Compile(c.uInChannels, c.uOutChannels, map, c.sfFormat);
+        const double scalarTime = bench(c, &plan, in, out, nRuns);
+        printf("%-18s %7.3f ms %7.3f ms %5.1fx", c.pszName, refTime, scalarTime, refTime / scalarTime);
+
+        av_force_cpu_flags(-1);
+        if (bSSSE3)
+        {
+            plan.Compile(c.uInChannels, c.uOutChannels, map, c.sfFormat);
+            const double shuffleTime = bench(c, &plan, in, out, nRuns);
+            printf(" %7.3f ms %5.1fx", shuffleTime, refTime / shuffleTime);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// ExtendedChannelMapping, as PostProcessor.cpp had it before CChannelRemapPlan, as reference for its tests and
+// benchmarks. Only the buffer handling is left out, it remaps from pIn to a separate pOut.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C"
+{
+#include "libavutil/common.h"
+}
+
+#include "ChannelRemapper.h"
+
+// PCM Volume Adjustment Factors, both for integer and float math
+// entries start at 2 channel mixing, half volume
+static int ref_volume_adjust_integer[7] = {362, 443, 512, 572, 627, 677, 724};
+
+static float ref_volume_adjust_float[7] = {1.41421356f, 1.73205081f, 2.00000000f, 2.23606798f,
+                                           2.44948974f, 2.64575131f, 2.82842712f};
+
+// SCALE_CA helper macro for SampleCopyAdjust
+#define REF_SCALE_CA(sample, iFactor, factor) \
+    {                                         \
+        if (iFactor > 0)                      \
+        {                                     \
+            sample *= factor;                 \
+            sample >>= 8;                     \
+        }                                     \
+        else                                  \
+        {                                     \
+            sample <<= 8;                     \
+            sample /= factor;                 \
+        }                                     \
+    }
+
+static inline void ref_sample_copy_adjust(uint8_t *pOut, const uint8_t *pIn, int iFactor,
+                                          RemapSampleFormat sfSampleFormat)
+{
+    assert(abs(iFactor) > 1 && abs(iFactor) <= 8);
+    const int factorIndex = abs(iFactor) - 2;
+
+    switch (sfSampleFormat)
+    {
+    case RemapSample_U8: {
+        uint8_t *pOutSample = pOut;
+        int32_t sample = *pIn + INT8_MIN;
+        REF_SCALE_CA(sample, iFactor, ref_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clip_uint8(sample - INT8_MIN);
+    }
+    break;
+    case RemapSample_16: {
+        int16_t *pOutSample = (int16_t *)pOut;
+        int32_t sample = *((int16_t *)pIn);
+        REF_SCALE_CA(sample, iFactor, ref_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clip_int16(sample);
+    }
+    break;
+    case RemapSample_24: {
+        int32_t sample = (pIn[0] << 8) + (pIn[1] << 16) + (pIn[2] << 24);
+        sample >>= 8;
+        REF_SCALE_CA(sample, iFactor, ref_volume_adjust_integer[factorIndex]);
+        sample = av_clip(sample, -8388607 - 1, 8388607);
+        pOut[0] = sample & 0xff;
+        pOut[1] = (sample >> 8) & 0xff;
+        pOut[2] = (sample >> 16) & 0xff;
+    }
+    break;
+    case RemapSample_32: {
+        int32_t *pOutSample = (int32_t *)pOut;
+        int64_t sample = *((int32_t *)pIn);
+        REF_SCALE_CA(sample, iFactor, ref_volume_adjust_integer[factorIndex]);
+        *pOutSample = av_clipl_int32(sample);
+    }
+    break;
+    case RemapSample_FP32: {
+        float *pOutSample = (float *)pOut;
+        float sample = *((float *)pIn);
+        if (iFactor > 0)
+        {
+            sample *= ref_volume_adjust_float[factorIndex];
+        }
+        else
+        {
+            sample /= ref_volume_adjust_float[factorIndex];
+        }
+        *pOutSample = av_clipf(sample, -1.0f, 1.0f);
+    }
+    break;
+    }
+}
+
+static inline void ref_silence(uint8_t *pBuffer, RemapSampleFormat sfSampleFormat)
+{
+    if (sfSampleFormat == RemapSample_U8)
+        *pBuffer = 128U;
+    else
+        memset(pBuffer, 0, remap_sample_size(sfSampleFormat));
+}
+
+static void ref_extended_channel_mapping(const uint8_t *pIn, uint8_t *pOut, size_t nSamples, unsigned uInChannels,
+                                         unsigned uOutChannels, const ExtendedChannelMap extMap,
+                                         RemapSampleFormat sfFormat)
+{
+    const unsigned uSampleSize = remap_sample_size(sfFormat);
+
+    for (size_t i = 0; i < nSamples; ++i)
+    {
+        for (unsigned ch = 0; ch < uOutChannels; ++ch)
+        {
+            if (extMap[ch].idx >= 0)
+            {
+                if (!extMap[ch].factor || abs(extMap[ch].factor) == 1)
+                    memcpy(pOut, pIn + (extMap[ch].idx * uSampleSize), uSampleSize);
+                else
+                    ref_sample_copy_adjust(pOut, pIn + (extMap[ch].idx * uSampleSize), extMap[ch].factor, sfFormat);
+            }
+            else
+                ref_silence(pOut, sfFormat);
+            pOut += uSampleSize;
+        }
+        pIn += uSampleSize * uInChannels;
+    }
+}
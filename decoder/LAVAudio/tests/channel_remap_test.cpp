@@ -0,0 +1,196 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Exactness test for CChannelRemapPlan
+//
+// Remaps random buffers with random maps and compares the result with the old ExtendedChannelMapping routine:
+// all sample formats, 1 to 10 input and 1 to 8 output channels, silent channels, repeated source channels and all
+// volume factors, with sample counts around the shuffle group sizes. Plans that work in place are run in place, as
+// the filter does. Everything runs with SSSE3 disabled and, if the CPU has it, enabled.
+//
+// The output has to be bit-identical, and nothing past the end of it may be written.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+}
+
+#include "ChannelRemapper.h"
+#include "channel_remap_ref.h"
+
+#define GUARD_SIZE 64
+#define RANDOM_CASES 20000
+
+static const RemapSampleFormat g_Formats[] = {RemapSample_U8, RemapSample_16, RemapSample_24, RemapSample_32,
+                                              RemapSample_FP32};
+static const char *g_FormatNames[] = {"u8", "s16", "s24", "s32", "flt"};
+
+static uint32_t g_Seed = 1;
+static uint32_t rand32()
+{
+    g_Seed = g_Seed * 1664525 + 1013904223;
+    return g_Seed >> 8;
+}
+
+// Random sample count, mostly small around the group sizes, sometimes a whole frame of audio
+static size_t rand_samples()
+{
+    switch (rand32() % 4)
+    {
+    case 0: return rand32() % 8;
+    case 1: return rand32() % 40;
+    case 2: return rand32() % 300;
+    }
+    return rand32() % 4000;
+}
+
+static bool test_case(RemapSampleFormat sfFormat, unsigned uInChannels, unsigned uOutChannels,
+                      const ExtendedChannelMap map, size_t nSamples)
+{
+    const unsigned S = remap_sample_size(sfFormat);
+    const size_t inSize = nSamples * S * uInChannels;
+    const size_t outSize = nSamples * S * uOutChannels;
+
+    std::vector<uint8_t> in(inSize);
+    for (uint8_t &b : in)
+        b = (uint8_t)rand32();
+
+    std::vector<uint8_t> ref(outSize);
+    ref_extended_channel_mapping(in.data(), ref.data(), nSamples, uInChannels, uOutChannels, map, sfFormat);
+
+    CChannelRemapPlan plan;
+    plan.Compile(uInChannels, uOutChannels, map, sfFormat);
+
+    // In place, the output buffer is the input buffer
+    // Empty vectors have no data pointer, so zero sizes skip the memcpy and memcmp
+    std::vector<uint8_t> out(FFMAX(inSize, outSize) + GUARD_SIZE, 0xcd);
+    if (plan.IsInPlace())
+    {
+        if (inSize)
+            memcpy(out.data(), in.data(), inSize);
+        plan.Remap(out.data(), out.data(), nSamples);
+    }
+    else
+        plan.Remap(in.data(), out.data(), nSamples);
+
+    char szName[128];
+    snprintf(szName, sizeof(szName), "%s %u->%u channels, %zu samples%s", g_FormatNames[sfFormat], uInChannels,
+             uOutChannels, nSamples, plan.IsInPlace() ? ", in place" : "");
+
+    if (outSize && memcmp(ref.data(), out.data(), outSize) != 0)
+    {
+        size_t i = 0;
+        while (ref[i] == out[i])
+            i++;
+        printf("%s: FAIL, differs at sample %zu channel %zu, map", szName, i / S / uOutChannels, i / S % uOutChannels);
+        for (unsigned ch = 0; ch < uOutChannels; ch++)
+            printf(" %d/%d", map[ch].idx, map[ch].factor);
+        printf("\n");
+        return false;
+    }
+
+    const size_t guardStart = plan.IsInPlace() ? inSize : outSize;
+    for (size_t i = guardStart; i < out.size(); i++)
+    {
+        if (out[i] != 0xcd)
+        {
+            printf("%s: FAIL, wrote past the end\n", szName);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The maps the filter uses: mono to stereo, 6.1 expanded to 7.1 and 5.1 with a back center split into two
+static int test_filter_maps()
+{
+    int nFailed = 0;
+    for (RemapSampleFormat sfFormat : g_Formats)
+    {
+        ExtendedChannelMap map;
+
+        ExtChMapClear(&map);
+        ExtChMapSet(&map, 0, 0, -2);
+        ExtChMapSet(&map, 1, 0, -2);
+        nFailed += !test_case(sfFormat, 1, 2, map, 1536);
+
+        ExtChMapClear(&map);
+        for (int ch = 0; ch < 6; ch++)
+            ExtChMapSet(&map, ch, ch, 0);
+        ExtChMapSet(&map, 6, 6, -2);
+        ExtChMapSet(&map, 7, 6, -2);
+        nFailed += !test_case(sfFormat, 7, 8, map, 1536);
+
+        ExtChMapClear(&map);
+        for (int ch = 0; ch < 4; ch++)
+            ExtChMapSet(&map, ch, ch, 0);
+        ExtChMapSet(&map, 4, 4, -2);
+        ExtChMapSet(&map, 5, 4, -2);
+        nFailed += !test_case(sfFormat, 5, 6, map, 1536);
+    }
+    return nFailed;
+}
+
+// Run all cases with the given CPU flags, returns the number of failures
+static int run_cases(const char *pszName, int cpuFlags)
+{
+    av_force_cpu_flags(cpuFlags);
+
+    int nFailed = test_filter_maps();
+    for (int n = 0; n < RANDOM_CASES; n++)
+    {
+        const RemapSampleFormat sfFormat = g_Formats[rand32() % FF_ARRAY_ELEMS(g_Formats)];
+        const unsigned uInChannels = 1 + rand32() % 10;
+        const unsigned uOutChannels = 1 + rand32() % 8;
+
+        // One in four channels silent, one in four with a factor
+        ExtendedChannelMap map;
+        ExtChMapClear(&map);
+        for (unsigned ch = 0; ch < uOutChannels; ch++)
+        {
+            const int idx = rand32() % 4 ? (int)(rand32() % uInChannels) : -1;
+            const int factor = rand32() % 4 ? 0 : (int)(rand32() % 17) - 8;
+            ExtChMapSet(&map, ch, idx, factor);
+        }
+        nFailed += !test_case(sfFormat, uInChannels, uOutChannels, map, rand_samples());
+    }
+
+    printf("%s: %d cases, %d failed\n", pszName, RANDOM_CASES + 3 * (int)FF_ARRAY_ELEMS(g_Formats), nFailed);
+    return nFailed;
+}
+
+int main()
+{
+    const int cpuFlags = av_get_cpu_flags();
+
+    int nFailed = run_cases("without SSSE3", cpuFlags & ~(AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 |
+                                                          AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2));
+    if (cpuFlags & AV_CPU_FLAG_SSSE3)
+        nFailed += run_cases("with SSSE3", cpuFlags);
+    else
+        printf("with SSSE3: skipped, the CPU has no SSSE3\n");
+    av_force_cpu_flags(-1);
+
+    return nFailed ? 1 : 0;
+}
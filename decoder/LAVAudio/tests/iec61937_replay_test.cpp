@@ -0,0 +1,129 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Replay test for CMATFramer
+//
+// Feeds raw TrueHD elementary streams through the framer and compares the MAT frames with stored IEC 61937 bursts.
+// The reference bursts were produced by the MAT framing in LAVAudio before it was moved into parser/iec61937.cpp, since
+// the ffmpeg spdif muxer distributes the padding differently and doesn't produce the same bursts.
+//
+// truehd_51     - 5.1 stream, continuous
+// truehd_20_gap - stereo stream with 8 access units cut out, resuming on a major sync, which exercises the
+//                 discontinuity handling
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "iec61937.h"
+#include "test_utils.h"
+
+class CollectOutput : public CMATFramer::Output
+{
+  public:
+    uint8_t *AllocFrame()
+    {
+        m_Frames.emplace_back(MAT_FRAME_SIZE);
+        return m_Frames.back().data();
+    }
+
+    void DeliverFrame(uint8_t *pFrame, int nSamplesOffset)
+    {
+        if (pFrame != m_Frames.back().data())
+            m_nErrors++;
+        m_Offsets.push_back(nSamplesOffset);
+    }
+
+    std::vector<std::vector<uint8_t>> m_Frames;
+    std::vector<int> m_Offsets;
+    int m_nErrors = 0;
+};
+
+static bool replay(const std::string &dataDir, const char *pszName)
+{
+    std::vector<uint8_t> es, ref;
+    const std::string base = dataDir + "/" + pszName;
+    if (!read_file((base + ".thd").c_str(), es) || !read_file((base + ".spdif").c_str(), ref))
+    {
+        printf("%s: FAIL, can't read the test data in %s\n", pszName, dataDir.c_str());
+        return false;
+    }
+
+    CollectOutput output;
+    CMATFramer framer(&output);
+
+    int nAccessUnits = 0;
+    for (size_t pos = 0; int size = truehd_next_frame(es, pos); pos += size)
+    {
+        int ret = framer.AddFrame(es.data() + pos, size);
+        if (ret < 0)
+        {
+            printf("%s: FAIL, AddFrame returned %d for access unit %d\n", pszName, ret, nAccessUnits);
+            return false;
+        }
+        nAccessUnits++;
+    }
+
+    // the last MAT frame is still under construction, and was allocated but not delivered
+    const size_t nDelivered = output.m_Offsets.size();
+    if (output.m_nErrors || nDelivered * MAT_FRAME_SIZE != ref.size())
+    {
+        printf("%s: FAIL, %zu MAT frames delivered, expected %zu\n", pszName, nDelivered, ref.size() / MAT_FRAME_SIZE);
+        return false;
+    }
+
+    for (size_t i = 0; i < nDelivered; i++)
+    {
+        const uint8_t *pRef = ref.data() + i * MAT_FRAME_SIZE;
+        const uint8_t *pOut = output.m_Frames[i].data();
+        if (memcmp(pOut, pRef, MAT_FRAME_SIZE) != 0)
+        {
+            int nByte = 0;
+            while (pOut[nByte] == pRef[nByte])
+                nByte++;
+            printf("%s: FAIL, MAT frame %zu differs at byte %d\n", pszName, i, nByte);
+            return false;
+        }
+        if (output.m_Offsets[i] != 0)
+        {
+            printf("%s: FAIL, MAT frame %zu has a sample offset of %d\n", pszName, i, output.m_Offsets[i]);
+            return false;
+        }
+    }
+
+    printf("%s: OK, %d access units, %zu MAT frames\n", pszName, nAccessUnits, nDelivered);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <data directory>\n", argv[0]);
+        return 2;
+    }
+
+    bool bOk = true;
+    bOk &= replay(argv[1], "truehd_51");
+    bOk &= replay(argv[1], "truehd_20_gap");
+
+    return bOk ? 0 : 1;
+}
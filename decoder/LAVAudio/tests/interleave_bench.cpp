@@ -0,0 +1,178 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Speed of the interleaving in Interleave.cpp against the loops DecodeReceive used before
+//
+//   interleave_bench [runs]
+//
+// Interleaves one second of 192 kHz audio per case and prints the best time of all runs, for the old loop and for
+// Interleave.cpp with AVX disabled and enabled. Only convert_dbl_to_flt has an AVX path, the other rows show the
+// spread between two runs of the same code.
+// The benchmark is built with -fno-tree-vectorize, so the old loops stay scalar like the MSVC build of them.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+}
+
+#include "Interleave.h"
+#include "interleave_ref.h"
+
+#define BENCH_SAMPLES 192000
+
+enum BenchKind
+{
+    BenchU8P,
+    BenchS16P,
+    BenchS32P,
+    BenchDBL,
+    BenchDBLP,
+};
+
+struct BenchCase
+{
+    const char *pszName;
+    BenchKind kind;
+    int nChannels;
+};
+
+static const BenchCase g_Cases[] = {
+    {"U8P", BenchU8P, 2},   {"U8P", BenchU8P, 6},   {"U8P", BenchU8P, 8},   {"S16P", BenchS16P, 2},
+    {"S16P", BenchS16P, 6}, {"S16P", BenchS16P, 8}, {"S32P", BenchS32P, 2}, {"S32P", BenchS32P, 3},
+    {"S32P", BenchS32P, 6}, {"S32P", BenchS32P, 8}, {"DBL", BenchDBL, 2},   {"DBL", BenchDBL, 6},
+    {"DBLP", BenchDBLP, 2}, {"DBLP", BenchDBLP, 6}, {"DBLP", BenchDBLP, 8},
+};
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run(const BenchCase &c, bool bReference, uint8_t *dst, const uint8_t *const *src)
+{
+    const size_t nCount = (size_t)BENCH_SAMPLES * c.nChannels;
+    switch (c.kind)
+    {
+    case BenchU8P:
+        if (bReference)
+            ref_interleave(dst, src, c.nChannels, BENCH_SAMPLES);
+        else
+            interleave_samples(dst, src, c.nChannels, BENCH_SAMPLES, 1);
+        break;
+    case BenchS16P:
+        if (bReference)
+            ref_interleave((int16_t *)dst, (const int16_t *const *)src, c.nChannels, BENCH_SAMPLES);
+        else
+            interleave_samples(dst, src, c.nChannels, BENCH_SAMPLES, 2);
+        break;
+    case BenchS32P:
+        if (bReference)
+            ref_interleave((int32_t *)dst, (const int32_t *const *)src, c.nChannels, BENCH_SAMPLES);
+        else
+            interleave_samples(dst, src, c.nChannels, BENCH_SAMPLES, 4);
+        break;
+    case BenchDBL:
+        if (bReference)
+            ref_convert_dbl_to_flt((float *)dst, (const double *)src[0], nCount);
+        else
+            convert_dbl_to_flt((float *)dst, (const double *)src[0], nCount);
+        break;
+    case BenchDBLP:
+        if (bReference)
+            ref_interleave_dbl((float *)dst, (const double *const *)src, c.nChannels, BENCH_SAMPLES);
+        else
+            interleave_samples_dbl((float *)dst, (const double *const *)src, c.nChannels, BENCH_SAMPLES);
+        break;
+    }
+}
+
+// Best time in ms of all runs
+static double bench(const BenchCase &c, bool bReference, uint8_t *dst, const uint8_t *const *src, int nRuns)
+{
+    double best = 1e9;
+    for (int i = 0; i < nRuns; i++)
+    {
+        const double start = now_ms();
+        run(c, bReference, dst, src);
+        const double t = now_ms() - start;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const int nRuns = argc > 1 ? atoi(argv[1]) : 20;
+    if (nRuns < 1)
+    {
+        printf("Usage: %s [runs]\n", argv[0]);
+        return 2;
+    }
+
+    const int cpuFlags = av_get_cpu_flags();
+    const bool bAVX = (cpuFlags & AV_CPU_FLAG_AVX) != 0;
+
+    printf("%-6s %3s %10s %18s %18s\n", "format", "ch", "old loop", "without AVX", "with AVX");
+    for (const BenchCase &c : g_Cases)
+    {
+        const int bytesPerSample = c.kind == BenchU8P ? 1 : c.kind == BenchS16P ? 2 : c.kind == BenchS32P ? 4 : 8;
+        const int nPlanes = c.kind == BenchDBL ? 1 : c.nChannels;
+        const size_t planeSize = (size_t)BENCH_SAMPLES * bytesPerSample * (c.kind == BenchDBL ? c.nChannels : 1);
+
+        // Small values, the doubles only need to be valid
+        std::vector<std::vector<uint8_t>> planes(nPlanes, std::vector<uint8_t>(planeSize));
+        std::vector<const uint8_t *> src;
+        for (auto &plane : planes)
+        {
+            if (bytesPerSample == 8)
+            {
+                for (size_t i = 0; i < planeSize / 8; i++)
+                    ((double *)plane.data())[i] = (double)(i % 1000) / 1000.0;
+            }
+            else
+            {
+                for (size_t i = 0; i < planeSize; i++)
+                    plane[i] = (uint8_t)i;
+            }
+            src.push_back(plane.data());
+        }
+        std::vector<uint8_t> dst((size_t)BENCH_SAMPLES * c.nChannels * (bytesPerSample == 8 ? 4 : bytesPerSample));
+
+        const double refTime = bench(c, true, dst.data(), src.data(), nRuns);
+        av_force_cpu_flags(cpuFlags & ~(AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2));
+        const double sseTime = bench(c, false, dst.data(), src.data(), nRuns);
+        av_force_cpu_flags(-1);
+        printf("%-6s %3d %7.3f ms %7.3f ms %5.1fx", c.pszName, c.nChannels, refTime, sseTime, refTime / sseTime);
+        if (bAVX)
+        {
+            const double avxTime = bench(c, false, dst.data(), src.data(), nRuns);
+            printf(" %7.3f ms %5.1fx", avxTime, refTime / avxTime);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
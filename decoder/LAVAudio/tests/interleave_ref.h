@@ -0,0 +1,53 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// The interleaving loops DecodeReceive used before Interleave.cpp, as reference for its tests and benchmarks
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T> static void ref_interleave(T *dst, const T *const *src, int nChannels, size_t nSamples)
+{
+    for (size_t i = 0; i < nSamples; ++i)
+    {
+        for (int ch = 0; ch < nChannels; ++ch)
+        {
+            *dst++ = src[ch][i];
+        }
+    }
+}
+
+static inline void ref_interleave_dbl(float *dst, const double *const *src, int nChannels, size_t nSamples)
+{
+    for (size_t i = 0; i < nSamples; ++i)
+    {
+        for (int ch = 0; ch < nChannels; ++ch)
+        {
+            *dst++ = (float)src[ch][i];
+        }
+    }
+}
+
+static inline void ref_convert_dbl_to_flt(float *dst, const double *src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = (float)src[i];
+}
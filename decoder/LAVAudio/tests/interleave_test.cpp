@@ -0,0 +1,238 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Exactness test for the interleaving in Interleave.cpp
+//
+// Compares interleave_samples, interleave_samples_dbl and convert_dbl_to_flt with the loops DecodeReceive used before,
+// for 1 to 8 channels, sample counts around the kernel widths and planes at unaligned offsets. The doubles include
+// random bit patterns, so NaN, infinity and denormals are converted as well. Everything runs with AVX disabled and,
+// if the CPU has it, enabled.
+//
+// The output has to be bit-identical, and nothing past the end of it may be written.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+}
+
+#include "Interleave.h"
+#include "interleave_ref.h"
+
+#define GUARD_SIZE 64
+#define RANDOM_CASES 2000
+
+static const size_t g_SampleCounts[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 255, 1536};
+
+static uint32_t g_Seed = 1;
+static uint32_t rand32()
+{
+    g_Seed = g_Seed * 1664525 + 1013904223;
+    return g_Seed;
+}
+
+static uint64_t rand64()
+{
+    return ((uint64_t)rand32() << 32) | rand32();
+}
+
+// Planes for nChannels channels of nSamples samples each, at random offsets that keep the natural alignment
+struct Planes
+{
+    Planes(int nChannels, size_t nSamples, int bytesPerSample)
+    {
+        for (int ch = 0; ch < nChannels; ch++)
+        {
+            const size_t offset = (rand32() % 16) * bytesPerSample;
+            buffers.emplace_back(offset + nSamples * bytesPerSample + 1);
+            ptrs.push_back(buffers.back().data() + offset);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<uint8_t *> ptrs;
+};
+
+// Doubles in the usual range, with every 16th value a random bit pattern
+static double rand_double()
+{
+    if (rand32() % 16 == 0)
+    {
+        const uint64_t bits = rand64();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    return ((int)(rand32() % 200001) - 100000) / 50000.0;
+}
+
+static void fill_planes(Planes &planes, size_t nSamples, int bytesPerSample, bool bDouble)
+{
+    for (uint8_t *p : planes.ptrs)
+    {
+        if (bDouble)
+        {
+            for (size_t i = 0; i < nSamples; i++)
+                ((double *)p)[i] = rand_double();
+        }
+        else
+        {
+            for (size_t i = 0; i < nSamples * bytesPerSample; i++)
+                p[i] = (uint8_t)rand32();
+        }
+    }
+}
+
+// Output buffer at a random offset, followed by guard bytes
+struct Output
+{
+    Output(size_t size)
+    {
+        offset = (rand32() % 16) * 4;
+        buffer.assign(offset + size + GUARD_SIZE, 0xcd);
+        ptr = buffer.data() + offset;
+        this->size = size;
+    }
+
+    bool GuardIntact() const
+    {
+        for (size_t i = offset + size; i < buffer.size(); i++)
+            if (buffer[i] != 0xcd)
+                return false;
+        return true;
+    }
+
+    std::vector<uint8_t> buffer;
+    size_t offset;
+    size_t size;
+    uint8_t *ptr;
+};
+
+enum TestKind
+{
+    Interleave8,
+    Interleave16,
+    Interleave32,
+    InterleaveDbl,
+    ConvertDbl,
+};
+
+static const char *g_KindNames[] = {"interleave u8", "interleave s16", "interleave s32", "interleave dbl",
+                                    "convert dbl"};
+
+static bool test_case(TestKind kind, int nChannels, size_t nSamples)
+{
+    const bool bDouble = kind == InterleaveDbl || kind == ConvertDbl;
+    const int bytesPerSample = kind == Interleave8 ? 1 : kind == Interleave16 ? 2 : bDouble ? 8 : 4;
+    const int outBytesPerSample = bDouble ? 4 : bytesPerSample;
+
+    // Packed doubles are one plane with all channels
+    Planes planes(kind == ConvertDbl ? 1 : nChannels, kind == ConvertDbl ? nSamples * nChannels : nSamples,
+                  bytesPerSample);
+    fill_planes(planes, kind == ConvertDbl ? nSamples * nChannels : nSamples, bytesPerSample, bDouble);
+
+    const size_t outSize = nSamples * nChannels * outBytesPerSample;
+    Output ref(outSize), out(outSize);
+    const uint8_t *const *src = planes.ptrs.data();
+
+    switch (kind)
+    {
+    case Interleave8:
+        ref_interleave(ref.ptr, src, nChannels, nSamples);
+        interleave_samples(out.ptr, src, nChannels, nSamples, 1);
+        break;
+    case Interleave16:
+        ref_interleave((int16_t *)ref.ptr, (const int16_t *const *)src, nChannels, nSamples);
+        interleave_samples(out.ptr, src, nChannels, nSamples, 2);
+        break;
+    case Interleave32:
+        ref_interleave((int32_t *)ref.ptr, (const int32_t *const *)src, nChannels, nSamples);
+        interleave_samples(out.ptr, src, nChannels, nSamples, 4);
+        break;
+    case InterleaveDbl:
+        ref_interleave_dbl((float *)ref.ptr, (const double *const *)src, nChannels, nSamples);
+        interleave_samples_dbl((float *)out.ptr, (const double *const *)src, nChannels, nSamples);
+        break;
+    case ConvertDbl:
+        ref_convert_dbl_to_flt((float *)ref.ptr, (const double *)src[0], nSamples * nChannels);
+        convert_dbl_to_flt((float *)out.ptr, (const double *)src[0], nSamples * nChannels);
+        break;
+    }
+
+    if (memcmp(ref.ptr, out.ptr, outSize) != 0)
+    {
+        size_t i = 0;
+        while (ref.ptr[i] == out.ptr[i])
+            i++;
+        printf("%s, %d channels, %zu samples: FAIL, differs at sample %zu\n", g_KindNames[kind], nChannels, nSamples,
+               i / outBytesPerSample / nChannels);
+        return false;
+    }
+    if (!out.GuardIntact())
+    {
+        printf("%s, %d channels, %zu samples: FAIL, wrote past the end\n", g_KindNames[kind], nChannels, nSamples);
+        return false;
+    }
+    return true;
+}
+
+// Run all cases with the given CPU flags, returns the number of failures
+static int run_cases(const char *pszName, int cpuFlags)
+{
+    av_force_cpu_flags(cpuFlags);
+
+    int nCases = 0, nFailed = 0;
+    for (int kind = Interleave8; kind <= ConvertDbl; kind++)
+    {
+        for (int nChannels = 1; nChannels <= 8; nChannels++)
+        {
+            for (size_t nSamples : g_SampleCounts)
+            {
+                nCases++;
+                nFailed += !test_case((TestKind)kind, nChannels, nSamples);
+            }
+            for (int n = 0; n < RANDOM_CASES / 8; n++)
+            {
+                nCases++;
+                nFailed += !test_case((TestKind)kind, nChannels, rand32() % 300);
+            }
+        }
+    }
+
+    printf("%s: %d cases, %d failed\n", pszName, nCases, nFailed);
+    return nFailed;
+}
+
+int main()
+{
+    const int cpuFlags = av_get_cpu_flags();
+
+    int nFailed = run_cases("without AVX", cpuFlags & ~(AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2));
+    if (cpuFlags & AV_CPU_FLAG_AVX)
+        nFailed += run_cases("with AVX", cpuFlags);
+    else
+        printf("with AVX: skipped, the CPU has no AVX\n");
+    av_force_cpu_flags(-1);
+
+    return nFailed ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// lavmat - pack a raw TrueHD elementary stream into IEC 61937 MAT bursts with CMATFramer
+//
+//   lavmat [-v] <input.thd> <output.spdif>
+//
+// The output is the sequence of bursts as LAVAudio sends them to the audio device, byte-swapped and without any
+// container. -v enables the verbose ffmpeg log, which shows the discontinuity handling of the framer.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/log.h"
+}
+
+#include "iec61937.h"
+#include "test_utils.h"
+
+class FileOutput : public CMATFramer::Output
+{
+  public:
+    uint8_t *AllocFrame() { return m_Frame; }
+
+    void DeliverFrame(uint8_t *pFrame, int nSamplesOffset)
+    {
+        m_Bursts.insert(m_Bursts.end(), pFrame, pFrame + MAT_FRAME_SIZE);
+        if (nSamplesOffset != 0)
+            printf("MAT frame %zu: sample offset %d\n", m_Bursts.size() / MAT_FRAME_SIZE - 1, nSamplesOffset);
+    }
+
+    uint8_t m_Frame[MAT_FRAME_SIZE];
+    std::vector<uint8_t> m_Bursts;
+};
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-v") == 0)
+    {
+        av_log_set_level(AV_LOG_VERBOSE);
+        arg++;
+    }
+    if (argc - arg != 2)
+    {
+        printf("Usage: %s [-v] <input.thd> <output.spdif>\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> es;
+    if (!read_file(argv[arg], es))
+    {
+        printf("Can't read %s\n", argv[arg]);
+        return 1;
+    }
+
+    FileOutput *pOutput = new FileOutput();
+    CMATFramer framer(pOutput);
+
+    int nAccessUnits = 0, nSkipped = 0;
+    size_t pos = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int size; (size = truehd_next_frame(es, pos)) != 0; pos += size)
+    {
+        int ret = framer.AddFrame(es.data() + pos, size);
+        if (ret < 0)
+        {
+            printf("Access unit %d at offset %zu is invalid (%d)\n", nAccessUnits, pos, ret);
+            delete pOutput;
+            return 1;
+        }
+        nSkipped += ret;
+        nAccessUnits++;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (pos != es.size())
+        printf("Ignored %zu bytes of trailing data\n", es.size() - pos);
+
+    FILE *f = fopen(argv[arg + 1], "wb");
+    if (f == nullptr || fwrite(pOutput->m_Bursts.data(), 1, pOutput->m_Bursts.size(), f) != pOutput->m_Bursts.size())
+    {
+        printf("Can't write %s\n", argv[arg + 1]);
+        if (f)
+            fclose(f);
+        delete pOutput;
+        return 1;
+    }
+    fclose(f);
+
+    // every access unit covers 1/1200 s, for all sample rates
+    printf("%d access units (%d skipped before the first major sync), %zu MAT frames\n", nAccessUnits, nSkipped,
+           pOutput->m_Bursts.size() / MAT_FRAME_SIZE);
+    printf("%.1f MB/s of output, %.0fx real time\n", pOutput->m_Bursts.size() / seconds / 1e6,
+           nAccessUnits / 1200.0 / seconds);
+
+    delete pOutput;
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Speed of CMatrixMixer against swr_convert
+//
+//   matrix_mixer_bench [runs]
+//
+// Mixes one second of 48 kHz audio in calls of 1536 samples (one AC3 frame), with swresample set up like PostProcessor
+// does and with the matrix mixer, and prints the best time of all runs.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/common.h"
+#include "libavutil/log.h"
+}
+
+#include "swr_mixer.h"
+
+#define BENCH_SAMPLES 48000
+#define BENCH_CALL_SIZE 1536
+
+struct BenchCase
+{
+    const char *pszName;
+    uint64_t inMask;
+    uint64_t outMask;
+    AVSampleFormat sfIn;
+    AVSampleFormat sfOut;
+};
+
+static const BenchCase g_Cases[] = {
+    {"5.1 -> 2.0  s16 -> flt", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLT},
+    {"5.1 -> 2.0  flt -> flt", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLT},
+    {"7.1 -> 2.0  s32 -> s16", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S16},
+    {"7.1 -> 5.1  flt -> flt", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_5POINT1, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLT},
+    {"2.0 -> 5.1  s16 -> s16", AV_CH_LAYOUT_STEREO, AV_CH_LAYOUT_5POINT1, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16},
+};
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best time in ms of all runs, mixing with swresample if swr is set, with the mixer otherwise
+static double bench(SwrContext *swr, CMatrixMixer &mixer, uint8_t *pOut, const uint8_t *pIn, size_t inFrameSize,
+                    size_t outFrameSize, int nRuns)
+{
+    double best = 1e9;
+    for (int run = 0; run < nRuns; run++)
+    {
+        const double start = now_ms();
+        for (size_t pos = 0; pos < BENCH_SAMPLES; pos += BENCH_CALL_SIZE)
+        {
+            const int n = (int)FFMIN((size_t)BENCH_CALL_SIZE, BENCH_SAMPLES - pos);
+            uint8_t *pCallOut = pOut + pos * outFrameSize;
+            const uint8_t *pCallIn = pIn + pos * inFrameSize;
+            if (swr)
+                swr_convert(swr, &pCallOut, n, &pCallIn, n);
+            else
+                mixer.Mix(pCallOut, pCallIn, n);
+        }
+        best = FFMIN(best, now_ms() - start);
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const int nRuns = argc > 1 ? atoi(argv[1]) : 20;
+    if (nRuns < 1)
+    {
+        printf("Usage: %s [runs]\n", argv[0]);
+        return 2;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    const MixSettings settings = {M_SQRT1_2, M_SQRT1_2, 0.0, false, false, AV_MATRIX_ENCODING_NONE};
+
+    printf("%-24s %12s %12s %8s\n", "layout / formats", "swresample", "native", "speedup");
+    for (const BenchCase &c : g_Cases)
+    {
+        AVChannelLayout inLayout, outLayout;
+        av_channel_layout_from_mask(&inLayout, c.inMask);
+        av_channel_layout_from_mask(&outLayout, c.outMask);
+
+        SwrContext *swr = swr_open_mixer(&inLayout, c.sfIn, &outLayout, c.sfOut, settings, nullptr);
+        CMatrixMixer *pMixer = new CMatrixMixer();
+        if (!swr || mixer_init(*pMixer, &inLayout, c.sfIn, &outLayout, c.sfOut, settings) < 0)
+        {
+            printf("%s: can't set up the mixers\n", c.pszName);
+            swr_free(&swr);
+            delete pMixer;
+            return 1;
+        }
+
+        const size_t inFrameSize = av_get_bytes_per_sample(c.sfIn) * inLayout.nb_channels;
+        const size_t outFrameSize = av_get_bytes_per_sample(c.sfOut) * outLayout.nb_channels;
+
+        // Quiet noise, so neither side spends time clipping
+        std::vector<uint8_t> in(BENCH_SAMPLES * inFrameSize), out(BENCH_SAMPLES * outFrameSize);
+        uint32_t seed = 1;
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            in[i] = (uint8_t)(seed >> 24);
+        }
+        if (c.sfIn == AV_SAMPLE_FMT_FLT)
+        {
+            float *pIn = (float *)in.data();
+            for (size_t i = 0; i < BENCH_SAMPLES * inLayout.nb_channels; i++)
+                pIn[i] = ((int)(i * 7919 % 2001) - 1000) / 4000.0f;
+        }
+
+        const double swrTime = bench(swr, *pMixer, out.data(), in.data(), inFrameSize, outFrameSize, nRuns);
+        const double nativeTime = bench(nullptr, *pMixer, out.data(), in.data(), inFrameSize, outFrameSize, nRuns);
+        printf("%-24s %9.3f ms %9.3f ms %7.1fx\n", c.pszName, swrTime, nativeTime, swrTime / nativeTime);
+
+        swr_free(&swr);
+        delete pMixer;
+    }
+
+    return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Exactness test for CMatrixMixer
+//
+// Mixes the same random signal with swr_convert, set up like PostProcessor does, and with CMatrixMixer, over several
+// layouts, sample formats, mix levels and matrix encodings, with and without normalization. The signal is fed in calls
+// of different sizes, below, at and above the mixer block size.
+//
+// Without clip protection, the output has to be bit-identical.
+//
+// Clip protection is an option of the LAV ffmpeg tree, the upstream swresample doesn't have it. The mixer output is
+// then checked against the swresample mix without it: every mixer block is scaled down by the highest peak seen so
+// far and clipped. Only float output can clip, integer output always uses a normalized matrix. If swresample accepts
+// the option, the mixer is also compared with it, in calls of one mixer block.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/common.h"
+#include "libavutil/log.h"
+}
+
+#include "swr_mixer.h"
+
+// Tolerance for the clip protection checks, the mixer lowers its float matrix in steps and rounds differently
+#define CLIP_TOLERANCE 1e-5f
+
+static const size_t g_CallSizes[] = {1, 255, 256, 257, 700, 3, 1000};
+
+struct LayoutPair
+{
+    const char *pszName;
+    uint64_t inMask;
+    uint64_t outMask;
+};
+
+static const LayoutPair g_Layouts[] = {
+    {"5.1->2.0", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO},
+    {"5.1(back)->2.0", AV_CH_LAYOUT_5POINT1_BACK, AV_CH_LAYOUT_STEREO},
+    {"7.1->2.0", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_STEREO},
+    {"7.1->5.1", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_5POINT1},
+    {"6.1->5.1", AV_CH_LAYOUT_6POINT1, AV_CH_LAYOUT_5POINT1},
+    {"5.1->1.0", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_MONO},
+    {"4.0->2.0", AV_CH_LAYOUT_QUAD, AV_CH_LAYOUT_STEREO},
+    {"2.1->2.0", AV_CH_LAYOUT_2POINT1, AV_CH_LAYOUT_STEREO},
+    {"2.0->5.1", AV_CH_LAYOUT_STEREO, AV_CH_LAYOUT_5POINT1},
+    {"1.0->2.0", AV_CH_LAYOUT_MONO, AV_CH_LAYOUT_STEREO},
+    {"3.0->7.1", AV_CH_LAYOUT_SURROUND, AV_CH_LAYOUT_7POINT1},
+};
+
+static const AVSampleFormat g_Formats[] = {AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_FLT};
+
+// Mix levels as PostProcessor computes them, the LFE level is divided by sqrt(0.5) unless mixing to mono
+static const double g_Levels[][3] = {
+    {M_SQRT1_2, M_SQRT1_2, 0.0},
+    {1.0, 1.0, 1.0 / M_SQRT1_2},
+    {0.5, 0.25, 0.75 / M_SQRT1_2},
+};
+
+static const AVMatrixEncoding g_Encodings[] = {AV_MATRIX_ENCODING_NONE, AV_MATRIX_ENCODING_DOLBY,
+                                               AV_MATRIX_ENCODING_DPLII};
+
+// Random samples at 90% of full scale
+static void fill_signal(std::vector<uint8_t> &buf, AVSampleFormat sf, size_t nCount, uint32_t seed)
+{
+    buf.resize(nCount * av_get_bytes_per_sample(sf));
+    for (size_t i = 0; i < nCount; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        const float x = ((int)(seed >> 16) - 32768) / 32768.0f * 0.9f;
+        switch (sf)
+        {
+        case AV_SAMPLE_FMT_S16: ((int16_t *)buf.data())[i] = (int16_t)lrintf(x * 32768.0f); break;
+        case AV_SAMPLE_FMT_S32: ((int32_t *)buf.data())[i] = (int32_t)llrint(x * 2147483648.0); break;
+        default: ((float *)buf.data())[i] = x; break;
+        }
+    }
+}
+
+// Mix the signal in calls of the given sizes
+static bool swr_mix(SwrContext *swr, std::vector<uint8_t> &out, const std::vector<uint8_t> &in, size_t inFrameSize,
+                    size_t outFrameSize, const size_t *pCallSizes, size_t nCalls)
+{
+    size_t pos = 0;
+    for (size_t c = 0; c < nCalls; c++)
+    {
+        uint8_t *pOut = out.data() + pos * outFrameSize;
+        const uint8_t *pIn = in.data() + pos * inFrameSize;
+        if (swr_convert(swr, &pOut, (int)pCallSizes[c], &pIn, (int)pCallSizes[c]) != (int)pCallSizes[c])
+            return false;
+        pos += pCallSizes[c];
+    }
+    return true;
+}
+
+static void mixer_mix(CMatrixMixer &mixer, std::vector<uint8_t> &out, const std::vector<uint8_t> &in,
+                      size_t inFrameSize, size_t outFrameSize, const size_t *pCallSizes, size_t nCalls)
+{
+    size_t pos = 0;
+    for (size_t c = 0; c < nCalls; c++)
+    {
+        mixer.Mix(out.data() + pos * outFrameSize, in.data() + pos * inFrameSize, pCallSizes[c]);
+        pos += pCallSizes[c];
+    }
+}
+
+// Expected clip protection result, from the float mix without it
+// Every block of every call is scaled by the highest peak seen up to and including that block, and clipped.
+static void clip_reference(std::vector<float> &out, const float *pMix, int nChannels, const size_t *pCallSizes,
+                           size_t nCalls)
+{
+    float fMaxPeak = 1.0f;
+    size_t pos = 0;
+    for (size_t c = 0; c < nCalls; c++)
+    {
+        for (size_t done = 0; done < pCallSizes[c]; done += MATRIX_MIXER_BLOCK)
+        {
+            const size_t first = (pos + done) * nChannels;
+            const size_t count = FFMIN(pCallSizes[c] - done, (size_t)MATRIX_MIXER_BLOCK) * nChannels;
+            for (size_t i = first; i < first + count; i++)
+                fMaxPeak = FFMAX(fMaxPeak, fabsf(pMix[i]));
+            for (size_t i = first; i < first + count; i++)
+                out[i] = av_clipf(pMix[i] / fMaxPeak, -1.0f, 1.0f);
+        }
+        pos += pCallSizes[c];
+    }
+}
+
+// Offset of the first differing byte, or the buffer size if there is none
+static size_t first_difference(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    size_t i = 0;
+    while (i < a.size() && a[i] == b[i])
+        i++;
+    return i;
+}
+
+static float max_difference(const float *a, const float *b, size_t nCount)
+{
+    float fMax = 0.0f;
+    for (size_t i = 0; i < nCount; i++)
+        fMax = FFMAX(fMax, fabsf(a[i] - b[i]));
+    return fMax;
+}
+
+struct TestStats
+{
+    int nCases = 0;
+    int nFailed = 0;
+    int nExact = 0;
+    int nClipped = 0;
+    int nForkCompared = 0;
+    float fMaxClipDifference = 0.0f;
+    float fMaxForkDifference = 0.0f;
+};
+
+static bool test_case(const LayoutPair &layouts, AVSampleFormat sfIn, AVSampleFormat sfOut,
+                      const MixSettings &settings, TestStats &stats, uint32_t seed)
+{
+    AVChannelLayout inLayout, outLayout;
+    av_channel_layout_from_mask(&inLayout, layouts.inMask);
+    av_channel_layout_from_mask(&outLayout, layouts.outMask);
+
+    char szName[256];
+    snprintf(szName, sizeof(szName), "%s %s->%s levels %.3f/%.3f/%.3f%s%s encoding %d", layouts.pszName,
+             av_get_sample_fmt_name(sfIn), av_get_sample_fmt_name(sfOut), settings.dCenterMixLevel,
+             settings.dSurroundMixLevel, settings.dLFEMixLevel, settings.bNormalize ? " normalize" : "",
+             settings.bClipProtection ? " clip" : "", settings.matrixEncoding);
+
+    stats.nCases++;
+
+    // The reference is always mixed without clip protection
+    MixSettings refSettings = settings;
+    refSettings.bClipProtection = false;
+    SwrContext *swr = swr_open_mixer(&inLayout, sfIn, &outLayout, sfOut, refSettings, nullptr);
+    CMatrixMixer *pMixer = new CMatrixMixer();
+    if (!swr || mixer_init(*pMixer, &inLayout, sfIn, &outLayout, sfOut, settings) < 0)
+    {
+        printf("%s: FAIL, can't set up the mixers\n", szName);
+        swr_free(&swr);
+        delete pMixer;
+        stats.nFailed++;
+        return false;
+    }
+
+    const size_t nCalls = FF_ARRAY_ELEMS(g_CallSizes);
+    size_t nSamples = 0;
+    for (size_t c = 0; c < nCalls; c++)
+        nSamples += g_CallSizes[c];
+
+    const size_t inFrameSize = av_get_bytes_per_sample(sfIn) * inLayout.nb_channels;
+    const size_t outFrameSize = av_get_bytes_per_sample(sfOut) * outLayout.nb_channels;
+    const size_t nOutCount = nSamples * outLayout.nb_channels;
+
+    std::vector<uint8_t> in, ref(nSamples * outFrameSize), out(nSamples * outFrameSize);
+    fill_signal(in, sfIn, nSamples * inLayout.nb_channels, seed);
+
+    bool bOk = swr_mix(swr, ref, in, inFrameSize, outFrameSize, g_CallSizes, nCalls);
+    mixer_mix(*pMixer, out, in, inFrameSize, outFrameSize, g_CallSizes, nCalls);
+    swr_free(&swr);
+    delete pMixer;
+
+    if (!bOk)
+    {
+        printf("%s: FAIL, swr_convert didn't return all samples\n", szName);
+        stats.nFailed++;
+        return false;
+    }
+
+    // Only the float mix can go above full scale
+    bool bClipped = false;
+    if (settings.bClipProtection && !settings.bNormalize && sfOut == AV_SAMPLE_FMT_FLT)
+    {
+        const float *pRef = (const float *)ref.data();
+        for (size_t i = 0; i < nOutCount && !bClipped; i++)
+            bClipped = fabsf(pRef[i]) > 1.0f;
+    }
+
+    if (!bClipped)
+    {
+        const size_t i = first_difference(ref, out);
+        if (i < ref.size())
+        {
+            printf("%s: FAIL, differs from swresample at sample %zu\n", szName, i / outFrameSize);
+            stats.nFailed++;
+            return false;
+        }
+        stats.nExact++;
+    }
+    else
+    {
+        std::vector<float> expected(nOutCount);
+        clip_reference(expected, (const float *)ref.data(), outLayout.nb_channels, g_CallSizes, nCalls);
+        const float fDiff = max_difference(expected.data(), (const float *)out.data(), nOutCount);
+        stats.fMaxClipDifference = FFMAX(stats.fMaxClipDifference, fDiff);
+        stats.nClipped++;
+        if (fDiff > CLIP_TOLERANCE)
+        {
+            printf("%s: FAIL, clip protection differs by %g from the scaled swresample mix\n", szName, fDiff);
+            stats.nFailed++;
+            return false;
+        }
+    }
+
+    // Compare with the swresample clip protection, where available
+    bool bForkClipProtection = false;
+    swr = swr_open_mixer(&inLayout, sfIn, &outLayout, sfOut, settings, &bForkClipProtection);
+    if (swr && bForkClipProtection && bClipped)
+    {
+        std::vector<size_t> blockCalls(nSamples / MATRIX_MIXER_BLOCK, MATRIX_MIXER_BLOCK);
+        const size_t nBlockSamples = blockCalls.size() * MATRIX_MIXER_BLOCK;
+
+        pMixer = new CMatrixMixer();
+        mixer_init(*pMixer, &inLayout, sfIn, &outLayout, sfOut, settings);
+        bOk = swr_mix(swr, ref, in, inFrameSize, outFrameSize, blockCalls.data(), blockCalls.size());
+        mixer_mix(*pMixer, out, in, inFrameSize, outFrameSize, blockCalls.data(), blockCalls.size());
+        delete pMixer;
+
+        const float fDiff = max_difference((const float *)ref.data(), (const float *)out.data(),
+                                           nBlockSamples * outLayout.nb_channels);
+        stats.fMaxForkDifference = FFMAX(stats.fMaxForkDifference, fDiff);
+        stats.nForkCompared++;
+        if (!bOk || fDiff > CLIP_TOLERANCE)
+        {
+            printf("%s: FAIL, differs by %g from the swresample clip protection\n", szName, fDiff);
+            stats.nFailed++;
+            swr_free(&swr);
+            return false;
+        }
+    }
+    swr_free(&swr);
+
+    return true;
+}
+
+int main()
+{
+    av_log_set_level(AV_LOG_ERROR);
+
+    TestStats stats;
+    uint32_t seed = 1;
+    for (const LayoutPair &layouts : g_Layouts)
+        for (AVSampleFormat sfIn : g_Formats)
+            for (AVSampleFormat sfOut : g_Formats)
+                for (const double *levels : g_Levels)
+                    for (AVMatrixEncoding encoding : g_Encodings)
+                        for (int flags = 0; flags < 4; flags++)
+                        {
+                            const MixSettings settings = {levels[0], levels[1], levels[2], !!(flags & 1), !!(flags & 2),
+                                                          encoding};
+                            test_case(layouts, sfIn, sfOut, settings, stats, seed++);
+                        }
+
+    printf("%d cases: %d bit-identical, %d clipped within %g of the scaled mix (max %g)\n", stats.nCases, stats.nExact,
+           stats.nClipped, CLIP_TOLERANCE, stats.fMaxClipDifference);
+    if (stats.nForkCompared)
+        printf("%d clipped cases compared with the swresample clip protection (max difference %g)\n",
+               stats.nForkCompared, stats.fMaxForkDifference);
+    else
+        printf("swresample has no clip_protection option, compared against the scaled mix only\n");
+
+    if (stats.nFailed)
+    {
+        printf("%d cases FAILED\n", stats.nFailed);
+        return 1;
+    }
+    return 0;
+}
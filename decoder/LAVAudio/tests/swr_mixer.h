@@ -0,0 +1,79 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// swresample mixing reference for the matrix mixer tests and benchmarks
+
+extern "C"
+{
+#include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
+#include "libavutil/samplefmt.h"
+#include "libswresample/swresample.h"
+}
+
+#include "MatrixMixer.h"
+
+// Mixing settings, as PostProcessor passes them to swresample and CMatrixMixer
+struct MixSettings
+{
+    double dCenterMixLevel;
+    double dSurroundMixLevel;
+    double dLFEMixLevel;
+    bool bNormalize;
+    bool bClipProtection;
+    AVMatrixEncoding matrixEncoding;
+};
+
+// Open a swresample context for mixing, with the options PostProcessor sets
+// *pbClipProtection tells if swresample accepted the clip_protection option, which only the LAV ffmpeg tree has
+static inline SwrContext *swr_open_mixer(const AVChannelLayout *inLayout, AVSampleFormat sfIn,
+                                         const AVChannelLayout *outLayout, AVSampleFormat sfOut,
+                                         const MixSettings &settings, bool *pbClipProtection)
+{
+    SwrContext *swr = nullptr;
+    if (swr_alloc_set_opts2(&swr, outLayout, sfOut, 48000, inLayout, sfIn, 48000, 0, nullptr) < 0)
+        return nullptr;
+
+    av_opt_set_int(swr, "dither_method", SWR_DITHER_NONE, 0);
+    const int ret = av_opt_set_int(swr, "clip_protection", settings.bClipProtection, 0);
+    if (pbClipProtection)
+        *pbClipProtection = settings.bClipProtection && ret >= 0;
+    av_opt_set_int(swr, "internal_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
+
+    av_opt_set_double(swr, "center_mix_level", settings.dCenterMixLevel, 0);
+    av_opt_set_double(swr, "surround_mix_level", settings.dSurroundMixLevel, 0);
+    av_opt_set_double(swr, "lfe_mix_level", settings.dLFEMixLevel, 0);
+    av_opt_set_double(swr, "rematrix_maxval", settings.bNormalize ? 1.0 : 0.0, 0);
+    av_opt_set_int(swr, "matrix_encoding", settings.matrixEncoding, 0);
+
+    if (swr_init(swr) < 0)
+        swr_free(&swr);
+    return swr;
+}
+
+// Initialize the matrix mixer with the same settings
+static inline int mixer_init(CMatrixMixer &mixer, const AVChannelLayout *inLayout, AVSampleFormat sfIn,
+                             const AVChannelLayout *outLayout, AVSampleFormat sfOut, const MixSettings &settings)
+{
+    return mixer.Init(inLayout, sfIn, outLayout, sfOut, settings.dCenterMixLevel, settings.dSurroundMixLevel,
+                      settings.dLFEMixLevel, settings.bNormalize ? 1.0 : 0.0,
+                      !settings.bNormalize && settings.bClipProtection, settings.matrixEncoding);
+}
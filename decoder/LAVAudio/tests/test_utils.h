@@ -0,0 +1,58 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Helpers shared by the standalone tests, benchmarks and tools
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Read a whole file, returns false if it can't be opened
+static inline bool read_file(const char *pszFile, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(pszFile, "rb");
+    if (f == nullptr)
+        return false;
+
+    uint8_t buf[65536];
+    size_t n;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+
+    fclose(f);
+    return true;
+}
+
+// Split a raw TrueHD elementary stream into its access units
+// The access unit length is the low 12 bits of the first word, in 16-bit words.
+// Returns the size of the access unit at pos, or 0 at the end of the stream or on a broken length.
+static inline int truehd_next_frame(const std::vector<uint8_t> &es, size_t pos)
+{
+    if (pos + 4 > es.size())
+        return 0;
+
+    const int size = (((es[pos] << 8) | es[pos + 1]) & 0xfff) * 2;
+    if (size < 4 || pos + size > es.size())
+        return 0;
+
+    return size;
+}
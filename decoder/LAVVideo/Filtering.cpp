@@ -19,6 +19,10 @@
 
 #include "stdafx.h"
 #include "LAVVideo.h"
+#include <vector>
+
+// Number of input frames to remember the submission time of, for the latency measurement
+#define FILTER_MAX_INPUT_TIMES 16
 
 static void lav_free_lavframe(void *opaque, uint8_t *data)
 {
@@ -38,118 +42,275 @@ static void avfilter_free_lav_buffer(LAVFrame *pFrame)
     av_frame_free((AVFrame **)&pFrame->priv_data);
 }
 
-HRESULT CLAVVideo::Filter(LAVFrame *pFrame)
+static AVPixelFormat GetFilterPixFmt(LAVPixelFormat pixFmt)
+{
+    return (pixFmt == LAVPixFmt_YUV420) ? AV_PIX_FMT_YUV420P
+                                        : (pixFmt == LAVPixFmt_YUV422) ? AV_PIX_FMT_YUV422P : AV_PIX_FMT_NV12;
+}
+
+// Wall-clock time in 100ns units
+static REFERENCE_TIME GetFilterClock()
+{
+    static LARGE_INTEGER frequency = {0};
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return av_rescale(now.QuadPart, 10000000LL, frequency.QuadPart);
+}
+
+int CLAVVideo::GetFilterThreadCount()
+{
+    // The deinterlacer runs in between decoding calls, give it half of the threads the decoder is allowed to use
+    int threads = m_settings.NumThreads ? (int)m_settings.NumThreads : av_cpu_count();
+    return max(1, threads / 2);
+}
+
+HRESULT CLAVVideo::InitFilterGraph(LAVFrame *pFrame)
 {
     int ret = 0;
-    BOOL bFlush = pFrame->flags & LAV_FRAME_FLAG_FLUSH;
-    if (m_Decoder.IsInterlaced(FALSE) && m_settings.DeintMode != DeintMode_Disable &&
-        m_settings.SWDeintMode != SWDeintMode_None &&
-        ((bFlush && m_pFilterGraph) || pFrame->format == LAVPixFmt_YUV420 || pFrame->format == LAVPixFmt_YUV422 ||
-         pFrame->format == LAVPixFmt_NV12))
+    char args[512];
+    AVPixelFormat ff_pixfmt = GetFilterPixFmt(pFrame->format);
+
+    DbgLog((LOG_TRACE, 10, L":Filter()(init) Initializing software deinterlacing filter..."));
+    CloseFilterGraph();
+
+    m_filterPixFmt = pFrame->format;
+    m_filterWidth = pFrame->width;
+    m_filterHeight = pFrame->height;
+    m_filterDeintMode = m_settings.SWDeintMode;
+    m_filterDeintOutput = m_settings.SWDeintOutput;
+
+    const AVFilter *buffersrc = avfilter_get_by_name("buffer");
+    const AVFilter *buffersink = avfilter_get_by_name("buffersink");
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+
+    m_pFilterGraph = avfilter_graph_alloc();
+
+    av_opt_set(m_pFilterGraph, "thread_type", "slice", AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(m_pFilterGraph, "threads", GetFilterThreadCount(), AV_OPT_SEARCH_CHILDREN);
+
+    // 0/0 is not a valid value for avfilter, make sure it doesn't happen
+    AVRational aspect_ratio = pFrame->aspect_ratio;
+    if (aspect_ratio.num == 0 || aspect_ratio.den == 0)
+        aspect_ratio = {0, 1};
+
+    _snprintf_s(args, sizeof(args), "video_size=%dx%d:pix_fmt=%s:time_base=1/10000000:pixel_aspect=%d/%d",
+                pFrame->width, pFrame->height, av_get_pix_fmt_name(ff_pixfmt), aspect_ratio.num, aspect_ratio.den);
+    ret = avfilter_graph_create_filter(&m_pFilterBufferSrc, buffersrc, "in", args, nullptr, m_pFilterGraph);
+    if (ret < 0)
     {
-        AVPixelFormat ff_pixfmt = (pFrame->format == LAVPixFmt_YUV420)
-                                      ? AV_PIX_FMT_YUV420P
-                                      : (pFrame->format == LAVPixFmt_YUV422) ? AV_PIX_FMT_YUV422P : AV_PIX_FMT_NV12;
+        DbgLog((LOG_TRACE, 10, L"::Filter()(init) Creating the input buffer filter failed with code %d", ret));
+        goto fail;
+    }
+
+    _snprintf_s(args, sizeof(args), "pixel_formats=%s",
+                (ff_pixfmt == AV_PIX_FMT_NV12) ? "nv12,yuv420p" : av_get_pix_fmt_name(ff_pixfmt));
+    ret = avfilter_graph_create_filter(&m_pFilterBufferSink, buffersink, "out", args, nullptr, m_pFilterGraph);
+    if (ret < 0)
+    {
+        DbgLog((LOG_TRACE, 10, L"::Filter()(init) Creating the buffer sink filter failed with code %d", ret));
+        goto fail;
+    }
+
+    /* Endpoints for the filter graph. */
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_pFilterBufferSrc;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = m_pFilterBufferSink;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+
+    if (m_settings.SWDeintMode == SWDeintMode_YADIF)
+        _snprintf_s(args, sizeof(args), "yadif=mode=%s:parity=auto:deint=interlaced",
+                    (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "send_field" : "send_frame");
+    else if (m_settings.SWDeintMode == SWDeintMode_W3FDIF_Simple)
+        _snprintf_s(args, sizeof(args), "w3fdif=filter=simple:deint=interlaced:mode=%s:parity=auto",
+                    (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "field" : "frame");
+    else if (m_settings.SWDeintMode == SWDeintMode_W3FDIF_Complex)
+        _snprintf_s(args, sizeof(args), "w3fdif=filter=complex:deint=interlaced:mode=%s:parity=auto",
+                    (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "field" : "frame");
+    else if (m_settings.SWDeintMode == SWDeintMode_BWDIF)
+        _snprintf_s(args, sizeof(args), "bwdif=mode=%s:parity=auto:deint=interlaced",
+                    (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "send_field" : "send_frame");
+    else
+        ASSERT(0);
+
+    if ((ret = avfilter_graph_parse_ptr(m_pFilterGraph, args, &inputs, &outputs, nullptr)) < 0)
+    {
+        DbgLog((LOG_TRACE, 10, L"::Filter()(init) Parsing the graph failed with code %d", ret));
+        goto fail;
+    }
 
-        if (!bFlush && (!m_pFilterGraph || pFrame->format != m_filterPixFmt || pFrame->width != m_filterWidth ||
-                        pFrame->height != m_filterHeight))
+    if ((ret = avfilter_graph_config(m_pFilterGraph, nullptr)) < 0)
+    {
+        DbgLog((LOG_TRACE, 10, L"::Filter()(init) Configuring the graph failed with code %d", ret));
+        goto fail;
+    }
+
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+
+    DbgLog((LOG_TRACE, 10, L":Filter()(init) avfilter Initialization complete"));
+    return S_OK;
+
+fail:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    CloseFilterGraph();
+    return E_FAIL;
+}
+
+void CLAVVideo::CloseFilterGraph()
+{
+    if (m_pFilterGraph)
+        avfilter_graph_free(&m_pFilterGraph);
+    m_pFilterBufferSrc = nullptr;
+    m_pFilterBufferSink = nullptr;
+    m_FilterInputTimes.clear();
+}
+
+HRESULT CLAVVideo::DeliverFilteredFrames(const LAVFrame *pFrame)
+{
+    BOOL bFramePerField =
+        (m_filterDeintMode != SWDeintMode_None && m_filterDeintOutput == DeintOutput_FramePerField);
+
+    const AVRational time_base = m_pFilterBufferSink->inputs[0]->time_base;
+
+    // Pull all fields the filter has ready before delivering any of them, so the latency samples do not include
+    // the time spent waiting for the renderer
+    std::vector<AVFrame *> out_frames;
+    AVFrame *out_frame = av_frame_alloc();
+    while (out_frame && av_buffersink_get_frame(m_pFilterBufferSink, out_frame) >= 0)
+    {
+        const REFERENCE_TIME pts = av_rescale(out_frame->pts, time_base.num * 10000000LL, time_base.den);
+
+        // Measure the latency from the source frame of this field entering the filter until the field is done
+        // The source is the last frame that started at or before the field
+        while (m_FilterInputTimes.size() > 1 && m_FilterInputTimes[1].first <= pts)
+            m_FilterInputTimes.pop_front();
+        if (!m_FilterInputTimes.empty() && m_FilterInputTimes.front().first <= pts)
         {
-            DbgLog((LOG_TRACE, 10, L":Filter()(init) Initializing software deinterlacing filter..."));
-            if (m_pFilterGraph)
-            {
-                avfilter_graph_free(&m_pFilterGraph);
-                m_pFilterBufferSrc = nullptr;
-                m_pFilterBufferSink = nullptr;
-            }
+            CAutoLock lock(&m_csDeintLatency);
+            m_faDeintLatency.Sample(GetFilterClock() - m_FilterInputTimes.front().second);
+            m_nDeintLatencySamples++;
+        }
 
-            m_filterPixFmt = pFrame->format;
-            m_filterWidth = pFrame->width;
-            m_filterHeight = pFrame->height;
+        out_frames.push_back(out_frame);
+        out_frame = av_frame_alloc();
+    }
+    av_frame_free(&out_frame);
 
-            char args[512];
+    HRESULT hrDeliver = S_OK;
+    for (size_t n = 0; n < out_frames.size(); n++)
+    {
+        out_frame = out_frames[n];
 
-            const AVFilter *buffersrc = avfilter_get_by_name("buffer");
-            const AVFilter *buffersink = avfilter_get_by_name("buffersink");
-            AVFilterInOut *outputs = avfilter_inout_alloc();
-            AVFilterInOut *inputs = avfilter_inout_alloc();
+        // fields that are left after a failed delivery are dropped
+        if (FAILED(hrDeliver))
+        {
+            av_frame_free(&out_frame);
+            continue;
+        }
 
-            m_pFilterGraph = avfilter_graph_alloc();
+        LAVFrame *outFrame = nullptr;
+        AllocateFrame(&outFrame);
+
+        REFERENCE_TIME rtDuration = pFrame->rtStop - pFrame->rtStart;
+        if (bFramePerField)
+            rtDuration >>= 1;
+
+        // Copy most settings over
+        outFrame->format = (out_frame->format == AV_PIX_FMT_YUV420P)
+                               ? LAVPixFmt_YUV420
+                               : (out_frame->format == AV_PIX_FMT_YUV422P) ? LAVPixFmt_YUV422 : LAVPixFmt_NV12;
+        outFrame->sw_format = outFrame->format;
+        outFrame->bpp = pFrame->bpp;
+        outFrame->ext_format = pFrame->ext_format;
+        outFrame->avgFrameDuration = pFrame->avgFrameDuration;
+        outFrame->flags = pFrame->flags;
+
+        outFrame->width = out_frame->width;
+        outFrame->height = out_frame->height;
+        outFrame->aspect_ratio = out_frame->sample_aspect_ratio;
+        outFrame->tff = !!(out_frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST);
+
+        REFERENCE_TIME pts = av_rescale(out_frame->pts, time_base.num * 10000000LL, time_base.den);
+        outFrame->rtStart = pts;
+        outFrame->rtStop = pts + rtDuration;
+
+        if (bFramePerField)
+        {
+            if (outFrame->avgFrameDuration != AV_NOPTS_VALUE)
+                outFrame->avgFrameDuration /= 2;
+        }
 
-            av_opt_set(m_pFilterGraph, "thread_type", "slice", AV_OPT_SEARCH_CHILDREN);
-            av_opt_set_int(m_pFilterGraph, "threads", FFMAX(1, av_cpu_count() / 2), AV_OPT_SEARCH_CHILDREN);
+        // Hand the filter output over without copying, the frame keeps a reference to it until it is released
+        for (int i = 0; i < 4; i++)
+        {
+            outFrame->data[i] = out_frame->data[i];
+            outFrame->stride[i] = out_frame->linesize[i];
+        }
 
-            // 0/0 is not a valid value for avfilter, make sure it doesn't happen
-            AVRational aspect_ratio = pFrame->aspect_ratio;
-            if (aspect_ratio.num == 0 || aspect_ratio.den == 0)
-                aspect_ratio = {0, 1};
+        outFrame->destruct = avfilter_free_lav_buffer;
+        outFrame->priv_data = out_frame;
 
-            _snprintf_s(args, sizeof(args), "video_size=%dx%d:pix_fmt=%s:time_base=1/10000000:pixel_aspect=%d/%d",
-                        pFrame->width, pFrame->height, av_get_pix_fmt_name(ff_pixfmt), pFrame->aspect_ratio.num,
-                        pFrame->aspect_ratio.den);
-            ret = avfilter_graph_create_filter(&m_pFilterBufferSrc, buffersrc, "in", args, nullptr, m_pFilterGraph);
-            if (ret < 0)
-            {
-                DbgLog((LOG_TRACE, 10, L"::Filter()(init) Creating the input buffer filter failed with code %d", ret));
-                avfilter_graph_free(&m_pFilterGraph);
-                goto deliver;
-            }
+        hrDeliver = DeliverToRenderer(outFrame);
+    }
 
-            _snprintf_s(args, sizeof(args), "pixel_formats=%s",
-                        (ff_pixfmt == AV_PIX_FMT_NV12) ? "nv12,yuv420p" : av_get_pix_fmt_name(ff_pixfmt));
-            ret = avfilter_graph_create_filter(&m_pFilterBufferSink, buffersink, "out", args, nullptr, m_pFilterGraph);
-            if (ret < 0)
-            {
-                DbgLog((LOG_TRACE, 10, L"::Filter()(init) Creating the buffer sink filter failed with code %d", ret));
-                avfilter_free(m_pFilterBufferSrc);
-                m_pFilterBufferSrc = nullptr;
-                avfilter_graph_free(&m_pFilterGraph);
-                goto deliver;
-            }
+    return hrDeliver;
+}
 
-            /* Endpoints for the filter graph. */
-            outputs->name = av_strdup("in");
-            outputs->filter_ctx = m_pFilterBufferSrc;
-            outputs->pad_idx = 0;
-            outputs->next = nullptr;
-
-            inputs->name = av_strdup("out");
-            inputs->filter_ctx = m_pFilterBufferSink;
-            inputs->pad_idx = 0;
-            inputs->next = nullptr;
-
-            if (m_settings.SWDeintMode == SWDeintMode_YADIF)
-                _snprintf_s(args, sizeof(args), "yadif=mode=%s:parity=auto:deint=interlaced",
-                            (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "send_field" : "send_frame");
-            else if (m_settings.SWDeintMode == SWDeintMode_W3FDIF_Simple)
-                _snprintf_s(args, sizeof(args), "w3fdif=filter=simple:deint=interlaced:mode=%s:parity=auto",
-                            (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "field" : "frame");
-            else if (m_settings.SWDeintMode == SWDeintMode_W3FDIF_Complex)
-                _snprintf_s(args, sizeof(args), "w3fdif=filter=complex:deint=interlaced:mode=%s:parity=auto",
-                            (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "field" : "frame");
-            else if (m_settings.SWDeintMode == SWDeintMode_BWDIF)
-                _snprintf_s(args, sizeof(args), "bwdif=mode=%s:parity=auto:deint=interlaced",
-                            (m_settings.SWDeintOutput == DeintOutput_FramePerField) ? "send_field" : "send_frame");
-            else
-                ASSERT(0);
-
-            if ((ret = avfilter_graph_parse_ptr(m_pFilterGraph, args, &inputs, &outputs, nullptr)) < 0)
-            {
-                DbgLog((LOG_TRACE, 10, L"::Filter()(init) Parsing the graph failed with code %d", ret));
-                avfilter_graph_free(&m_pFilterGraph);
-                goto deliver;
-            }
+HRESULT CLAVVideo::DrainFilterGraph()
+{
+    HRESULT hr = S_OK;
 
-            if ((ret = avfilter_graph_config(m_pFilterGraph, nullptr)) < 0)
-            {
-                DbgLog((LOG_TRACE, 10, L"::Filter()(init) Configuring the graph failed with code %d", ret));
-                avfilter_graph_free(&m_pFilterGraph);
-                goto deliver;
-            }
+    // if height is not set, no frame was filtered and there is nothing to drain
+    if (m_pFilterGraph && m_FilterPrevFrame.height)
+    {
+        // Feeding a NULL frame signals EOF, which makes the filter output the fields it is still holding on to
+        if (av_buffersrc_write_frame(m_pFilterBufferSrc, nullptr) >= 0)
+            hr = DeliverFilteredFrames(&m_FilterPrevFrame);
+    }
+
+    // We EOF'ed the graph, need to close it
+    CloseFilterGraph();
+    return hr;
+}
+
+HRESULT CLAVVideo::Filter(LAVFrame *pFrame, BOOL bInterlaced, BOOL bRefcounted)
+{
+    int ret = 0;
+    BOOL bFlush = pFrame->flags & LAV_FRAME_FLAG_FLUSH;
+    if (bInterlaced && m_settings.DeintMode != DeintMode_Disable &&
+        m_settings.SWDeintMode != SWDeintMode_None &&
+        ((bFlush && m_pFilterGraph) || pFrame->format == LAVPixFmt_YUV420 || pFrame->format == LAVPixFmt_YUV422 ||
+         pFrame->format == LAVPixFmt_NV12))
+    {
+        // When flushing, drain the remaining fields out of the graph
+        if (bFlush)
+        {
+            ReleaseFrame(&pFrame);
+            DrainFilterGraph();
+            return S_OK;
+        }
 
-            DbgLog((LOG_TRACE, 10, L":Filter()(init) avfilter Initialization complete"));
+        // The graph stays alive for the whole stream. If the format or the settings change, the old graph is drained
+        // first, so the fields it still holds are output as well.
+        if (m_pFilterGraph && (pFrame->format != m_filterPixFmt || pFrame->width != m_filterWidth ||
+                               pFrame->height != m_filterHeight || m_settings.SWDeintMode != m_filterDeintMode ||
+                               m_settings.SWDeintOutput != m_filterDeintOutput))
+        {
+            DbgLog((LOG_TRACE, 10, L":Filter() Format changed, reconfiguring the software deinterlacing filter"));
+            DrainFilterGraph();
         }
 
-        if (!m_pFilterGraph)
+        if (!m_pFilterGraph && FAILED(InitFilterGraph(pFrame)))
             goto deliver;
 
         if (pFrame->direct)
@@ -162,136 +323,102 @@ HRESULT CLAVVideo::Filter(LAVFrame *pFrame)
             }
         }
 
-        AVFrame *in_frame = nullptr;
-        BOOL refcountedFrame = (m_Decoder.HasThreadSafeBuffers() == S_OK);
-        // When flushing, we feed a NULL frame
-        if (!bFlush)
+        AVFrame *in_frame = av_frame_alloc();
+
+        for (int i = 0; i < 4; i++)
         {
-            in_frame = av_frame_alloc();
+            in_frame->data[i] = pFrame->data[i];
+            in_frame->linesize[i] = (int)pFrame->stride[i];
+        }
 
-            for (int i = 0; i < 4; i++)
-            {
-                in_frame->data[i] = pFrame->data[i];
-                in_frame->linesize[i] = (int)pFrame->stride[i];
-            }
+        in_frame->width = pFrame->width;
+        in_frame->height = pFrame->height;
+        in_frame->format = GetFilterPixFmt(pFrame->format);
+        in_frame->pts = pFrame->rtStart;
+        in_frame->flags |= pFrame->interlaced ? AV_FRAME_FLAG_INTERLACED : 0;
+        in_frame->flags |= pFrame->tff ? AV_FRAME_FLAG_TOP_FIELD_FIRST : 0;
+        in_frame->sample_aspect_ratio = pFrame->aspect_ratio;
 
-            in_frame->width = pFrame->width;
-            in_frame->height = pFrame->height;
-            in_frame->format = ff_pixfmt;
-            in_frame->pts = pFrame->rtStart;
-            in_frame->flags |= pFrame->interlaced ? AV_FRAME_FLAG_INTERLACED : 0;
-            in_frame->flags |= pFrame->tff ? AV_FRAME_FLAG_TOP_FIELD_FIRST : 0;
-            in_frame->sample_aspect_ratio = pFrame->aspect_ratio;
+        // Refcounted frames are passed into the filter without a copy, and released once the filter is done with them
+        if (bRefcounted)
+        {
+            AVBufferRef *pFrameBuf = av_buffer_create(nullptr, 0, lav_free_lavframe, pFrame, 0);
+            const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)in_frame->format);
+            int planes = (in_frame->format == AV_PIX_FMT_NV12) ? 2 : desc->nb_components;
 
-            if (refcountedFrame)
+            for (int i = 0; i < planes; i++)
             {
-                AVBufferRef *pFrameBuf = av_buffer_create(nullptr, 0, lav_free_lavframe, pFrame, 0);
-                const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)in_frame->format);
-                int planes = (in_frame->format == AV_PIX_FMT_NV12) ? 2 : desc->nb_components;
-
-                for (int i = 0; i < planes; i++)
-                {
-                    int h_shift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
-                    int plane_size = (in_frame->height >> h_shift) * in_frame->linesize[i];
-
-                    AVBufferRef *planeRef = av_buffer_ref(pFrameBuf);
-                    in_frame->buf[i] = av_buffer_create(in_frame->data[i], plane_size, lav_unref_frame, planeRef,
-                                                        AV_BUFFER_FLAG_READONLY);
-                }
-                av_buffer_unref(&pFrameBuf);
-            }
+                int h_shift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+                int plane_size = (in_frame->height >> h_shift) * in_frame->linesize[i];
 
-            m_FilterPrevFrame = *pFrame;
-            memset(m_FilterPrevFrame.data, 0, sizeof(m_FilterPrevFrame.data));
-            m_FilterPrevFrame.destruct = nullptr;
+                AVBufferRef *planeRef = av_buffer_ref(pFrameBuf);
+                in_frame->buf[i] = av_buffer_create(in_frame->data[i], plane_size, lav_unref_frame, planeRef,
+                                                    AV_BUFFER_FLAG_READONLY);
+            }
+            av_buffer_unref(&pFrameBuf);
         }
-        else
+
+        m_FilterPrevFrame = *pFrame;
+        memset(m_FilterPrevFrame.data, 0, sizeof(m_FilterPrevFrame.data));
+        m_FilterPrevFrame.destruct = nullptr;
+
+        if (pFrame->rtStart != AV_NOPTS_VALUE)
         {
-            if (!m_FilterPrevFrame.height) // if height is not set, the frame is most likely not valid
-                return S_OK;
-            *pFrame = m_FilterPrevFrame;
+            if (m_FilterInputTimes.size() >= FILTER_MAX_INPUT_TIMES)
+                m_FilterInputTimes.pop_front();
+            m_FilterInputTimes.push_back(std::make_pair(pFrame->rtStart, GetFilterClock()));
         }
 
         if ((ret = av_buffersrc_write_frame(m_pFilterBufferSrc, in_frame)) < 0)
         {
+            DbgLog((LOG_TRACE, 10, L"::Filter() Feeding the frame into the graph failed with code %d", ret));
+            // Refcounted frames are owned by the input frame now, and released with it
             av_frame_free(&in_frame);
+            if (bRefcounted)
+                return S_FALSE;
             goto deliver;
         }
 
-        BOOL bFramePerField =
-            (m_settings.SWDeintMode != SWDeintMode_None && m_settings.SWDeintOutput == DeintOutput_FramePerField);
-
-        AVFrame *out_frame = av_frame_alloc();
-        HRESULT hrDeliver = S_OK;
-        while (SUCCEEDED(hrDeliver) && (av_buffersink_get_frame(m_pFilterBufferSink, out_frame) >= 0))
-        {
-            LAVFrame *outFrame = nullptr;
-            AllocateFrame(&outFrame);
-
-            REFERENCE_TIME rtDuration = pFrame->rtStop - pFrame->rtStart;
-            if (bFramePerField)
-                rtDuration >>= 1;
-
-            // Copy most settings over
-            outFrame->format = (out_frame->format == AV_PIX_FMT_YUV420P)
-                                   ? LAVPixFmt_YUV420
-                                   : (out_frame->format == AV_PIX_FMT_YUV422P) ? LAVPixFmt_YUV422 : LAVPixFmt_NV12;
-            outFrame->sw_format = outFrame->format;
-            outFrame->bpp = pFrame->bpp;
-            outFrame->ext_format = pFrame->ext_format;
-            outFrame->avgFrameDuration = pFrame->avgFrameDuration;
-            outFrame->flags = pFrame->flags;
-
-            outFrame->width = out_frame->width;
-            outFrame->height = out_frame->height;
-            outFrame->aspect_ratio = out_frame->sample_aspect_ratio;
-            outFrame->tff = !!(out_frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST);
-
-            REFERENCE_TIME pts = av_rescale(out_frame->pts, m_pFilterBufferSink->inputs[0]->time_base.num * 10000000LL,
-                                            m_pFilterBufferSink->inputs[0]->time_base.den);
-            outFrame->rtStart = pts;
-            outFrame->rtStop = pts + rtDuration;
-
-            if (bFramePerField)
-            {
-                if (outFrame->avgFrameDuration != AV_NOPTS_VALUE)
-                    outFrame->avgFrameDuration /= 2;
-            }
+        DeliverFilteredFrames(pFrame);
 
-            for (int i = 0; i < 4; i++)
-            {
-                outFrame->data[i] = out_frame->data[i];
-                outFrame->stride[i] = out_frame->linesize[i];
-            }
-
-            outFrame->destruct = avfilter_free_lav_buffer;
-            outFrame->priv_data = av_frame_alloc();
-            av_frame_move_ref((AVFrame *)outFrame->priv_data, out_frame);
-
-            hrDeliver = DeliverToRenderer(outFrame);
-        }
-        if (!refcountedFrame)
+        if (!bRefcounted)
             ReleaseFrame(&pFrame);
         av_frame_free(&in_frame);
-        av_frame_free(&out_frame);
-
-        // We EOF'ed the graph, need to close it
-        if (bFlush)
-        {
-            if (m_pFilterGraph)
-            {
-                avfilter_graph_free(&m_pFilterGraph);
-                m_pFilterBufferSrc = nullptr;
-                m_pFilterBufferSink = nullptr;
-            }
-        }
 
         return S_OK;
     }
     else
     {
+        // Deinterlacing was switched off, or the frame cannot be deinterlaced. Any fields still held by the graph
+        // are older than this frame, and have to be output first.
+        if (m_pFilterGraph)
+        {
+            DbgLog((LOG_TRACE, 10, L":Filter() Bypassing the software deinterlacing filter, draining it"));
+            DrainFilterGraph();
+        }
         m_filterPixFmt = LAVPixFmt_None;
     deliver:
         return DeliverToRenderer(pFrame);
     }
 }
+
+STDMETHODIMP CLAVVideo::GetSWDeintLatency(REFERENCE_TIME *prtAverage, REFERENCE_TIME *prtMaximum)
+{
+    CAutoLock lock(&m_csDeintLatency);
+
+    if (m_nDeintLatencySamples == 0)
+        return S_FALSE;
+
+    // The average covers the whole window, scale it if the window is not filled yet
+    if (prtAverage)
+    {
+        if (m_nDeintLatencySamples < SW_DEINT_LATENCY_SAMPLES)
+            *prtAverage = m_faDeintLatency.Average() * SW_DEINT_LATENCY_SAMPLES / m_nDeintLatencySamples;
+        else
+            *prtAverage = m_faDeintLatency.Average();
+    }
+    if (prtMaximum)
+        *prtMaximum = m_faDeintLatency.Maximum();
+
+    return S_OK;
+}
@@ -26,8 +26,9 @@
 #include <MMReg.h>
 #include "moreuuids.h"
 
-#include <time.h>
-#include "rand_sse.h"
+static_assert((int)PixConvOut_NB == (int)LAVOutPixFmt_NB && (int)PixConvOut_RGB48 == (int)LAVOutPixFmt_RGB48,
+              "PixConvOutFmt has to match LAVOutPixFmts");
+static_assert((int)PixConvDither_Random == (int)LAVDither_Random, "PixConvDitherMode has to match LAVDitherMode");
 
 /*
  * Availability of custom high-quality converters
@@ -123,25 +124,25 @@ static LAV_INOUT_PIXFMT_MAP lav_pixfmt_map[] = {
   { LAVPixFmt_D3D11, 16,    { PIXOUT_420_16, PIXOUT_420_10, PIXOUT_420_8, PIXOUT_422_16, PIXOUT_422_10, PIXOUT_422_8, PIXOUT_RGB_8, PIXOUT_RGB_16, PIXOUT_444_16, PIXOUT_444_10, PIXOUT_444_8 } },
 };
 
-LAVOutPixFmtDesc lav_pixfmt_desc[] = {
-  { MEDIASUBTYPE_YV12,  12, 1, 3, { 1, 2, 2 }, { 1, 2, 2 } },        // YV12
-  { MEDIASUBTYPE_NV12,  12, 1, 2, { 1, 2 }, { 1, 1 } },              // NV12
-  { MEDIASUBTYPE_YUY2,  16, 2, 0, { 1 }, { 1 } },                    // YUY2 (packed)
-  { MEDIASUBTYPE_UYVY,  16, 2, 0, { 1 }, { 1 } },                    // UYVY (packed)
-  { MEDIASUBTYPE_AYUV,  32, 4, 0, { 1 }, { 1 } },                    // AYUV (packed)
-  { MEDIASUBTYPE_P010,  24, 2, 2, { 1, 2 }, { 1, 1 } },              // P010
-  { MEDIASUBTYPE_P210,  32, 2, 2, { 1, 1 }, { 1, 1 } },              // P210
-  { MEDIASUBTYPE_Y410,  32, 4, 0, { 1 }, { 1 }  },                   // Y410 (packed)
-  { MEDIASUBTYPE_P016,  24, 2, 2, { 1, 2 }, { 1, 1 } },              // P016
-  { MEDIASUBTYPE_P216,  32, 2, 2, { 1, 1 }, { 1, 1 } },              // P216
-  { MEDIASUBTYPE_Y416,  64, 8, 0, { 1 }, { 1 } },                    // Y416 (packed)
-  { MEDIASUBTYPE_RGB32, 32, 4, 0, { 1 }, { 1 } },                    // RGB32
-  { MEDIASUBTYPE_RGB24, 24, 3, 0, { 1 }, { 1 } },                    // RGB24
-  { FOURCCMap('012v'),  24, 4, 0, { 1 }, { 1 } },                    // v210 (packed)
-  { FOURCCMap('014v'),  32, 4, 0, { 1 }, { 1 }  },                   // v410 (packed)
-  { MEDIASUBTYPE_YV16,  16, 1, 3, { 1, 1, 1 }, { 1, 2, 2 } },        // YV16
-  { MEDIASUBTYPE_YV24,  24, 1, 3, { 1, 1, 1 }, { 1, 1, 1 } },        // YV24
-  { FOURCCMap('0BGR'),  48, 6, 0, { 1 }, { 1 } },                    // RGB48
+static const GUID lav_pixfmt_subtype[] = {
+  MEDIASUBTYPE_YV12,  // YV12
+  MEDIASUBTYPE_NV12,  // NV12
+  MEDIASUBTYPE_YUY2,  // YUY2 (packed)
+  MEDIASUBTYPE_UYVY,  // UYVY (packed)
+  MEDIASUBTYPE_AYUV,  // AYUV (packed)
+  MEDIASUBTYPE_P010,  // P010
+  MEDIASUBTYPE_P210,  // P210
+  MEDIASUBTYPE_Y410,  // Y410 (packed)
+  MEDIASUBTYPE_P016,  // P016
+  MEDIASUBTYPE_P216,  // P216
+  MEDIASUBTYPE_Y416,  // Y416 (packed)
+  MEDIASUBTYPE_RGB32, // RGB32
+  MEDIASUBTYPE_RGB24, // RGB24
+  FOURCCMap('012v'),  // v210 (packed)
+  FOURCCMap('014v'),  // v410 (packed)
+  MEDIASUBTYPE_YV16,  // YV16
+  MEDIASUBTYPE_YV24,  // YV24
+  FOURCCMap('0BGR'),  // RGB48
 };
 // clang-format on
 
@@ -161,25 +162,20 @@ static LAV_INOUT_PIXFMT_MAP *lookupFormatMap(LAVPixelFormat informat, int bpp, B
 
 CLAVPixFmtConverter::CLAVPixFmtConverter()
 {
-    convert = &CLAVPixFmtConverter::convert_generic;
-    convert_direct = nullptr;
-
-    m_NumThreads = min(8, max(1, av_cpu_count() / 2));
-
+    m_pContext = pixconv_alloc(min(8, max(1, av_cpu_count() / 2)));
     ZeroMemory(&m_ColorProps, sizeof(m_ColorProps));
 }
 
 CLAVPixFmtConverter::~CLAVPixFmtConverter()
 {
-    DestroySWScale();
-    av_freep(&m_pAlignedBuffer);
+    pixconv_free(&m_pContext);
 }
 
 LAVOutPixFmts CLAVPixFmtConverter::GetOutputBySubtype(const GUID *guid)
 {
-    for (int i = 0; i < countof(lav_pixfmt_desc); ++i)
+    for (int i = 0; i < countof(lav_pixfmt_subtype); ++i)
     {
-        if (lav_pixfmt_desc[i].subtype == *guid)
+        if (lav_pixfmt_subtype[i] == *guid)
         {
             return (LAVOutPixFmts)i;
         }
@@ -239,7 +235,7 @@ void CLAVPixFmtConverter::GetMediaType(CMediaType *mt, int index, LONG biWidth,
 
     LAVOutPixFmts pixFmt = GetFilteredFormat(index);
 
-    GUID guid = lav_pixfmt_desc[pixFmt].subtype;
+    GUID guid = lav_pixfmt_subtype[pixFmt];
 
     mt->SetType(&MEDIATYPE_Video);
     mt->SetSubtype(&guid);
@@ -335,7 +331,7 @@ BOOL CLAVPixFmtConverter::IsAllowedSubtype(const GUID *guid)
 {
     for (int i = 0; i < GetFilteredFormatCount(); ++i)
     {
-        if (lav_pixfmt_desc[GetFilteredFormat(i)].subtype == *guid)
+        if (lav_pixfmt_subtype[GetFilteredFormat(i)] == *guid)
             return TRUE;
     }
 
@@ -344,415 +340,97 @@ BOOL CLAVPixFmtConverter::IsAllowedSubtype(const GUID *guid)
 
 void CLAVPixFmtConverter::SelectConvertFunction()
 {
-    m_RequiredAlignment = 16;
-    m_bRGBConverter = FALSE;
-    convert = nullptr;
+    if (m_pContext)
+        pixconv_set_formats(m_pContext, m_InputPixFmt, m_InBpp, (PixConvOutFmt)m_OutputPixFmt, av_get_cpu_flags());
+}
 
-    int cpu = av_get_cpu_flags();
-    if (m_OutputPixFmt == LAVOutPixFmt_v210 || m_OutputPixFmt == LAVOutPixFmt_v410)
-    {
-        // We assume that every filter that understands v210 will also properly handle it
-        m_RequiredAlignment = 0;
-    }
-    else if ((m_OutputPixFmt == LAVOutPixFmt_RGB32 &&
-              (m_InputPixFmt == LAVPixFmt_RGB32 || m_InputPixFmt == LAVPixFmt_ARGB32)) ||
-             (m_OutputPixFmt == LAVOutPixFmt_RGB24 && m_InputPixFmt == LAVPixFmt_RGB24) ||
-             (m_OutputPixFmt == LAVOutPixFmt_RGB48 && m_InputPixFmt == LAVPixFmt_RGB48) ||
-             (m_OutputPixFmt == LAVOutPixFmt_YUY2 && m_InputPixFmt == LAVPixFmt_YUY2) ||
-             (m_OutputPixFmt == LAVOutPixFmt_AYUV && m_InputPixFmt == LAVPixFmt_AYUV) ||
-             (m_OutputPixFmt == LAVOutPixFmt_Y410 && m_InputPixFmt == LAVPixFmt_Y410) ||
-             (m_OutputPixFmt == LAVOutPixFmt_Y416 && m_InputPixFmt == LAVPixFmt_Y416) ||
-             (m_OutputPixFmt == LAVOutPixFmt_NV12 && m_InputPixFmt == LAVPixFmt_NV12) ||
-             ((m_OutputPixFmt == LAVOutPixFmt_P010 || m_OutputPixFmt == LAVOutPixFmt_P016) &&
-              m_InputPixFmt == LAVPixFmt_P016))
-    {
-        if (cpu & AV_CPU_FLAG_SSE2)
-            convert = &CLAVPixFmtConverter::plane_copy_sse2;
-        else
-            convert = &CLAVPixFmtConverter::plane_copy;
-        m_RequiredAlignment = 0;
-    }
-    else if (m_InputPixFmt == LAVPixFmt_RGB48 && m_OutputPixFmt == LAVOutPixFmt_RGB32 && (cpu & AV_CPU_FLAG_SSSE3))
-    {
-        convert = &CLAVPixFmtConverter::convert_rgb48_rgb32_ssse3;
-    }
-    else if (cpu & AV_CPU_FLAG_SSE2)
+void CLAVPixFmtConverter::SetColorProps(DXVA2_ExtendedFormat props, int RGBOutputRange)
+{
+    if (props.value != m_ColorProps.value || m_RGBOutputRange != RGBOutputRange)
     {
-        if (m_OutputPixFmt == LAVOutPixFmt_AYUV && m_InputPixFmt == LAVPixFmt_YUV444bX)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv444_ayuv_dither_le;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_AYUV && m_InputPixFmt == LAVPixFmt_YUV444)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv444_ayuv;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_Y410 && m_InputPixFmt == LAVPixFmt_YUV444bX && m_InBpp <= 10)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv444_y410;
-        }
-        else if (((m_OutputPixFmt == LAVOutPixFmt_YV12 || m_OutputPixFmt == LAVOutPixFmt_NV12) &&
-                  m_InputPixFmt == LAVPixFmt_YUV420bX) ||
-                 (m_OutputPixFmt == LAVOutPixFmt_YV16 && m_InputPixFmt == LAVPixFmt_YUV422bX) ||
-                 (m_OutputPixFmt == LAVOutPixFmt_YV24 && m_InputPixFmt == LAVPixFmt_YUV444bX))
-        {
-            if (m_OutputPixFmt == LAVOutPixFmt_NV12)
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv_yv_nv12_dither_le<TRUE>;
-            }
-            else
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv_yv_nv12_dither_le<FALSE>;
-            }
-            m_RequiredAlignment = 32;
-        }
-        else if (((m_OutputPixFmt == LAVOutPixFmt_P010 || m_OutputPixFmt == LAVOutPixFmt_P016) &&
-                  m_InputPixFmt == LAVPixFmt_YUV420bX) ||
-                 ((m_OutputPixFmt == LAVOutPixFmt_P210 || m_OutputPixFmt == LAVOutPixFmt_P216) &&
-                  m_InputPixFmt == LAVPixFmt_YUV422bX))
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv420_px1x_le;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_NV12 && m_InputPixFmt == LAVPixFmt_YUV420)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv420_nv12;
-            m_RequiredAlignment = 32;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_YUY2 && m_InputPixFmt == LAVPixFmt_YUV422)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy<0>;
-            m_RequiredAlignment = 32;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_UYVY && m_InputPixFmt == LAVPixFmt_YUV422)
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy<1>;
-            m_RequiredAlignment = 32;
-        }
-        else if ((m_OutputPixFmt == LAVOutPixFmt_RGB32 || m_OutputPixFmt == LAVOutPixFmt_RGB24) &&
-                 (m_InputPixFmt == LAVPixFmt_YUV420 || m_InputPixFmt == LAVPixFmt_YUV420bX ||
-                  m_InputPixFmt == LAVPixFmt_YUV422 || m_InputPixFmt == LAVPixFmt_YUV422bX ||
-                  m_InputPixFmt == LAVPixFmt_YUV444 || m_InputPixFmt == LAVPixFmt_YUV444bX ||
-                  m_InputPixFmt == LAVPixFmt_NV12 || m_InputPixFmt == LAVPixFmt_P016))
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv_rgb;
-            if (m_OutputPixFmt == LAVOutPixFmt_RGB32)
-            {
-                m_RequiredAlignment = 4;
-            }
-            m_bRGBConverter = TRUE;
-        }
-        else if (m_OutputPixFmt == LAVOutPixFmt_YV12 && m_InputPixFmt == LAVPixFmt_NV12)
-        {
-            convert = &CLAVPixFmtConverter::convert_nv12_yv12;
-            m_RequiredAlignment = 32;
-        }
-        else if ((m_OutputPixFmt == LAVOutPixFmt_YUY2 || m_OutputPixFmt == LAVOutPixFmt_UYVY) &&
-                 (m_InputPixFmt == LAVPixFmt_YUV420 || m_InputPixFmt == LAVPixFmt_NV12 ||
-                  m_InputPixFmt == LAVPixFmt_YUV420bX) &&
-                 m_InBpp <= 14)
-        {
-            if (m_OutputPixFmt == LAVOutPixFmt_YUY2)
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv420_yuy2<0>;
-            }
-            else
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv420_yuy2<1>;
-            }
-            m_RequiredAlignment = 8; // Pixel alignment of 8 guarantees a byte alignment of 16
-        }
-        else if ((m_OutputPixFmt == LAVOutPixFmt_YUY2 || m_OutputPixFmt == LAVOutPixFmt_UYVY) &&
-                 m_InputPixFmt == LAVPixFmt_YUV422bX)
-        {
-            if (m_OutputPixFmt == LAVOutPixFmt_YUY2)
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy_dither_le<0>;
-            }
-            else
-            {
-                convert = &CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy_dither_le<1>;
-            }
-
-            m_RequiredAlignment = 8; // Pixel alignment of 8 guarantees a byte alignment of 16
-        }
-        else if ((m_OutputPixFmt == LAVOutPixFmt_YV12 && m_InputPixFmt == LAVPixFmt_YUV420) ||
-                 (m_OutputPixFmt == LAVOutPixFmt_YV16 && m_InputPixFmt == LAVPixFmt_YUV422) ||
-                 (m_OutputPixFmt == LAVOutPixFmt_YV24 && m_InputPixFmt == LAVPixFmt_YUV444))
-        {
-            convert = &CLAVPixFmtConverter::convert_yuv_yv;
-            m_RequiredAlignment = 0;
-        }
-        else if (m_InputPixFmt == LAVPixFmt_RGB48 &&
-                 (m_OutputPixFmt == LAVOutPixFmt_RGB24 || m_OutputPixFmt == LAVOutPixFmt_RGB32))
-        {
-            if (m_OutputPixFmt == LAVOutPixFmt_RGB32)
-                convert = &CLAVPixFmtConverter::convert_rgb48_rgb<1>;
-            else
-                convert = &CLAVPixFmtConverter::convert_rgb48_rgb<0>;
-        }
-        else if (m_InputPixFmt == LAVPixFmt_P016 && m_OutputPixFmt == LAVOutPixFmt_NV12)
-        {
-            convert = &CLAVPixFmtConverter::convert_p010_nv12_sse2;
-        }
-        else if (m_InputPixFmt == LAVPixFmt_Y216 &&
-                 (m_OutputPixFmt == LAVOutPixFmt_P210 || m_OutputPixFmt == LAVOutPixFmt_P216) &&
-                  (cpu & AV_CPU_FLAG_SSE4))
-        {
-            convert = &CLAVPixFmtConverter::convert_y210_p210_sse4;
-            m_RequiredAlignment = 4; // alignment of four pixel gives us a byte alignment of 16, the absolute minimum requirement
-        }
-        else if (m_InputPixFmt == LAVPixFmt_YUY2 && m_OutputPixFmt == LAVOutPixFmt_YV16)
+        m_ColorProps = props;
+        m_RGBOutputRange = RGBOutputRange;
+
+        if (m_pContext)
         {
-            convert = &CLAVPixFmtConverter::convert_yuy2_yv16_sse2;
+            PixConvColorProps colorProps = {};
+            colorProps.matrix = props.VideoTransferMatrix;
+            colorProps.fullRange = props.NominalRange == DXVA2_NominalRange_0_255;
+            colorProps.rgbOutputRange = RGBOutputRange;
+            pixconv_set_color_props(m_pContext, &colorProps);
         }
     }
+}
 
-    if (convert == nullptr)
-    {
-        convert = &CLAVPixFmtConverter::convert_generic;
-    }
-
-    SelectConvertFunctionDirect();
+void CLAVPixFmtConverter::UpdateDitherMode()
+{
+    pixconv_set_dither_mode(m_pContext, (PixConvDitherMode)m_pSettings->GetDitherMode());
 }
 
-void CLAVPixFmtConverter::SelectConvertFunctionDirect()
+BOOL CLAVPixFmtConverter::IsBandSupported()
 {
-    convert_direct = nullptr;
-    m_bDirectMode = FALSE;
+    if (!m_pContext)
+        return FALSE;
 
-    int cpu = av_get_cpu_flags();
-    if ((m_InputPixFmt == LAVPixFmt_NV12 && m_OutputPixFmt == LAVOutPixFmt_NV12) ||
-        (m_InputPixFmt == LAVPixFmt_P016 &&
-         (m_OutputPixFmt == LAVOutPixFmt_P010 || m_OutputPixFmt == LAVOutPixFmt_P016)))
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::plane_copy_direct_nv12_sse4;
-        else if (cpu & AV_CPU_FLAG_SSE2)
-            convert_direct = &CLAVPixFmtConverter::plane_copy_sse2;
-        else
-            convert_direct = &CLAVPixFmtConverter::plane_copy;
-    }
-    else if ((m_InputPixFmt == LAVPixFmt_YUY2 && m_OutputPixFmt == LAVOutPixFmt_YUY2) ||
-        (m_InputPixFmt == LAVPixFmt_AYUV && m_OutputPixFmt == LAVOutPixFmt_AYUV) ||
-        (m_InputPixFmt == LAVPixFmt_Y410 && m_OutputPixFmt == LAVOutPixFmt_Y410) ||
-        (m_InputPixFmt == LAVPixFmt_Y416 && m_OutputPixFmt == LAVOutPixFmt_Y416))
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::plane_copy_direct_sse4;
-        else if (cpu & AV_CPU_FLAG_SSE2)
-            convert_direct = &CLAVPixFmtConverter::plane_copy_sse2;
-        else
-            convert_direct = &CLAVPixFmtConverter::plane_copy;
-    }
-    else if (m_InputPixFmt == LAVPixFmt_P016 && m_OutputPixFmt == LAVOutPixFmt_NV12)
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::convert_p010_nv12_direct_sse4;
-        else if (cpu & AV_CPU_FLAG_SSE2)
-            convert_direct = &CLAVPixFmtConverter::convert_p010_nv12_sse2;
-    }
-    else if (m_InputPixFmt == LAVPixFmt_NV12 && m_OutputPixFmt == LAVOutPixFmt_YV12)
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::convert_nv12_yv12_direct_sse4;
-        else if (cpu & AV_CPU_FLAG_SSE2)
-            convert_direct = &CLAVPixFmtConverter::convert_nv12_yv12;
-    }
-    else if (m_InputPixFmt == LAVPixFmt_Y216 && (m_OutputPixFmt == LAVOutPixFmt_P210 || m_OutputPixFmt == LAVOutPixFmt_P216))
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::convert_y210_p210_direct_sse4;
-    }
-    else if (m_InputPixFmt == LAVPixFmt_YUY2 && m_OutputPixFmt == LAVOutPixFmt_YV16)
-    {
-        if (cpu & AV_CPU_FLAG_SSE4)
-            convert_direct = &CLAVPixFmtConverter::convert_yuy2_yv16_direct_sse4;
-        else if (cpu & AV_CPU_FLAG_SSE2)
-            convert_direct = &CLAVPixFmtConverter::convert_yuy2_yv16_sse2;
-    }
+    UpdateDitherMode();
+    return pixconv_is_band_supported(m_pContext);
+}
 
-    if (convert_direct != nullptr)
-        m_bDirectMode = TRUE;
+static HRESULT pixconv_hresult(int ret)
+{
+    if (ret == AVERROR(ENOMEM))
+        return E_OUTOFMEMORY;
+    return ret < 0 ? E_FAIL : S_OK;
 }
 
 HRESULT CLAVPixFmtConverter::Convert(const BYTE *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst, int width,
-                                     int height, ptrdiff_t dstStride, int planeHeight)
+                                     int height, ptrdiff_t dstStride, int planeHeight, const LAVFrameBand *pBand)
 {
-    uint8_t *out = dst;
-    ptrdiff_t outStride = dstStride, i;
-    planeHeight = max(height, planeHeight);
-    // Check if we have proper pixel alignment and the dst memory is actually aligned
-    if (m_RequiredAlignment && (FFALIGN(dstStride, m_RequiredAlignment) != dstStride || ((uintptr_t)dst % 16u)))
-    {
-        outStride = FFALIGN(dstStride, m_RequiredAlignment);
-        size_t requiredSize = (outStride * planeHeight * lav_pixfmt_desc[m_OutputPixFmt].bpp) >> 3;
-        if (requiredSize > m_nAlignedBufferSize || !m_pAlignedBuffer)
-        {
-            DbgLog((LOG_TRACE, 10,
-                    L"::Convert(): Conversion requires a bigger stride (need: %d, have: %d), allocating buffer...",
-                    outStride, dstStride));
-            av_freep(&m_pAlignedBuffer);
-            m_pAlignedBuffer = (uint8_t *)av_malloc(requiredSize + AV_INPUT_BUFFER_PADDING_SIZE);
-            if (!m_pAlignedBuffer)
-            {
-                return E_FAIL;
-            }
-            m_nAlignedBufferSize = requiredSize;
-        }
-        out = m_pAlignedBuffer;
-    }
-
-    uint8_t *dstArray[4] = {0};
-    ptrdiff_t dstStrideArray[4] = {0};
-    ptrdiff_t byteStride = outStride * lav_pixfmt_desc[m_OutputPixFmt].codedbytes;
+    if (!m_pContext)
+        return E_OUTOFMEMORY;
 
-    dstArray[0] = out;
-    dstStrideArray[0] = byteStride;
+    UpdateDitherMode();
 
-    for (i = 1; i < lav_pixfmt_desc[m_OutputPixFmt].planes; ++i)
+    PixConvBand band = {};
+    if (pBand)
     {
-        dstArray[i] = dstArray[i - 1] +
-                      dstStrideArray[i - 1] * (planeHeight / lav_pixfmt_desc[m_OutputPixFmt].planeHeight[i - 1]);
-        dstStrideArray[i] = byteStride / lav_pixfmt_desc[m_OutputPixFmt].planeWidth[i];
+        band.top = pBand->top;
+        band.height = pBand->height;
+        for (int i = 0; i < 4; i++)
+        {
+            band.data[i] = pBand->data[i];
+            band.stride[i] = pBand->stride[i];
+        }
     }
 
-    HRESULT hr = (this->*convert)(src, srcStride, dstArray, dstStrideArray, width, height, m_InputPixFmt, m_InBpp,
-                                  m_OutputPixFmt);
-    if (out != dst)
-    {
-        ChangeStride(out, outStride, dst, dstStride, width, height, planeHeight, m_OutputPixFmt);
-    }
-    return hr;
+    int ret = pixconv_convert(m_pContext, src, srcStride, dst, width, height, dstStride, planeHeight,
+                              pBand ? &band : nullptr);
+    return pixconv_hresult(ret);
 }
 
 BOOL CLAVPixFmtConverter::IsDirectModeSupported(uintptr_t dst, ptrdiff_t stride)
 {
-    const int stride_align = ((m_OutputPixFmt == LAVOutPixFmt_YV12 || m_OutputPixFmt == LAVOutPixFmt_YV16) ? 32 : 16);
-    if (FFALIGN(stride, stride_align) != stride || (dst % 16u))
-        return false;
-    return m_bDirectMode;
+    return m_pContext && pixconv_is_direct_supported(m_pContext, dst, stride);
 }
 
 HRESULT CLAVPixFmtConverter::ConvertDirect(LAVFrame *pFrame, uint8_t *dst, int width, int height, ptrdiff_t dstStride,
                                            int planeHeight)
 {
     HRESULT hr = S_OK;
-    planeHeight = max(height, planeHeight);
     ASSERT(pFrame->direct && pFrame->direct_lock && pFrame->direct_unlock);
 
+    if (!m_pContext)
+        return E_OUTOFMEMORY;
+
+    UpdateDitherMode();
+
     LAVDirectBuffer buffer{};
     if (pFrame->direct_lock(pFrame, &buffer))
     {
-        uint8_t *dstArray[4] = {0};
-        ptrdiff_t dstStrideArray[4] = {0};
-        ptrdiff_t byteStride = dstStride * lav_pixfmt_desc[m_OutputPixFmt].codedbytes;
-
-        dstArray[0] = dst;
-        dstStrideArray[0] = byteStride;
-
-        for (int i = 1; i < lav_pixfmt_desc[m_OutputPixFmt].planes; ++i)
-        {
-            dstArray[i] = dstArray[i - 1] +
-                          dstStrideArray[i - 1] * (planeHeight / lav_pixfmt_desc[m_OutputPixFmt].planeHeight[i - 1]);
-            dstStrideArray[i] = byteStride / lav_pixfmt_desc[m_OutputPixFmt].planeWidth[i];
-        }
-
-        hr = (this->*convert_direct)(buffer.data, buffer.stride, dstArray, dstStrideArray, width, height, m_InputPixFmt,
-                                     m_InBpp, m_OutputPixFmt);
+        hr = pixconv_hresult(pixconv_convert_direct(m_pContext, buffer.data, buffer.stride, dst, width, height,
+                                                    dstStride, planeHeight));
         pFrame->direct_unlock(pFrame);
     }
 
     return hr;
 }
-
-void CLAVPixFmtConverter::ChangeStride(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
-                                       int width, int height, int planeHeight, LAVOutPixFmts format)
-{
-    LAVOutPixFmtDesc desc = lav_pixfmt_desc[format];
-
-    int line = 0;
-
-    // Copy first plane
-    const size_t widthBytes = width * desc.codedbytes;
-    const ptrdiff_t srcStrideBytes = srcStride * desc.codedbytes;
-    const ptrdiff_t dstStrideBytes = dstStride * desc.codedbytes;
-    for (line = 0; line < height; ++line)
-    {
-        memcpy(dst, src, widthBytes);
-        src += srcStrideBytes;
-        dst += dstStrideBytes;
-    }
-    dst += (planeHeight - height) * dstStrideBytes;
-
-    for (int plane = 1; plane < desc.planes; ++plane)
-    {
-        const size_t planeWidth = widthBytes / desc.planeWidth[plane];
-        const int activePlaneHeight = height / desc.planeHeight[plane];
-        const int totalPlaneHeight = planeHeight / desc.planeHeight[plane];
-        const ptrdiff_t srcPlaneStride = srcStrideBytes / desc.planeWidth[plane];
-        const ptrdiff_t dstPlaneStride = dstStrideBytes / desc.planeWidth[plane];
-        for (line = 0; line < activePlaneHeight; ++line)
-        {
-            memcpy(dst, src, planeWidth);
-            src += srcPlaneStride;
-            dst += dstPlaneStride;
-        }
-        dst += (totalPlaneHeight - activePlaneHeight) * dstPlaneStride;
-    }
-}
-
-const uint16_t *CLAVPixFmtConverter::GetRandomDitherCoeffs(int height, int coeffs, int bits, int line)
-{
-    if (m_pSettings->GetDitherMode() != LAVDither_Random)
-        return nullptr;
-
-    int totalWidth = 8 * coeffs;
-    if (!m_pRandomDithers || totalWidth > m_ditherWidth || height > m_ditherHeight || bits != m_ditherBits)
-    {
-        if (m_pRandomDithers)
-            _aligned_free(m_pRandomDithers);
-        m_pRandomDithers = nullptr;
-        m_ditherWidth = totalWidth;
-        m_ditherHeight = height;
-        m_ditherBits = bits;
-        m_pRandomDithers = (uint16_t *)_aligned_malloc(m_ditherWidth * m_ditherHeight * 2, 16);
-        if (m_pRandomDithers == nullptr)
-            return nullptr;
-
-#ifdef DEBUG
-        LARGE_INTEGER frequency, start, end;
-        QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&start);
-        DbgLog((LOG_TRACE, 10, L"Creating dither matrix"));
-#endif
-
-        // Seed random number generator
-        time_t seed = time(nullptr);
-        seed >>= 1;
-        srand_sse((unsigned int)seed);
-
-        bits = (1 << bits);
-        for (int i = 0; i < m_ditherHeight; i++)
-        {
-            uint16_t *ditherline = m_pRandomDithers + (m_ditherWidth * i);
-            for (int j = 0; j < m_ditherWidth; j += 4)
-            {
-                int rnds[4];
-                rand_sse(rnds);
-                ditherline[j + 0] = rnds[0] % bits;
-                ditherline[j + 1] = rnds[1] % bits;
-                ditherline[j + 2] = rnds[2] % bits;
-                ditherline[j + 3] = rnds[3] % bits;
-            }
-        }
-#ifdef DEBUG
-        QueryPerformanceCounter(&end);
-        double diff = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
-        DbgLog((LOG_TRACE, 10, L"Finished creating dither matrix (took %2.3fms)", diff));
-#endif
-    }
-
-    if (line < 0 || line >= m_ditherHeight)
-        line = rand() % m_ditherHeight;
-
-    return &m_pRandomDithers[line * m_ditherWidth];
-}
@@ -47,8 +47,11 @@
 CLAVVideo::CLAVVideo(LPUNKNOWN pUnk, HRESULT *phr)
     : CTransformFilter(NAME("LAV Video Decoder"), 0, __uuidof(CLAVVideo))
     , m_Decoder(this)
+    , m_OutputQueue(this)
 {
     *phr = S_OK;
+    m_pFrameBufferPool = CreateLAVFrameBufferPool();
+
     m_pInput = new CVideoInputPin(TEXT("CVideoInputPin"), this, phr, L"Input");
     ASSERT(SUCCEEDED(*phr));
 
@@ -77,10 +80,7 @@ CLAVVideo::~CLAVVideo()
     ReleaseLastSequenceFrame();
     m_Decoder.Close();
 
-    if (m_pFilterGraph)
-        avfilter_graph_free(&m_pFilterGraph);
-    m_pFilterBufferSrc = nullptr;
-    m_pFilterBufferSink = nullptr;
+    CloseFilterGraph();
 
     if (m_SubtitleConsumer)
         m_SubtitleConsumer->DisconnectProvider();
@@ -88,6 +88,8 @@ CLAVVideo::~CLAVVideo()
 
     SAFE_DELETE(m_pSubtitleInput);
     SAFE_DELETE(m_pCCOutputPin);
+
+    CloseLAVFrameBufferPool(m_pFrameBufferPool);
 }
 
 HRESULT CLAVVideo::CreateTrayIcon()
@@ -174,6 +176,8 @@ HRESULT CLAVVideo::LoadDefaults()
     m_settings.bH264MVCOverride = TRUE;
     m_settings.bCCOutputPinEnabled = FALSE;
 
+    m_settings.OutputQueueDepth = 0;
+
     return S_OK;
 }
 
@@ -256,6 +260,10 @@ HRESULT CLAVVideo::ReadSettings(HKEY rootKey)
         bFlag = reg.ReadBOOL(L"MSWMV9DMO", hr);
         if (SUCCEEDED(hr))
             m_settings.bMSWMV9DMO = bFlag;
+
+        dwVal = reg.ReadDWORD(L"OutputQueueDepth", hr);
+        if (SUCCEEDED(hr))
+            m_settings.OutputQueueDepth = min(dwVal, (DWORD)OUTPUT_QUEUE_MAX_DEPTH);
     }
 
     CRegistry regF = CRegistry(rootKey, LAVC_VIDEO_REGISTRY_KEY_FORMATS, hr, TRUE);
@@ -423,6 +431,7 @@ HRESULT CLAVVideo::SaveSettings()
         reg.WriteDWORD(L"SWDeintMode", m_settings.SWDeintMode);
         reg.WriteDWORD(L"SWDeintOutput", m_settings.SWDeintOutput);
         reg.WriteDWORD(L"DitherMode", m_settings.DitherMode);
+        reg.WriteDWORD(L"OutputQueueDepth", m_settings.OutputQueueDepth);
 
         reg.DeleteKey(L"DeintAggressive");
         reg.DeleteKey(L"DeintForce");
@@ -706,10 +715,9 @@ HRESULT CLAVVideo::CreateDecoder(const CMediaType *pmt)
         m_LAVPinInfoValid = FALSE;
     }
 
-    // Clear old sidedata
-    memset(&m_SideData, 0, sizeof(m_SideData));
-
-    // Read and store stream-level sidedata
+    // Read stream-level sidedata, it replaces the sidedata of the previous decoder
+    AVMasteringDisplayMetadata mastering = {0};
+    AVContentLightMetadata contentLight = {0};
     IMediaSideData *pPinSideData = nullptr;
     MediaSideDataFFMpeg *pSideDataFFmpeg = nullptr;
     hr = FindPinIntefaceInGraph(m_pInput, __uuidof(IMediaSideData), (void **)&pPinSideData);
@@ -727,11 +735,11 @@ HRESULT CLAVVideo::CreateDecoder(const CMediaType *pmt)
                 if (sd->type == AV_PKT_DATA_MASTERING_DISPLAY_METADATA &&
                     sd->size == sizeof(AVMasteringDisplayMetadata))
                 {
-                    m_SideData.Mastering = *(AVMasteringDisplayMetadata *)sd->data;
+                    mastering = *(AVMasteringDisplayMetadata *)sd->data;
                 }
                 else if (sd->type == AV_PKT_DATA_CONTENT_LIGHT_LEVEL && sd->size == sizeof(AVContentLightMetadata))
                 {
-                    m_SideData.ContentLight = *(AVContentLightMetadata *)sd->data;
+                    contentLight = *(AVContentLightMetadata *)sd->data;
                 }
                 else if (sd->type == AV_PKT_DATA_X264_BUILD && sd->size == 4 && codec == AV_CODEC_ID_H264)
                 {
@@ -743,6 +751,13 @@ HRESULT CLAVVideo::CreateDecoder(const CMediaType *pmt)
         SafeRelease(&pPinSideData);
     }
 
+    // and store it, the output thread can be attaching it to frames at the same time
+    {
+        CAutoLock lock(&m_csSideData);
+        m_SideData.Mastering = mastering;
+        m_SideData.ContentLight = contentLight;
+    }
+
     m_dwDecodeFlags = 0;
 
     LPWSTR pszExtension = GetFileExtension();
@@ -894,6 +909,10 @@ HRESULT CLAVVideo::SetMediaType(PIN_DIRECTION dir, const CMediaType *pmt)
     else if (dir == PINDIR_OUTPUT)
     {
         m_PixFmtConverter.SetOutputPixFmt(m_PixFmtConverter.GetOutputBySubtype(pmt->Subtype()));
+
+        REFERENCE_TIME rtAvgTime = 0;
+        videoFormatTypeHandler(pmt->Format(), pmt->FormatType(), nullptr, &rtAvgTime, nullptr, nullptr);
+        m_rtOutputAvgTimePerFrame = rtAvgTime;
     }
     return __super::SetMediaType(dir, pmt);
 }
@@ -904,7 +923,8 @@ HRESULT CLAVVideo::EndOfStream()
     CAutoLock cAutoLock(&m_csReceive);
 
     m_Decoder.EndOfStream();
-    Filter(GetFlushFrame());
+    QueueOutput(GetFlushFrame(), TRUE);
+    m_OutputQueue.Drain();
 
     if (m_pCCOutputPin)
         m_pCCOutputPin->DeliverEndOfStream();
@@ -919,7 +939,8 @@ HRESULT CLAVVideo::EndOfSegment()
     CAutoLock cAutoLock(&m_csReceive);
 
     m_Decoder.EndOfStream();
-    Filter(GetFlushFrame());
+    QueueOutput(GetFlushFrame(), TRUE);
+    m_OutputQueue.Drain();
 
     // Forward the EndOfSegment call downstream
     if (m_pOutput != NULL && m_pOutput->IsConnected())
@@ -945,7 +966,12 @@ HRESULT CLAVVideo::BeginFlush()
     if (m_pCCOutputPin)
         m_pCCOutputPin->DeliverBeginFlush();
 
-    return __super::BeginFlush();
+    HRESULT hr = __super::BeginFlush();
+
+    // Drop the frames waiting for the output thread, the downstream flush released it if it was blocked
+    m_OutputQueue.BeginFlush();
+
+    return hr;
 }
 
 HRESULT CLAVVideo::EndFlush()
@@ -964,6 +990,9 @@ HRESULT CLAVVideo::EndFlush()
 
     if (m_pCCOutputPin)
         m_pCCOutputPin->DeliverEndFlush();
+
+    m_OutputQueue.EndFlush();
+    m_hrDeliver = S_OK;
     m_bFlushing = FALSE;
 
     return hr;
@@ -997,8 +1026,7 @@ HRESULT CLAVVideo::PerformFlush()
 
     m_bInDVDMenu = FALSE;
 
-    if (m_pFilterGraph)
-        avfilter_graph_free(&m_pFilterGraph);
+    CloseFilterGraph();
 
     m_rtPrevStart = m_rtPrevStop = 0;
     memset(&m_FilterPrevFrame, 0, sizeof(m_FilterPrevFrame));
@@ -1010,6 +1038,8 @@ HRESULT CLAVVideo::NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, doubl
 {
     DbgLog((LOG_TRACE, 1, L"::NewSegment - %I64d / %I64d", tStart, tStop));
 
+    // Frames still waiting for the output thread belong to the previous segment
+    m_OutputQueue.Drain();
     PerformFlush();
 
     if (m_pCCOutputPin)
@@ -1056,8 +1086,7 @@ HRESULT CLAVVideo::BreakConnect(PIN_DIRECTION dir)
     DbgLog((LOG_TRACE, 10, L"::BreakConnect"));
     if (dir == PINDIR_INPUT)
     {
-        if (m_pFilterGraph)
-            avfilter_graph_free(&m_pFilterGraph);
+        CloseFilterGraph();
 
         m_Decoder.Close();
         m_X264Build = -1;
@@ -1066,6 +1095,9 @@ HRESULT CLAVVideo::BreakConnect(PIN_DIRECTION dir)
     {
         m_Decoder.BreakConnect();
     }
+
+    // the next connection likely uses a different frame layout
+    TrimLAVFrameBufferPool(m_pFrameBufferPool);
     return __super::BreakConnect(dir);
 }
 
@@ -1200,11 +1232,30 @@ HRESULT CLAVVideo::StartStreaming()
         }
     }
 
+    // DVD playback stays on the streaming thread, still frames and subtitles depend on it
+    if (m_settings.OutputQueueDepth > 0 && !(m_dwDecodeFlags & LAV_VIDEO_DEC_FLAG_DVD))
+    {
+        m_hrDeliver = S_OK;
+        if (FAILED(m_OutputQueue.Start(m_settings.OutputQueueDepth)))
+            DbgLog((LOG_ERROR, 10, L"CLAVVideo::StartStreaming(): Starting the output thread failed"));
+    }
+
     return S_OK;
 }
 
+HRESULT CLAVVideo::StopStreaming()
+{
+    // Output pins are inactive at this point, so the output thread can no longer be blocked by a delivery
+    m_OutputQueue.Stop();
+
+    return __super::StopStreaming();
+}
+
 STDMETHODIMP CLAVVideo::Stop()
 {
+    // Release the streaming thread if its waiting for room in the output queue
+    m_OutputQueue.BeginFlush();
+
     // Get the receiver lock and prevent frame delivery
     {
         CAutoLock lck3(&m_csReceive);
@@ -1216,6 +1267,9 @@ STDMETHODIMP CLAVVideo::Stop()
 
     // unblock delivery again, if we continue receiving frames
     m_bFlushing = FALSE;
+
+    // don't hold on to idle frame buffers while stopped
+    TrimLAVFrameBufferPool(m_pFrameBufferPool);
     return hr;
 }
 
@@ -1642,7 +1696,11 @@ HRESULT CLAVVideo::ReconnectOutput(int width, int height, AVRational ar, DXVA2_E
 
         hr = S_OK;
 
-        CheckDirectMode();
+        // The decoder is only accessed on the streaming thread, the output thread leaves the direct mode to it
+        if (m_OutputQueue.IsOutputThread())
+            m_bRecheckDirectMode = TRUE;
+        else
+            CheckDirectMode();
     }
 
     return hr;
@@ -1710,6 +1768,7 @@ HRESULT CLAVVideo::Receive(IMediaSample *pIn)
     AM_SAMPLE2_PROPERTIES const *pProps = m_pInput->SampleProps();
     if (pProps->dwStreamId != AM_STREAM_MEDIA)
     {
+        m_OutputQueue.Drain();
         return m_pOutput->Deliver(pIn);
     }
 
@@ -1722,6 +1781,8 @@ HRESULT CLAVVideo::Receive(IMediaSample *pIn)
         {
             DbgLog((LOG_TRACE, 10, L"::Receive(): Input sample contained media type, dynamic format change..."));
             m_Decoder.EndOfStream();
+            // All frames of the old format have to be delivered before the decoder is re-created
+            m_OutputQueue.Drain();
             hr = m_pInput->SetMediaType(&mt);
             if (FAILED(hr))
             {
@@ -1731,7 +1792,9 @@ HRESULT CLAVVideo::Receive(IMediaSample *pIn)
         }
     }
 
-    m_hrDeliver = S_OK;
+    // The output thread fails deliveries asynchronously, those failures are reported with the following sample
+    if (!m_OutputQueue.IsActive())
+        m_hrDeliver = S_OK;
 
     // Skip over empty packets
     if (pIn->GetActualDataLength() == 0)
@@ -1739,12 +1802,20 @@ HRESULT CLAVVideo::Receive(IMediaSample *pIn)
         return S_OK;
     }
 
+    // The output thread reconnected the output, update the direct mode once it is done with the old type
+    if (m_bRecheckDirectMode.exchange(FALSE))
+    {
+        m_OutputQueue.Drain();
+        CheckDirectMode();
+    }
+
     hr = m_Decoder.Decode(pIn);
     if (FAILED(hr))
         return hr;
 
-    if (FAILED(m_hrDeliver))
-        return m_hrDeliver;
+    HRESULT hrDeliver = InterlockedExchange(&m_hrDeliver, S_OK);
+    if (FAILED(hrDeliver))
+        return hrDeliver;
 
     return S_OK;
 }
@@ -1771,6 +1842,7 @@ STDMETHODIMP CLAVVideo::AllocateFrame(LAVFrame **ppFrame)
     (*ppFrame)->aspect_ratio = {0, 1};
 
     (*ppFrame)->frame_type = '?';
+    (*ppFrame)->pool = m_pFrameBufferPool;
 
     return S_OK;
 }
@@ -1864,7 +1936,7 @@ STDMETHODIMP CLAVVideo::Deliver(LAVFrame *pFrame)
     if (pFrame->flags & LAV_FRAME_FLAG_FLUSH)
     {
         DbgLog((LOG_TRACE, 10, L"Decoder triggered a flush..."));
-        Filter(GetFlushFrame());
+        QueueOutput(GetFlushFrame(), TRUE);
 
         ReleaseFrame(&pFrame);
         return S_FALSE;
@@ -1890,11 +1962,7 @@ STDMETHODIMP CLAVVideo::Deliver(LAVFrame *pFrame)
 
     if (pFrame->rtStop == AV_NOPTS_VALUE)
     {
-        REFERENCE_TIME duration = 0;
-
-        CMediaType &mt = m_pOutput->CurrentMediaType();
-        videoFormatTypeHandler(mt.Format(), mt.FormatType(), nullptr, &duration, nullptr, nullptr);
-
+        REFERENCE_TIME duration = m_rtOutputAvgTimePerFrame;
         REFERENCE_TIME decoderDuration = m_Decoder.GetFrameDuration();
         if (pFrame->avgFrameDuration && pFrame->avgFrameDuration != AV_NOPTS_VALUE)
         {
@@ -1939,15 +2007,42 @@ STDMETHODIMP CLAVVideo::Deliver(LAVFrame *pFrame)
         !(m_Decoder.IsInterlaced(FALSE) && m_settings.SWDeintMode != SWDeintMode_None) ||
         pFrame->flags & LAV_FRAME_FLAG_REDRAW)
     {
-        return DeliverToRenderer(pFrame);
+        return QueueOutput(pFrame, FALSE);
     }
     else
     {
-        Filter(pFrame);
+        QueueOutput(pFrame, TRUE);
     }
     return S_OK;
 }
 
+HRESULT CLAVVideo::QueueOutput(LAVFrame *pFrame, BOOL bFilter)
+{
+    BOOL bInterlaced = m_Decoder.IsInterlaced(FALSE);
+    BOOL bRefcounted = (m_Decoder.HasThreadSafeBuffers() == S_OK);
+
+    if (m_OutputQueue.IsActive())
+    {
+        // The output thread only gets frames which stay valid without the decoder, and don't need it for delivery.
+        // Hardware decoders are excluded as they can fall back to software and get replaced while decoding.
+        if (bRefcounted && !pFrame->direct && !m_Decoder.IsHWDecoderActive())
+            return m_OutputQueue.Queue(pFrame, bFilter, bInterlaced);
+
+        // Everything else is delivered right here, after the frames already queued
+        m_OutputQueue.Drain();
+    }
+
+    return ProcessOutput(pFrame, bFilter, bInterlaced, bRefcounted);
+}
+
+HRESULT CLAVVideo::ProcessOutput(LAVFrame *pFrame, BOOL bFilter, BOOL bInterlaced, BOOL bRefcounted)
+{
+    if (bFilter)
+        return Filter(pFrame, bInterlaced, bRefcounted);
+
+    return DeliverToRenderer(pFrame);
+}
+
 HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
 {
     HRESULT hr = S_OK;
@@ -2043,17 +2138,26 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
     }
 
     // Process stream-level sidedata and attach it to the frame if necessary
-    if (m_SideData.Mastering.has_colorspace)
+    // Work on a copy, since the streaming thread replaces the sidedata when it creates a new decoder
+    AVMasteringDisplayMetadata mastering;
+    AVContentLightMetadata contentLight;
     {
+        CAutoLock lock(&m_csSideData);
+
         // preserve HLG setting, as the container can often indicate the corresponding SDR format
-        if (pFrame->ext_format.VideoTransferFunction == MFVideoTransFunc_HLG)
+        if (m_SideData.Mastering.has_colorspace && pFrame->ext_format.VideoTransferFunction == MFVideoTransFunc_HLG)
             m_SideData.Mastering.color_trc = AVCOL_TRC_ARIB_STD_B67;
 
-        fillDXVAExtFormat(pFrame->ext_format, m_SideData.Mastering.color_range - 1,
-                          m_SideData.Mastering.color_primaries, m_SideData.Mastering.colorspace,
-                          m_SideData.Mastering.color_trc, m_SideData.Mastering.chroma_location, false);
+        mastering = m_SideData.Mastering;
+        contentLight = m_SideData.ContentLight;
     }
-    if (m_SideData.Mastering.has_luminance || m_SideData.Mastering.has_primaries)
+
+    if (mastering.has_colorspace)
+    {
+        fillDXVAExtFormat(pFrame->ext_format, mastering.color_range - 1, mastering.color_primaries,
+                          mastering.colorspace, mastering.color_trc, mastering.chroma_location, false);
+    }
+    if (mastering.has_luminance || mastering.has_primaries)
     {
         MediaSideDataHDR *hdr = nullptr;
 
@@ -2073,10 +2177,10 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
         if (hdr == nullptr)
             hdr = (MediaSideDataHDR *)AddLAVFrameSideData(pFrame, IID_MediaSideDataHDR, sizeof(MediaSideDataHDR));
 
-        processFFHDRData(hdr, &m_SideData.Mastering);
+        processFFHDRData(hdr, &mastering);
     }
 
-    if (m_SideData.ContentLight.MaxCLL && m_SideData.ContentLight.MaxFALL)
+    if (contentLight.MaxCLL && contentLight.MaxFALL)
     {
         MediaSideDataHDRContentLightLevel *hdr = nullptr;
 
@@ -2097,8 +2201,8 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
             hdr = (MediaSideDataHDRContentLightLevel *)AddLAVFrameSideData(
                 pFrame, IID_MediaSideDataHDRContentLightLevel, sizeof(MediaSideDataHDRContentLightLevel));
 
-        hdr->MaxCLL = m_SideData.ContentLight.MaxCLL;
-        hdr->MaxFALL = m_SideData.ContentLight.MaxFALL;
+        hdr->MaxCLL = contentLight.MaxCLL;
+        hdr->MaxFALL = contentLight.MaxFALL;
     }
 
     // Collect width/height
@@ -2145,6 +2249,8 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
                     m_PixFmtConverter.GetOutputPixFmt() == LAVOutPixFmt_RGB32);
     // And blend subtitles if we're on YUV output before blending (because the output YUV formats are more complicated
     // to handle)
+    // Read-only frames only get the lines touched by the subtitles copied into a band, if the converter supports it
+    LAVFrameBand subtitleBand = {0};
     if (m_SubtitleConsumer && m_SubtitleConsumer->HasProvider())
     {
         m_SubtitleConsumer->SetVideoSize(width, height);
@@ -2160,7 +2266,7 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
                     return hr;
                 }
             }
-            m_SubtitleConsumer->ProcessFrame(pFrame);
+            m_SubtitleConsumer->ProcessFrame(pFrame, m_PixFmtConverter.IsBandSupported() ? &subtitleBand : nullptr);
         }
     }
 
@@ -2263,11 +2369,19 @@ HRESULT CLAVVideo::DeliverToRenderer(LAVFrame *pFrame)
             DeDirectFrame(pFrame, true);
         }
 
+        // The converter can change when the output is reconnected, merge the subtitle band into the frame if the new
+        // one can't take it separately
+        if (subtitleBand.height > 0 && !m_PixFmtConverter.IsBandSupported())
+        {
+            MergeLAVFrameBand(pFrame, &subtitleBand);
+            subtitleBand.height = 0;
+        }
+
         if (pFrame->direct)
             m_PixFmtConverter.ConvertDirect(pFrame, pDataOut, width, height, pBIH->biWidth, abs(pBIH->biHeight));
         else
             m_PixFmtConverter.Convert(pFrame->data, pFrame->stride, pDataOut, width, height, pBIH->biWidth,
-                                      abs(pBIH->biHeight));
+                                      abs(pBIH->biHeight), &subtitleBand);
 
 #if defined(DEBUG) && DEBUG_PIXELCONV_TIMINGS
         QueryPerformanceCounter(&end);
@@ -2979,7 +3093,30 @@ STDMETHODIMP CLAVVideo::SetEnableCCOutputPin(BOOL bEnabled)
     return S_OK;
 }
 
+STDMETHODIMP CLAVVideo::SetOutputQueueDepth(DWORD dwDepth)
+{
+    if (dwDepth > OUTPUT_QUEUE_MAX_DEPTH)
+        return E_INVALIDARG;
+
+    m_settings.OutputQueueDepth = dwDepth;
+    return SaveSettings();
+}
+
+STDMETHODIMP_(DWORD) CLAVVideo::GetOutputQueueDepth()
+{
+    return m_settings.OutputQueueDepth;
+}
+
 STDMETHODIMP CLAVVideo::GetHWAccelActiveDevice(BSTR *pstrDeviceName)
 {
     return m_Decoder.GetHWAccelActiveDevice(pstrDeviceName);
 }
+
+STDMETHODIMP CLAVVideo::GetFrameBufferPoolStats(LONGLONG *pllHits, LONGLONG *pllMisses)
+{
+    CheckPointer(pllHits, E_POINTER);
+    CheckPointer(pllMisses, E_POINTER);
+
+    GetLAVFrameBufferPoolStats(m_pFrameBufferPool, pllHits, pllMisses);
+    return S_OK;
+}
@@ -34,10 +34,14 @@
 #include "subtitles/LAVVideoSubtitleInputPin.h"
 
 #include "CCOutputPin.h"
+#include "VideoOutputQueue.h"
 
 #include "BaseTrayIcon.h"
 #include "IMediaSideData.h"
 
+#include <atomic>
+#include <deque>
+
 extern "C"
 {
 #include "libavutil/mastering_display_metadata.h"
@@ -53,6 +57,9 @@ extern "C"
 #define DEBUG_FRAME_TIMINGS 0
 #define DEBUG_PIXELCONV_TIMINGS 0
 
+// Number of output fields the software deinterlacer latency is measured over
+#define SW_DEINT_LATENCY_SAMPLES 64
+
 typedef struct
 {
     REFERENCE_TIME rtStart;
@@ -149,9 +156,14 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
 
     STDMETHODIMP SetEnableCCOutputPin(BOOL bEnabled);
 
+    STDMETHODIMP SetOutputQueueDepth(DWORD dwDepth);
+    STDMETHODIMP_(DWORD) GetOutputQueueDepth();
+
     // ILAVVideoStatus
     STDMETHODIMP_(const WCHAR *) GetActiveDecoderName() { return m_Decoder.GetDecoderName(); }
     STDMETHODIMP GetHWAccelActiveDevice(BSTR *pstrDeviceName);
+    STDMETHODIMP GetSWDeintLatency(REFERENCE_TIME *prtAverage, REFERENCE_TIME *prtMaximum);
+    STDMETHODIMP GetFrameBufferPoolStats(LONGLONG *pllHits, LONGLONG *pllMisses);
 
     // CTransformFilter
     STDMETHODIMP Stop();
@@ -173,6 +185,7 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
     HRESULT CompleteConnect(PIN_DIRECTION dir, IPin *pReceivePin);
 
     HRESULT StartStreaming();
+    HRESULT StopStreaming();
 
     int GetPinCount();
     CBasePin *GetPin(int n);
@@ -261,7 +274,14 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
     HRESULT CheckDirectMode();
     HRESULT DeDirectFrame(LAVFrame *pFrame, bool bDisableDirectMode = true);
 
-    HRESULT Filter(LAVFrame *pFrame);
+    HRESULT QueueOutput(LAVFrame *pFrame, BOOL bFilter);
+    HRESULT ProcessOutput(LAVFrame *pFrame, BOOL bFilter, BOOL bInterlaced, BOOL bRefcounted);
+    HRESULT Filter(LAVFrame *pFrame, BOOL bInterlaced, BOOL bRefcounted);
+    HRESULT InitFilterGraph(LAVFrame *pFrame);
+    HRESULT DeliverFilteredFrames(const LAVFrame *pFrame);
+    HRESULT DrainFilterGraph();
+    void CloseFilterGraph();
+    int GetFilterThreadCount();
     HRESULT DeliverToRenderer(LAVFrame *pFrame);
 
     HRESULT PerformFlush();
@@ -281,13 +301,23 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
     friend class CDecodeManager;
     friend class CLAVSubtitleProvider;
     friend class CLAVSubtitleConsumer;
+    friend class CVideoOutputQueue;
 
     CDecodeManager m_Decoder;
+    CVideoOutputQueue m_OutputQueue;
+
+    // Buffers for the frames of this instance, kept alive by frames still in use after the filter is destroyed
+    CLAVFrameBufferPool *m_pFrameBufferPool = nullptr;
 
     REFERENCE_TIME m_rtPrevStart = 0;
     REFERENCE_TIME m_rtPrevStop = 0;
     REFERENCE_TIME m_rtAvgTimePerFrame = AV_NOPTS_VALUE;
 
+    // Frame duration of the output media type, which the output thread can change while decoding continues
+    std::atomic<REFERENCE_TIME> m_rtOutputAvgTimePerFrame{0};
+    // Set when the output thread reconnected the output, the streaming thread then updates the direct mode
+    std::atomic<BOOL> m_bRecheckDirectMode{FALSE};
+
     BOOL m_bForceInputAR = FALSE;
     BOOL m_bSendMediaType = FALSE;
     BOOL m_bFlushing = FALSE;
@@ -313,12 +343,23 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
     LAVPixelFormat m_filterPixFmt = LAVPixFmt_None;
     int m_filterWidth = 0;
     int m_filterHeight = 0;
+    DWORD m_filterDeintMode = SWDeintMode_None;
+    DWORD m_filterDeintOutput = DeintOutput_FramePerField;
     LAVFrame m_FilterPrevFrame;
 
+    // Start time and wall-clock time of the frames fed into the filter graph, to measure the latency of their fields
+    std::deque<std::pair<REFERENCE_TIME, REFERENCE_TIME>> m_FilterInputTimes;
+
+    CCritSec m_csDeintLatency;
+    FloatingAverage<REFERENCE_TIME> m_faDeintLatency{SW_DEINT_LATENCY_SAMPLES};
+    ULONGLONG m_nDeintLatencySamples = 0;
+
     BOOL m_LAVPinInfoValid = FALSE;
     LAVPinInfo m_LAVPinInfo;
     int m_X264Build = -1;
 
+    // Stream-level side data, written when the decoder is created and used by the output stage
+    CCritSec m_csSideData;
     struct
     {
         AVMasteringDisplayMetadata Mastering;
@@ -362,6 +403,7 @@ class __declspec(uuid("EE30215D-164F-4A92-A4EB-9D4C13390F9F")) CLAVVideo
         DWORD HWAccelDeviceD3D11Desc;
         BOOL bH264MVCOverride;
         BOOL bCCOutputPinEnabled;
+        DWORD OutputQueueDepth;
     } m_settings;
 
     DWORD m_dwGPUDeviceIndex = DWORD_MAX;
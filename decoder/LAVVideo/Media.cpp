@@ -1245,18 +1245,3 @@ int CheckForSequenceMarkers(AVCodecID codec, const uint8_t *buf, long len, uint3
   }
   return status;
 }
-
-int sws_scale2(struct SwsContext *c, const uint8_t *const srcSlice[], const ptrdiff_t srcStride[], int srcSliceY, int srcSliceH, uint8_t *const dst[], const ptrdiff_t dstStride[])
-{
-  if (!c)
-    return -1;
-
-  int srcStride2[4];
-  int dstStride2[4];
-
-  for (int i = 0; i < 4; i++) {
-    srcStride2[i] = (int)srcStride[i];
-    dstStride2[i] = (int)dstStride[i];
-  }
-  return sws_scale(c, srcSlice, srcStride2, srcSliceY, srcSliceH, dst, dstStride2);
-}
@@ -0,0 +1,163 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "VideoOutputQueue.h"
+#include "LAVVideo.h"
+
+CVideoOutputQueue::CVideoOutputQueue(CLAVVideo *pLAVVideo)
+    : m_pLAVVideo(pLAVVideo)
+{
+}
+
+CVideoOutputQueue::~CVideoOutputQueue()
+{
+    Stop();
+}
+
+HRESULT CVideoOutputQueue::Start(DWORD dwDepth)
+{
+    ASSERT(!ThreadExists());
+
+    {
+        CAutoLock lock(&m_csQueue);
+        m_nDepth = max(dwDepth, 1UL);
+        m_bFlushing = FALSE;
+        m_evSpace.Set();
+        m_evIdle.Set();
+    }
+
+    if (!Create())
+        return E_FAIL;
+
+    return S_OK;
+}
+
+void CVideoOutputQueue::Stop()
+{
+    if (!ThreadExists())
+        return;
+
+    BeginFlush();
+
+    CallWorker(CMD_EXIT);
+    Close();
+}
+
+HRESULT CVideoOutputQueue::Queue(LAVFrame *pFrame, BOOL bFilter, BOOL bInterlaced)
+{
+    CAutoLock lock(&m_csQueue);
+
+    while (!m_bFlushing && m_Queue.size() >= m_nDepth)
+    {
+        m_evSpace.Reset();
+        m_csQueue.Unlock();
+        m_evSpace.Wait();
+        m_csQueue.Lock();
+    }
+
+    if (m_bFlushing)
+    {
+        m_pLAVVideo->ReleaseFrame(&pFrame);
+        return S_FALSE;
+    }
+
+    m_Queue.push_back({pFrame, bFilter, bInterlaced});
+    m_evIdle.Reset();
+    m_evWork.Set();
+
+    return S_OK;
+}
+
+void CVideoOutputQueue::Drain()
+{
+    if (ThreadExists())
+        m_evIdle.Wait();
+}
+
+void CVideoOutputQueue::BeginFlush()
+{
+    {
+        CAutoLock lock(&m_csQueue);
+        m_bFlushing = TRUE;
+
+        for (OutputFrame &frame : m_Queue)
+            m_pLAVVideo->ReleaseFrame(&frame.pFrame);
+        m_Queue.clear();
+
+        // Wake up a blocked producer, it will drop its frame
+        m_evSpace.Set();
+        if (!m_bBusy)
+            m_evIdle.Set();
+    }
+
+    // The downstream flush has already released the worker if it was blocked in a delivery
+    Drain();
+}
+
+void CVideoOutputQueue::EndFlush()
+{
+    CAutoLock lock(&m_csQueue);
+    m_bFlushing = FALSE;
+}
+
+DWORD CVideoOutputQueue::ThreadProc()
+{
+    SetThreadName(-1, "CVideoOutputQueue");
+    m_dwThreadId = GetCurrentThreadId();
+
+    HANDLE hWaitEvents[2] = {GetRequestHandle(), m_evWork};
+
+    while (1)
+    {
+        DWORD dwWait = WaitForMultipleObjects(countof(hWaitEvents), hWaitEvents, FALSE, INFINITE);
+        if (dwWait == WAIT_OBJECT_0)
+        {
+            // the wait consumed the request event, so fetch the command directly
+            DWORD cmd = GetRequestParam();
+            Reply(S_OK);
+            ASSERT(cmd == CMD_EXIT);
+            return 0;
+        }
+
+        for (;;)
+        {
+            OutputFrame frame;
+            {
+                CAutoLock lock(&m_csQueue);
+                if (m_Queue.empty())
+                {
+                    m_bBusy = FALSE;
+                    m_evIdle.Set();
+                    break;
+                }
+
+                frame = m_Queue.front();
+                m_Queue.pop_front();
+                m_bBusy = TRUE;
+                m_evSpace.Set();
+            }
+
+            // Delivery failures are recorded by the filter, and reported to the upstream filter with the next sample
+            m_pLAVVideo->ProcessOutput(frame.pFrame, frame.bFilter, frame.bInterlaced, TRUE);
+        }
+    }
+
+    return 0;
+}
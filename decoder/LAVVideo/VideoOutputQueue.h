@@ -0,0 +1,89 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <deque>
+
+#define OUTPUT_QUEUE_MAX_DEPTH 8 // Maximum number of frames waiting for the output thread
+
+class CLAVVideo;
+
+// Output stage of LAV Video on a separate thread
+//
+// Decoded frames are queued here, and a worker thread performs the software deinterlacing, pixel format
+// conversion and delivery for them, while the streaming thread can already decode the next frame.
+// The queue is bounded, and queueing a frame blocks while it is full.
+class CVideoOutputQueue : protected CAMThread
+{
+  public:
+    CVideoOutputQueue(CLAVVideo *pLAVVideo);
+    ~CVideoOutputQueue();
+
+    // Start the worker, with room for dwDepth frames
+    HRESULT Start(DWORD dwDepth);
+
+    // Release all queued frames, and stop the worker
+    void Stop();
+
+    BOOL IsActive() { return ThreadExists(); }
+
+    // Check if the caller is the worker thread
+    BOOL IsOutputThread() { return ThreadExists() && GetCurrentThreadId() == m_dwThreadId; }
+
+    // Queue a frame for output, the queue takes ownership of the frame
+    // Returns S_FALSE if the frame was dropped because of a flush
+    HRESULT Queue(LAVFrame *pFrame, BOOL bFilter, BOOL bInterlaced);
+
+    // Wait until all queued frames have been delivered
+    void Drain();
+
+    // Release all queued frames, and wait for the frame the worker is currently processing
+    // Any frames queued until EndFlush is called are dropped
+    void BeginFlush();
+    void EndFlush();
+
+  private:
+    enum
+    {
+        CMD_EXIT
+    };
+    DWORD ThreadProc();
+
+    struct OutputFrame
+    {
+        LAVFrame *pFrame;
+        BOOL bFilter;
+        BOOL bInterlaced;
+    };
+
+  private:
+    CLAVVideo *m_pLAVVideo = nullptr;
+    DWORD m_dwThreadId = 0;
+
+    CCritSec m_csQueue;
+    std::deque<OutputFrame> m_Queue;
+    size_t m_nDepth = 0;
+    BOOL m_bBusy = FALSE;
+    BOOL m_bFlushing = FALSE;
+
+    CAMEvent m_evWork;        // signaled when a frame was queued
+    CAMEvent m_evSpace{TRUE}; // set while the queue has room for another frame
+    CAMEvent m_evIdle{TRUE};  // set while the queue is empty and the worker is idle
+};
@@ -21,73 +21,7 @@
 
 #include "LAVVideoSettings.h"
 #include "ILAVPinInfo.h"
-
-/**
- * List of internally used pixel formats
- *
- * Note for high bit-depth formats:
- * All bX (9-16 bit) formats always use 2 bytes, are little-endian, and the values are right-aligned.
- * That means that there are leading zero-bits, and not trailing like in DirectShow
- * The actual number of valid bits is stored in the LAVFrame
- */
-// clang-format off
-typedef enum LAVPixelFormat {
-    LAVPixFmt_None = -1,
-    /* planar YUV */
-    LAVPixFmt_YUV420,      ///< YUV 4:2:0, 8 bit
-    LAVPixFmt_YUV420bX,    ///< YUV 4:2:0, 9-16 bit
-
-    LAVPixFmt_YUV422,      ///< YUV 4:2:2, 8 bit
-    LAVPixFmt_YUV422bX,    ///< YUV 4:2:2, 9-16 bit
-
-    LAVPixFmt_YUV444,      ///< YUV 4:4:4, 8 bit
-    LAVPixFmt_YUV444bX,    ///< YUV 4:4:4, 9-16 bit
-
-    /* packed/half-packed YUV */
-    LAVPixFmt_NV12,        ///< YUV 4:2:0, U/V interleaved
-    LAVPixFmt_YUY2,        ///< YUV 4:2:2, packed, YUYV order
-    LAVPixFmt_P016,        ///< YUV 4:2:0, 10 to 16-bit, U/V interleaved, MSB aligned
-
-    /* RGB */
-    LAVPixFmt_RGB24,       ///< RGB24, in BGR order
-    LAVPixFmt_RGB32,       ///< RGB32, in BGRA order (A is invalid and should be 0xFF)
-    LAVPixFmt_ARGB32,      ///< ARGB32, in BGRA order
-    LAVPixFmt_RGB48,       ///< RGB48, in RGB order (16-bit per pixel)
-
-    /* HW formats */
-    LAVPixFmt_AYUV,        ///< AYUV, 4:4:4 8-bit
-    LAVPixFmt_Y410,        ///< Y410, 4:4:4 10-bit packed into 32-bit, AVYU order (A is 2 bit)
-    LAVPixFmt_Y416,        ///< Y416, 4:4:4 16-bit, AVYU order
-    LAVPixFmt_Y216,        ///< Y210/Y216, 4:2:2, 10 to 16-bit packed into 64-bit, Y0/U/Y1/V
-
-    LAVPixFmt_HWFormats,
-    LAVPixFmt_DXVA2 = LAVPixFmt_HWFormats, ///< DXVA2 Surface
-    LAVPixFmt_D3D11,       ///< D3D11 Surface
-
-    LAVPixFmt_NB,          ///< number of formats
-} LAVPixelFormat;
-// clang-format on
-
-/**
- * Structure describing a pixel format
- */
-typedef struct LAVPixFmtDesc
-{
-    int codedbytes;     ///< coded byte per pixel in one plane (for packed and multibyte formats)
-    int planes;         ///< number of planes
-    int planeWidth[4];  ///< log2 width factor
-    int planeHeight[4]; ///< log2 height factor
-} LAVPixFmtDesc;
-
-/**
- * Get the Pixel Format Descriptor for the given format
- */
-LAVPixFmtDesc getPixelFormatDesc(LAVPixelFormat pixFmt);
-
-/**
- * Map the LAV Pixel Format to a FFMpeg pixel format (for swscale, etc)
- */
-AVPixelFormat getFFPixelFormatFromLAV(LAVPixelFormat pixFmt, int bpp);
+#include "LAVPixelFormat.h"
 
 typedef struct LAVDirectBuffer
 {
@@ -104,6 +38,9 @@ typedef struct LAVFrameSideData
     size_t size;   ///< size
 } LAVFrameSideData;
 
+// Pool of frame buffers, see CreateLAVFrameBufferPool
+class CLAVFrameBufferPool;
+
 /**
  * A Video Frame
  *
@@ -155,6 +92,8 @@ typedef struct LAVFrame
     LAVFrameSideData *side_data;
     int side_data_count;
 
+    CLAVFrameBufferPool *pool; ///< pool used by AllocLAVFrameBuffers (may be null)
+
     /* destruct function to free any buffers being held by this frame (may be null) */
     void (*destruct)(struct LAVFrame *);
     void *priv_data; ///< private data from the decoder (mostly for destruct)
@@ -164,6 +103,20 @@ typedef struct LAVFrame
     void (*direct_unlock)(struct LAVFrame *);
 } LAVFrame;
 
+/**
+ * A band of lines replacing the same lines of a LAVFrame
+ *
+ * Allows modifying some lines of a frame whose buffers are not writable, without copying the whole frame.
+ * The pixel converter reads the lines covered by the band from the band buffers instead of the frame.
+ */
+typedef struct LAVFrameBand
+{
+    int top;             ///< first line of the frame covered by the band
+    int height;          ///< number of lines covered by the band (0 if unused)
+    BYTE *data[4];       ///< pointer to the first line of the band in each plane
+    ptrdiff_t stride[4]; ///< stride of the band planes (in bytes)
+} LAVFrameBand;
+
 /**
  * Allocate buffers for the LAVFrame "data" element to fit the pixfmt with the given stride
  *
@@ -176,6 +129,35 @@ typedef struct LAVFrame
  */
 HRESULT AllocLAVFrameBuffers(LAVFrame *pFrame, ptrdiff_t stride = 0);
 
+/**
+ * Create a frame buffer pool for AllocLAVFrameBuffers
+ *
+ * Buffers of released frames are kept for re-use by frames with the same layout (format, size, stride, MVC).
+ * AllocLAVFrameBuffers uses the pool set in LAVFrame::pool, frames without one get unpooled buffers.
+ */
+CLAVFrameBufferPool *CreateLAVFrameBufferPool();
+
+/**
+ * Close a frame buffer pool, freeing its idle buffers
+ *
+ * Buffers still in use are freed when their frames are released, the pool itself is freed with the last of them.
+ */
+void CloseLAVFrameBufferPool(CLAVFrameBufferPool *pPool);
+
+/**
+ * Free the idle buffers of a frame buffer pool
+ */
+void TrimLAVFrameBufferPool(CLAVFrameBufferPool *pPool);
+
+/**
+ * Get the statistics of a frame buffer pool
+ *
+ * @param pPool pool to query
+ * @param pHits number of allocations served from the pool (may be NULL)
+ * @param pMisses number of allocations that required new memory (may be NULL)
+ */
+void GetLAVFrameBufferPoolStats(CLAVFrameBufferPool *pPool, LONGLONG *pHits, LONGLONG *pMisses);
+
 /**
  * Destruct a LAV Frame, freeing its data pointers
  */
@@ -193,6 +175,11 @@ HRESULT CopyLAVFrame(LAVFrame *pSrc, LAVFrame **ppDst);
  */
 HRESULT CopyLAVFrameInPlace(LAVFrame *pFrame);
 
+/**
+ * Copy the buffers in the LAV Frame like CopyLAVFrameInPlace, and replace the lines covered by the band with its data
+ */
+HRESULT MergeLAVFrameBand(LAVFrame *pFrame, const LAVFrameBand *pBand);
+
 /**
  * Add Side Data to the frame and return a pointer to it
  */
@@ -0,0 +1,109 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "LAVPixelFormat.h"
+
+extern "C"
+{
+#include "libavutil/common.h"
+};
+
+#include <assert.h>
+
+static LAVPixFmtDesc lav_pixfmt_desc[] = {
+    {1, 3, {1, 2, 2}, {1, 2, 2}}, ///< LAVPixFmt_YUV420
+    {2, 3, {1, 2, 2}, {1, 2, 2}}, ///< LAVPixFmt_YUV420bX
+    {1, 3, {1, 2, 2}, {1, 1, 1}}, ///< LAVPixFmt_YUV422
+    {2, 3, {1, 2, 2}, {1, 1, 1}}, ///< LAVPixFmt_YUV422bX
+    {1, 3, {1, 1, 1}, {1, 1, 1}}, ///< LAVPixFmt_YUV444
+    {2, 3, {1, 1, 1}, {1, 1, 1}}, ///< LAVPixFmt_YUV444bX
+    {1, 2, {1, 1}, {1, 2}},       ///< LAVPixFmt_NV12
+    {2, 1, {1}, {1}},             ///< LAVPixFmt_YUY2
+    {2, 2, {1, 1}, {1, 2}},       ///< LAVPixFmt_P016
+    {3, 1, {1}, {1}},             ///< LAVPixFmt_RGB24
+    {4, 1, {1}, {1}},             ///< LAVPixFmt_RGB32
+    {4, 1, {1}, {1}},             ///< LAVPixFmt_ARGB32
+    {6, 1, {1}, {1}},             ///< LAVPixFmt_RGB48
+    {4, 1, {1}, {1}},             ///< LAVPixFmt_AYUV
+    {4, 1, {1}, {1}},             ///< LAVPixFmt_Y410
+    {8, 1, {1}, {1}},             ///< LAVPixFmt_Y416
+    {4, 1, {1}, {1}},             ///< LAVPixFmt_Y216
+};
+
+LAVPixFmtDesc getPixelFormatDesc(LAVPixelFormat pixFmt)
+{
+    return lav_pixfmt_desc[pixFmt];
+}
+
+static struct
+{
+    LAVPixelFormat pixfmt;
+    AVPixelFormat ffpixfmt;
+} lav_ff_pixfmt_map[] = {
+    {LAVPixFmt_YUV420, AV_PIX_FMT_YUV420P}, {LAVPixFmt_YUV422, AV_PIX_FMT_YUV422P},
+    {LAVPixFmt_YUV444, AV_PIX_FMT_YUV444P}, {LAVPixFmt_NV12, AV_PIX_FMT_NV12},
+    {LAVPixFmt_YUY2, AV_PIX_FMT_YUYV422},   {LAVPixFmt_RGB24, AV_PIX_FMT_BGR24},
+    {LAVPixFmt_RGB32, AV_PIX_FMT_BGRA},     {LAVPixFmt_ARGB32, AV_PIX_FMT_BGRA},
+    {LAVPixFmt_RGB48, AV_PIX_FMT_RGB48LE},  {LAVPixFmt_AYUV, AV_PIX_FMT_VUYX},
+    {LAVPixFmt_Y410, AV_PIX_FMT_XV30},      {LAVPixFmt_Y416, AV_PIX_FMT_XV48},
+};
+
+AVPixelFormat getFFPixelFormatFromLAV(LAVPixelFormat pixFmt, int bpp)
+{
+    AVPixelFormat fmt = AV_PIX_FMT_NONE;
+    for (int i = 0; i < FF_ARRAY_ELEMS(lav_ff_pixfmt_map); i++)
+    {
+        if (lav_ff_pixfmt_map[i].pixfmt == pixFmt)
+        {
+            fmt = lav_ff_pixfmt_map[i].ffpixfmt;
+            break;
+        }
+    }
+    if (fmt == AV_PIX_FMT_NONE)
+    {
+        switch (pixFmt)
+        {
+        case LAVPixFmt_YUV420bX:
+            fmt = (bpp == 9)
+                      ? AV_PIX_FMT_YUV420P9LE
+                      : ((bpp == 10) ? AV_PIX_FMT_YUV420P10LE
+                                     : ((bpp == 12) ? AV_PIX_FMT_YUV420P12LE
+                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV420P14LE : AV_PIX_FMT_YUV420P16LE)));
+            break;
+        case LAVPixFmt_YUV422bX:
+            fmt = (bpp == 9)
+                      ? AV_PIX_FMT_YUV422P9LE
+                      : ((bpp == 10) ? AV_PIX_FMT_YUV422P10LE
+                                     : ((bpp == 12) ? AV_PIX_FMT_YUV422P12LE
+                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV422P14LE : AV_PIX_FMT_YUV422P16LE)));
+            break;
+        case LAVPixFmt_YUV444bX:
+            fmt = (bpp == 9)
+                      ? AV_PIX_FMT_YUV444P9LE
+                      : ((bpp == 10) ? AV_PIX_FMT_YUV444P10LE
+                                     : ((bpp == 12) ? AV_PIX_FMT_YUV444P12LE
+                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV444P14LE : AV_PIX_FMT_YUV444P16LE)));
+            break;
+        case LAVPixFmt_P016: fmt = (bpp <= 10) ? AV_PIX_FMT_P010LE : AV_PIX_FMT_P016LE; break;
+        case LAVPixFmt_Y216: fmt = (bpp <= 10) ? AV_PIX_FMT_Y210 : AV_PIX_FMT_Y216; break;
+        default: assert(0);
+        }
+    }
+    return fmt;
+}
@@ -0,0 +1,94 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Pixel formats used between the decoders and the output, without any Windows or DirectShow dependency
+
+extern "C"
+{
+#include "libavutil/pixfmt.h"
+};
+
+/**
+ * List of internally used pixel formats
+ *
+ * Note for high bit-depth formats:
+ * All bX (9-16 bit) formats always use 2 bytes, are little-endian, and the values are right-aligned.
+ * That means that there are leading zero-bits, and not trailing like in DirectShow
+ * The actual number of valid bits is stored in the LAVFrame
+ */
+// clang-format off
+typedef enum LAVPixelFormat {
+    LAVPixFmt_None = -1,
+    /* planar YUV */
+    LAVPixFmt_YUV420,      ///< YUV 4:2:0, 8 bit
+    LAVPixFmt_YUV420bX,    ///< YUV 4:2:0, 9-16 bit
+
+    LAVPixFmt_YUV422,      ///< YUV 4:2:2, 8 bit
+    LAVPixFmt_YUV422bX,    ///< YUV 4:2:2, 9-16 bit
+
+    LAVPixFmt_YUV444,      ///< YUV 4:4:4, 8 bit
+    LAVPixFmt_YUV444bX,    ///< YUV 4:4:4, 9-16 bit
+
+    /* packed/half-packed YUV */
+    LAVPixFmt_NV12,        ///< YUV 4:2:0, U/V interleaved
+    LAVPixFmt_YUY2,        ///< YUV 4:2:2, packed, YUYV order
+    LAVPixFmt_P016,        ///< YUV 4:2:0, 10 to 16-bit, U/V interleaved, MSB aligned
+
+    /* RGB */
+    LAVPixFmt_RGB24,       ///< RGB24, in BGR order
+    LAVPixFmt_RGB32,       ///< RGB32, in BGRA order (A is invalid and should be 0xFF)
+    LAVPixFmt_ARGB32,      ///< ARGB32, in BGRA order
+    LAVPixFmt_RGB48,       ///< RGB48, in RGB order (16-bit per pixel)
+
+    /* HW formats */
+    LAVPixFmt_AYUV,        ///< AYUV, 4:4:4 8-bit
+    LAVPixFmt_Y410,        ///< Y410, 4:4:4 10-bit packed into 32-bit, AVYU order (A is 2 bit)
+    LAVPixFmt_Y416,        ///< Y416, 4:4:4 16-bit, AVYU order
+    LAVPixFmt_Y216,        ///< Y210/Y216, 4:2:2, 10 to 16-bit packed into 64-bit, Y0/U/Y1/V
+
+    LAVPixFmt_HWFormats,
+    LAVPixFmt_DXVA2 = LAVPixFmt_HWFormats, ///< DXVA2 Surface
+    LAVPixFmt_D3D11,       ///< D3D11 Surface
+
+    LAVPixFmt_NB,          ///< number of formats
+} LAVPixelFormat;
+// clang-format on
+
+/**
+ * Structure describing a pixel format
+ */
+typedef struct LAVPixFmtDesc
+{
+    int codedbytes;     ///< coded byte per pixel in one plane (for packed and multibyte formats)
+    int planes;         ///< number of planes
+    int planeWidth[4];  ///< log2 width factor
+    int planeHeight[4]; ///< log2 height factor
+} LAVPixFmtDesc;
+
+/**
+ * Get the Pixel Format Descriptor for the given format
+ */
+LAVPixFmtDesc getPixelFormatDesc(LAVPixelFormat pixFmt);
+
+/**
+ * Map the LAV Pixel Format to a FFMpeg pixel format (for swscale, etc)
+ */
+AVPixelFormat getFFPixelFormatFromLAV(LAVPixelFormat pixFmt, int bpp);
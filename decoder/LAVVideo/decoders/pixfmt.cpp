@@ -20,100 +20,189 @@
 #include "stdafx.h"
 #include "ILAVDecoder.h"
 
-static LAVPixFmtDesc lav_pixfmt_desc[] = {
-    {1, 3, {1, 2, 2}, {1, 2, 2}}, ///< LAVPixFmt_YUV420
-    {2, 3, {1, 2, 2}, {1, 2, 2}}, ///< LAVPixFmt_YUV420bX
-    {1, 3, {1, 2, 2}, {1, 1, 1}}, ///< LAVPixFmt_YUV422
-    {2, 3, {1, 2, 2}, {1, 1, 1}}, ///< LAVPixFmt_YUV422bX
-    {1, 3, {1, 1, 1}, {1, 1, 1}}, ///< LAVPixFmt_YUV444
-    {2, 3, {1, 1, 1}, {1, 1, 1}}, ///< LAVPixFmt_YUV444bX
-    {1, 2, {1, 1}, {1, 2}},       ///< LAVPixFmt_NV12
-    {2, 1, {1}, {1}},             ///< LAVPixFmt_YUY2
-    {2, 2, {1, 1}, {1, 2}},       ///< LAVPixFmt_P016
-    {3, 1, {1}, {1}},             ///< LAVPixFmt_RGB24
-    {4, 1, {1}, {1}},             ///< LAVPixFmt_RGB32
-    {4, 1, {1}, {1}},             ///< LAVPixFmt_ARGB32
-    {6, 1, {1}, {1}},             ///< LAVPixFmt_RGB48
-    {4, 1, {1}, {1}},             ///< LAVPixFmt_AYUV
-    {4, 1, {1}, {1}},             ///< LAVPixFmt_Y410
-    {8, 1, {1}, {1}},             ///< LAVPixFmt_Y416
-    {4, 1, {1}, {1}},             ///< LAVPixFmt_Y216
-};
+#include <deque>
 
-LAVPixFmtDesc getPixelFormatDesc(LAVPixelFormat pixFmt)
-{
-    return lav_pixfmt_desc[pixFmt];
-}
+// Maximum number of idle frame buffers kept in the pool
+#define LAV_FRAME_POOL_MAX_IDLE 8
 
-static struct
+// Frame buffer from the pool, one allocation holds all planes of a frame (including the second view of MVC)
+typedef struct LAVFrameBuffer
 {
-    LAVPixelFormat pixfmt;
-    AVPixelFormat ffpixfmt;
-} lav_ff_pixfmt_map[] = {
-    {LAVPixFmt_YUV420, AV_PIX_FMT_YUV420P}, {LAVPixFmt_YUV422, AV_PIX_FMT_YUV422P},
-    {LAVPixFmt_YUV444, AV_PIX_FMT_YUV444P}, {LAVPixFmt_NV12, AV_PIX_FMT_NV12},
-    {LAVPixFmt_YUY2, AV_PIX_FMT_YUYV422},   {LAVPixFmt_RGB24, AV_PIX_FMT_BGR24},
-    {LAVPixFmt_RGB32, AV_PIX_FMT_BGRA},     {LAVPixFmt_ARGB32, AV_PIX_FMT_BGRA},
-    {LAVPixFmt_RGB48, AV_PIX_FMT_RGB48LE},  {LAVPixFmt_AYUV, AV_PIX_FMT_VUYX},
-    {LAVPixFmt_Y410, AV_PIX_FMT_XV30},      {LAVPixFmt_Y416, AV_PIX_FMT_XV48},
-};
-
-AVPixelFormat getFFPixelFormatFromLAV(LAVPixelFormat pixFmt, int bpp)
+    LAVPixelFormat format;     ///< pixel format of the buffer
+    int height;                ///< height the buffer was allocated for (aligned to 2)
+    ptrdiff_t stride;          ///< stride of the first plane (in bytes)
+    bool mvc;                  ///< buffer holds the second view
+    BYTE *data;                ///< memory block
+    CLAVFrameBufferPool *pool; ///< pool the buffer returns to (NULL if unpooled)
+} LAVFrameBuffer;
+
+// Pool of frame buffers, owned by one decoder instance
+//
+// The owner holds one reference, and every buffer handed out holds another one, so a pool that was closed by its
+// owner stays alive until the last frame using one of its buffers is released.
+class CLAVFrameBufferPool
 {
-    AVPixelFormat fmt = AV_PIX_FMT_NONE;
-    for (int i = 0; i < countof(lav_ff_pixfmt_map); i++)
+  public:
+    void AddRef() { InterlockedIncrement(&m_cRef); }
+
+    void Release()
+    {
+        if (InterlockedDecrement(&m_cRef) == 0)
+            delete this;
+    }
+
+    LAVFrameBuffer *Acquire(LAVPixelFormat format, int height, ptrdiff_t stride, bool mvc, size_t size)
+    {
+        LAVFrameBuffer *pBuffer = nullptr;
+        {
+            CAutoLock lock(&m_csPool);
+            for (auto it = m_Idle.begin(); it != m_Idle.end(); it++)
+            {
+                if ((*it)->format == format && (*it)->height == height && (*it)->stride == stride &&
+                    (*it)->mvc == mvc)
+                {
+                    pBuffer = *it;
+                    m_Idle.erase(it);
+                    m_llHits++;
+                    break;
+                }
+            }
+            if (pBuffer == nullptr)
+                m_llMisses++;
+        }
+
+        if (pBuffer == nullptr)
+        {
+            pBuffer = AllocBuffer(format, height, stride, mvc, size);
+            if (pBuffer == nullptr)
+                return nullptr;
+            pBuffer->pool = this;
+        }
+
+        AddRef();
+        return pBuffer;
+    }
+
+    // Take a buffer back, it is kept for re-use unless the pool was closed
+    void Return(LAVFrameBuffer *pBuffer)
+    {
+        LAVFrameBuffer *pEvicted = pBuffer;
+        {
+            CAutoLock lock(&m_csPool);
+            if (!m_bClosed)
+            {
+                m_Idle.push_front(pBuffer);
+                pEvicted = nullptr;
+                if (m_Idle.size() > LAV_FRAME_POOL_MAX_IDLE)
+                {
+                    pEvicted = m_Idle.back();
+                    m_Idle.pop_back();
+                }
+            }
+        }
+        if (pEvicted)
+            FreeBuffer(pEvicted);
+
+        Release();
+    }
+
+    // Free all idle buffers
+    void Trim()
+    {
+        std::deque<LAVFrameBuffer *> idle;
+        {
+            CAutoLock lock(&m_csPool);
+            idle.swap(m_Idle);
+        }
+        for (LAVFrameBuffer *pBuffer : idle)
+            FreeBuffer(pBuffer);
+    }
+
+    // Called by the owner instead of Release, buffers still in use are freed when they are returned
+    void Close()
     {
-        if (lav_ff_pixfmt_map[i].pixfmt == pixFmt)
         {
-            fmt = lav_ff_pixfmt_map[i].ffpixfmt;
-            break;
+            CAutoLock lock(&m_csPool);
+            m_bClosed = true;
         }
+        Trim();
+        Release();
     }
-    if (fmt == AV_PIX_FMT_NONE)
+
+    void GetStats(LONGLONG *pHits, LONGLONG *pMisses)
+    {
+        CAutoLock lock(&m_csPool);
+        if (pHits)
+            *pHits = m_llHits;
+        if (pMisses)
+            *pMisses = m_llMisses;
+    }
+
+    static LAVFrameBuffer *AllocBuffer(LAVPixelFormat format, int height, ptrdiff_t stride, bool mvc, size_t size)
     {
-        switch (pixFmt)
+        LAVFrameBuffer *pBuffer = new LAVFrameBuffer{format, height, stride, mvc, nullptr, nullptr};
+        pBuffer->data = (BYTE *)_aligned_malloc(size, 64);
+        if (pBuffer->data == nullptr)
         {
-        case LAVPixFmt_YUV420bX:
-            fmt = (bpp == 9)
-                      ? AV_PIX_FMT_YUV420P9LE
-                      : ((bpp == 10) ? AV_PIX_FMT_YUV420P10LE
-                                     : ((bpp == 12) ? AV_PIX_FMT_YUV420P12LE
-                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV420P14LE : AV_PIX_FMT_YUV420P16LE)));
-            break;
-        case LAVPixFmt_YUV422bX:
-            fmt = (bpp == 9)
-                      ? AV_PIX_FMT_YUV422P9LE
-                      : ((bpp == 10) ? AV_PIX_FMT_YUV422P10LE
-                                     : ((bpp == 12) ? AV_PIX_FMT_YUV422P12LE
-                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV422P14LE : AV_PIX_FMT_YUV422P16LE)));
-            break;
-        case LAVPixFmt_YUV444bX:
-            fmt = (bpp == 9)
-                      ? AV_PIX_FMT_YUV444P9LE
-                      : ((bpp == 10) ? AV_PIX_FMT_YUV444P10LE
-                                     : ((bpp == 12) ? AV_PIX_FMT_YUV444P12LE
-                                                    : ((bpp == 14) ? AV_PIX_FMT_YUV444P14LE : AV_PIX_FMT_YUV444P16LE)));
-            break;
-        case LAVPixFmt_P016: fmt = (bpp <= 10) ? AV_PIX_FMT_P010LE : AV_PIX_FMT_P016LE; break;
-        case LAVPixFmt_Y216: fmt = (bpp <= 10) ? AV_PIX_FMT_Y210 : AV_PIX_FMT_Y216; break;
-        default: ASSERT(0);
+            delete pBuffer;
+            return nullptr;
         }
+        return pBuffer;
     }
-    return fmt;
+
+    static void FreeBuffer(LAVFrameBuffer *pBuffer)
+    {
+        _aligned_free(pBuffer->data);
+        delete pBuffer;
+    }
+
+  private:
+    ~CLAVFrameBufferPool() { ASSERT(m_Idle.empty()); }
+
+  private:
+    LONG m_cRef = 1;
+
+    CCritSec m_csPool;
+    std::deque<LAVFrameBuffer *> m_Idle; ///< idle buffers, most recently released first
+    bool m_bClosed = false;
+
+    LONGLONG m_llHits = 0;
+    LONGLONG m_llMisses = 0;
+};
+
+CLAVFrameBufferPool *CreateLAVFrameBufferPool()
+{
+    return new CLAVFrameBufferPool();
+}
+
+void CloseLAVFrameBufferPool(CLAVFrameBufferPool *pPool)
+{
+    if (pPool)
+        pPool->Close();
+}
+
+void TrimLAVFrameBufferPool(CLAVFrameBufferPool *pPool)
+{
+    if (pPool)
+        pPool->Trim();
+}
+
+void GetLAVFrameBufferPoolStats(CLAVFrameBufferPool *pPool, LONGLONG *pHits, LONGLONG *pMisses)
+{
+    if (pPool)
+        pPool->GetStats(pHits, pMisses);
 }
 
 static void free_buffers(struct LAVFrame *pFrame)
 {
-    _aligned_free(pFrame->data[0]);
-    _aligned_free(pFrame->data[1]);
-    _aligned_free(pFrame->data[2]);
-    _aligned_free(pFrame->data[3]);
-    memset(pFrame->data, 0, sizeof(pFrame->data));
+    LAVFrameBuffer *pBuffer = (LAVFrameBuffer *)pFrame->priv_data;
+    if (pBuffer && pBuffer->pool)
+        pBuffer->pool->Return(pBuffer);
+    else if (pBuffer)
+        CLAVFrameBufferPool::FreeBuffer(pBuffer);
+    pFrame->priv_data = nullptr;
 
-    _aligned_free(pFrame->stereo[0]);
-    _aligned_free(pFrame->stereo[1]);
-    _aligned_free(pFrame->stereo[2]);
-    _aligned_free(pFrame->stereo[3]);
+    memset(pFrame->data, 0, sizeof(pFrame->data));
     memset(pFrame->stereo, 0, sizeof(pFrame->stereo));
 }
 
@@ -130,38 +219,41 @@ HRESULT AllocLAVFrameBuffers(LAVFrame *pFrame, ptrdiff_t stride)
     stride *= desc.codedbytes;
 
     int alignedHeight = FFALIGN(pFrame->height, 2);
+    bool mvc = !!(pFrame->flags & LAV_FRAME_FLAG_MVC);
 
-    memset(pFrame->data, 0, sizeof(pFrame->data));
-    memset(pFrame->stereo, 0, sizeof(pFrame->stereo));
-    memset(pFrame->stride, 0, sizeof(pFrame->stride));
+    // Lay out all planes in one block, each plane starting 64-byte aligned and followed by padding
+    size_t planeOffset[4] = {0};
+    size_t size = 0;
     for (int plane = 0; plane < desc.planes; plane++)
     {
         ptrdiff_t planeStride = stride / desc.planeWidth[plane];
-        size_t size = planeStride * (alignedHeight / desc.planeHeight[plane]);
-        pFrame->data[plane] = (BYTE *)_aligned_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE, 64);
-        if (pFrame->data[plane] == nullptr)
-        {
-            free_buffers(pFrame);
-            return E_OUTOFMEMORY;
-        }
-        pFrame->stride[plane] = planeStride;
+        planeOffset[plane] = size;
+        size += FFALIGN(planeStride * (alignedHeight / desc.planeHeight[plane]) + AV_INPUT_BUFFER_PADDING_SIZE, 64);
     }
+    size_t viewSize = size;
+    if (mvc)
+        size += viewSize;
+
+    memset(pFrame->data, 0, sizeof(pFrame->data));
+    memset(pFrame->stereo, 0, sizeof(pFrame->stereo));
+    memset(pFrame->stride, 0, sizeof(pFrame->stride));
+
+    LAVFrameBuffer *pBuffer = pFrame->pool ? pFrame->pool->Acquire(pFrame->format, alignedHeight, stride, mvc, size)
+                                           : CLAVFrameBufferPool::AllocBuffer(pFrame->format, alignedHeight, stride,
+                                                                              mvc, size);
+    if (pBuffer == nullptr)
+        return E_OUTOFMEMORY;
 
-    if (pFrame->flags & LAV_FRAME_FLAG_MVC)
+    for (int plane = 0; plane < desc.planes; plane++)
     {
-        for (int plane = 0; plane < desc.planes; plane++)
-        {
-            size_t size = pFrame->stride[plane] * (alignedHeight / desc.planeHeight[plane]);
-            pFrame->stereo[plane] = (BYTE *)_aligned_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE, 64);
-            if (pFrame->stereo[plane] == nullptr)
-            {
-                free_buffers(pFrame);
-                return E_OUTOFMEMORY;
-            }
-        }
+        pFrame->data[plane] = pBuffer->data + planeOffset[plane];
+        pFrame->stride[plane] = stride / desc.planeWidth[plane];
+        if (mvc)
+            pFrame->stereo[plane] = pBuffer->data + viewSize + planeOffset[plane];
     }
 
     pFrame->destruct = &free_buffers;
+    pFrame->priv_data = pBuffer;
     pFrame->flags |= LAV_FRAME_FLAG_BUFFER_MODIFY;
 
     return S_OK;
@@ -258,6 +350,31 @@ HRESULT CopyLAVFrameInPlace(LAVFrame *pFrame)
     return S_OK;
 }
 
+HRESULT MergeLAVFrameBand(LAVFrame *pFrame, const LAVFrameBand *pBand)
+{
+    HRESULT hr = CopyLAVFrameInPlace(pFrame);
+    if (FAILED(hr) || pBand->height <= 0)
+        return hr;
+
+    LAVPixFmtDesc desc = getPixelFormatDesc(pFrame->format);
+    for (int plane = 0; plane < desc.planes; plane++)
+    {
+        size_t linesize = (pFrame->width / desc.planeWidth[plane]) * desc.codedbytes;
+        int firstLine = pBand->top / desc.planeHeight[plane];
+        int lines = (pBand->top + pBand->height + desc.planeHeight[plane] - 1) / desc.planeHeight[plane] - firstLine;
+        BYTE *dst = pFrame->data[plane] + firstLine * pFrame->stride[plane];
+        const BYTE *src = pBand->data[plane];
+        for (int i = 0; i < lines; i++)
+        {
+            memcpy(dst, src, linesize);
+            dst += pFrame->stride[plane];
+            src += pBand->stride[plane];
+        }
+    }
+
+    return S_OK;
+}
+
 BYTE *AddLAVFrameSideData(LAVFrame *pFrame, GUID guidType, size_t size)
 {
     BYTE *ptr = (BYTE *)CoTaskMemRealloc(pFrame->side_data, sizeof(LAVFrameSideData) * (pFrame->side_data_count + 1));
@@ -17,23 +17,22 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
+#include <atomic>
 #include <emmintrin.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
 
 // This function is only designed for NV12-like pixel formats, like NV12, P010, P016, ...
-DECLARE_CONV_FUNC_IMPL(plane_copy_direct_nv12_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(plane_copy_direct_nv12_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
     const ptrdiff_t chromaHeight = (height >> 1);
 
     const ptrdiff_t byteWidth =
-        (outputFormat == LAVOutPixFmt_P010 || outputFormat == LAVOutPixFmt_P016) ? width << 1 : width;
-    const ptrdiff_t stride = min(FFALIGN(byteWidth, 64), min(inStride, outStride));
+        (outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) ? width << 1 : width;
+    const ptrdiff_t stride = FFMIN((ptrdiff_t)FFALIGN(byteWidth, 64), FFMIN(inStride, outStride));
 
     __m128i xmm0, xmm1, xmm2, xmm3;
 
@@ -52,7 +51,7 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_direct_nv12_sse4)
             PIXCONV_STREAM_LOAD(xmm2, y + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, y + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             PIXCONV_PUT_STREAM(dy + i + 0, xmm0);
             PIXCONV_PUT_STREAM(dy + i + 16, xmm1);
@@ -78,7 +77,7 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_direct_nv12_sse4)
             PIXCONV_STREAM_LOAD(xmm2, uv + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, uv + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             PIXCONV_PUT_STREAM(duv + i + 0, xmm0);
             PIXCONV_PUT_STREAM(duv + i + 16, xmm1);
@@ -93,15 +92,15 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_direct_nv12_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(plane_copy_direct_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(plane_copy_direct_sse4)
 {
     LAVOutPixFmtDesc desc = lav_pixfmt_desc[outputFormat];
 
     const int widthBytes = width * desc.codedbytes;
-    const int planes = max(desc.planes, 1);
+    const int planes = FFMAX(desc.planes, 1);
 
     ptrdiff_t line, plane;
 
@@ -127,7 +126,7 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_direct_sse4)
                 PIXCONV_STREAM_LOAD(r3, srcLinePtr + i + 32);
                 PIXCONV_STREAM_LOAD(r4, srcLinePtr + i + 48);
 
-                _ReadWriteBarrier();
+                std::atomic_signal_fence(std::memory_order_seq_cst);
 
                 PIXCONV_PUT_STREAM(dstLinePtr + i + 0, r1);
                 PIXCONV_PUT_STREAM(dstLinePtr + i + 16, r2);
@@ -142,17 +141,17 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_direct_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12_direct_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_nv12_yv12_direct_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
     const ptrdiff_t outChromaStride = dstStride[1];
     const ptrdiff_t chromaHeight = (height >> 1);
 
-    const ptrdiff_t stride = min(FFALIGN(width, 64), min(inStride, outStride));
+    const ptrdiff_t stride = FFMIN((ptrdiff_t)FFALIGN(width, 64), FFMIN(inStride, outStride));
 
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm7;
     xmm7 = _mm_set1_epi16(0x00FF);
@@ -172,7 +171,7 @@ DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12_direct_sse4)
             PIXCONV_STREAM_LOAD(xmm2, y + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, y + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             PIXCONV_PUT_STREAM(dy + i + 0, xmm0);
             PIXCONV_PUT_STREAM(dy + i + 16, xmm1);
@@ -199,7 +198,7 @@ DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12_direct_sse4)
             PIXCONV_STREAM_LOAD(xmm2, uv + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, uv + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             // process first pair
             xmm4 = _mm_srli_epi16(xmm0, 8);
@@ -241,22 +240,22 @@ DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12_direct_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_p010_nv12_direct_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
     const ptrdiff_t chromaHeight = (height >> 1);
 
     const ptrdiff_t byteWidth = width << 1;
-    const ptrdiff_t stride = min(FFALIGN(byteWidth, 64), min(inStride, outStride << 1));
+    const ptrdiff_t stride = FFMIN((ptrdiff_t)FFALIGN(byteWidth, 64), FFMIN(inStride, outStride << 1));
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 4, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 4, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
 
@@ -267,7 +266,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
     for (line = 0; line < height; line++)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm4 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 0));
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 8));
@@ -290,7 +289,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
             PIXCONV_STREAM_LOAD(xmm2, y + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, y + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             // apply dithering coeffs
             xmm0 = _mm_adds_epu16(xmm0, xmm4);
@@ -325,7 +324,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
     for (line = 0; line < chromaHeight; line++)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm4 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 0));
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 8));
@@ -348,7 +347,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
             PIXCONV_STREAM_LOAD(xmm2, uv + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, uv + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             // apply dithering coeffs
             xmm0 = _mm_adds_epu16(xmm0, xmm4);
@@ -380,16 +379,16 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_direct_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_y210_p210_direct_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_y210_p210_direct_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
 
     const ptrdiff_t byteWidth = width << 2;
-    const ptrdiff_t stride = min(FFALIGN(byteWidth, 64), min(inStride, outStride << 1));
+    const ptrdiff_t stride = FFMIN((ptrdiff_t)FFALIGN(byteWidth, 64), FFMIN(inStride, outStride << 1));
 
     ptrdiff_t line, i;
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
@@ -433,16 +432,16 @@ DECLARE_CONV_FUNC_IMPL(convert_y210_p210_direct_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuy2_yv16_direct_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_yuy2_yv16_direct_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
 
     const ptrdiff_t byteWidth = width << 1;
-    const ptrdiff_t stride = min(FFALIGN(byteWidth, 64), min(inStride, outStride << 1));
+    const ptrdiff_t stride = FFMIN((ptrdiff_t)FFALIGN(byteWidth, 64), FFMIN(inStride, outStride << 1));
 
     ptrdiff_t line, i;
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
@@ -461,7 +460,7 @@ DECLARE_CONV_FUNC_IMPL(convert_yuy2_yv16_direct_sse4)
             PIXCONV_STREAM_LOAD(xmm2, srcLine + i + 32);
             PIXCONV_STREAM_LOAD(xmm3, srcLine + i + 48);
 
-            _ReadWriteBarrier();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
 
             // extract Y
             xmm4 = _mm_and_si128(xmm0, xmm7);
@@ -497,5 +496,5 @@ DECLARE_CONV_FUNC_IMPL(convert_yuy2_yv16_direct_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
@@ -17,7 +17,6 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
 #include "pixconv_internal.h"
 
 extern "C"
@@ -27,113 +26,134 @@ extern "C"
 
 #define ALIGN(x, a) (((x) + (a)-1UL) & ~((a)-1UL))
 
-DECLARE_CONV_FUNC_IMPL(convert_generic)
+static int swscale_scale(PixConvContext *ctx, enum AVPixelFormat srcPix, enum AVPixelFormat dstPix,
+                         const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[4], int width,
+                         int height, const ptrdiff_t dstStride[4], LAVOutPixFmtDesc pixFmtDesc,
+                         bool swapPlanes12 = false);
+static int ConvertTo422Packed(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                              uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+static int ConvertToAYUV(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+static int ConvertToPX1X(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4], int chromaVertical);
+static int ConvertToY410(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+static int ConvertToY416(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+static int ConvertTov210(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+static int ConvertTov410(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[4], int width, int height, const ptrdiff_t dstStride[4]);
+
+DECLARE_CONV_FUNC(convert_generic)
 {
-    HRESULT hr = S_OK;
+    int hr = 0;
 
-    AVPixelFormat inputFmt = GetFFInput();
+    AVPixelFormat inputFmt = getFFPixelFormatFromLAV(inputFormat, bpp);
 
-    switch (m_OutputPixFmt)
+    switch (outputFormat)
     {
-    case LAVOutPixFmt_YV12:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_YUV420P, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt], true);
+    case PixConvOut_YV12:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_YUV420P, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat], true);
         break;
-    case LAVOutPixFmt_NV12:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_NV12, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt]);
+    case PixConvOut_NV12:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_NV12, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat]);
         break;
-    case LAVOutPixFmt_YUY2: hr = ConvertTo422Packed(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_UYVY: hr = ConvertTo422Packed(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_AYUV: hr = ConvertToAYUV(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_P010: hr = ConvertToPX1X(src, srcStride, dst, width, height, dstStride, 2); break;
-    case LAVOutPixFmt_P016: hr = ConvertToPX1X(src, srcStride, dst, width, height, dstStride, 2); break;
-    case LAVOutPixFmt_P210: hr = ConvertToPX1X(src, srcStride, dst, width, height, dstStride, 1); break;
-    case LAVOutPixFmt_P216: hr = ConvertToPX1X(src, srcStride, dst, width, height, dstStride, 1); break;
-    case LAVOutPixFmt_Y410: hr = ConvertToY410(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_Y416: hr = ConvertToY416(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_RGB32:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_BGRA, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt]);
+    case PixConvOut_YUY2: hr = ConvertTo422Packed(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_UYVY: hr = ConvertTo422Packed(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_AYUV: hr = ConvertToAYUV(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_P010: hr = ConvertToPX1X(ctx, src, srcStride, dst, width, height, dstStride, 2); break;
+    case PixConvOut_P016: hr = ConvertToPX1X(ctx, src, srcStride, dst, width, height, dstStride, 2); break;
+    case PixConvOut_P210: hr = ConvertToPX1X(ctx, src, srcStride, dst, width, height, dstStride, 1); break;
+    case PixConvOut_P216: hr = ConvertToPX1X(ctx, src, srcStride, dst, width, height, dstStride, 1); break;
+    case PixConvOut_Y410: hr = ConvertToY410(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_Y416: hr = ConvertToY416(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_RGB32:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_BGRA, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat]);
         break;
-    case LAVOutPixFmt_RGB24:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_BGR24, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt]);
+    case PixConvOut_RGB24:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_BGR24, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat]);
         break;
-    case LAVOutPixFmt_v210: hr = ConvertTov210(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_v410: hr = ConvertTov410(src, srcStride, dst, width, height, dstStride); break;
-    case LAVOutPixFmt_YV16:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_YUV422P, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt], true);
+    case PixConvOut_v210: hr = ConvertTov210(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_v410: hr = ConvertTov410(ctx, src, srcStride, dst, width, height, dstStride); break;
+    case PixConvOut_YV16:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_YUV422P, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat], true);
         break;
-    case LAVOutPixFmt_YV24:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_YUV444P, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt], true);
+    case PixConvOut_YV24:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_YUV444P, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat], true);
         break;
-    case LAVOutPixFmt_RGB48:
-        hr = swscale_scale(inputFmt, AV_PIX_FMT_RGB48LE, src, srcStride, dst, width, height, dstStride,
-                           lav_pixfmt_desc[m_OutputPixFmt]);
+    case PixConvOut_RGB48:
+        hr = swscale_scale(ctx, inputFmt, AV_PIX_FMT_RGB48LE, src, srcStride, dst, width, height, dstStride,
+                           lav_pixfmt_desc[outputFormat]);
         break;
     default:
-        ASSERT(0);
-        hr = E_FAIL;
+        assert(0);
+        hr = AVERROR(EINVAL);
         break;
     }
 
-    return S_OK;
+    return 0;
 }
 
-inline SwsContext *CLAVPixFmtConverter::GetSWSContext(int width, int height, enum AVPixelFormat srcPix,
-                                                      enum AVPixelFormat dstPix, int flags)
+SwsContext *pixconv_sws_context(PixConvContext *ctx, int width, int height, enum AVPixelFormat srcPix,
+                                enum AVPixelFormat dstPix, int flags)
 {
-    if (!m_pSwsContext || swsWidth != width || swsHeight != height)
+    if (!ctx->swsContext || ctx->swsWidth != width || ctx->swsHeight != height)
     {
         // Get context
-        m_pSwsContext = sws_getCachedContext(m_pSwsContext, width, height, srcPix, width, height, dstPix,
-                                             flags | SWS_PRINT_INFO, nullptr, nullptr, nullptr);
+        ctx->swsContext = sws_getCachedContext(ctx->swsContext, width, height, srcPix, width, height, dstPix,
+                                               flags | SWS_PRINT_INFO, nullptr, nullptr, nullptr);
+        if (!ctx->swsContext)
+            return nullptr;
 
         int *inv_tbl = nullptr, *tbl = nullptr;
         int srcRange, dstRange, brightness, contrast, saturation;
-        int ret = sws_getColorspaceDetails(m_pSwsContext, &inv_tbl, &srcRange, &tbl, &dstRange, &brightness, &contrast,
-                                           &saturation);
+        int ret = sws_getColorspaceDetails(ctx->swsContext, &inv_tbl, &srcRange, &tbl, &dstRange, &brightness,
+                                           &contrast, &saturation);
         if (ret >= 0)
         {
             const int *rgbTbl = nullptr;
-            if (m_ColorProps.VideoTransferMatrix != DXVA2_VideoTransferMatrix_Unknown)
+            if (ctx->colorProps.matrix != PixConvMatrix_Unknown)
             {
                 int colorspace = SWS_CS_ITU709;
-                switch (m_ColorProps.VideoTransferMatrix)
+                switch (ctx->colorProps.matrix)
                 {
-                case DXVA2_VideoTransferMatrix_BT709: colorspace = SWS_CS_ITU709; break;
-                case DXVA2_VideoTransferMatrix_BT601: colorspace = SWS_CS_ITU601; break;
-                case DXVA2_VideoTransferMatrix_SMPTE240M: colorspace = SWS_CS_SMPTE240M; break;
+                case PixConvMatrix_BT709: colorspace = SWS_CS_ITU709; break;
+                case PixConvMatrix_BT601: colorspace = SWS_CS_ITU601; break;
+                case PixConvMatrix_SMPTE240M: colorspace = SWS_CS_SMPTE240M; break;
                 }
                 rgbTbl = sws_getCoefficients(colorspace);
             }
             else
             {
-                BOOL isHD = (height >= 720 || width >= 1280);
+                bool isHD = (height >= 720 || width >= 1280);
                 rgbTbl = sws_getCoefficients(isHD ? SWS_CS_ITU709 : SWS_CS_ITU601);
             }
-            srcRange = dstRange = (m_ColorProps.NominalRange == DXVA2_NominalRange_0_255);
-            sws_setColorspaceDetails(m_pSwsContext, rgbTbl, srcRange, rgbTbl, dstRange, brightness, contrast,
+            srcRange = dstRange = ctx->colorProps.fullRange;
+            sws_setColorspaceDetails(ctx->swsContext, rgbTbl, srcRange, rgbTbl, dstRange, brightness, contrast,
                                      saturation);
         }
-        swsWidth = width;
-        swsHeight = height;
+        ctx->swsWidth = width;
+        ctx->swsHeight = height;
     }
-    return m_pSwsContext;
+    return ctx->swsContext;
 }
 
-HRESULT CLAVPixFmtConverter::swscale_scale(enum AVPixelFormat srcPix, enum AVPixelFormat dstPix,
-                                           const uint8_t *const src[], const ptrdiff_t srcStride[], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[],
-                                           LAVOutPixFmtDesc pixFmtDesc, bool swapPlanes12)
+static int swscale_scale(PixConvContext *ctx, enum AVPixelFormat srcPix, enum AVPixelFormat dstPix,
+                         const uint8_t *const src[], const ptrdiff_t srcStride[], uint8_t *dst[], int width,
+                         int height, const ptrdiff_t dstStride[], LAVOutPixFmtDesc pixFmtDesc, bool swapPlanes12)
 {
     int ret;
 
-    SwsContext *ctx = GetSWSContext(width, height, srcPix, dstPix, SWS_BILINEAR);
-    CheckPointer(m_pSwsContext, E_POINTER);
+    SwsContext *swsCtx = pixconv_sws_context(ctx, width, height, srcPix, dstPix, SWS_BILINEAR);
+    if (!swsCtx)
+        return AVERROR(EINVAL);
 
     if (swapPlanes12)
     {
@@ -142,30 +162,31 @@ HRESULT CLAVPixFmtConverter::swscale_scale(enum AVPixelFormat srcPix, enum AVPix
         dst[2] = tmp;
     }
 
-    ret = sws_scale2(ctx, src, srcStride, 0, height, dst, dstStride);
+    ret = sws_scale2(swsCtx, src, srcStride, 0, height, dst, dstStride);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], const ptrdiff_t srcStride[4],
-                                                uint8_t *dst[], int width, int height, const ptrdiff_t dstStride[])
+static int ConvertTo422Packed(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                              uint8_t *dst[], int width, int height, const ptrdiff_t dstStride[])
 {
-    const BYTE *y = nullptr;
-    const BYTE *u = nullptr;
-    const BYTE *v = nullptr;
+    const uint8_t *y = nullptr;
+    const uint8_t *u = nullptr;
+    const uint8_t *v = nullptr;
     ptrdiff_t line, i;
     ptrdiff_t sourceStride = 0;
-    BYTE *pTmpBuffer = nullptr;
+    ptrdiff_t sourceStrideUV = 0;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if (m_InputPixFmt != LAVPixFmt_YUV422)
+    if (ctx->inputFormat != LAVPixFmt_YUV422)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 2);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 2);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride);
@@ -177,13 +198,16 @@ HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], con
         tmpStride[2] = scaleStride / 2;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV422P, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV422P, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = tmp[0];
         u = tmp[1];
         v = tmp[2];
         sourceStride = scaleStride;
+        sourceStrideUV = scaleStride / 2;
     }
     else
     {
@@ -191,6 +215,7 @@ HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], con
         u = src[1];
         v = src[2];
         sourceStride = srcStride[0];
+        sourceStrideUV = srcStride[1];
     }
 
 #define YUV422_PACK_YUY2(offset) \
@@ -200,9 +225,8 @@ HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], con
 
     uint8_t *out = dst[0];
     int halfwidth = width >> 1;
-    ptrdiff_t halfstride = sourceStride >> 1;
 
-    if (m_OutputPixFmt == LAVOutPixFmt_YUY2)
+    if (ctx->outputFormat == PixConvOut_YUY2)
     {
         for (line = 0; line < height; ++line)
         {
@@ -223,8 +247,8 @@ HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], con
                 YUV422_PACK_YUY2(0)
             }
             y += sourceStride;
-            u += halfstride;
-            v += halfstride;
+            u += sourceStrideUV;
+            v += sourceStrideUV;
             out += dstStride[0];
         }
     }
@@ -249,36 +273,36 @@ HRESULT CLAVPixFmtConverter::ConvertTo422Packed(const uint8_t *const src[4], con
                 YUV422_PACK_UYVY(0)
             }
             y += sourceStride;
-            u += halfstride;
-            v += halfstride;
+            u += sourceStrideUV;
+            v += sourceStrideUV;
             out += dstStride[0];
         }
     }
 
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertToAYUV(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[])
+static int ConvertToAYUV(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
+                         int width, int height, const ptrdiff_t dstStride[])
 {
-    const BYTE *y = nullptr;
-    const BYTE *u = nullptr;
-    const BYTE *v = nullptr;
+    const uint8_t *y = nullptr;
+    const uint8_t *u = nullptr;
+    const uint8_t *v = nullptr;
     ptrdiff_t line, i = 0;
     ptrdiff_t sourceStride = 0;
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if (m_InputPixFmt != LAVPixFmt_YUV444)
+    if (ctx->inputFormat != LAVPixFmt_YUV444)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 3);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 3);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride);
@@ -289,8 +313,10 @@ HRESULT CLAVPixFmtConverter::ConvertToAYUV(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV444P, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV444P, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = tmp[0];
         u = tmp[1];
@@ -307,7 +333,7 @@ HRESULT CLAVPixFmtConverter::ConvertToAYUV(const uint8_t *const src[4], const pt
 
 #define YUV444_PACK_AYUV(offset) *idst++ = v[i + offset] | (u[i + offset] << 8) | (y[i + offset] << 16) | (0xff << 24);
 
-    BYTE *out = dst[0];
+    uint8_t *out = dst[0];
     for (line = 0; line < height; ++line)
     {
         uint32_t *idst = (uint32_t *)out;
@@ -334,32 +360,33 @@ HRESULT CLAVPixFmtConverter::ConvertToAYUV(const uint8_t *const src[4], const pt
 
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[], int chromaVertical)
+static int ConvertToPX1X(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                         uint8_t *dst[], int width, int height, const ptrdiff_t dstStride[], int chromaVertical)
 {
-    const BYTE *y = nullptr;
-    const BYTE *u = nullptr;
-    const BYTE *v = nullptr;
+    const uint8_t *y = nullptr;
+    const uint8_t *u = nullptr;
+    const uint8_t *v = nullptr;
     ptrdiff_t line, i = 0;
     ptrdiff_t sourceStride = 0;
+    ptrdiff_t sourceStrideUV = 0;
 
     int shift = 0;
 
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if ((chromaVertical == 1 && m_InputPixFmt != LAVPixFmt_YUV422bX) ||
-        (chromaVertical == 2 && m_InputPixFmt != LAVPixFmt_YUV420bX))
+    if ((chromaVertical == 1 && ctx->inputFormat != LAVPixFmt_YUV422bX) ||
+        (chromaVertical == 2 && ctx->inputFormat != LAVPixFmt_YUV420bX))
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32) * 2;
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 2);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 2);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride);
@@ -370,15 +397,16 @@ HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride / 2;
         tmpStride[3] = 0;
 
-        SwsContext *ctx =
-            GetSWSContext(width, height, GetFFInput(),
-                          chromaVertical == 1 ? AV_PIX_FMT_YUV422P16LE : AV_PIX_FMT_YUV420P16LE, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(
+            ctx, width, height, getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+            chromaVertical == 1 ? AV_PIX_FMT_YUV422P16LE : AV_PIX_FMT_YUV420P16LE, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = tmp[0];
         u = tmp[1];
         v = tmp[2];
         sourceStride = scaleStride;
+        sourceStrideUV = scaleStride / 2;
     }
     else
     {
@@ -386,13 +414,14 @@ HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const pt
         u = src[1];
         v = src[2];
         sourceStride = srcStride[0];
+        sourceStrideUV = srcStride[1];
 
-        shift = (16 - m_InBpp);
+        shift = (16 - ctx->inBpp);
     }
 
     // copy Y
-    BYTE *pLineOut = dst[0];
-    const BYTE *pLineIn = y;
+    uint8_t *pLineOut = dst[0];
+    const uint8_t *pLineIn = y;
     for (line = 0; line < height; ++line)
     {
         if (shift == 0)
@@ -415,10 +444,10 @@ HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const pt
         pLineIn += sourceStride;
     }
 
-    sourceStride >>= 2;
+    sourceStrideUV >>= 1;
 
     // Merge U/V
-    BYTE *out = dst[1];
+    uint8_t *out = dst[1];
     const uint16_t *uc = (uint16_t *)u;
     const uint16_t *vc = (uint16_t *)v;
     for (line = 0; line < height / chromaVertical; ++line)
@@ -435,14 +464,14 @@ HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const pt
             }
             *idst++ = uv | (vv << 16);
         }
-        uc += sourceStride;
-        vc += sourceStride;
+        uc += sourceStrideUV;
+        vc += sourceStrideUV;
         out += dstStride[1];
     }
 
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
 #define YUV444_PACKED_LOOP_HEAD(width, height, y, u, v, out) \
@@ -467,8 +496,8 @@ HRESULT CLAVPixFmtConverter::ConvertToPX1X(const uint8_t *const src[4], const pt
     out += dstStride;                                              \
     }
 
-HRESULT CLAVPixFmtConverter::ConvertToY410(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[])
+static int ConvertToY410(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
+                         int width, int height, const ptrdiff_t dstStride[])
 {
     const uint16_t *y = nullptr;
     const uint16_t *u = nullptr;
@@ -476,17 +505,17 @@ HRESULT CLAVPixFmtConverter::ConvertToY410(const uint8_t *const src[4], const pt
     ptrdiff_t sourceStride = 0;
     bool b9Bit = false;
 
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if (m_InputPixFmt != LAVPixFmt_YUV444bX || m_InBpp > 10)
+    if (ctx->inputFormat != LAVPixFmt_YUV444bX || ctx->inBpp > 10)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 6);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 6);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride * 2);
@@ -497,8 +526,10 @@ HRESULT CLAVPixFmtConverter::ConvertToY410(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride * 2;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV444P10LE, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV444P10LE, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = (uint16_t *)tmp[0];
         u = (uint16_t *)tmp[1];
@@ -512,12 +543,12 @@ HRESULT CLAVPixFmtConverter::ConvertToY410(const uint8_t *const src[4], const pt
         v = (uint16_t *)src[2];
         sourceStride = srcStride[0] / 2;
 
-        b9Bit = (m_InBpp == 9);
+        b9Bit = (ctx->inBpp == 9);
     }
 
 #define YUV444_Y410_PACK *idst++ = (uv & 0x3FF) | ((yv & 0x3FF) << 10) | ((vv & 0x3FF) << 20) | (3 << 30);
 
-    BYTE *out = dst[0];
+    uint8_t *out = dst[0];
     YUV444_PACKED_LOOP_HEAD_LE(width, height, y, u, v, out)
     if (b9Bit)
     {
@@ -530,29 +561,29 @@ HRESULT CLAVPixFmtConverter::ConvertToY410(const uint8_t *const src[4], const pt
 
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertToY416(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[])
+static int ConvertToY416(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
+                         int width, int height, const ptrdiff_t dstStride[])
 {
     const uint16_t *y = nullptr;
     const uint16_t *u = nullptr;
     const uint16_t *v = nullptr;
     ptrdiff_t sourceStride = 0;
 
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    int shift = (16 - m_InBpp);
-    if (m_InputPixFmt != LAVPixFmt_YUV444bX)
+    int shift = (16 - ctx->inBpp);
+    if (ctx->inputFormat != LAVPixFmt_YUV444bX)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 6);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 6);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride * 2);
@@ -563,8 +594,10 @@ HRESULT CLAVPixFmtConverter::ConvertToY416(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride * 2;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV444P16LE, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV444P16LE, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = (uint16_t *)tmp[0];
         u = (uint16_t *)tmp[1];
@@ -580,7 +613,7 @@ HRESULT CLAVPixFmtConverter::ConvertToY416(const uint8_t *const src[4], const pt
         sourceStride = srcStride[0] / 2;
     }
 
-    BYTE *out = dst[0];
+    uint8_t *out = dst[0];
     YUV444_PACKED_LOOP_HEAD_LE(width, height, y, u, v, out)
     uint16_t *p = (uint16_t *)idst;
     p[0] = (uv << shift);
@@ -593,11 +626,11 @@ HRESULT CLAVPixFmtConverter::ConvertToY416(const uint8_t *const src[4], const pt
 
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[])
+static int ConvertTov210(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
+                         int width, int height, const ptrdiff_t dstStride[])
 {
     const uint16_t *y = nullptr;
     const uint16_t *u = nullptr;
@@ -605,17 +638,17 @@ HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const pt
     ptrdiff_t srcyStride = 0;
     ptrdiff_t srcuvStride = 0;
 
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if (m_InputPixFmt != LAVPixFmt_YUV422bX || m_InBpp != 10)
+    if (ctx->inputFormat != LAVPixFmt_YUV422bX || ctx->inBpp != 10)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 6);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 6);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride * 2);
@@ -626,8 +659,10 @@ HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV422P10LE, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV422P10LE, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = (uint16_t *)tmp[0];
         u = (uint16_t *)tmp[1];
@@ -651,7 +686,7 @@ HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const pt
     // This may read into the source stride, but otherwise the algorithm won't work.
     width = FFALIGN(width, 2);
 
-    BYTE *pdst = dst[0];
+    uint8_t *pdst = dst[0];
     uint32_t *p = (uint32_t *)pdst;
     int w;
 
@@ -693,7 +728,7 @@ HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const pt
         }
 
         pdst += outStride;
-        memset(p, 0, pdst - (BYTE *)p);
+        memset(p, 0, pdst - (uint8_t *)p);
         p = (uint32_t *)pdst;
         y += srcyStride - width;
         u += srcuvStride - (width >> 1);
@@ -701,11 +736,11 @@ HRESULT CLAVPixFmtConverter::ConvertTov210(const uint8_t *const src[4], const pt
     }
     av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
 }
 
-HRESULT CLAVPixFmtConverter::ConvertTov410(const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
-                                           int width, int height, const ptrdiff_t dstStride[])
+static int ConvertTov410(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[],
+                         int width, int height, const ptrdiff_t dstStride[])
 {
     const uint16_t *y = nullptr;
     const uint16_t *u = nullptr;
@@ -713,17 +748,17 @@ HRESULT CLAVPixFmtConverter::ConvertTov410(const uint8_t *const src[4], const pt
     ptrdiff_t sourceStride = 0;
     bool b9Bit = false;
 
-    BYTE *pTmpBuffer = nullptr;
+    uint8_t *pTmpBuffer = nullptr;
 
-    if (m_InputPixFmt != LAVPixFmt_YUV444bX || m_InBpp > 10)
+    if (ctx->inputFormat != LAVPixFmt_YUV444bX || ctx->inBpp > 10)
     {
         uint8_t *tmp[4] = {nullptr};
         ptrdiff_t tmpStride[4] = {0};
         ptrdiff_t scaleStride = FFALIGN(width, 32);
 
-        pTmpBuffer = (BYTE *)av_malloc(height * scaleStride * 6);
+        pTmpBuffer = (uint8_t *)av_malloc(height * scaleStride * 6);
         if (pTmpBuffer == nullptr)
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
 
         tmp[0] = pTmpBuffer;
         tmp[1] = tmp[0] + (height * scaleStride * 2);
@@ -734,8 +769,10 @@ HRESULT CLAVPixFmtConverter::ConvertTov410(const uint8_t *const src[4], const pt
         tmpStride[2] = scaleStride * 2;
         tmpStride[3] = 0;
 
-        SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_YUV444P10LE, SWS_BILINEAR);
-        sws_scale2(ctx, src, srcStride, 0, height, tmp, tmpStride);
+        SwsContext *swsCtx = pixconv_sws_context(ctx, width, height,
+                                                 getFFPixelFormatFromLAV(ctx->inputFormat, ctx->inBpp),
+                                                 AV_PIX_FMT_YUV444P10LE, SWS_BILINEAR);
+        sws_scale2(swsCtx, src, srcStride, 0, height, tmp, tmpStride);
 
         y = (uint16_t *)tmp[0];
         u = (uint16_t *)tmp[1];
@@ -749,12 +786,12 @@ HRESULT CLAVPixFmtConverter::ConvertTov410(const uint8_t *const src[4], const pt
         v = (uint16_t *)src[2];
         sourceStride = srcStride[0] / 2;
 
-        b9Bit = (m_InBpp == 9);
+        b9Bit = (ctx->inBpp == 9);
     }
 
 #define YUV444_v410_PACK *idst++ = ((uv & 0x3FF) << 2) | ((yv & 0x3FF) << 12) | ((vv & 0x3FF) << 22);
 
-    BYTE *out = dst[0];
+    uint8_t *out = dst[0];
     YUV444_PACKED_LOOP_HEAD_LE(width, height, y, u, v, out)
     if (b9Bit)
     {
@@ -766,5 +803,22 @@ HRESULT CLAVPixFmtConverter::ConvertTov410(const uint8_t *const src[4], const pt
 
         av_freep(&pTmpBuffer);
 
-    return S_OK;
+    return 0;
+}
+
+int sws_scale2(struct SwsContext *c, const uint8_t *const srcSlice[], const ptrdiff_t srcStride[], int srcSliceY,
+               int srcSliceH, uint8_t *const dst[], const ptrdiff_t dstStride[])
+{
+    if (!c)
+        return -1;
+
+    int srcStride2[4];
+    int dstStride2[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        srcStride2[i] = (int)srcStride[i];
+        dstStride2[i] = (int)dstStride[i];
+    }
+    return sws_scale(c, srcSlice, srcStride2, srcSliceY, srcSliceH, dst, dstStride2);
 }
@@ -17,14 +17,13 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
+#include "pixconv_avx2_templates.h"
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv444_y410)
+DECLARE_CONV_FUNC(convert_yuv444_y410)
 {
     const uint16_t *y = (const uint16_t *)src[0];
     const uint16_t *u = (const uint16_t *)src[1];
@@ -78,5 +77,94 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv444_y410)
         u += inStride;
         v += inStride;
     }
-    return S_OK;
+    return 0;
+}
+
+// Pack 16 Y/U/V pixels into Y410
+// The result is split over two registers, which hold the pixels 0-3/8-11 and 4-7/12-15 respectively
+PIXCONV_TARGET_AVX2 __forceinline static void yuv444_y410_pack_avx2(const __m256i &y, const __m256i &u,
+                                                                    const __m256i &v, const __m256i &alpha,
+                                                                    __m256i &out1, __m256i &out2)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i ymm0, ymm1;
+
+    out1 = _mm256_unpacklo_epi16(u, v);  // 0VVVVV00000UUUUU
+    out2 = _mm256_unpackhi_epi16(u, v);  // 0VVVVV00000UUUUU
+    out1 = _mm256_or_si256(out1, alpha); // AVVVVV00000UUUUU
+    out2 = _mm256_or_si256(out2, alpha); // AVVVVV00000UUUUU
+
+    ymm0 = _mm256_unpacklo_epi16(y, zero); // 00000000000YYYYY
+    ymm1 = _mm256_unpackhi_epi16(y, zero); // 00000000000YYYYY
+    ymm0 = _mm256_slli_epi32(ymm0, 10);    // 000000YYYYY00000
+    ymm1 = _mm256_slli_epi32(ymm1, 10);    // 000000YYYYY00000
+
+    out1 = _mm256_or_si256(out1, ymm0); // AVVVVVYYYYYUUUUU
+    out2 = _mm256_or_si256(out2, ymm1); // AVVVVVYYYYYUUUUU
+}
+
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv444_y410_avx2)
+{
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, 1))
+        return convert_yuv444_y410(ctx, src, srcStride, dst, dstStride, width, height, inputFormat, bpp, outputFormat);
+
+    const uint16_t *y = (const uint16_t *)src[0];
+    const uint16_t *u = (const uint16_t *)src[1];
+    const uint16_t *v = (const uint16_t *)src[2];
+
+    const ptrdiff_t inStride = srcStride[0] >> 1;
+    const ptrdiff_t outStride = dstStride[0];
+    const __m128i shift = _mm_cvtsi32_si128(10 - bpp);
+    const __m128i shiftV = _mm_cvtsi32_si128(10 - bpp + 4); // +4 so its directly aligned properly
+
+    ptrdiff_t line, i;
+
+    __m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm7;
+
+    ymm7 = _mm256_set1_epi32(0xC0000000);
+
+    _mm_sfence();
+
+    for (line = 0; line < height; ++line)
+    {
+        uint8_t *const d = dst[0] + line * outStride;
+
+        for (i = 0; i < (width - 15); i += 16)
+        {
+            PIXCONV_AVX2_LOAD(ymm0, (y + i));
+            PIXCONV_AVX2_LOAD(ymm1, (u + i));
+            PIXCONV_AVX2_LOAD(ymm2, (v + i));
+            ymm0 = _mm256_sll_epi16(ymm0, shift);
+            ymm1 = _mm256_sll_epi16(ymm1, shift);
+            ymm2 = _mm256_sll_epi16(ymm2, shiftV);
+
+            yuv444_y410_pack_avx2(ymm0, ymm1, ymm2, ymm7, ymm3, ymm4);
+
+            // Write data back
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2) + 0, _mm256_permute2x128_si256(ymm3, ymm4, 0x20));
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2) + 32, _mm256_permute2x128_si256(ymm3, ymm4, 0x31));
+        }
+        for (; i < width; i += 8)
+        {
+            // Only the low lane carries valid pixels here
+            ymm0 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(y + i)));
+            ymm1 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(u + i)));
+            ymm2 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(v + i)));
+            ymm0 = _mm256_sll_epi16(ymm0, shift);
+            ymm1 = _mm256_sll_epi16(ymm1, shift);
+            ymm2 = _mm256_sll_epi16(ymm2, shiftV);
+
+            yuv444_y410_pack_avx2(ymm0, ymm1, ymm2, ymm7, ymm3, ymm4);
+
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2), _mm256_permute2x128_si256(ymm3, ymm4, 0x20));
+        }
+
+        y += inStride;
+        u += inStride;
+        v += inStride;
+    }
+
+    _mm256_zeroupper();
+
+    return 0;
 }
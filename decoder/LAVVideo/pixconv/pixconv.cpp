@@ -17,14 +17,25 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
 
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rand_sse.h"
+
+// Minimum number of pixels in one band when threading a conversion, below this the threading overhead dominates
+#define PIXCONV_BAND_MIN_PIXELS (256 * 1024)
+// Band height alignment, covers the vertical chroma subsampling and keeps the 8x8 dither pattern intact
+#define PIXCONV_BAND_ALIGN 16
+
 // 8x8 Bayes ordered dithering table, scaled to the 0-255 range for 16->8 conversion
 // stored as 16-bit unsigned for optimized SIMD access
 // clang-format off
-__declspec(align(16)) const uint16_t dither_8x8_256[8][8] = {
+alignas(16) const uint16_t dither_8x8_256[8][8] = {
   {   0, 192,  48, 240,  12, 204,  60, 252 },
   { 128,  64, 176, 112, 140,  76, 188, 124 },
   {  32, 224,  16, 208,  44, 236,  28, 220 },
@@ -36,12 +47,36 @@ __declspec(align(16)) const uint16_t dither_8x8_256[8][8] = {
 };
 // clang-format on
 
-DECLARE_CONV_FUNC_IMPL(plane_copy)
+// Memory layout of the output pixel formats, indexed by LAVOutPixFmts
+// clang-format off
+const LAVOutPixFmtDesc lav_pixfmt_desc[] = {
+  { 12, 1, 3, { 1, 2, 2 }, { 1, 2, 2 } }, // YV12
+  { 12, 1, 2, { 1, 2 }, { 1, 1 } },       // NV12
+  { 16, 2, 0, { 1 }, { 1 } },             // YUY2 (packed)
+  { 16, 2, 0, { 1 }, { 1 } },             // UYVY (packed)
+  { 32, 4, 0, { 1 }, { 1 } },             // AYUV (packed)
+  { 24, 2, 2, { 1, 2 }, { 1, 1 } },       // P010
+  { 32, 2, 2, { 1, 1 }, { 1, 1 } },       // P210
+  { 32, 4, 0, { 1 }, { 1 } },             // Y410 (packed)
+  { 24, 2, 2, { 1, 2 }, { 1, 1 } },       // P016
+  { 32, 2, 2, { 1, 1 }, { 1, 1 } },       // P216
+  { 64, 8, 0, { 1 }, { 1 } },             // Y416 (packed)
+  { 32, 4, 0, { 1 }, { 1 } },             // RGB32
+  { 24, 3, 0, { 1 }, { 1 } },             // RGB24
+  { 24, 4, 0, { 1 }, { 1 } },             // v210 (packed)
+  { 32, 4, 0, { 1 }, { 1 } },             // v410 (packed)
+  { 16, 1, 3, { 1, 1, 1 }, { 1, 2, 2 } }, // YV16
+  { 24, 1, 3, { 1, 1, 1 }, { 1, 1, 1 } }, // YV24
+  { 48, 6, 0, { 1 }, { 1 } },             // RGB48
+};
+// clang-format on
+
+DECLARE_CONV_FUNC(plane_copy)
 {
     LAVOutPixFmtDesc desc = lav_pixfmt_desc[outputFormat];
 
     const int widthBytes = width * desc.codedbytes;
-    const int planes = max(desc.planes, 1);
+    const int planes = FFMAX(desc.planes, 1);
 
     ptrdiff_t line, plane;
 
@@ -60,15 +95,15 @@ DECLARE_CONV_FUNC_IMPL(plane_copy)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(plane_copy_sse2)
+DECLARE_CONV_FUNC(plane_copy_sse2)
 {
     LAVOutPixFmtDesc desc = lav_pixfmt_desc[outputFormat];
 
     const int widthBytes = width * desc.codedbytes;
-    const int planes = max(desc.planes, 1);
+    const int planes = FFMAX(desc.planes, 1);
 
     ptrdiff_t line, plane;
 
@@ -97,5 +132,646 @@ DECLARE_CONV_FUNC_IMPL(plane_copy_sse2)
         }
     }
 
-    return S_OK;
+    return 0;
+}
+
+static void pixconv_free_buffers(PixConvContext *ctx)
+{
+    if (ctx->swsContext)
+        sws_freeContext(ctx->swsContext);
+    ctx->swsContext = nullptr;
+    av_freep(&ctx->rgbCoeffs);
+    av_freep(&ctx->randomDithers);
+}
+
+PixConvContext *pixconv_alloc(int threads)
+{
+    PixConvContext *ctx = new (std::nothrow) PixConvContext;
+    if (ctx == nullptr)
+        return nullptr;
+
+    ctx->convert = convert_generic;
+    ctx->numThreads = FFMAX(threads, 1);
+    ctx->threadPool.SetNumThreads(ctx->numThreads - 1);
+
+    return ctx;
+}
+
+void pixconv_free(PixConvContext **pCtx)
+{
+    if (!pCtx || !*pCtx)
+        return;
+
+    PixConvContext *ctx = *pCtx;
+    pixconv_free_buffers(ctx);
+    av_freep(&ctx->alignedBuffer);
+    delete ctx;
+
+    *pCtx = nullptr;
+}
+
+static void pixconv_select_convert_function(PixConvContext *ctx)
+{
+    const LAVPixelFormat inputFormat = ctx->inputFormat;
+    const PixConvOutFmt outputFormat = ctx->outputFormat;
+    const int cpu = ctx->cpuFlags;
+
+    ctx->requiredAlignment = 16;
+    ctx->rgbConverter = false;
+    ctx->convert = nullptr;
+
+    if (outputFormat == PixConvOut_v210 || outputFormat == PixConvOut_v410)
+    {
+        // We assume that every filter that understands v210 will also properly handle it
+        ctx->requiredAlignment = 0;
+    }
+    else if ((outputFormat == PixConvOut_RGB32 &&
+              (inputFormat == LAVPixFmt_RGB32 || inputFormat == LAVPixFmt_ARGB32)) ||
+             (outputFormat == PixConvOut_RGB24 && inputFormat == LAVPixFmt_RGB24) ||
+             (outputFormat == PixConvOut_RGB48 && inputFormat == LAVPixFmt_RGB48) ||
+             (outputFormat == PixConvOut_YUY2 && inputFormat == LAVPixFmt_YUY2) ||
+             (outputFormat == PixConvOut_AYUV && inputFormat == LAVPixFmt_AYUV) ||
+             (outputFormat == PixConvOut_Y410 && inputFormat == LAVPixFmt_Y410) ||
+             (outputFormat == PixConvOut_Y416 && inputFormat == LAVPixFmt_Y416) ||
+             (outputFormat == PixConvOut_NV12 && inputFormat == LAVPixFmt_NV12) ||
+             ((outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) && inputFormat == LAVPixFmt_P016))
+    {
+        if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convert = plane_copy_sse2;
+        else
+            ctx->convert = plane_copy;
+        ctx->requiredAlignment = 0;
+    }
+    else if (inputFormat == LAVPixFmt_RGB48 && outputFormat == PixConvOut_RGB32 && (cpu & AV_CPU_FLAG_SSSE3))
+    {
+        ctx->convert = convert_rgb48_rgb32_ssse3;
+    }
+    else if (cpu & AV_CPU_FLAG_SSE2)
+    {
+        if (outputFormat == PixConvOut_AYUV && inputFormat == LAVPixFmt_YUV444bX)
+        {
+            if (cpu & AV_CPU_FLAG_AVX2)
+                ctx->convert = convert_yuv444_ayuv_dither_le_avx2;
+            else
+                ctx->convert = convert_yuv444_ayuv_dither_le;
+        }
+        else if (outputFormat == PixConvOut_AYUV && inputFormat == LAVPixFmt_YUV444)
+        {
+            ctx->convert = convert_yuv444_ayuv;
+        }
+        else if (outputFormat == PixConvOut_Y410 && inputFormat == LAVPixFmt_YUV444bX && ctx->inBpp <= 10)
+        {
+            if (cpu & AV_CPU_FLAG_AVX2)
+                ctx->convert = convert_yuv444_y410_avx2;
+            else
+                ctx->convert = convert_yuv444_y410;
+        }
+        else if (((outputFormat == PixConvOut_YV12 || outputFormat == PixConvOut_NV12) &&
+                  inputFormat == LAVPixFmt_YUV420bX) ||
+                 (outputFormat == PixConvOut_YV16 && inputFormat == LAVPixFmt_YUV422bX) ||
+                 (outputFormat == PixConvOut_YV24 && inputFormat == LAVPixFmt_YUV444bX))
+        {
+            if (outputFormat == PixConvOut_NV12)
+            {
+                if (cpu & AV_CPU_FLAG_AVX2)
+                    ctx->convert = convert_yuv_yv_nv12_dither_le_avx2<1>;
+                else
+                    ctx->convert = convert_yuv_yv_nv12_dither_le<1>;
+            }
+            else
+            {
+                if (cpu & AV_CPU_FLAG_AVX2)
+                    ctx->convert = convert_yuv_yv_nv12_dither_le_avx2<0>;
+                else
+                    ctx->convert = convert_yuv_yv_nv12_dither_le<0>;
+            }
+            ctx->requiredAlignment = 32;
+        }
+        else if (((outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) &&
+                  inputFormat == LAVPixFmt_YUV420bX) ||
+                 ((outputFormat == PixConvOut_P210 || outputFormat == PixConvOut_P216) &&
+                  inputFormat == LAVPixFmt_YUV422bX))
+        {
+            if (cpu & AV_CPU_FLAG_AVX2)
+                ctx->convert = convert_yuv420_px1x_le_avx2;
+            else
+                ctx->convert = convert_yuv420_px1x_le;
+        }
+        else if (outputFormat == PixConvOut_NV12 && inputFormat == LAVPixFmt_YUV420)
+        {
+            ctx->convert = convert_yuv420_nv12;
+            ctx->requiredAlignment = 32;
+        }
+        else if (outputFormat == PixConvOut_YUY2 && inputFormat == LAVPixFmt_YUV422)
+        {
+            ctx->convert = convert_yuv422_yuy2_uyvy<0>;
+            ctx->requiredAlignment = 32;
+        }
+        else if (outputFormat == PixConvOut_UYVY && inputFormat == LAVPixFmt_YUV422)
+        {
+            ctx->convert = convert_yuv422_yuy2_uyvy<1>;
+            ctx->requiredAlignment = 32;
+        }
+        else if ((outputFormat == PixConvOut_RGB32 || outputFormat == PixConvOut_RGB24) &&
+                 (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_YUV420bX ||
+                  inputFormat == LAVPixFmt_YUV422 || inputFormat == LAVPixFmt_YUV422bX ||
+                  inputFormat == LAVPixFmt_YUV444 || inputFormat == LAVPixFmt_YUV444bX ||
+                  inputFormat == LAVPixFmt_NV12 || inputFormat == LAVPixFmt_P016))
+        {
+            ctx->convert = convert_yuv_rgb;
+            if (outputFormat == PixConvOut_RGB32)
+            {
+                ctx->requiredAlignment = 4;
+            }
+            ctx->rgbConverter = true;
+        }
+        else if (outputFormat == PixConvOut_YV12 && inputFormat == LAVPixFmt_NV12)
+        {
+            ctx->convert = convert_nv12_yv12;
+            ctx->requiredAlignment = 32;
+        }
+        else if ((outputFormat == PixConvOut_YUY2 || outputFormat == PixConvOut_UYVY) &&
+                 (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_NV12 ||
+                  inputFormat == LAVPixFmt_YUV420bX) &&
+                 ctx->inBpp <= 14)
+        {
+            if (outputFormat == PixConvOut_YUY2)
+            {
+                if (cpu & AV_CPU_FLAG_AVX2)
+                    ctx->convert = convert_yuv420_yuy2_avx2<0>;
+                else
+                    ctx->convert = convert_yuv420_yuy2<0>;
+            }
+            else
+            {
+                if (cpu & AV_CPU_FLAG_AVX2)
+                    ctx->convert = convert_yuv420_yuy2_avx2<1>;
+                else
+                    ctx->convert = convert_yuv420_yuy2<1>;
+            }
+            ctx->requiredAlignment = 8; // Pixel alignment of 8 guarantees a byte alignment of 16
+        }
+        else if ((outputFormat == PixConvOut_YUY2 || outputFormat == PixConvOut_UYVY) &&
+                 inputFormat == LAVPixFmt_YUV422bX)
+        {
+            if (outputFormat == PixConvOut_YUY2)
+            {
+                ctx->convert = convert_yuv422_yuy2_uyvy_dither_le<0>;
+            }
+            else
+            {
+                ctx->convert = convert_yuv422_yuy2_uyvy_dither_le<1>;
+            }
+
+            ctx->requiredAlignment = 8; // Pixel alignment of 8 guarantees a byte alignment of 16
+        }
+        else if ((outputFormat == PixConvOut_YV12 && inputFormat == LAVPixFmt_YUV420) ||
+                 (outputFormat == PixConvOut_YV16 && inputFormat == LAVPixFmt_YUV422) ||
+                 (outputFormat == PixConvOut_YV24 && inputFormat == LAVPixFmt_YUV444))
+        {
+            ctx->convert = convert_yuv_yv;
+            ctx->requiredAlignment = 0;
+        }
+        else if (inputFormat == LAVPixFmt_RGB48 &&
+                 (outputFormat == PixConvOut_RGB24 || outputFormat == PixConvOut_RGB32))
+        {
+            if (outputFormat == PixConvOut_RGB32)
+                ctx->convert = convert_rgb48_rgb<1>;
+            else
+                ctx->convert = convert_rgb48_rgb<0>;
+        }
+        else if (inputFormat == LAVPixFmt_P016 && outputFormat == PixConvOut_NV12)
+        {
+            if (cpu & AV_CPU_FLAG_AVX2)
+                ctx->convert = convert_p010_nv12_avx2;
+            else
+                ctx->convert = convert_p010_nv12_sse2;
+        }
+        else if (inputFormat == LAVPixFmt_Y216 &&
+                 (outputFormat == PixConvOut_P210 || outputFormat == PixConvOut_P216) && (cpu & AV_CPU_FLAG_SSE4))
+        {
+            ctx->convert = convert_y210_p210_sse4;
+            ctx->requiredAlignment = 8; // P210 has two bytes per pixel, so eight pixels give the byte alignment of 16
+                                        // the streaming stores need
+        }
+        else if (inputFormat == LAVPixFmt_YUY2 && outputFormat == PixConvOut_YV16)
+        {
+            ctx->convert = convert_yuy2_yv16_sse2;
+            ctx->requiredAlignment = 32; // the chroma planes use half the stride, and are written with aligned stores
+        }
+    }
+
+    if (ctx->convert == nullptr)
+    {
+        ctx->convert = convert_generic;
+    }
+
+    // Most converters only work on the lines they are given, and the frame can be split into bands for threading.
+    // The exceptions are swscale, which needs to see the whole frame, and the 4:2:0 -> YUY2 and RGB converters,
+    // which interpolate chroma across lines and split the work internally instead.
+    if (ctx->convert == convert_generic)
+    {
+        ctx->bandThreading = (outputFormat == PixConvOut_YUY2 && inputFormat == LAVPixFmt_YUV422) ||
+                             (outputFormat == PixConvOut_UYVY && inputFormat == LAVPixFmt_YUV422) ||
+                             (outputFormat == PixConvOut_AYUV && inputFormat == LAVPixFmt_YUV444) ||
+                             ((outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) &&
+                              inputFormat == LAVPixFmt_YUV420bX) ||
+                             ((outputFormat == PixConvOut_P210 || outputFormat == PixConvOut_P216) &&
+                              inputFormat == LAVPixFmt_YUV422bX) ||
+                             (outputFormat == PixConvOut_Y416 && inputFormat == LAVPixFmt_YUV444bX) ||
+                             ((outputFormat == PixConvOut_Y410 || outputFormat == PixConvOut_v410) &&
+                              inputFormat == LAVPixFmt_YUV444bX && ctx->inBpp <= 10) ||
+                             (outputFormat == PixConvOut_v210 && inputFormat == LAVPixFmt_YUV422bX &&
+                              ctx->inBpp == 10);
+    }
+    else
+    {
+        ctx->bandThreading = !ctx->rgbConverter && ctx->convert != convert_yuv420_yuy2<0> &&
+                             ctx->convert != convert_yuv420_yuy2<1> && ctx->convert != convert_yuv420_yuy2_avx2<0> &&
+                             ctx->convert != convert_yuv420_yuy2_avx2<1> && ctx->convert != convert_rgb48_rgb<0> &&
+                             ctx->convert != convert_rgb48_rgb<1>;
+    }
+
+    ctx->randomDitherConverter = ctx->convert == convert_yuv444_ayuv_dither_le ||
+                                 ctx->convert == convert_yuv444_ayuv_dither_le_avx2 ||
+                                 ctx->convert == convert_yuv_yv_nv12_dither_le<0> ||
+                                 ctx->convert == convert_yuv_yv_nv12_dither_le<1> ||
+                                 ctx->convert == convert_yuv_yv_nv12_dither_le_avx2<0> ||
+                                 ctx->convert == convert_yuv_yv_nv12_dither_le_avx2<1> ||
+                                 ctx->convert == convert_yuv422_yuy2_uyvy_dither_le<0> ||
+                                 ctx->convert == convert_yuv422_yuy2_uyvy_dither_le<1> ||
+                                 ctx->convert == convert_p010_nv12_sse2 || ctx->convert == convert_p010_nv12_avx2 ||
+                                 ctx->convert == convert_rgb48_rgb32_ssse3;
+}
+
+static void pixconv_select_convert_function_direct(PixConvContext *ctx)
+{
+    const LAVPixelFormat inputFormat = ctx->inputFormat;
+    const PixConvOutFmt outputFormat = ctx->outputFormat;
+    const int cpu = ctx->cpuFlags;
+
+    ctx->convertDirect = nullptr;
+
+    if ((inputFormat == LAVPixFmt_NV12 && outputFormat == PixConvOut_NV12) ||
+        (inputFormat == LAVPixFmt_P016 && (outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016)))
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = plane_copy_direct_nv12_sse4;
+        else if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convertDirect = plane_copy_sse2;
+        else
+            ctx->convertDirect = plane_copy;
+    }
+    else if ((inputFormat == LAVPixFmt_YUY2 && outputFormat == PixConvOut_YUY2) ||
+             (inputFormat == LAVPixFmt_AYUV && outputFormat == PixConvOut_AYUV) ||
+             (inputFormat == LAVPixFmt_Y410 && outputFormat == PixConvOut_Y410) ||
+             (inputFormat == LAVPixFmt_Y416 && outputFormat == PixConvOut_Y416))
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = plane_copy_direct_sse4;
+        else if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convertDirect = plane_copy_sse2;
+        else
+            ctx->convertDirect = plane_copy;
+    }
+    else if (inputFormat == LAVPixFmt_P016 && outputFormat == PixConvOut_NV12)
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = convert_p010_nv12_direct_sse4;
+        else if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convertDirect = convert_p010_nv12_sse2;
+    }
+    else if (inputFormat == LAVPixFmt_NV12 && outputFormat == PixConvOut_YV12)
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = convert_nv12_yv12_direct_sse4;
+        else if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convertDirect = convert_nv12_yv12;
+    }
+    else if (inputFormat == LAVPixFmt_Y216 && (outputFormat == PixConvOut_P210 || outputFormat == PixConvOut_P216))
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = convert_y210_p210_direct_sse4;
+    }
+    else if (inputFormat == LAVPixFmt_YUY2 && outputFormat == PixConvOut_YV16)
+    {
+        if (cpu & AV_CPU_FLAG_SSE4)
+            ctx->convertDirect = convert_yuy2_yv16_direct_sse4;
+        else if (cpu & AV_CPU_FLAG_SSE2)
+            ctx->convertDirect = convert_yuy2_yv16_sse2;
+    }
+}
+
+void pixconv_set_formats(PixConvContext *ctx, LAVPixelFormat inputFormat, int bpp, PixConvOutFmt outputFormat,
+                         int cpuFlags)
+{
+    ctx->inputFormat = inputFormat;
+    ctx->inBpp = bpp;
+    ctx->outputFormat = outputFormat;
+    ctx->cpuFlags = cpuFlags;
+
+    // the RGB dispatcher depends on the CPU flags
+    ctx->rgbConvInit = false;
+
+    pixconv_free_buffers(ctx);
+    pixconv_select_convert_function(ctx);
+    pixconv_select_convert_function_direct(ctx);
+}
+
+void pixconv_set_color_props(PixConvContext *ctx, const PixConvColorProps *props)
+{
+    if (props->matrix != ctx->colorProps.matrix || props->fullRange != ctx->colorProps.fullRange ||
+        props->rgbOutputRange != ctx->colorProps.rgbOutputRange)
+    {
+        pixconv_free_buffers(ctx);
+        ctx->colorProps = *props;
+    }
+}
+
+void pixconv_set_dither_mode(PixConvContext *ctx, PixConvDitherMode ditherMode)
+{
+    ctx->ditherMode = ditherMode;
+}
+
+int pixconv_is_rgb_converter(const PixConvContext *ctx)
+{
+    return ctx->rgbConverter;
+}
+
+int pixconv_is_band_supported(const PixConvContext *ctx)
+{
+    // Random dithering picks its coefficients by the line within the converted area, so every band would restart the
+    // dithering pattern and the output would no longer match a single pass over the frame
+    if (ctx->randomDitherConverter && ctx->ditherMode == PixConvDither_Random)
+        return 0;
+
+    return ctx->bandThreading;
+}
+
+int pixconv_is_direct_supported(const PixConvContext *ctx, uintptr_t dst, ptrdiff_t stride)
+{
+    const int stride_align =
+        ((ctx->outputFormat == PixConvOut_YV12 || ctx->outputFormat == PixConvOut_YV16) ? 32 : 16);
+    if (FFALIGN(stride, stride_align) != stride || (dst % 16u))
+        return 0;
+    return ctx->convertDirect != nullptr;
+}
+
+int pixconv_num_bands(const PixConvContext *ctx, int width, int height)
+{
+    if (ctx->numThreads <= 1)
+        return 1;
+
+    int bands = FFMIN((width * height) / PIXCONV_BAND_MIN_PIXELS, height / PIXCONV_BAND_ALIGN);
+    return FFMAX(1, FFMIN(bands, ctx->numThreads));
+}
+
+// Distance in bytes between two lines of a destination plane
+// v210 packs 48 pixels into 128 bytes, and its converter derives the line size from the stride in pixels
+static ptrdiff_t pixconv_dst_line_size(PixConvOutFmt format, const ptrdiff_t dstStride[4], int plane)
+{
+    if (format == PixConvOut_v210)
+        return (((dstStride[0] >> 2) + 47) / 48) * 128;
+    return dstStride[plane];
+}
+
+static int pixconv_convert_bands(PixConvContext *ctx, ConverterFn fn, int bands, const uint8_t *const src[4],
+                                 const ptrdiff_t srcStride[4], uint8_t *dst[4], const ptrdiff_t dstStride[4],
+                                 int width, int height)
+{
+    if (bands <= 1)
+        return fn(ctx, src, srcStride, dst, dstStride, width, height, ctx->inputFormat, ctx->inBpp,
+                  ctx->outputFormat);
+
+    const int bandHeight = FFALIGN((height + bands - 1) / bands, PIXCONV_BAND_ALIGN);
+    bands = (height + bandHeight - 1) / bandHeight;
+
+    const LAVPixFmtDesc inDesc = getPixelFormatDesc(ctx->inputFormat);
+    const LAVOutPixFmtDesc outDesc = lav_pixfmt_desc[ctx->outputFormat];
+    const int outPlanes = FFMAX(outDesc.planes, 1);
+
+    // Random dithering coefficients are shared by all bands, and need to be allocated for the full frame height
+    ctx->convertHeight = height;
+
+    std::atomic<int> ret(0);
+    ctx->threadPool.Run(bands, [&](int band) {
+        const int bandStart = band * bandHeight;
+        const int bandLines = FFMIN(bandHeight, height - bandStart);
+
+        const uint8_t *bandSrc[4] = {0};
+        uint8_t *bandDst[4] = {0};
+        for (int i = 0; i < inDesc.planes; i++)
+            bandSrc[i] = src[i] + (bandStart / inDesc.planeHeight[i]) * srcStride[i];
+        for (int i = 0; i < outPlanes; i++)
+            bandDst[i] = dst[i] + (bandStart / outDesc.planeHeight[i]) *
+                                      pixconv_dst_line_size(ctx->outputFormat, dstStride, i);
+
+        int retBand = fn(ctx, bandSrc, srcStride, bandDst, dstStride, width, bandLines, ctx->inputFormat, ctx->inBpp,
+                         ctx->outputFormat);
+        if (retBand < 0)
+            ret = retBand;
+
+        // make the streaming writes visible before the band is reported as finished
+        _mm_sfence();
+    });
+
+    ctx->convertHeight = 0;
+    return ret;
+}
+
+static int pixconv_convert_lines(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                                 uint8_t *const dst[4], const ptrdiff_t dstStride[4], int width, int top, int lines)
+{
+    if (lines <= 0)
+        return 0;
+
+    const LAVOutPixFmtDesc outDesc = lav_pixfmt_desc[ctx->outputFormat];
+    uint8_t *linesDst[4] = {0};
+    for (int i = 0; i < FFMAX(outDesc.planes, 1); i++)
+        linesDst[i] = dst[i] + (top / outDesc.planeHeight[i]) * pixconv_dst_line_size(ctx->outputFormat, dstStride, i);
+
+    return pixconv_convert_bands(ctx, ctx->convert, pixconv_num_bands(ctx, width, lines), src, srcStride, linesDst,
+                                 dstStride, width, lines);
+}
+
+static void pixconv_change_stride(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst, ptrdiff_t dstStride,
+                                  int width, int height, int planeHeight, PixConvOutFmt format)
+{
+    LAVOutPixFmtDesc desc = lav_pixfmt_desc[format];
+
+    int line = 0;
+
+    // Copy first plane
+    const size_t widthBytes = width * desc.codedbytes;
+    const ptrdiff_t srcStrideBytes = srcStride * desc.codedbytes;
+    const ptrdiff_t dstStrideBytes = dstStride * desc.codedbytes;
+    for (line = 0; line < height; ++line)
+    {
+        memcpy(dst, src, widthBytes);
+        src += srcStrideBytes;
+        dst += dstStrideBytes;
+    }
+    dst += (planeHeight - height) * dstStrideBytes;
+
+    for (int plane = 1; plane < desc.planes; ++plane)
+    {
+        const size_t planeWidth = widthBytes / desc.planeWidth[plane];
+        const int activePlaneHeight = height / desc.planeHeight[plane];
+        const int totalPlaneHeight = planeHeight / desc.planeHeight[plane];
+        const ptrdiff_t srcPlaneStride = srcStrideBytes / desc.planeWidth[plane];
+        const ptrdiff_t dstPlaneStride = dstStrideBytes / desc.planeWidth[plane];
+        for (line = 0; line < activePlaneHeight; ++line)
+        {
+            memcpy(dst, src, planeWidth);
+            src += srcPlaneStride;
+            dst += dstPlaneStride;
+        }
+        dst += (totalPlaneHeight - activePlaneHeight) * dstPlaneStride;
+    }
+}
+
+// Set up the plane pointers of a destination with all planes in one buffer
+static void pixconv_dst_planes(const PixConvContext *ctx, uint8_t *dst, ptrdiff_t dstStride, int planeHeight,
+                               uint8_t *dstArray[4], ptrdiff_t dstStrideArray[4])
+{
+    const LAVOutPixFmtDesc desc = lav_pixfmt_desc[ctx->outputFormat];
+    const ptrdiff_t byteStride = dstStride * desc.codedbytes;
+
+    dstArray[0] = dst;
+    dstStrideArray[0] = byteStride;
+
+    for (int i = 1; i < desc.planes; ++i)
+    {
+        dstArray[i] = dstArray[i - 1] + dstStrideArray[i - 1] * (planeHeight / desc.planeHeight[i - 1]);
+        dstStrideArray[i] = byteStride / desc.planeWidth[i];
+    }
+}
+
+int pixconv_convert(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst,
+                    int width, int height, ptrdiff_t dstStride, int planeHeight, const PixConvBand *band)
+{
+    uint8_t *out = dst;
+    ptrdiff_t outStride = dstStride;
+    planeHeight = FFMAX(height, planeHeight);
+    // Check if we have proper pixel alignment and the dst memory is actually aligned
+    if (ctx->requiredAlignment &&
+        (FFALIGN(dstStride, ctx->requiredAlignment) != dstStride || ((uintptr_t)dst % 16u)))
+    {
+        outStride = FFALIGN(dstStride, ctx->requiredAlignment);
+        size_t requiredSize = (outStride * planeHeight * lav_pixfmt_desc[ctx->outputFormat].bpp) >> 3;
+        if (requiredSize > ctx->alignedBufferSize || !ctx->alignedBuffer)
+        {
+            av_log(nullptr, AV_LOG_DEBUG,
+                   "pixconv_convert(): Conversion requires a bigger stride (need: %td, have: %td), allocating "
+                   "buffer...\n",
+                   outStride, dstStride);
+            av_freep(&ctx->alignedBuffer);
+            ctx->alignedBuffer = (uint8_t *)av_malloc(requiredSize + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!ctx->alignedBuffer)
+            {
+                return AVERROR(ENOMEM);
+            }
+            ctx->alignedBufferSize = requiredSize;
+        }
+        out = ctx->alignedBuffer;
+    }
+
+    uint8_t *dstArray[4] = {0};
+    ptrdiff_t dstStrideArray[4] = {0};
+    pixconv_dst_planes(ctx, out, outStride, planeHeight, dstArray, dstStrideArray);
+
+    int ret = 0;
+    if (band && band->height > 0)
+    {
+        assert(pixconv_is_band_supported(ctx));
+        // Convert the lines above, inside and below the band separately, taking the band lines from its own buffers
+        const LAVPixFmtDesc inDesc = getPixelFormatDesc(ctx->inputFormat);
+        const int bandEnd = band->top + band->height;
+
+        const uint8_t *belowSrc[4] = {0};
+        for (int i = 0; i < inDesc.planes; i++)
+            belowSrc[i] = src[i] + (bandEnd / inDesc.planeHeight[i]) * srcStride[i];
+
+        ret = pixconv_convert_lines(ctx, src, srcStride, dstArray, dstStrideArray, width, 0, band->top);
+        if (ret >= 0)
+            ret = pixconv_convert_lines(ctx, band->data, band->stride, dstArray, dstStrideArray, width, band->top,
+                                        band->height);
+        if (ret >= 0)
+            ret = pixconv_convert_lines(ctx, belowSrc, srcStride, dstArray, dstStrideArray, width, bandEnd,
+                                        height - bandEnd);
+    }
+    else
+    {
+        const int bands = pixconv_is_band_supported(ctx) ? pixconv_num_bands(ctx, width, height) : 1;
+        ret = pixconv_convert_bands(ctx, ctx->convert, bands, src, srcStride, dstArray, dstStrideArray, width, height);
+    }
+
+    if (out != dst)
+    {
+        pixconv_change_stride(out, outStride, dst, dstStride, width, height, planeHeight, ctx->outputFormat);
+    }
+    return ret;
+}
+
+int pixconv_convert_direct(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                           uint8_t *dst, int width, int height, ptrdiff_t dstStride, int planeHeight)
+{
+    if (!ctx->convertDirect)
+        return AVERROR(EINVAL);
+
+    planeHeight = FFMAX(height, planeHeight);
+
+    uint8_t *dstArray[4] = {0};
+    ptrdiff_t dstStrideArray[4] = {0};
+    pixconv_dst_planes(ctx, dst, dstStride, planeHeight, dstArray, dstStrideArray);
+
+    const int bands = pixconv_is_band_supported(ctx) ? pixconv_num_bands(ctx, width, height) : 1;
+    return pixconv_convert_bands(ctx, ctx->convertDirect, bands, src, srcStride, dstArray, dstStrideArray, width,
+                                 height);
+}
+
+const uint16_t *pixconv_random_dither_coeffs(PixConvContext *ctx, int height, int coeffs, int bits, int line)
+{
+    if (ctx->ditherMode != PixConvDither_Random)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(ctx->ditherLock);
+    height = FFMAX(height, ctx->convertHeight);
+
+    int totalWidth = 8 * coeffs;
+    if (!ctx->randomDithers || totalWidth > ctx->ditherWidth || height > ctx->ditherHeight || bits != ctx->ditherBits)
+    {
+        av_freep(&ctx->randomDithers);
+        ctx->ditherWidth = totalWidth;
+        ctx->ditherHeight = height;
+        ctx->ditherBits = bits;
+        ctx->randomDithers = (uint16_t *)av_malloc(ctx->ditherWidth * ctx->ditherHeight * 2);
+        if (ctx->randomDithers == nullptr)
+            return nullptr;
+
+        // Seed random number generator
+        time_t seed = time(nullptr);
+        seed >>= 1;
+        srand_sse((unsigned int)seed);
+
+        bits = (1 << bits);
+        for (int i = 0; i < ctx->ditherHeight; i++)
+        {
+            uint16_t *ditherline = ctx->randomDithers + (ctx->ditherWidth * i);
+            for (int j = 0; j < ctx->ditherWidth; j += 4)
+            {
+                int rnds[4];
+                rand_sse(rnds);
+                ditherline[j + 0] = rnds[0] % bits;
+                ditherline[j + 1] = rnds[1] % bits;
+                ditherline[j + 2] = rnds[2] % bits;
+                ditherline[j + 3] = rnds[3] % bits;
+            }
+        }
+    }
+
+    if (line < 0 || line >= ctx->ditherHeight)
+        line = rand() % ctx->ditherHeight;
+
+    return &ctx->randomDithers[line * ctx->ditherWidth];
 }
@@ -0,0 +1,133 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../decoders/LAVPixelFormat.h"
+
+// Pixel format converters from the decoder formats to the output formats
+// They don't need any Windows or DirectShow headers, so they can be built and tested on their own (see tests/)
+//
+// Functions returning int return 0 on success, or a negative AVERROR code
+
+// Output pixel formats, numbered like LAVOutPixFmts
+typedef enum PixConvOutFmt
+{
+    PixConvOut_None = -1,
+    PixConvOut_YV12,  // 4:2:0, 8bit, planar
+    PixConvOut_NV12,  // 4:2:0, 8bit, Y planar, U/V packed
+    PixConvOut_YUY2,  // 4:2:2, 8bit, packed
+    PixConvOut_UYVY,  // 4:2:2, 8bit, packed
+    PixConvOut_AYUV,  // 4:4:4, 8bit, packed
+    PixConvOut_P010,  // 4:2:0, 10bit, Y planar, U/V packed
+    PixConvOut_P210,  // 4:2:2, 10bit, Y planar, U/V packed
+    PixConvOut_Y410,  // 4:4:4, 10bit, packed
+    PixConvOut_P016,  // 4:2:0, 16bit, Y planar, U/V packed
+    PixConvOut_P216,  // 4:2:2, 16bit, Y planar, U/V packed
+    PixConvOut_Y416,  // 4:4:4, 16bit, packed
+    PixConvOut_RGB32, // 32-bit RGB (BGRA)
+    PixConvOut_RGB24, // 24-bit RGB (BGR)
+    PixConvOut_v210,  // 4:2:2, 10bit, packed
+    PixConvOut_v410,  // 4:4:4, 10bit, packed
+    PixConvOut_YV16,  // 4:2:2, 8-bit, planar
+    PixConvOut_YV24,  // 4:4:4, 8-bit, planar
+    PixConvOut_RGB48, // 48-bit RGB (16-bit per pixel, BGR)
+    PixConvOut_NB     // Number of formats
+} PixConvOutFmt;
+
+// Dithering used when reducing the bit depth, numbered like LAVDitherMode
+typedef enum PixConvDitherMode
+{
+    PixConvDither_Ordered,
+    PixConvDither_Random
+} PixConvDitherMode;
+
+// Important, when adding new pixel formats, they need to be added in pixconv/pixconv.cpp as well to the format
+// descriptors, and to the media subtypes in LAVPixFmtConverter.cpp
+typedef struct
+{
+    int bpp;
+    int codedbytes;
+    int planes;
+    int planeHeight[4];
+    int planeWidth[4];
+} LAVOutPixFmtDesc;
+
+// Memory layout of the output pixel formats, indexed by PixConvOutFmt
+extern const LAVOutPixFmtDesc lav_pixfmt_desc[];
+
+// Transfer matrices, numbered like DXVA2_VideoTransferMatrix
+// LAV Video extends it with 4 = BT.2020, 6 = FCC and 7 = YCgCo
+typedef enum PixConvMatrix
+{
+    PixConvMatrix_Unknown,
+    PixConvMatrix_BT709,
+    PixConvMatrix_BT601,
+    PixConvMatrix_SMPTE240M
+} PixConvMatrix;
+
+// Color properties of the input, used by the YUV -> RGB converters and swscale
+typedef struct PixConvColorProps
+{
+    int matrix;         // transfer matrix, see PixConvMatrix
+    int fullRange;      // input uses the full 0-255 range
+    int rgbOutputRange; // RGB output range, 0 = same as input, 1 = limited, 2 = full
+} PixConvColorProps;
+
+// Lines of the frame taken from a separate buffer, see LAVFrameBand
+typedef struct PixConvBand
+{
+    int top;                // first line of the frame covered by the band
+    int height;             // number of lines covered by the band (0 if unused)
+    const uint8_t *data[4]; // pointer to the first line of the band in each plane
+    ptrdiff_t stride[4];    // stride of the band planes (in bytes)
+} PixConvBand;
+
+typedef struct PixConvContext PixConvContext;
+
+// Allocate a converter, which splits the work over up to the given number of threads (including the caller)
+PixConvContext *pixconv_alloc(int threads);
+void pixconv_free(PixConvContext **pCtx);
+
+// Select the converter for the formats and the CPU flags (AV_CPU_FLAG_*)
+void pixconv_set_formats(PixConvContext *ctx, LAVPixelFormat inputFormat, int bpp, PixConvOutFmt outputFormat,
+                         int cpuFlags);
+void pixconv_set_color_props(PixConvContext *ctx, const PixConvColorProps *props);
+void pixconv_set_dither_mode(PixConvContext *ctx, PixConvDitherMode ditherMode);
+
+// The selected converter is a custom YUV -> RGB converter
+int pixconv_is_rgb_converter(const PixConvContext *ctx);
+// pixconv_convert can take some of the source lines from a separate band
+int pixconv_is_band_supported(const PixConvContext *ctx);
+// pixconv_convert_direct can write to this destination
+int pixconv_is_direct_supported(const PixConvContext *ctx, uintptr_t dst, ptrdiff_t stride);
+
+// Convert a frame into a destination with all planes in one buffer
+// dstStride   - stride of the destination in pixels
+// planeHeight - number of lines of each plane in the destination, at least height
+// band        - lines taken from a separate buffer, or nullptr
+int pixconv_convert(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst,
+                    int width, int height, ptrdiff_t dstStride, int planeHeight, const PixConvBand *band);
+
+// Convert a frame that has to be read with streaming loads, like a mapped hardware surface
+int pixconv_convert_direct(PixConvContext *ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4],
+                           uint8_t *dst, int width, int height, ptrdiff_t dstStride, int planeHeight);
@@ -0,0 +1,99 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <immintrin.h>
+
+// Check if the destination planes are suitable for 256-bit streaming writes
+// The AVX2 kernels fall back to their SSE2 counterparts if they are not
+// dst       - destination plane pointers
+// dstStride - destination plane strides
+// planes    - number of planes to check
+static inline bool pixconv_avx2_dst_aligned(uint8_t *const dst[4], const ptrdiff_t dstStride[4], int planes)
+{
+    for (int i = 0; i < planes; i++)
+    {
+        if (((uintptr_t)dst[i] % 32u) || (dstStride[i] % 32))
+            return false;
+    }
+    return true;
+}
+
+// Clear the upper halves of the AVX registers after AVX2 code, from a function that is not compiled for AVX2 itself
+PIXCONV_TARGET_AVX2 static inline void pixconv_avx2_zeroupper()
+{
+    _mm256_zeroupper();
+}
+
+// Load the dithering coefficients for this line into both lanes
+// reg   - register to load coefficients into
+// line  - index of line to process (0 based)
+// bits  - number of bits to dither (for 10 -> 8, set to 2)
+#define PIXCONV_AVX2_LOAD_DITHER_COEFFS(reg, line, bits, name)                \
+    const uint16_t *name = dither_8x8_256[(line) % 8];                        \
+    reg = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)name)); \
+    reg = _mm256_srli_epi16(reg, 8 - bits); /* shift to the required dithering strength */
+
+// Load 16 16-bit pixels into a register, and dither them to 8 bit
+// The 8-bit pixels will be in the low-bytes of the 16 16-bit parts
+// reg   - register to store pixels in
+// dreg  - register with dithering coefficients
+// src   - memory pointer of the source
+// shift - register holding the shift to 16-bit (16 - bpp)
+#define PIXCONV_AVX2_LOAD_PIXEL16_DITHER(reg, dreg, src, shift)             \
+    reg = _mm256_loadu_si256((const __m256i *)(src)); /* load */            \
+    reg = _mm256_sll_epi16(reg, shift);               /* shift to 16-bit */ \
+    reg = _mm256_adds_epu16(reg, dreg);               /* dither */          \
+    reg = _mm256_srli_epi16(reg, 8);                  /* shift to 8-bit */
+
+// Load 256-bit into a register
+// reg   - register to store pixels in
+// src   - memory pointer of the source
+#define PIXCONV_AVX2_LOAD(reg, src) reg = _mm256_loadu_si256((const __m256i *)(src)); /* load (unaligned) */
+
+// Load 2x 128-bit from two locations into the low and high lane of one register
+// reg   - register to store pixels in
+// src1  - memory pointer for the low lane
+// src2  - memory pointer for the high lane
+#define PIXCONV_AVX2_LOAD_LANES(reg, src1, src2)                                                    \
+    reg = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src1))), \
+                                  _mm_loadu_si128((const __m128i *)(src2)), 1);
+
+// Load 2x 64-bit from two locations into the low halves of the two lanes of one register
+// reg   - register to store pixels in
+// src1  - memory pointer for the low lane
+// src2  - memory pointer for the high lane
+#define PIXCONV_AVX2_LOAD_LANES_64(reg, src1, src2)                                                 \
+    reg = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(src1))), \
+                                  _mm_loadl_epi64((const __m128i *)(src2)), 1);
+
+// Load 2x 32-bit from two locations into the low dwords of the two lanes of one register
+// reg   - register to store pixels in
+// src1  - memory pointer for the low lane
+// src2  - memory pointer for the high lane
+#define PIXCONV_AVX2_LOAD_LANES_32(reg, src1, src2)                                                \
+    reg = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_cvtsi32_si128(*(const int *)(src1))), \
+                                  _mm_cvtsi32_si128(*(const int *)(src2)), 1);
+
+// Put 256-bit into memory, using streaming write
+#define PIXCONV_AVX2_PUT_STREAM(dst, reg) _mm256_stream_si256((__m256i *)(dst), reg); /* streaming write */
+
+// Pack 2x16 16-bit values into 32 8-bit values, keeping the pixel order across both lanes
+#define PIXCONV_AVX2_PACKUS_EPI16(reg1, reg2) _mm256_permute4x64_epi64(_mm256_packus_epi16(reg1, reg2), 0xD8)
@@ -19,9 +19,165 @@
 
 #pragma once
 
-#include "LAVPixFmtConverter.h"
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libswscale/swscale.h"
+};
+
+#include <assert.h>
 #include <emmintrin.h>
-#include "timer.h"
-#include "Media.h"
+#include <mutex>
+
+#include "pixconv.h"
+#include "pixconv_threadpool.h"
+
+#ifndef _MSC_VER
+#define __forceinline inline __attribute__((always_inline))
+#endif
+
+// Kernels using instructions beyond SSE2 are only called when the CPU supports them
+// MSVC accepts the intrinsics anywhere, GCC and Clang need the instruction set enabled on the function
+#ifdef _MSC_VER
+#define PIXCONV_TARGET_SSSE3
+#define PIXCONV_TARGET_SSE4
+#define PIXCONV_TARGET_AVX2
+#else
+#define PIXCONV_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define PIXCONV_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define PIXCONV_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define CONV_FUNC_PARAMS                                                                               \
+    (PixConvContext * ctx, const uint8_t *const src[4], const ptrdiff_t srcStride[4], uint8_t *dst[4], \
+     const ptrdiff_t dstStride[4], int width, int height, LAVPixelFormat inputFormat, int bpp,         \
+     PixConvOutFmt outputFormat)
+
+#define DECLARE_CONV_FUNC(name) int name CONV_FUNC_PARAMS
+
+typedef int(*ConverterFn) CONV_FUNC_PARAMS;
+
+typedef struct _RGBCoeffs
+{
+    __m128i Ysub;
+    __m128i CbCr_center;
+    __m128i rgb_add;
+    __m128i cy;
+    __m128i cR_Cr;
+    __m128i cG_Cb_cG_Cr;
+    __m128i cB_Cb;
+} RGBCoeffs;
+
+typedef int (*YUVRGBConversionFunc)(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst,
+                                    int width, int height, ptrdiff_t srcStrideY, ptrdiff_t srcStrideUV,
+                                    ptrdiff_t dstStride, ptrdiff_t sliceYStart, ptrdiff_t sliceYEnd,
+                                    const RGBCoeffs *coeffs, const uint16_t *dithers);
+
+struct PixConvContext
+{
+    LAVPixelFormat inputFormat = LAVPixFmt_None;
+    PixConvOutFmt outputFormat = PixConvOut_YV12;
+    int inBpp = 0;
+    int cpuFlags = 0;
+
+    PixConvColorProps colorProps = {};
+    PixConvDitherMode ditherMode = PixConvDither_Ordered;
+
+    // Conversion function pointers
+    ConverterFn convert = nullptr;
+    ConverterFn convertDirect = nullptr;
+
+    ptrdiff_t requiredAlignment = 0;
+    bool rgbConverter = false;
+    // The selected converter only touches the lines it is given, and can be run in bands
+    bool bandThreading = false;
+    // The selected converter indexes the random dithering coefficients by line
+    bool randomDitherConverter = false;
+
+    int numThreads = 1;
+    CPixConvThreadPool threadPool;
+    // Height of the whole conversion while it runs in bands
+    int convertHeight = 0;
+
+    size_t alignedBufferSize = 0;
+    uint8_t *alignedBuffer = nullptr;
+
+    SwsContext *swsContext = nullptr;
+    int swsWidth = 0;
+    int swsHeight = 0;
+
+    RGBCoeffs *rgbCoeffs = nullptr;
+    bool rgbConvInit = false;
+
+    // [out32][dithermode][ycgco][format][shift]
+    YUVRGBConversionFunc rgbConvFuncs[2][2][2][LAVPixFmt_NB][9];
+    // [dithermode][ycgco][format][shift], RGB32 only
+    YUVRGBConversionFunc rgbConvFuncsAVX2[2][2][LAVPixFmt_NB][9];
+
+    std::mutex ditherLock;
+    uint16_t *randomDithers = nullptr;
+    int ditherWidth = 0;
+    int ditherHeight = 0;
+    int ditherBits = 0;
+};
+
+alignas(16) extern const uint16_t dither_8x8_256[8][8];
+
+// Threading helpers
+int pixconv_num_bands(const PixConvContext *ctx, int width, int height);
+
+// Random dithering coefficients for the given line, nullptr if random dithering is not active
+const uint16_t *pixconv_random_dither_coeffs(PixConvContext *ctx, int height, int coeffs, int bits, int line);
+
+// Cached swscale context for the given conversion, configured with the color properties of the context
+SwsContext *pixconv_sws_context(PixConvContext *ctx, int width, int height, enum AVPixelFormat srcPix,
+                                enum AVPixelFormat dstPix, int flags);
+
+// Also declared in Media.h for the rest of LAV Video
+int sws_scale2(struct SwsContext *c, const uint8_t *const srcSlice[], const ptrdiff_t srcStride[], int srcSliceY,
+               int srcSliceH, uint8_t *const dst[], const ptrdiff_t dstStride[]);
+
+// Pixel Implementations
+DECLARE_CONV_FUNC(convert_generic);
+DECLARE_CONV_FUNC(plane_copy);
+DECLARE_CONV_FUNC(plane_copy_sse2);
+DECLARE_CONV_FUNC(convert_yuv444_ayuv);
+DECLARE_CONV_FUNC(convert_yuv444_ayuv_dither_le);
+DECLARE_CONV_FUNC(convert_yuv444_y410);
+DECLARE_CONV_FUNC(convert_yuv420_px1x_le);
+DECLARE_CONV_FUNC(convert_yuv420_nv12);
+DECLARE_CONV_FUNC(convert_yuv_yv);
+DECLARE_CONV_FUNC(convert_nv12_yv12);
+DECLARE_CONV_FUNC(convert_p010_nv12_sse2);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_y210_p210_sse4);
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv420_yuy2);
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv422_yuy2_uyvy);
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv422_yuy2_uyvy_dither_le);
+template <int nv12> DECLARE_CONV_FUNC(convert_yuv_yv_nv12_dither_le);
+
+// AVX2 versions, these fall back to the SSE2 version if the output is not suitably aligned
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv444_ayuv_dither_le_avx2);
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv444_y410_avx2);
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv420_px1x_le_avx2);
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_p010_nv12_avx2);
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv420_yuy2_avx2);
+template <int nv12> PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv_yv_nv12_dither_le_avx2);
+
+PIXCONV_TARGET_SSSE3 DECLARE_CONV_FUNC(convert_rgb48_rgb32_ssse3);
+template <int out32> DECLARE_CONV_FUNC(convert_rgb48_rgb);
+
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(plane_copy_direct_sse4);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(plane_copy_direct_nv12_sse4);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_nv12_yv12_direct_sse4);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_p010_nv12_direct_sse4);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_y210_p210_direct_sse4);
+
+DECLARE_CONV_FUNC(convert_yuy2_yv16_sse2);
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_yuy2_yv16_direct_sse4);
 
-extern __declspec(align(16)) const uint16_t dither_8x8_256[8][8];
+DECLARE_CONV_FUNC(convert_yuv_rgb);
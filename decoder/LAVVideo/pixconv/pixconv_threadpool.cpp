@@ -0,0 +1,117 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "pixconv_threadpool.h"
+
+#include <algorithm>
+
+CPixConvThreadPool::~CPixConvThreadPool()
+{
+    StopThreads();
+}
+
+void CPixConvThreadPool::SetNumThreads(int threads)
+{
+    threads = std::max(threads, 0);
+    if (threads != m_nThreads)
+    {
+        StopThreads();
+        m_nThreads = threads;
+    }
+}
+
+void CPixConvThreadPool::StartThreads()
+{
+    m_bExit = false;
+    for (int i = 0; i < m_nThreads; i++)
+        m_Threads.emplace_back(&CPixConvThreadPool::WorkerProc, this);
+}
+
+void CPixConvThreadPool::StopThreads()
+{
+    if (m_Threads.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_bExit = true;
+    }
+    m_WorkCond.notify_all();
+
+    for (std::thread &thread : m_Threads)
+        thread.join();
+    m_Threads.clear();
+}
+
+void CPixConvThreadPool::Run(int count, const std::function<void(int)> &fn)
+{
+    if (count <= 1 || m_nThreads == 0)
+    {
+        for (int i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    if (m_Threads.empty())
+        StartThreads();
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_pJob = &fn;
+    m_nJobCount = count;
+    m_nNextJob = 0;
+    m_nJobsPending = count;
+    m_WorkCond.notify_all();
+
+    // Take part in the work, then wait for the jobs still running on the workers
+    ProcessJobs(lock);
+    m_DoneCond.wait(lock, [this]() { return m_nJobsPending == 0; });
+
+    m_pJob = nullptr;
+    m_nJobCount = 0;
+    m_nNextJob = 0;
+}
+
+void CPixConvThreadPool::ProcessJobs(std::unique_lock<std::mutex> &lock)
+{
+    while (m_nNextJob < m_nJobCount)
+    {
+        const int job = m_nNextJob++;
+        const std::function<void(int)> *fn = m_pJob;
+
+        lock.unlock();
+        (*fn)(job);
+        lock.lock();
+
+        if (--m_nJobsPending == 0)
+            m_DoneCond.notify_all();
+    }
+}
+
+void CPixConvThreadPool::WorkerProc()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    for (;;)
+    {
+        m_WorkCond.wait(lock, [this]() { return m_bExit || m_nNextJob < m_nJobCount; });
+        if (m_bExit)
+            break;
+
+        ProcessJobs(lock);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal fork/join pool used by the pixel converters to process a frame in bands
+//
+// The calling thread always participates in the work, so a pool with N threads
+// runs N+1 jobs concurrently. Worker threads are started lazily on the first Run.
+class CPixConvThreadPool
+{
+  public:
+    CPixConvThreadPool() = default;
+    ~CPixConvThreadPool();
+
+    // Set the number of worker threads (excluding the calling thread)
+    void SetNumThreads(int threads);
+
+    // Run fn(0) ... fn(count - 1) and wait until all jobs have finished
+    void Run(int count, const std::function<void(int)> &fn);
+
+  private:
+    void StartThreads();
+    void StopThreads();
+    void WorkerProc();
+
+    // Execute jobs of the current batch until none are left, called with the lock held
+    void ProcessJobs(std::unique_lock<std::mutex> &lock);
+
+  private:
+    int m_nThreads = 0;
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_Lock;
+    std::condition_variable m_WorkCond;
+    std::condition_variable m_DoneCond;
+
+    const std::function<void(int)> *m_pJob = nullptr;
+    int m_nJobCount = 0;
+    int m_nNextJob = 0;
+    int m_nJobsPending = 0;
+    bool m_bExit = false;
+};
@@ -17,14 +17,12 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
 
-DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb32_ssse3)
+PIXCONV_TARGET_SSSE3 DECLARE_CONV_FUNC(convert_rgb48_rgb32_ssse3)
 {
     const uint16_t *rgb = (const uint16_t *)src[0];
     const ptrdiff_t inStride = srcStride[0] >> 1;
@@ -33,10 +31,10 @@ DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb32_ssse3)
 
     int processWidth = width * 3;
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 4, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 4, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
     __m128i mask = _mm_setr_epi8(4, 5, 2, 3, 0, 1, -1, -1, 10, 11, 8, 9, 6, 7, -1, -1);
@@ -47,7 +45,7 @@ DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb32_ssse3)
         __m128i *dst128 = (__m128i *)(dst[0] + line * outStride);
 
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 0));
             xmm6 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 8));
@@ -85,19 +83,20 @@ DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb32_ssse3)
         rgb += inStride;
     }
 
-    return S_OK;
+    return 0;
 }
 
-template <int out32> DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb)
+template <int out32> DECLARE_CONV_FUNC(convert_rgb48_rgb)
 {
     // Byte Swap to BGR layout
     uint8_t *dstBS[4] = {nullptr};
-    dstBS[0] = (BYTE *)av_malloc(height * srcStride[0]);
+    dstBS[0] = (uint8_t *)av_malloc(height * srcStride[0]);
     if (dstBS[0] == nullptr)
-        return E_OUTOFMEMORY;
+        return AVERROR(ENOMEM);
 
-    SwsContext *ctx = GetSWSContext(width, height, GetFFInput(), AV_PIX_FMT_BGR48LE, SWS_POINT);
-    sws_scale2(ctx, src, srcStride, 0, height, dstBS, srcStride);
+    SwsContext *swsCtx = pixconv_sws_context(ctx, width, height, getFFPixelFormatFromLAV(inputFormat, bpp),
+                                             AV_PIX_FMT_BGR48LE, SWS_POINT);
+    sws_scale2(swsCtx, src, srcStride, 0, height, dstBS, srcStride);
 
     // Dither to RGB24/32 with SSE2
     const uint16_t *rgb = (const uint16_t *)dstBS[0];
@@ -106,10 +105,10 @@ template <int out32> DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb)
     ptrdiff_t line, i;
     int processWidth = width * 3;
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 2, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 2, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     __m128i xmm0, xmm1, xmm6, xmm7;
 
@@ -120,7 +119,7 @@ template <int out32> DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb)
         if (rgb24buffer == nullptr)
         {
             av_freep(&dstBS[0]);
-            return E_OUTOFMEMORY;
+            return AVERROR(ENOMEM);
         }
     }
 
@@ -138,7 +137,7 @@ template <int out32> DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb)
         }
 
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm6 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 0));
             xmm7 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 8));
@@ -186,8 +185,8 @@ template <int out32> DECLARE_CONV_FUNC_IMPL(convert_rgb48_rgb)
         av_freep(&rgb24buffer);
     av_freep(&dstBS[0]);
 
-    return S_OK;
+    return 0;
 }
 
-template HRESULT CLAVPixFmtConverter::convert_rgb48_rgb<0> CONV_FUNC_PARAMS;
-template HRESULT CLAVPixFmtConverter::convert_rgb48_rgb<1> CONV_FUNC_PARAMS;
+template int convert_rgb48_rgb<0> CONV_FUNC_PARAMS;
+template int convert_rgb48_rgb<1> CONV_FUNC_PARAMS;
@@ -0,0 +1,130 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Speed of the pixel converters
+//
+//   pixconv_bench [min ms per case] [threads] [input format] [C|SSE2|SSE4|AVX2]
+//
+// Converts every input format to every output format at 720p, 1080p and 2160p, with the converter LAV Video selects
+// for the CPU, and reports the throughput in MPix/s. Pairs converted by the swscale fallback are marked with "sws".
+// With more than one thread, the converters that support it split the frame into bands, as LAV Video does.
+// The instruction set limits the converters to that level, to compare the AVX2 kernels with their SSE2 versions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "pixconv_test_utils.h"
+
+static const struct
+{
+    int width, height;
+    const char *name;
+} bench_sizes[] = {{1280, 720, "720p"}, {1920, 1080, "1080p"}, {3840, 2160, "2160p"}};
+
+int main(int argc, char *argv[])
+{
+    const double minMs = argc > 1 ? atof(argv[1]) : 100.0;
+    const int threads = argc > 2 ? FFMAX(atoi(argv[2]), 1) : 1;
+    const char *filter = argc > 3 && strcmp(argv[3], "all") != 0 ? argv[3] : nullptr;
+    int cpuFlags = av_get_cpu_flags();
+    const char *cpuName = "native";
+    std::mt19937 rng(1);
+
+    if (argc > 4)
+    {
+        const PixConvCpu *cpu = nullptr;
+        for (const PixConvCpu &c : pixconv_cpus)
+        {
+            if (strcmp(argv[4], c.name) == 0)
+                cpu = &c;
+        }
+        if (!cpu || !pixconv_cpu_supported(*cpu, cpuFlags))
+        {
+            printf("Unknown or unsupported instruction set %s\n", argv[4]);
+            return 1;
+        }
+        cpuFlags = cpu->flags;
+        cpuName = cpu->name;
+        av_force_cpu_flags(cpuFlags);
+    }
+
+    av_log_set_level(AV_LOG_QUIET);
+
+    printf("%-10s %-6s %-4s %10s %10s %10s  (MPix/s, %d thread%s, %s)\n", "input", "output", "", bench_sizes[0].name,
+           bench_sizes[1].name, bench_sizes[2].name, threads, threads > 1 ? "s" : "", cpuName);
+    for (const PixConvInput &input : pixconv_inputs)
+    {
+        if (filter && strcmp(filter, input.name) != 0)
+            continue;
+
+        PixConvSource sources[FF_ARRAY_ELEMS(bench_sizes)] = {
+            PixConvSource(input, bench_sizes[0].width, bench_sizes[0].height, rng),
+            PixConvSource(input, bench_sizes[1].width, bench_sizes[1].height, rng),
+            PixConvSource(input, bench_sizes[2].width, bench_sizes[2].height, rng),
+        };
+
+        for (int o = 0; o < PixConvOut_NB; o++)
+        {
+            const PixConvOutFmt output = (PixConvOutFmt)o;
+            PixConvContext *ctx = pixconv_test_alloc(input, output, cpuFlags, threads);
+            if (!ctx)
+                return 1;
+
+            printf("%-10s %-6s %-4s", input.name, pixconv_output_names[o], pixconv_is_generic(ctx) ? "sws" : "");
+            for (const PixConvSource &src : sources)
+            {
+                if (!pixconv_is_supported(ctx, input))
+                {
+                    printf(" %10s", "-");
+                    continue;
+                }
+
+                PixConvDest dst(output, src.width, src.height, FFALIGN(src.width, 64));
+
+                // the first conversion sets up swscale and the buffers
+                if (pixconv_convert(ctx, src.data, src.stride, dst.buffer.get(), src.width, src.height, dst.stride,
+                                    src.height, nullptr) < 0)
+                {
+                    printf(" %10s", "-");
+                    continue;
+                }
+
+                int repeats = 0;
+                double ms = 0.0;
+                const auto start = std::chrono::steady_clock::now();
+                do
+                {
+                    pixconv_convert(ctx, src.data, src.stride, dst.buffer.get(), src.width, src.height, dst.stride,
+                                    src.height, nullptr);
+                    repeats++;
+                    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                } while (ms < minMs);
+
+                printf(" %10.1f", (double)src.width * src.height * repeats / (ms * 1000.0));
+            }
+            printf("\n");
+            fflush(stdout);
+
+            pixconv_free(&ctx);
+        }
+    }
+    return 0;
+}
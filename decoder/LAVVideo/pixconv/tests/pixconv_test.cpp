@@ -0,0 +1,294 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Golden output test of the pixel converters
+//
+//   pixconv_test [--generate] [golden file]
+//
+// Converts a random frame of every input format to every output format, at two sizes and with every instruction set
+// the CPU supports, and compares a hash of the output with the golden file. --generate writes the golden file instead.
+//
+// Besides that, for every pair it checks that
+//  - the SSE2, SSE4 and AVX2 converters give the same output, whenever they are not the swscale fallback
+//  - an unaligned destination stride, a band of source lines from separate buffers, multiple threads and the direct
+//    conversion all give the same output as the plain conversion
+//
+// Pairs converted by swscale depend on the FFmpeg version, and the golden file has to be regenerated with it.
+// Pairs swscale cannot convert are recorded as unsupported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+
+#include "pixconv_test_utils.h"
+
+static const struct
+{
+    int width, height;
+} test_sizes[] = {{320, 180}, {202, 58}};
+
+static int failures = 0;
+
+#define FAIL(...)                  \
+    do                             \
+    {                              \
+        if (failures < 50)         \
+            printf(__VA_ARGS__);   \
+        failures++;                \
+    } while (0)
+
+struct ConvResult
+{
+    int ret;
+    uint64_t hash;
+    ConverterFn convert;
+};
+
+static ConvResult convert(const PixConvInput &input, const PixConvSource &src, PixConvOutFmt output, int cpuFlags,
+                          int threads, ptrdiff_t stride, const PixConvBand *band = nullptr, bool direct = false)
+{
+    ConvResult result = {AVERROR(ENOMEM), 0, nullptr};
+    PixConvContext *ctx = pixconv_test_alloc(input, output, cpuFlags, threads);
+    if (!ctx)
+        return result;
+
+    PixConvDest dst(output, src.width, src.height, stride);
+    if (!pixconv_is_supported(ctx, input))
+        result.ret = AVERROR(ENOSYS);
+    else if (direct)
+        result.ret = pixconv_convert_direct(ctx, src.data, src.stride, dst.buffer.get(), src.width, src.height,
+                                            dst.stride, src.height);
+    else
+        result.ret = pixconv_convert(ctx, src.data, src.stride, dst.buffer.get(), src.width, src.height, dst.stride,
+                                     src.height, band);
+    result.hash = dst.Hash();
+    result.convert = ctx->convert;
+
+    pixconv_free(&ctx);
+    return result;
+}
+
+static std::string result_string(const ConvResult &result)
+{
+    char buf[32];
+    if (result.ret < 0)
+        return "unsupported";
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)result.hash);
+    return buf;
+}
+
+static bool load_golden(const char *path, std::map<std::string, std::string> &golden)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    char line[256], in[32], out[32], size[32], cpu[32], value[32];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%31s %31s %31s %31s %31s", in, out, size, cpu, value) == 5)
+            golden[std::string(in) + " " + out + " " + size + " " + cpu] = value;
+    }
+    fclose(f);
+    return true;
+}
+
+// Check the conversion paths that have to match the plain conversion, with the given instruction set
+static void check_variants(const PixConvInput &input, PixConvOutFmt output, const PixConvCpu &cpu,
+                           const PixConvSource &src, const ConvResult &ref, const char *key)
+{
+    // unaligned stride, the converters that need alignment go through an intermediate buffer
+    const ConvResult unaligned = convert(input, src, output, cpu.flags, 1, src.width + 2);
+    if (unaligned.ret != ref.ret || (ref.ret >= 0 && unaligned.hash != ref.hash))
+        FAIL("%s: unaligned stride differs\n", key);
+
+    PixConvContext *ctx = pixconv_test_alloc(input, output, cpu.flags, 1);
+    const bool bandSupported = pixconv_is_band_supported(ctx);
+    const bool directSupported = pixconv_is_direct_supported(ctx, 0, FFALIGN(src.width, 64));
+    pixconv_free(&ctx);
+
+    if (bandSupported && ref.ret >= 0)
+    {
+        PixConvBand band;
+        PixConvBuffer bandPlanes[4];
+        src.GetBand(16, 32, &band, bandPlanes, input.pixFmt);
+        const ConvResult banded = convert(input, src, output, cpu.flags, 1, FFALIGN(src.width, 64), &band);
+        if (banded.ret < 0 || banded.hash != ref.hash)
+            FAIL("%s: conversion with a band differs\n", key);
+    }
+
+    if (directSupported && ref.ret >= 0)
+    {
+        const ConvResult direct = convert(input, src, output, cpu.flags, 1, FFALIGN(src.width, 64), nullptr, true);
+        if (direct.ret < 0 || direct.hash != ref.hash)
+            FAIL("%s: direct conversion differs\n", key);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool generate = false;
+    const char *goldenPath = PIXCONV_GOLDEN_FILE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--generate") == 0)
+            generate = true;
+        else
+            goldenPath = argv[i];
+    }
+
+    av_log_set_level(AV_LOG_QUIET);
+    const int cpuFlags = av_get_cpu_flags();
+
+    std::map<std::string, std::string> golden;
+    if (!generate && !load_golden(goldenPath, golden))
+    {
+        printf("Cannot read the golden file %s\n", goldenPath);
+        return 1;
+    }
+
+    FILE *out = nullptr;
+    if (generate)
+    {
+        out = fopen(goldenPath, "w");
+        if (!out)
+        {
+            printf("Cannot write the golden file %s\n", goldenPath);
+            return 1;
+        }
+        fprintf(out, "# Golden output of the pixel converters, written by pixconv_test --generate\n");
+        fprintf(out, "# input output size cpu hash\n");
+    }
+
+    int compared = 0, simdCompared = 0, threadCompared = 0;
+    std::mt19937 rng(1);
+    for (const PixConvInput &input : pixconv_inputs)
+    {
+        PixConvSource sources[FF_ARRAY_ELEMS(test_sizes)] = {
+            PixConvSource(input, test_sizes[0].width, test_sizes[0].height, rng),
+            PixConvSource(input, test_sizes[1].width, test_sizes[1].height, rng),
+        };
+        PixConvSource large(input, 1280, 720, rng);
+
+        for (int o = 0; o < PixConvOut_NB; o++)
+        {
+            const PixConvOutFmt output = (PixConvOutFmt)o;
+            for (const PixConvSource &src : sources)
+            {
+                ConvResult simd = {0, 0, nullptr};
+                const PixConvCpu *simdCpu = nullptr;
+                for (const PixConvCpu &cpu : pixconv_cpus)
+                {
+                    char key[128];
+                    snprintf(key, sizeof(key), "%s %s %dx%d %s", input.name, pixconv_output_names[o], src.width,
+                             src.height, cpu.name);
+
+                    if (!pixconv_cpu_supported(cpu, cpuFlags))
+                    {
+                        if (generate)
+                        {
+                            printf("The CPU does not support %s, cannot generate the golden file\n", cpu.name);
+                            fclose(out);
+                            return 1;
+                        }
+                        continue;
+                    }
+
+                    av_force_cpu_flags(cpu.flags);
+                    const ConvResult result = convert(input, src, output, cpu.flags, 1, FFALIGN(src.width, 64));
+
+                    if (generate)
+                    {
+                        fprintf(out, "%s %s\n", key, result_string(result).c_str());
+                    }
+                    else
+                    {
+                        auto it = golden.find(key);
+                        if (it == golden.end())
+                            FAIL("%s: missing from the golden file\n", key);
+                        else if (it->second != result_string(result))
+                            FAIL("%s: got %s, expected %s\n", key, result_string(result).c_str(),
+                                 it->second.c_str());
+                        compared++;
+                    }
+
+                    // the custom converters have to give the same output with every instruction set
+                    // except the SSSE3 RGB48 to RGB32 one, which rounds its dithering differently (within 1 LSB)
+                    if (cpu.flags && result.convert != convert_generic &&
+                        result.convert != convert_rgb48_rgb32_ssse3 && result.ret >= 0)
+                    {
+                        if (simdCpu && simd.convert != result.convert)
+                        {
+                            if (simd.hash != result.hash)
+                                FAIL("%s: differs from %s\n", key, simdCpu->name);
+                            simdCompared++;
+                        }
+                        simd = result;
+                        simdCpu = &cpu;
+                    }
+
+                    check_variants(input, output, cpu, src, result, key);
+                }
+            }
+
+            // threading only splits the frame if it is big enough
+            const PixConvCpu &cpu = pixconv_cpus[FF_ARRAY_ELEMS(pixconv_cpus) - 1];
+            if (pixconv_cpu_supported(cpu, cpuFlags))
+            {
+                av_force_cpu_flags(cpu.flags);
+                PixConvContext *ctx = pixconv_test_alloc(input, output, cpu.flags, 4);
+                const bool bandSupported = pixconv_is_band_supported(ctx);
+                pixconv_free(&ctx);
+
+                if (bandSupported)
+                {
+                    const ptrdiff_t stride = FFALIGN(large.width, 64);
+                    const ConvResult single = convert(input, large, output, cpu.flags, 1, stride);
+                    const ConvResult threaded = convert(input, large, output, cpu.flags, 4, stride);
+                    if (single.ret != threaded.ret || single.hash != threaded.hash)
+                        FAIL("%s %s: threaded conversion differs\n", input.name, pixconv_output_names[o]);
+                    threadCompared++;
+                }
+            }
+        }
+    }
+    av_force_cpu_flags(-1);
+
+    if (generate)
+    {
+        fclose(out);
+        printf("Wrote %s\n", goldenPath);
+    }
+    else
+    {
+        printf("%d conversions compared with the golden output\n", compared);
+    }
+    printf("%d SIMD converter pairs compared, %d threaded conversions compared\n", simdCompared, threadCompared);
+
+    if (failures)
+    {
+        printf("FAILED, %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
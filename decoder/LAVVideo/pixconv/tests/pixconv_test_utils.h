@@ -0,0 +1,250 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Helpers shared by the pixel converter test and benchmark
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <random>
+
+#include "pixconv_internal.h"
+
+extern "C"
+{
+#include "libavutil/pixdesc.h"
+};
+
+struct PixConvInput
+{
+    LAVPixelFormat pixFmt;
+    int bpp;
+    const char *name;
+};
+
+// Every format the decoders produce, the high bit-depth ones with the depths that select different converters
+static const PixConvInput pixconv_inputs[] = {
+    {LAVPixFmt_YUV420, 8, "YUV420"},          {LAVPixFmt_YUV420bX, 10, "YUV420P10"},
+    {LAVPixFmt_YUV420bX, 12, "YUV420P12"},    {LAVPixFmt_YUV420bX, 16, "YUV420P16"},
+    {LAVPixFmt_YUV422, 8, "YUV422"},          {LAVPixFmt_YUV422bX, 10, "YUV422P10"},
+    {LAVPixFmt_YUV422bX, 16, "YUV422P16"},    {LAVPixFmt_YUV444, 8, "YUV444"},
+    {LAVPixFmt_YUV444bX, 10, "YUV444P10"},    {LAVPixFmt_YUV444bX, 16, "YUV444P16"},
+    {LAVPixFmt_NV12, 8, "NV12"},              {LAVPixFmt_YUY2, 8, "YUY2"},
+    {LAVPixFmt_P016, 10, "P010"},             {LAVPixFmt_P016, 16, "P016"},
+    {LAVPixFmt_RGB24, 8, "RGB24"},            {LAVPixFmt_RGB32, 8, "RGB32"},
+    {LAVPixFmt_ARGB32, 8, "ARGB32"},          {LAVPixFmt_RGB48, 8, "RGB48"},
+    {LAVPixFmt_AYUV, 8, "AYUV"},              {LAVPixFmt_Y410, 10, "Y410"},
+    {LAVPixFmt_Y416, 16, "Y416"},             {LAVPixFmt_Y216, 10, "Y210"},
+    {LAVPixFmt_Y216, 16, "Y216"},
+};
+
+// Names of the output formats, indexed by PixConvOutFmt
+static const char *const pixconv_output_names[PixConvOut_NB] = {
+    "YV12", "NV12", "YUY2", "UYVY",  "AYUV",  "P010", "P210", "Y410", "P016",
+    "P216", "Y416", "RGB32", "RGB24", "v210", "v410", "YV16", "YV24", "RGB48",
+};
+
+// Instruction sets the converters are selected with
+// The same flags are forced on FFmpeg, so the swscale fallback gives the same result on every CPU
+struct PixConvCpu
+{
+    int flags;
+    const char *name;
+};
+
+static const PixConvCpu pixconv_cpus[] = {
+    {0, "C"},
+    {AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2, "SSE2"},
+    {AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 |
+         AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42,
+     "SSE4"},
+    {AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 |
+         AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 | AV_CPU_FLAG_AVX | AV_CPU_FLAG_AVX2 |
+         AV_CPU_FLAG_FMA3,
+     "AVX2"},
+};
+
+static inline bool pixconv_cpu_supported(const PixConvCpu &cpu, int cpuFlags)
+{
+    return (cpuFlags & cpu.flags) == cpu.flags;
+}
+
+struct PixConvFree
+{
+    void operator()(uint8_t *p) const { av_free(p); }
+};
+typedef std::unique_ptr<uint8_t, PixConvFree> PixConvBuffer;
+
+static inline PixConvBuffer pixconv_buffer_alloc(size_t size)
+{
+    // the padding covers the over-reads of the SIMD converters, which are allowed on decoder buffers
+    uint8_t *p = (uint8_t *)av_mallocz(size + 2 * AV_INPUT_BUFFER_PADDING_SIZE);
+    return PixConvBuffer(p);
+}
+
+// A source frame with random content, holding only valid values for its bit depth
+struct PixConvSource
+{
+    PixConvSource(const PixConvInput &input, int width, int height, std::mt19937 &rng)
+        : width(width), height(height)
+    {
+        const LAVPixFmtDesc desc = getPixelFormatDesc(input.pixFmt);
+        for (int p = 0; p < desc.planes; p++)
+        {
+            const int lineBytes = width * desc.codedbytes / desc.planeWidth[p];
+            const int lines = height / desc.planeHeight[p];
+            stride[p] = FFALIGN(lineBytes, 64);
+            planes[p] = pixconv_buffer_alloc((size_t)stride[p] * lines);
+            data[p] = planes[p].get();
+
+            uint8_t *line = planes[p].get();
+            for (int y = 0; y < lines; y++, line += stride[p])
+            {
+                if (desc.codedbytes == 2 && input.pixFmt != LAVPixFmt_YUY2)
+                {
+                    // bX formats are LSB aligned, P016 is MSB aligned
+                    const uint16_t mask = input.pixFmt == LAVPixFmt_P016
+                                              ? (uint16_t)(0xffff << (16 - input.bpp))
+                                              : (uint16_t)((1 << input.bpp) - 1);
+                    for (int x = 0; x < lineBytes / 2; x++)
+                        ((uint16_t *)line)[x] = (uint16_t)rng() & mask;
+                }
+                else if (input.pixFmt == LAVPixFmt_Y216)
+                {
+                    const uint16_t mask = (uint16_t)(0xffff << (16 - input.bpp));
+                    for (int x = 0; x < lineBytes / 2; x++)
+                        ((uint16_t *)line)[x] = (uint16_t)rng() & mask;
+                }
+                else
+                {
+                    for (int x = 0; x < lineBytes; x++)
+                        line[x] = (uint8_t)rng();
+                }
+            }
+        }
+    }
+
+    // Copy of the lines [top, top + lines) of the frame, in separate buffers
+    void GetBand(int top, int lines, PixConvBand *band, PixConvBuffer bandPlanes[4], LAVPixelFormat pixFmt) const
+    {
+        const LAVPixFmtDesc desc = getPixelFormatDesc(pixFmt);
+        memset(band, 0, sizeof(*band));
+        band->top = top;
+        band->height = lines;
+        for (int p = 0; p < desc.planes; p++)
+        {
+            const int planeLines = lines / desc.planeHeight[p];
+            bandPlanes[p] = pixconv_buffer_alloc((size_t)stride[p] * planeLines);
+            memcpy(bandPlanes[p].get(), data[p] + (top / desc.planeHeight[p]) * stride[p],
+                   (size_t)stride[p] * planeLines);
+            band->data[p] = bandPlanes[p].get();
+            band->stride[p] = stride[p];
+        }
+    }
+
+    int width, height;
+    PixConvBuffer planes[4];
+    const uint8_t *data[4] = {0};
+    ptrdiff_t stride[4] = {0};
+};
+
+// Destination frame, with all planes in one buffer like a DirectShow media sample
+struct PixConvDest
+{
+    // stride in pixels, like the converters take it
+    PixConvDest(PixConvOutFmt format, int width, int height, ptrdiff_t stride)
+        : format(format), width(width), height(height), stride(stride)
+    {
+        const LAVOutPixFmtDesc desc = lav_pixfmt_desc[format];
+        size = (size_t)stride * desc.codedbytes * height * 3;
+        buffer = pixconv_buffer_alloc(size);
+    }
+
+    // Call fn(plane, line, bytes) for the bytes of every line that hold pixels
+    template <class Fn> void ForEachLine(Fn fn) const
+    {
+        const LAVOutPixFmtDesc desc = lav_pixfmt_desc[format];
+        // v210 lines hold groups of 48 pixels in 128 bytes, for the width and for the stride
+        const ptrdiff_t byteStride =
+            format == PixConvOut_v210 ? ((stride + 47) / 48) * 128 : stride * desc.codedbytes;
+        const int lineBytes = format == PixConvOut_v210 ? ((width + 47) / 48) * 128 : width * desc.codedbytes;
+
+        const uint8_t *plane = buffer.get();
+        for (int p = 0; p < FFMAX(desc.planes, 1); p++)
+        {
+            const ptrdiff_t planeStride = byteStride / desc.planeWidth[p];
+            const int lines = height / desc.planeHeight[p];
+            for (int y = 0; y < lines; y++)
+                fn(p, plane + y * planeStride, lineBytes / desc.planeWidth[p]);
+            plane += planeStride * lines;
+        }
+    }
+
+    // FNV-1a hash of the pixels
+    // RGB32 is delivered as X8R8G8B8, and the converters leave different values in the unused byte
+    uint64_t Hash() const
+    {
+        const int skipX = format == PixConvOut_RGB32;
+        uint64_t hash = 14695981039346656037ULL;
+        ForEachLine([&](int, const uint8_t *line, int bytes) {
+            for (int x = 0; x < bytes; x++)
+            {
+                if (skipX && (x & 3) == 3)
+                    continue;
+                hash = (hash ^ line[x]) * 1099511628211ULL;
+            }
+        });
+        return hash;
+    }
+
+    PixConvOutFmt format;
+    int width, height;
+    ptrdiff_t stride;
+    size_t size;
+    PixConvBuffer buffer;
+};
+
+// Converter for a format pair, configured like LAV Video does for a BT.709 limited range input
+static inline PixConvContext *pixconv_test_alloc(const PixConvInput &input, PixConvOutFmt output, int cpuFlags,
+                                                 int threads)
+{
+    PixConvContext *ctx = pixconv_alloc(threads);
+    if (!ctx)
+        return nullptr;
+
+    const PixConvColorProps props = {PixConvMatrix_BT709, 0, 0};
+    pixconv_set_formats(ctx, input.pixFmt, input.bpp, output, cpuFlags);
+    pixconv_set_color_props(ctx, &props);
+    pixconv_set_dither_mode(ctx, PixConvDither_Ordered);
+    return ctx;
+}
+
+// The pair is converted by swscale, and not by one of the LAV Video converters
+static inline bool pixconv_is_generic(const PixConvContext *ctx)
+{
+    return ctx->convert == convert_generic;
+}
+
+// The swscale fallback can only convert formats known to the FFmpeg version it is built with
+static inline bool pixconv_is_supported(const PixConvContext *ctx, const PixConvInput &input)
+{
+    return !pixconv_is_generic(ctx) || av_pix_fmt_desc_get(getFFPixelFormatFromLAV(input.pixFmt, input.bpp));
+}
@@ -17,13 +17,11 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
-#include <ppl.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
+#include "pixconv_avx2_templates.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4556)
@@ -379,7 +377,7 @@ __forceinline static int yuv2rgb_convert_pixels(const uint8_t *&srcY, const uint
     }
 
     // Dithering
-    if (dithertype == LAVDither_Random)
+    if (dithertype == PixConvDither_Random)
     {
         /* Load random dithering coeffs from the dithers buffer */
         int offset = (pos % (DITHER_STEPS * 4 * 2)) * 6;
@@ -436,7 +434,7 @@ __forceinline static int yuv2rgb_convert_pixels(const uint8_t *&srcY, const uint
     {
         // RGB 24 output is terribly inefficient due to the un-aligned size of 3 bytes per pixel
         uint32_t eax;
-        __declspec(align(16)) uint8_t rgbbuf[32];
+        alignas(16) uint8_t rgbbuf[32];
         *(uint32_t *)rgbbuf = _mm_cvtsi128_si32(xmm1);
         xmm1 = _mm_srli_si128(xmm1, 4);
         *(uint32_t *)(rgbbuf + 3) = _mm_cvtsi128_si32(xmm1);
@@ -470,11 +468,383 @@ __forceinline static int yuv2rgb_convert_pixels(const uint8_t *&srcY, const uint
     return 0;
 }
 
-template <LAVPixelFormat inputFormat, int shift, int outFmt, int dithertype, int ycgco>
-static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst,
-                                     int width, int height, ptrdiff_t srcStrideY, ptrdiff_t srcStrideUV,
-                                     ptrdiff_t dstStride, ptrdiff_t sliceYStart, ptrdiff_t sliceYEnd,
-                                     const RGBCoeffs *coeffs, const uint16_t *dithers)
+// This function converts 8x2 pixels from the source into 8x2 RGB32 pixels in the destination
+// Each 128-bit lane performs the same operations as the SSE2 version on 4x2 pixels, the right edge is always handled
+// by the SSE2 version
+template <LAVPixelFormat inputFormat, int shift, int dithertype, int ycgco>
+PIXCONV_TARGET_AVX2 __forceinline static int yuv2rgb_convert_pixels_avx2(
+    const uint8_t *&srcY, const uint8_t *&srcU, const uint8_t *&srcV, uint8_t *&dst, ptrdiff_t srcStrideY,
+    ptrdiff_t srcStrideUV, ptrdiff_t dstStride, ptrdiff_t line, const RGBCoeffs *coeffs, const uint16_t *&dithers,
+    ptrdiff_t pos)
+{
+    __m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+    ymm7 = _mm256_setzero_si256();
+
+    // Number of bytes the source pointers advance for every 4x2 pixels
+    const bool subsampled = (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_NV12 ||
+                             inputFormat == LAVPixFmt_YUV422 || inputFormat == LAVPixFmt_P016);
+    const ptrdiff_t uvStep = (inputFormat == LAVPixFmt_P016) ? 8
+                             : subsampled ? ((shift > 0 || inputFormat == LAVPixFmt_NV12) ? 4 : 2)
+                                          : ((shift > 0) ? 8 : 4);
+    const ptrdiff_t yStep = (shift > 0) ? 8 : 4;
+
+    // Shift > 0 is for 9/10 bit formats
+    if (inputFormat == LAVPixFmt_P016)
+    {
+        // Load 2 32-bit macro pixels from each line, which contain 4 UV at 16-bit each samples
+        PIXCONV_AVX2_LOAD_LANES(ymm0, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES(ymm2, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+    }
+    else if (shift > 0)
+    {
+        // Load 4 U/V values from line 0/1 into registers
+        PIXCONV_AVX2_LOAD_LANES_64(ymm1, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm3, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcV, srcV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm2, srcV + srcStrideUV, srcV + srcStrideUV + uvStep);
+
+        // Interleave U and V
+        ymm0 = _mm256_unpacklo_epi16(ymm1, ymm0); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi16(ymm3, ymm2); /* 0V0U0V0U */
+    }
+    else if (inputFormat == LAVPixFmt_NV12)
+    {
+        // Load 4 16-bit macro pixels, which contain 4 UV samples
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm2, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+
+        // Expand to 16-bit
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi8(ymm2, ymm7); /* 0V0U0V0U */
+    }
+    else
+    {
+        PIXCONV_AVX2_LOAD_LANES_32(ymm1, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm3, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm0, srcV, srcV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm2, srcV + srcStrideUV, srcV + srcStrideUV + uvStep);
+
+        // Interleave U and V
+        ymm0 = _mm256_unpacklo_epi8(ymm1, ymm0); /* VUVU0000 */
+        ymm2 = _mm256_unpacklo_epi8(ymm3, ymm2); /* VUVU0000 */
+
+        // Expand to 16-bit
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi8(ymm2, ymm7); /* 0V0U0V0U */
+    }
+
+    srcU += uvStep << 1;
+    srcV += uvStep << 1;
+
+    // Chroma upsampling required
+    if (subsampled)
+    {
+        // 4:2:0 - upsample to 4:2:2 using 75:25
+        if (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_NV12 || inputFormat == LAVPixFmt_P016)
+        {
+            // Too high bitdepth, shift down to 14-bit
+            if (shift >= 7)
+            {
+                ymm0 = _mm256_srli_epi16(ymm0, shift - 6);
+                ymm2 = _mm256_srli_epi16(ymm2, shift - 6);
+            }
+            ymm1 = ymm0;
+            ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 2x line 0 */
+            ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 3x line 0 */
+            ymm1 = _mm256_add_epi16(ymm1, ymm2); /* 3x line 0 + line 1 (10bit) */
+
+            ymm3 = ymm2;
+            ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 2x line 1 */
+            ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 3x line 1 */
+            ymm3 = _mm256_add_epi16(ymm3, ymm0); /* 3x line 1 + line 0 (10bit) */
+
+            // If the bit depth is too high, we need to reduce it here (max 15bit)
+            if (shift >= 6)
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, 1);
+                ymm3 = _mm256_srli_epi16(ymm3, 1);
+            }
+        }
+        else
+        {
+            ymm1 = ymm0;
+            ymm3 = ymm2;
+
+            // Shift to maximum of 15-bit, if required
+            if (shift >= 8)
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, 1);
+                ymm3 = _mm256_srli_epi16(ymm3, 1);
+            }
+        }
+
+        // Upsample to 4:4:4 using 100:0, 50:50, 0:100 scheme (MPEG2 chroma siting)
+        ymm0 = ymm1;                              /* UV UV UV UV */
+        ymm0 = _mm256_unpacklo_epi32(ymm0, ymm7); /* UV 00 UV 00 */
+        ymm1 = _mm256_srli_si256(ymm1, 4);        /* UV UV UV 00 */
+        ymm1 = _mm256_unpacklo_epi32(ymm7, ymm1); /* 00 UV 00 UV */
+
+        ymm1 = _mm256_add_epi16(ymm1, ymm0); /*  UV  UV  UV  UV */
+        ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 2UV  UV 2UV  UV */
+
+        ymm0 = _mm256_slli_si256(ymm0, 4);   /*  00  UV  00  UV */
+        ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 2UV 2UV 2UV 2UV */
+
+        // Same for the second row
+        ymm2 = ymm3;                              /* UV UV UV UV */
+        ymm2 = _mm256_unpacklo_epi32(ymm2, ymm7); /* UV 00 UV 00 */
+        ymm3 = _mm256_srli_si256(ymm3, 4);        /* UV UV UV 00 */
+        ymm3 = _mm256_unpacklo_epi32(ymm7, ymm3); /* 00 UV 00 UV */
+
+        ymm3 = _mm256_add_epi16(ymm3, ymm2); /*  UV  UV  UV  UV */
+        ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 2UV  UV 2UV  UV */
+
+        ymm2 = _mm256_slli_si256(ymm2, 4);   /*  00  UV  00  UV */
+        ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 2UV 2UV 2UV 2UV */
+
+        // Shift the result to 12 bit
+        if ((inputFormat == LAVPixFmt_YUV420 && shift > 1) || inputFormat == LAVPixFmt_P016)
+        {
+            if (shift >= 5)
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, 4);
+                ymm3 = _mm256_srli_epi16(ymm3, 4);
+            }
+            else
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, shift - 1);
+                ymm3 = _mm256_srli_epi16(ymm3, shift - 1);
+            }
+        }
+        else if (inputFormat == LAVPixFmt_YUV422)
+        {
+            if (shift >= 7)
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, 4);
+                ymm3 = _mm256_srli_epi16(ymm3, 4);
+            }
+            else if (shift > 3)
+            {
+                ymm1 = _mm256_srli_epi16(ymm1, shift - 3);
+                ymm3 = _mm256_srli_epi16(ymm3, shift - 3);
+            }
+            else if (shift < 3)
+            {
+                ymm1 = _mm256_slli_epi16(ymm1, 3 - shift);
+                ymm3 = _mm256_slli_epi16(ymm3, 3 - shift);
+            }
+        }
+        else if ((inputFormat == LAVPixFmt_YUV420 && shift == 0) || inputFormat == LAVPixFmt_NV12)
+        {
+            ymm1 = _mm256_slli_epi16(ymm1, 1);
+            ymm3 = _mm256_slli_epi16(ymm3, 1);
+        }
+    }
+    else if (inputFormat == LAVPixFmt_YUV444)
+    {
+        // Shift to 12 bit
+        if (shift > 4)
+        {
+            ymm1 = _mm256_srli_epi16(ymm0, shift - 4);
+            ymm3 = _mm256_srli_epi16(ymm2, shift - 4);
+        }
+        else if (shift < 4)
+        {
+            ymm1 = _mm256_slli_epi16(ymm0, 4 - shift);
+            ymm3 = _mm256_slli_epi16(ymm2, 4 - shift);
+        }
+        else
+        {
+            ymm1 = ymm0;
+            ymm3 = ymm2;
+        }
+    }
+
+    // Load Y
+    if (shift > 0)
+    {
+        // Load 4 Y values from line 0/1 into registers
+        PIXCONV_AVX2_LOAD_LANES_64(ymm5, srcY, srcY + yStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcY + srcStrideY, srcY + srcStrideY + yStep);
+    }
+    else
+    {
+        PIXCONV_AVX2_LOAD_LANES_32(ymm5, srcY, srcY + yStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm0, srcY + srcStrideY, srcY + srcStrideY + yStep);
+
+        ymm5 = _mm256_unpacklo_epi8(ymm5, ymm7); /* YYYY0000 (16-bit fields) */
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* YYYY0000 (16-bit fields)*/
+    }
+    srcY += yStep << 1;
+
+    ymm0 = _mm256_unpacklo_epi64(ymm0, ymm5); /* YYYYYYYY */
+
+    if (!ycgco)
+    {
+        // YCbCr conversion
+        // Shift Y to 14 bits
+        if (shift < 6)
+        {
+            ymm0 = _mm256_slli_epi16(ymm0, 6 - shift);
+        }
+        else if (shift > 6)
+        {
+            ymm0 = _mm256_srli_epi16(ymm0, shift - 6);
+        }
+        ymm0 = _mm256_subs_epu16(ymm0, _mm256_broadcastsi128_si256(coeffs->Ysub));
+        ymm0 = _mm256_mulhi_epi16(ymm0, _mm256_broadcastsi128_si256(coeffs->cy));
+        ymm0 = _mm256_add_epi16(ymm0, _mm256_broadcastsi128_si256(coeffs->rgb_add));
+
+        ymm2 = _mm256_broadcastsi128_si256(coeffs->CbCr_center);
+        ymm1 = _mm256_subs_epi16(ymm1, ymm2); /* move CbCr to proper range */
+        ymm3 = _mm256_subs_epi16(ymm3, ymm2);
+
+        ymm2 = _mm256_broadcastsi128_si256(coeffs->cR_Cr);
+        ymm6 = _mm256_madd_epi16(ymm1, ymm2); /* Result is 25 bits (12 from chroma, 13 from coeff) */
+        ymm4 = _mm256_madd_epi16(ymm3, ymm2);
+        ymm6 = _mm256_srai_epi32(ymm6, 13); /* Reduce to 12 bit */
+        ymm4 = _mm256_srai_epi32(ymm4, 13);
+        ymm6 = _mm256_packs_epi32(ymm6, ymm7); /* Pack back into 16 bit cells */
+        ymm4 = _mm256_packs_epi32(ymm4, ymm7);
+        ymm6 = _mm256_unpacklo_epi64(ymm4, ymm6); /* Interleave both parts */
+        ymm6 = _mm256_add_epi16(ymm6, ymm0);      /* R (12bit) */
+
+        ymm2 = _mm256_broadcastsi128_si256(coeffs->cG_Cb_cG_Cr);
+        ymm5 = _mm256_madd_epi16(ymm1, ymm2); /* Result is 25 bits (12 from chroma, 13 from coeff) */
+        ymm4 = _mm256_madd_epi16(ymm3, ymm2);
+        ymm5 = _mm256_srai_epi32(ymm5, 13); /* Reduce to 12 bit */
+        ymm4 = _mm256_srai_epi32(ymm4, 13);
+        ymm5 = _mm256_packs_epi32(ymm5, ymm7); /* Pack back into 16 bit cells */
+        ymm4 = _mm256_packs_epi32(ymm4, ymm7);
+        ymm5 = _mm256_unpacklo_epi64(ymm4, ymm5); /* Interleave both parts */
+        ymm5 = _mm256_add_epi16(ymm5, ymm0);      /* G (12bit) */
+
+        ymm2 = _mm256_broadcastsi128_si256(coeffs->cB_Cb);
+        ymm1 = _mm256_madd_epi16(ymm1, ymm2); /* Result is 25 bits (12 from chroma, 13 from coeff) */
+        ymm3 = _mm256_madd_epi16(ymm3, ymm2);
+        ymm1 = _mm256_srai_epi32(ymm1, 13); /* Reduce to 12 bit */
+        ymm3 = _mm256_srai_epi32(ymm3, 13);
+        ymm1 = _mm256_packs_epi32(ymm1, ymm7); /* Pack back into 16 bit cells */
+        ymm3 = _mm256_packs_epi32(ymm3, ymm7);
+        ymm1 = _mm256_unpacklo_epi64(ymm3, ymm1); /* Interleave both parts */
+        ymm1 = _mm256_add_epi16(ymm1, ymm0);      /* B (12bit) */
+    }
+    else
+    {
+        // YCgCo conversion
+        // Shift Y to 12 bits
+        if (shift < 4)
+        {
+            ymm0 = _mm256_slli_epi16(ymm0, 4 - shift);
+        }
+        else if (shift > 4)
+        {
+            ymm0 = _mm256_srli_epi16(ymm0, shift - 4);
+        }
+
+        ymm7 = _mm256_set1_epi32(0x0000FFFF);
+        ymm2 = ymm1;
+        ymm4 = ymm3;
+
+        ymm1 = _mm256_and_si256(ymm1, ymm7); /* null out the high-order bytes to get the Cg values */
+        ymm4 = _mm256_and_si256(ymm4, ymm7);
+
+        ymm3 = _mm256_srli_epi32(ymm3, 16); /* right shift the Co values */
+        ymm2 = _mm256_srli_epi32(ymm2, 16);
+
+        ymm1 = _mm256_packs_epi32(ymm4, ymm1); /* Pack Cg into ymm1 */
+        ymm3 = _mm256_packs_epi32(ymm3, ymm2); /* Pack Co into ymm3 */
+
+        ymm2 = _mm256_broadcastsi128_si256(coeffs->CbCr_center); /* move CgCo to proper range */
+        ymm1 = _mm256_subs_epi16(ymm1, ymm2);
+        ymm3 = _mm256_subs_epi16(ymm3, ymm2);
+
+        ymm2 = ymm0;
+        ymm2 = _mm256_subs_epi16(ymm2, ymm1); /* tmp = Y - Cg */
+        ymm6 = _mm256_adds_epi16(ymm2, ymm3); /* R = tmp + Co */
+        ymm5 = _mm256_adds_epi16(ymm0, ymm1); /* G = Y + Cg */
+        ymm1 = _mm256_subs_epi16(ymm2, ymm3); /* B = tmp - Co */
+    }
+
+    // Dithering
+    if (dithertype == PixConvDither_Random)
+    {
+        /* Load random dithering coeffs from the dithers buffer */
+        int offset1 = (pos % (DITHER_STEPS * 4 * 2)) * 6;
+        int offset2 = ((pos + 4) % (DITHER_STEPS * 4 * 2)) * 6;
+        PIXCONV_AVX2_LOAD_LANES(ymm2, dithers + 0 + offset1, dithers + 0 + offset2);
+        PIXCONV_AVX2_LOAD_LANES(ymm3, dithers + 8 + offset1, dithers + 8 + offset2);
+        PIXCONV_AVX2_LOAD_LANES(ymm4, dithers + 16 + offset1, dithers + 16 + offset2);
+    }
+    else
+    {
+        /* Load dithering coeffs and combine them for two lines */
+        const uint16_t *d1 = dither_8x8_256[line % 8];
+        ymm2 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)d1));
+        const uint16_t *d2 = dither_8x8_256[(line + 1) % 8];
+        ymm3 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)d2));
+
+        ymm4 = ymm2;
+        ymm2 = _mm256_unpacklo_epi64(ymm2, ymm3);
+        ymm4 = _mm256_unpackhi_epi64(ymm4, ymm3);
+        ymm2 = _mm256_srli_epi16(ymm2, 4);
+        ymm4 = _mm256_srli_epi16(ymm4, 4);
+
+        ymm3 = ymm4;
+    }
+
+    ymm6 = _mm256_adds_epu16(ymm6, ymm2); /* Apply coefficients to the RGB values */
+    ymm5 = _mm256_adds_epu16(ymm5, ymm3);
+    ymm1 = _mm256_adds_epu16(ymm1, ymm4);
+
+    ymm6 = _mm256_srai_epi16(ymm6, 4); /* Shift to 8 bit */
+    ymm5 = _mm256_srai_epi16(ymm5, 4);
+    ymm1 = _mm256_srai_epi16(ymm1, 4);
+
+    ymm2 = _mm256_cmpeq_epi8(ymm2, ymm2);   /* 0xffffffff,0xffffffff,0xffffffff,0xffffffff */
+    ymm6 = _mm256_packus_epi16(ymm6, ymm7); /* R (lower 8bytes,8bit) * 8 */
+    ymm5 = _mm256_packus_epi16(ymm5, ymm7); /* G (lower 8bytes,8bit) * 8 */
+    ymm1 = _mm256_packus_epi16(ymm1, ymm7); /* B (lower 8bytes,8bit) * 8 */
+
+    ymm6 = _mm256_unpacklo_epi8(ymm6, ymm2); // 0xff,R
+    ymm1 = _mm256_unpacklo_epi8(ymm1, ymm5); // G,B
+    ymm2 = ymm1;
+
+    ymm1 = _mm256_unpackhi_epi16(ymm1, ymm6); // 0xff,RGB * 4 (line 0)
+    ymm2 = _mm256_unpacklo_epi16(ymm2, ymm6); // 0xff,RGB * 4 (line 1)
+
+    // The lanes hold consecutive pixels of the same line
+    PIXCONV_AVX2_PUT_STREAM(dst, ymm1);
+    PIXCONV_AVX2_PUT_STREAM(dst + dstStride, ymm2);
+    dst += 32;
+
+    return 0;
+}
+
+// Convert two lines in blocks of 8x2 pixels, up to the last 4 pixels which are left to the SSE2 version
+// Returns the position the SSE2 version continues at
+template <LAVPixelFormat inputFormat, int shift, int dithertype, int ycgco>
+PIXCONV_TARGET_AVX2 static ptrdiff_t yuv2rgb_convert_line_avx2(const uint8_t *&srcY, const uint8_t *&srcU,
+                                                               const uint8_t *&srcV, uint8_t *&dst,
+                                                               ptrdiff_t srcStrideY, ptrdiff_t srcStrideUV,
+                                                               ptrdiff_t dstStride, ptrdiff_t line,
+                                                               const RGBCoeffs *coeffs, const uint16_t *&dithers,
+                                                               ptrdiff_t endx)
+{
+    ptrdiff_t i = 0;
+    for (; i < (endx - 4); i += 8)
+    {
+        yuv2rgb_convert_pixels_avx2<inputFormat, shift, dithertype, ycgco>(
+            srcY, srcU, srcV, dst, srcStrideY, srcStrideUV, dstStride, line, coeffs, dithers, i);
+    }
+    return i;
+}
+
+template <LAVPixelFormat inputFormat, int shift, int outFmt, int dithertype, int ycgco, int avx2>
+static int yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV, uint8_t *dst,
+                           int width, int height, ptrdiff_t srcStrideY, ptrdiff_t srcStrideUV,
+                           ptrdiff_t dstStride, ptrdiff_t sliceYStart, ptrdiff_t sliceYEnd,
+                           const RGBCoeffs *coeffs, const uint16_t *dithers)
 {
     const uint8_t *y = srcY;
     const uint8_t *u = srcU;
@@ -496,7 +866,13 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
     {
         if (line == 0)
         {
-            for (ptrdiff_t i = 0; i < endx; i += 4)
+            ptrdiff_t i = 0;
+            if (avx2)
+            {
+                i = yuv2rgb_convert_line_avx2<inputFormat, shift, dithertype, ycgco>(y, u, v, rgb, 0, 0, 0, line,
+                                                                                     coeffs, lineDither, endx);
+            }
+            for (; i < endx; i += 4)
             {
                 yuv2rgb_convert_pixels<inputFormat, shift, outFmt, 0, dithertype, ycgco>(y, u, v, rgb, 0, 0, 0, line,
                                                                                          coeffs, lineDither, i);
@@ -517,7 +893,7 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
 
     for (; line < lastLine; line += 2)
     {
-        if (dithertype == LAVDither_Random)
+        if (dithertype == PixConvDither_Random)
             lineDither = dithers + (line * 24 * DITHER_STEPS);
         y = srcY + line * srcStrideY;
 
@@ -534,7 +910,13 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
 
         rgb = dst + line * dstStride;
 
-        for (ptrdiff_t i = 0; i < endx; i += 4)
+        ptrdiff_t i = 0;
+        if (avx2)
+        {
+            i = yuv2rgb_convert_line_avx2<inputFormat, shift, dithertype, ycgco>(
+                y, u, v, rgb, srcStrideY, srcStrideUV, dstStride, line, coeffs, lineDither, endx);
+        }
+        for (; i < endx; i += 4)
         {
             yuv2rgb_convert_pixels<inputFormat, shift, outFmt, 0, dithertype, ycgco>(
                 y, u, v, rgb, srcStrideY, srcStrideUV, dstStride, line, coeffs, lineDither, i);
@@ -548,7 +930,7 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
     {
         if (sliceYEnd == height)
         {
-            if (dithertype == LAVDither_Random)
+            if (dithertype == PixConvDither_Random)
                 lineDither = dithers + ((height - 2) * 24 * DITHER_STEPS);
             y = srcY + (height - 1) * srcStrideY;
             if (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_NV12 || inputFormat == LAVPixFmt_P016)
@@ -563,7 +945,13 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
             }
             rgb = dst + (height - 1) * dstStride;
 
-            for (ptrdiff_t i = 0; i < endx; i += 4)
+            ptrdiff_t i = 0;
+            if (avx2)
+            {
+                i = yuv2rgb_convert_line_avx2<inputFormat, shift, dithertype, ycgco>(y, u, v, rgb, 0, 0, 0, line,
+                                                                                     coeffs, lineDither, endx);
+            }
+            for (; i < endx; i += 4)
             {
                 yuv2rgb_convert_pixels<inputFormat, shift, outFmt, 0, dithertype, ycgco>(y, u, v, rgb, 0, 0, 0, line,
                                                                                          coeffs, lineDither, i);
@@ -572,39 +960,47 @@ static int __stdcall yuv2rgb_convert(const uint8_t *srcY, const uint8_t *srcU, c
                                                                                      coeffs, lineDither, 0);
         }
     }
+
+    if (avx2)
+        pixconv_avx2_zeroupper();
+
     return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv_rgb)
+static void InitRGBConvDispatcher(PixConvContext *ctx);
+static const RGBCoeffs *getRGBCoeffs(PixConvContext *ctx, int width, int height);
+
+DECLARE_CONV_FUNC(convert_yuv_rgb)
 {
-    const RGBCoeffs *coeffs = getRGBCoeffs(width, height);
+    const RGBCoeffs *coeffs = getRGBCoeffs(ctx, width, height);
     if (coeffs == nullptr)
-        return E_OUTOFMEMORY;
+        return AVERROR(ENOMEM);
 
-    if (!m_bRGBConvInit)
+    if (!ctx->rgbConvInit)
     {
-        m_bRGBConvInit = TRUE;
-        InitRGBConvDispatcher();
+        ctx->rgbConvInit = true;
+        InitRGBConvDispatcher(ctx);
     }
 
-    BOOL bYCgCo = (m_ColorProps.VideoTransferMatrix == 7);
-    int shift = max(bpp - 8, 0);
-    ASSERT(shift >= 0 && shift <= 8);
+    const int bYCgCo = (ctx->colorProps.matrix == 7);
+    int shift = FFMAX(bpp - 8, 0);
+    assert(shift >= 0 && shift <= 8);
 
     int outFmt = -1;
     switch (outputFormat)
     {
-    case LAVOutPixFmt_RGB24: outFmt = 0; break;
-    case LAVOutPixFmt_RGB32: outFmt = 1; break;
-    default: ASSERT(0);
+    case PixConvOut_RGB24: outFmt = 0; break;
+    case PixConvOut_RGB32: outFmt = 1; break;
+    default: assert(0);
     }
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers =
-        (ditherMode == LAVDither_Random) ? GetRandomDitherCoeffs(height, DITHER_STEPS * 3, 4, 0) : nullptr;
-    if (ditherMode == LAVDither_Random && dithers == nullptr)
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = (ditherMode == PixConvDither_Random)
+                                  ? pixconv_random_dither_coeffs(ctx, height, DITHER_STEPS * 3, 4, 0)
+                                  : nullptr;
+    if (ditherMode == PixConvDither_Random && dithers == nullptr)
     {
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
     }
 
     // Map the bX formats to their normal counter part, the shift parameter controls this now
@@ -615,15 +1011,23 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv_rgb)
     if (inputFormat == LAVPixFmt_P016)
         shift = 8;
 
-    YUVRGBConversionFunc convFn = m_RGBConvFuncs[outFmt][ditherMode][bYCgCo][inputFormat][shift];
+    YUVRGBConversionFunc convFn = ctx->rgbConvFuncs[outFmt][ditherMode][bYCgCo][inputFormat][shift];
     if (convFn == nullptr)
     {
-        ASSERT(0);
-        return E_FAIL;
+        assert(0);
+        return AVERROR(EINVAL);
+    }
+
+    // Use the AVX2 version for RGB32, if available and the output is aligned for 256-bit writes
+    if (outFmt == 1 && pixconv_avx2_dst_aligned(dst, dstStride, 1) &&
+        ctx->rgbConvFuncsAVX2[ditherMode][bYCgCo][inputFormat][shift])
+    {
+        convFn = ctx->rgbConvFuncsAVX2[ditherMode][bYCgCo][inputFormat][shift];
     }
 
     // run conversion, threaded
-    if (m_NumThreads <= 1)
+    const int threads = pixconv_num_bands(ctx, width, height);
+    if (threads <= 1)
     {
         convFn(src[0], src[1], src[2], dst[0], width, height, srcStride[0], srcStride[1], dstStride[0], 0, height,
                coeffs, dithers);
@@ -632,31 +1036,34 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv_rgb)
     {
         const int is_odd =
             (inputFormat == LAVPixFmt_YUV420 || inputFormat == LAVPixFmt_NV12 || inputFormat == LAVPixFmt_P016);
-        const ptrdiff_t lines_per_thread = (height / m_NumThreads) & ~1;
+        const ptrdiff_t lines_per_thread = (height / threads) & ~1;
 
-        Concurrency::parallel_for(0, m_NumThreads, [&](int i) {
+        ctx->threadPool.Run(threads, [&](int i) {
             const ptrdiff_t starty = (i * lines_per_thread);
-            const ptrdiff_t endy = (i == (m_NumThreads - 1)) ? height : starty + lines_per_thread + is_odd;
+            const ptrdiff_t endy = (i == (threads - 1)) ? height : starty + lines_per_thread + is_odd;
             convFn(src[0], src[1], src[2], dst[0], width, height, srcStride[0], srcStride[1], dstStride[0],
                    starty + (i ? is_odd : 0), endy, coeffs, dithers);
+            _mm_sfence();
         });
     }
 
-    return S_OK;
+    return 0;
 }
 
 #define CONV_FUNC_INT2(out32, dither, ycgco, format, shift) \
-    m_RGBConvFuncs[out32][dither][ycgco][format][shift] = yuv2rgb_convert<format, shift, out32, dither, ycgco>;
+    ctx->rgbConvFuncs[out32][dither][ycgco][format][shift] = yuv2rgb_convert<format, shift, out32, dither, ycgco, 0>;
 
 #define CONV_FUNC_INT(dither, ycgco, format, shift) \
     CONV_FUNC_INT2(0, dither, ycgco, format, shift) \
-    CONV_FUNC_INT2(1, dither, ycgco, format, shift)
+    CONV_FUNC_INT2(1, dither, ycgco, format, shift) \
+    if (bAVX2)                                      \
+        ctx->rgbConvFuncsAVX2[dither][ycgco][format][shift] = yuv2rgb_convert<format, shift, 1, dither, ycgco, 1>;
 
-#define CONV_FUNC(format, shift)                       \
-    CONV_FUNC_INT(LAVDither_Ordered, 0, format, shift) \
-    CONV_FUNC_INT(LAVDither_Random, 0, format, shift)  \
-    CONV_FUNC_INT(LAVDither_Ordered, 1, format, shift) \
-    CONV_FUNC_INT(LAVDither_Random, 1, format, shift)
+#define CONV_FUNC(format, shift)                           \
+    CONV_FUNC_INT(PixConvDither_Ordered, 0, format, shift) \
+    CONV_FUNC_INT(PixConvDither_Random, 0, format, shift)  \
+    CONV_FUNC_INT(PixConvDither_Ordered, 1, format, shift) \
+    CONV_FUNC_INT(PixConvDither_Random, 1, format, shift)
 
 #define CONV_FUNCX(format)     \
     CONV_FUNC(format, 0)       \
@@ -669,9 +1076,12 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv_rgb)
     /* CONV_FUNC(format, 7) */ \
     CONV_FUNC(format, 8)
 
-void CLAVPixFmtConverter::InitRGBConvDispatcher()
+static void InitRGBConvDispatcher(PixConvContext *ctx)
 {
-    ZeroMemory(&m_RGBConvFuncs, sizeof(m_RGBConvFuncs));
+    memset(&ctx->rgbConvFuncs, 0, sizeof(ctx->rgbConvFuncs));
+    memset(&ctx->rgbConvFuncsAVX2, 0, sizeof(ctx->rgbConvFuncsAVX2));
+
+    const bool bAVX2 = (ctx->cpuFlags & AV_CPU_FLAG_AVX2) != 0;
 
     CONV_FUNC(LAVPixFmt_NV12, 0);
     CONV_FUNC(LAVPixFmt_P016, 8);
@@ -681,29 +1091,29 @@ void CLAVPixFmtConverter::InitRGBConvDispatcher()
     CONV_FUNCX(LAVPixFmt_YUV444);
 }
 
-const RGBCoeffs *CLAVPixFmtConverter::getRGBCoeffs(int width, int height)
+static const RGBCoeffs *getRGBCoeffs(PixConvContext *ctx, int width, int height)
 {
-    if (!m_rgbCoeffs || width != swsWidth || height != swsHeight)
+    if (!ctx->rgbCoeffs || width != ctx->swsWidth || height != ctx->swsHeight)
     {
-        swsWidth = width;
-        swsHeight = height;
+        ctx->swsWidth = width;
+        ctx->swsHeight = height;
 
-        if (!m_rgbCoeffs)
+        if (!ctx->rgbCoeffs)
         {
-            m_rgbCoeffs = (RGBCoeffs *)_aligned_malloc(sizeof(RGBCoeffs), 16);
-            if (m_rgbCoeffs == nullptr)
+            ctx->rgbCoeffs = (RGBCoeffs *)av_malloc(sizeof(RGBCoeffs));
+            if (ctx->rgbCoeffs == nullptr)
                 return nullptr;
         }
 
-        DXVA2_VideoTransferMatrix matrix = (DXVA2_VideoTransferMatrix)m_ColorProps.VideoTransferMatrix;
-        if (matrix == DXVA2_VideoTransferMatrix_Unknown)
+        int matrix = ctx->colorProps.matrix;
+        if (matrix == PixConvMatrix_Unknown)
         {
-            matrix = (swsHeight > 576 || swsWidth > 1024) ? DXVA2_VideoTransferMatrix_BT709
-                                                          : DXVA2_VideoTransferMatrix_BT601;
+            matrix = (ctx->swsHeight > 576 || ctx->swsWidth > 1024) ? PixConvMatrix_BT709 : PixConvMatrix_BT601;
         }
 
-        BOOL inFullRange = (m_ColorProps.NominalRange == DXVA2_NominalRange_0_255);
-        BOOL outFullRange = (swsOutputRange == 0) ? inFullRange : (swsOutputRange == 2);
+        const bool inFullRange = ctx->colorProps.fullRange != 0;
+        const bool outFullRange = (ctx->colorProps.rgbOutputRange == 0) ? inFullRange
+                                                                         : (ctx->colorProps.rgbOutputRange == 2);
 
         int inputWhite, inputBlack, inputChroma, outputWhite, outputBlack;
         if (inFullRange)
@@ -733,12 +1143,12 @@ const RGBCoeffs *CLAVPixFmtConverter::getRGBCoeffs(int width, int height)
         double Kr, Kg, Kb;
         switch (matrix)
         {
-        case DXVA2_VideoTransferMatrix_BT601:
+        case PixConvMatrix_BT601:
             Kr = 0.299;
             Kg = 0.587;
             Kb = 0.114;
             break;
-        case DXVA2_VideoTransferMatrix_SMPTE240M:
+        case PixConvMatrix_SMPTE240M:
             Kr = 0.2120;
             Kg = 0.7010;
             Kb = 0.0870;
@@ -753,8 +1163,9 @@ const RGBCoeffs *CLAVPixFmtConverter::getRGBCoeffs(int width, int height)
             Kg = 0.6780;
             Kb = 0.0593;
             break;
-        default: DbgLog((LOG_TRACE, 10, L"::getRGBCoeffs(): Unknown color space: %d - defaulting to BT709", matrix));
-        case DXVA2_VideoTransferMatrix_BT709:
+        default:
+            av_log(nullptr, AV_LOG_DEBUG, "getRGBCoeffs(): Unknown color space: %d - defaulting to BT709\n", matrix);
+        case PixConvMatrix_BT709:
             Kr = 0.2126;
             Kg = 0.7152;
             Kb = 0.0722;
@@ -772,7 +1183,7 @@ const RGBCoeffs *CLAVPixFmtConverter::getRGBCoeffs(int width, int height)
         ug_mul = (cspOptionsRGBrange / chr_range) * (1.0 - Kb) * Kb / Kg;
         vg_mul = (cspOptionsRGBrange / chr_range) * (1.0 - Kr) * Kr / Kg;
         ub_mul = (cspOptionsRGBrange / chr_range) * (1.0 - Kb);
-        short sub = min(outputBlack, inputBlack);
+        short sub = FFMIN(outputBlack, inputBlack);
         short Ysub = inputBlack - sub;
         short RGB_add1 = outputBlack - sub;
 
@@ -782,24 +1193,24 @@ const RGBCoeffs *CLAVPixFmtConverter::getRGBCoeffs(int width, int height)
         short cgv = short(-vg_mul * 8192 - 0.5);
         short cbu = short(ub_mul * 8192 + 0.5);
 
-        m_rgbCoeffs->Ysub = _mm_set1_epi16(Ysub << 6);
-        m_rgbCoeffs->cy = _mm_set1_epi16(cy);
-        m_rgbCoeffs->CbCr_center = _mm_set1_epi16(128 << 4);
+        ctx->rgbCoeffs->Ysub = _mm_set1_epi16(Ysub << 6);
+        ctx->rgbCoeffs->cy = _mm_set1_epi16(cy);
+        ctx->rgbCoeffs->CbCr_center = _mm_set1_epi16(128 << 4);
 
-        m_rgbCoeffs->cR_Cr = _mm_set1_epi32(crv << 16);               // R
-        m_rgbCoeffs->cG_Cb_cG_Cr = _mm_set1_epi32((cgv << 16) + cgu); // G
-        m_rgbCoeffs->cB_Cb = _mm_set1_epi32(cbu);                     // B
+        ctx->rgbCoeffs->cR_Cr = _mm_set1_epi32(crv << 16);               // R
+        ctx->rgbCoeffs->cG_Cb_cG_Cr = _mm_set1_epi32((cgv << 16) + cgu); // G
+        ctx->rgbCoeffs->cB_Cb = _mm_set1_epi32(cbu);                     // B
 
-        m_rgbCoeffs->rgb_add = _mm_set1_epi16(RGB_add1 << 4);
+        ctx->rgbCoeffs->rgb_add = _mm_set1_epi16(RGB_add1 << 4);
 
         // YCgCo
         if (matrix == 7)
         {
-            m_rgbCoeffs->CbCr_center = _mm_set1_epi16(0x0800);
+            ctx->rgbCoeffs->CbCr_center = _mm_set1_epi16(0x0800);
             // Other Coeffs are not used in YCgCo
         }
     }
-    return m_rgbCoeffs;
+    return ctx->rgbCoeffs;
 }
 
 #pragma warning(pop)
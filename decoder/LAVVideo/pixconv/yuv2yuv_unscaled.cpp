@@ -17,14 +17,13 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
+#include "pixconv_avx2_templates.h"
 
-template <int nv12> DECLARE_CONV_FUNC_IMPL(convert_yuv_yv_nv12_dither_le)
+template <int nv12> DECLARE_CONV_FUNC(convert_yuv_yv_nv12_dither_le)
 {
     const ptrdiff_t inYStride = srcStride[0];
     const ptrdiff_t inUVStride = srcStride[1];
@@ -35,10 +34,10 @@ template <int nv12> DECLARE_CONV_FUNC_IMPL(convert_yuv_yv_nv12_dither_le)
     ptrdiff_t chromaWidth = width;
     ptrdiff_t chromaHeight = height;
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 4, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 4, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     if (inputFormat == LAVPixFmt_YUV420bX)
         chromaHeight = chromaHeight >> 1;
@@ -55,7 +54,7 @@ template <int nv12> DECLARE_CONV_FUNC_IMPL(convert_yuv_yv_nv12_dither_le)
     for (line = 0; line < height; ++line)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm4 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 0));
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 8));
@@ -123,21 +122,123 @@ template <int nv12> DECLARE_CONV_FUNC_IMPL(convert_yuv_yv_nv12_dither_le)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
 // Force creation of these two variants
-template HRESULT CLAVPixFmtConverter::convert_yuv_yv_nv12_dither_le<0> CONV_FUNC_PARAMS;
-template HRESULT CLAVPixFmtConverter::convert_yuv_yv_nv12_dither_le<1> CONV_FUNC_PARAMS;
+template int convert_yuv_yv_nv12_dither_le<0> CONV_FUNC_PARAMS;
+template int convert_yuv_yv_nv12_dither_le<1> CONV_FUNC_PARAMS;
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv420_px1x_le)
+template <int nv12> PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv_yv_nv12_dither_le_avx2)
+{
+    // The U/V planes of YV12 are only written with 128-bit stores
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, nv12 ? 2 : 1))
+        return convert_yuv_yv_nv12_dither_le<nv12>(ctx, src, srcStride, dst, dstStride, width, height, inputFormat,
+                                                   bpp, outputFormat);
+
+    const ptrdiff_t inYStride = srcStride[0];
+    const ptrdiff_t inUVStride = srcStride[1];
+
+    const ptrdiff_t outYStride = dstStride[0];
+    const ptrdiff_t outUVStride = dstStride[1];
+
+    ptrdiff_t chromaWidth = width;
+    ptrdiff_t chromaHeight = height;
+
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 4, 8, 0);
+    if (dithers == nullptr)
+        ditherMode = PixConvDither_Ordered;
+
+    if (inputFormat == LAVPixFmt_YUV420bX)
+        chromaHeight = chromaHeight >> 1;
+    if (inputFormat == LAVPixFmt_YUV420bX || inputFormat == LAVPixFmt_YUV422bX)
+        chromaWidth = (chromaWidth + 1) >> 1;
+
+    ptrdiff_t line, i;
+
+    const __m128i shift = _mm_cvtsi32_si128(16 - bpp);
+    __m256i ymm0, ymm1, ymm4, ymm5;
+
+    _mm_sfence();
+
+    // Process Y
+    for (line = 0; line < height; ++line)
+    {
+        // Load dithering coefficients for this line
+        if (ditherMode == PixConvDither_Random)
+        {
+            PIXCONV_AVX2_LOAD(ymm4, dithers + (line << 5) + 0);
+            PIXCONV_AVX2_LOAD(ymm5, dithers + (line << 5) + 16);
+        }
+        else
+        {
+            PIXCONV_AVX2_LOAD_DITHER_COEFFS(ymm5, line, 8, dithers);
+            ymm4 = ymm5;
+        }
+
+        const uint16_t *const y = (const uint16_t *)(src[0] + line * inYStride);
+        uint8_t *const dy = dst[0] + line * outYStride;
+
+        for (i = 0; i < width; i += 32)
+        {
+            // Load pixels into registers, and apply dithering
+            PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm0, ymm4, (y + i + 0), shift);  /* Y0Y0Y0Y0 */
+            PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm1, ymm5, (y + i + 16), shift); /* Y0Y0Y0Y0 */
+            ymm0 = PIXCONV_AVX2_PACKUS_EPI16(ymm0, ymm1);                      /* YYYYYYYY */
+
+            // Write data back
+            PIXCONV_AVX2_PUT_STREAM(dy + i, ymm0);
+        }
+
+        // Process U/V for chromaHeight lines
+        if (line < chromaHeight)
+        {
+            const uint16_t *const u = (const uint16_t *)(src[1] + line * inUVStride);
+            const uint16_t *const v = (const uint16_t *)(src[2] + line * inUVStride);
+
+            uint8_t *const duv = (uint8_t *)(dst[1] + line * outUVStride);
+            uint8_t *const du = (uint8_t *)(dst[2] + line * outUVStride);
+            uint8_t *const dv = (uint8_t *)(dst[1] + line * outUVStride);
+
+            for (i = 0; i < chromaWidth; i += 16)
+            {
+                PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm0, ymm4, (u + i), shift); /* U0U0U0U0 */
+                PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm1, ymm5, (v + i), shift); /* V0V0V0V0 */
+
+                if (nv12)
+                {
+                    // All values are 8-bit after dithering, so V can be shifted into the high bytes directly
+                    ymm0 = _mm256_or_si256(ymm0, _mm256_slli_epi16(ymm1, 8)); /* UVUVUVUV */
+                    PIXCONV_AVX2_PUT_STREAM(duv + (i << 1), ymm0);
+                }
+                else
+                {
+                    ymm0 = PIXCONV_AVX2_PACKUS_EPI16(ymm0, ymm1); /* UUUUVVVV */
+                    PIXCONV_PUT_STREAM(du + i, _mm256_castsi256_si128(ymm0));
+                    PIXCONV_PUT_STREAM(dv + i, _mm256_extracti128_si256(ymm0, 1));
+                }
+            }
+        }
+    }
+
+    _mm256_zeroupper();
+
+    return 0;
+}
+
+// Force creation of these two variants
+template int convert_yuv_yv_nv12_dither_le_avx2<0> CONV_FUNC_PARAMS;
+template int convert_yuv_yv_nv12_dither_le_avx2<1> CONV_FUNC_PARAMS;
+
+DECLARE_CONV_FUNC(convert_yuv420_px1x_le)
 {
     const ptrdiff_t inYStride = srcStride[0];
     const ptrdiff_t inUVStride = srcStride[1];
     const ptrdiff_t outYStride = dstStride[0];
     const ptrdiff_t outUVStride = dstStride[1];
     const ptrdiff_t uvHeight =
-        (outputFormat == LAVOutPixFmt_P010 || outputFormat == LAVOutPixFmt_P016) ? (height >> 1) : height;
+        (outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) ? (height >> 1) : height;
     const ptrdiff_t uvWidth = (width + 1) >> 1;
 
     ptrdiff_t line, i;
@@ -182,10 +283,85 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv420_px1x_le)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv_yv)
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv420_px1x_le_avx2)
+{
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, 2))
+        return convert_yuv420_px1x_le(ctx, src, srcStride, dst, dstStride, width, height, inputFormat, bpp,
+                                      outputFormat);
+
+    const ptrdiff_t inYStride = srcStride[0];
+    const ptrdiff_t inUVStride = srcStride[1];
+    const ptrdiff_t outYStride = dstStride[0];
+    const ptrdiff_t outUVStride = dstStride[1];
+    const ptrdiff_t uvHeight =
+        (outputFormat == PixConvOut_P010 || outputFormat == PixConvOut_P016) ? (height >> 1) : height;
+    const ptrdiff_t uvWidth = (width + 1) >> 1;
+
+    const __m128i shift = _mm_cvtsi32_si128(16 - bpp);
+
+    ptrdiff_t line, i;
+    __m256i ymm0, ymm1, ymm2;
+
+    _mm_sfence();
+
+    // Process Y
+    for (line = 0; line < height; ++line)
+    {
+        const uint16_t *const y = (const uint16_t *)(src[0] + line * inYStride);
+        uint16_t *const d = (uint16_t *)(dst[0] + line * outYStride);
+
+        for (i = 0; i < width; i += 16)
+        {
+            // Load 16 pixels, shift them to 16-bit, and write them out
+            PIXCONV_AVX2_LOAD(ymm0, y + i);
+            ymm0 = _mm256_sll_epi16(ymm0, shift);
+            PIXCONV_AVX2_PUT_STREAM(d + i, ymm0);
+        }
+    }
+
+    // Process UV
+    for (line = 0; line < uvHeight; ++line)
+    {
+        const uint16_t *const u = (const uint16_t *)(src[1] + line * inUVStride);
+        const uint16_t *const v = (const uint16_t *)(src[2] + line * inUVStride);
+        uint16_t *const d = (uint16_t *)(dst[1] + line * outUVStride);
+
+        for (i = 0; i < (uvWidth - 15); i += 16)
+        {
+            // Load 16 pixels each into registers
+            PIXCONV_AVX2_LOAD(ymm0, u + i);
+            PIXCONV_AVX2_LOAD(ymm1, v + i);
+            ymm0 = _mm256_sll_epi16(ymm0, shift);
+            ymm1 = _mm256_sll_epi16(ymm1, shift);
+
+            ymm2 = _mm256_unpacklo_epi16(ymm0, ymm1); /* UVUV (0-3, 8-11) */
+            ymm0 = _mm256_unpackhi_epi16(ymm0, ymm1); /* UVUV (4-7, 12-15) */
+
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 1) + 0, _mm256_permute2x128_si256(ymm2, ymm0, 0x20));
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 1) + 16, _mm256_permute2x128_si256(ymm2, ymm0, 0x31));
+        }
+        for (; i < uvWidth; i += 8)
+        {
+            // Load the remaining 8 pixels of U and V into the two lanes
+            PIXCONV_AVX2_LOAD_LANES(ymm0, u + i, v + i);
+            ymm0 = _mm256_sll_epi16(ymm0, shift);
+
+            ymm1 = _mm256_permute4x64_epi64(ymm0, 0xD8);                         /* UUVV (0-3, 4-7) */
+            ymm1 = _mm256_unpacklo_epi16(ymm1, _mm256_shuffle_epi32(ymm1, 0x4E)); /* UVUV */
+
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 1), ymm1);
+        }
+    }
+
+    _mm256_zeroupper();
+
+    return 0;
+}
+
+DECLARE_CONV_FUNC(convert_yuv_yv)
 {
     const uint8_t *y = src[0];
     const uint8_t *u = src[1];
@@ -244,10 +420,10 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv_yv)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv420_nv12)
+DECLARE_CONV_FUNC(convert_yuv420_nv12)
 {
     const ptrdiff_t inLumaStride = srcStride[0];
     const ptrdiff_t inChromaStride = srcStride[1];
@@ -310,10 +486,10 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv420_nv12)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv422_yuy2_uyvy)
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv422_yuy2_uyvy)
 {
     const ptrdiff_t inLumaStride = srcStride[0];
     const ptrdiff_t inChromaStride = srcStride[1];
@@ -376,24 +552,24 @@ template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv422_yuy2_uyvy)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
 // Force creation of these two variants
-template HRESULT CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy<0> CONV_FUNC_PARAMS;
-template HRESULT CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy<1> CONV_FUNC_PARAMS;
+template int convert_yuv422_yuy2_uyvy<0> CONV_FUNC_PARAMS;
+template int convert_yuv422_yuy2_uyvy<1> CONV_FUNC_PARAMS;
 
-template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv422_yuy2_uyvy_dither_le)
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv422_yuy2_uyvy_dither_le)
 {
     const ptrdiff_t inLumaStride = srcStride[0];
     const ptrdiff_t inChromaStride = srcStride[1];
     const ptrdiff_t outStride = dstStride[0];
     const ptrdiff_t chromaWidth = (width + 1) >> 1;
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 4, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 4, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     ptrdiff_t line, i;
     __m128i xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7;
@@ -408,7 +584,7 @@ template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv422_yuy2_uyvy_dither_le)
         uint16_t *const d = (uint16_t *)(dst[0] + line * outStride);
 
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm4 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 0));
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line << 5) + 8));
@@ -456,14 +632,14 @@ template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv422_yuy2_uyvy_dither_le)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
 // Force creation of these two variants
-template HRESULT CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy_dither_le<0> CONV_FUNC_PARAMS;
-template HRESULT CLAVPixFmtConverter::convert_yuv422_yuy2_uyvy_dither_le<1> CONV_FUNC_PARAMS;
+template int convert_yuv422_yuy2_uyvy_dither_le<0> CONV_FUNC_PARAMS;
+template int convert_yuv422_yuy2_uyvy_dither_le<1> CONV_FUNC_PARAMS;
 
-DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12)
+DECLARE_CONV_FUNC(convert_nv12_yv12)
 {
     const ptrdiff_t inLumaStride = srcStride[0];
     const ptrdiff_t inChromaStride = srcStride[1];
@@ -512,10 +688,10 @@ DECLARE_CONV_FUNC_IMPL(convert_nv12_yv12)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_sse2)
+DECLARE_CONV_FUNC(convert_p010_nv12_sse2)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
@@ -523,10 +699,10 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_sse2)
 
     const ptrdiff_t byteWidth = width << 1;
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 2, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 2, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     __m128i xmm0, xmm1, xmm2, xmm3;
 
@@ -537,7 +713,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_sse2)
     for (line = 0; line < height; line++)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm2 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 0));
             xmm3 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 8));
@@ -570,7 +746,7 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_sse2)
     for (line = 0; line < chromaHeight; line++)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm2 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 0));
             xmm3 = _mm_load_si128((const __m128i *)(dithers + (line << 4) + 8));
@@ -600,10 +776,82 @@ DECLARE_CONV_FUNC_IMPL(convert_p010_nv12_sse2)
         }
     }
 
-    return S_OK;
+    return 0;
+}
+
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_p010_nv12_avx2)
+{
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, 2))
+        return convert_p010_nv12_sse2(ctx, src, srcStride, dst, dstStride, width, height, inputFormat, bpp,
+                                      outputFormat);
+
+    const ptrdiff_t inStride = srcStride[0];
+    const ptrdiff_t outStride = dstStride[0];
+    const ptrdiff_t chromaHeight = (height >> 1);
+
+    const ptrdiff_t byteWidth = width << 1;
+
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 2, 8, 0);
+    if (dithers == nullptr)
+        ditherMode = PixConvDither_Ordered;
+
+    __m256i ymm0, ymm1, ymm2;
+
+    _mm_sfence();
+
+    ptrdiff_t line, i, plane;
+
+    for (plane = 0; plane < 2; plane++)
+    {
+        const ptrdiff_t planeHeight = plane ? chromaHeight : height;
+        for (line = 0; line < planeHeight; line++)
+        {
+            // Load dithering coefficients for this line
+            if (ditherMode == PixConvDither_Random)
+            {
+                PIXCONV_AVX2_LOAD(ymm2, dithers + (line << 4));
+            }
+            else
+            {
+                PIXCONV_AVX2_LOAD_DITHER_COEFFS(ymm2, line, 8, dithers);
+            }
+
+            const uint8_t *s = (src[plane] + line * inStride);
+            uint8_t *d = (dst[plane] + line * outStride);
+
+            for (i = 0; i < (byteWidth - 63); i += 64)
+            {
+                PIXCONV_AVX2_LOAD(ymm0, s + i + 0);
+                PIXCONV_AVX2_LOAD(ymm1, s + i + 32);
+
+                // apply dithering coeffs
+                ymm0 = _mm256_adds_epu16(ymm0, ymm2);
+                ymm1 = _mm256_adds_epu16(ymm1, ymm2);
+
+                // shift and pack to 8-bit
+                ymm0 = PIXCONV_AVX2_PACKUS_EPI16(_mm256_srli_epi16(ymm0, 8), _mm256_srli_epi16(ymm1, 8));
+
+                PIXCONV_AVX2_PUT_STREAM(d + (i >> 1), ymm0);
+            }
+            for (; i < byteWidth; i += 32)
+            {
+                PIXCONV_AVX2_LOAD(ymm0, s + i);
+                ymm0 = _mm256_adds_epu16(ymm0, ymm2);
+                ymm0 = _mm256_srli_epi16(ymm0, 8);
+                ymm0 = PIXCONV_AVX2_PACKUS_EPI16(ymm0, ymm0);
+
+                PIXCONV_PUT_STREAM(d + (i >> 1), _mm256_castsi256_si128(ymm0));
+            }
+        }
+    }
+
+    _mm256_zeroupper();
+
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_y210_p210_sse4)
+PIXCONV_TARGET_SSE4 DECLARE_CONV_FUNC(convert_y210_p210_sse4)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
@@ -665,10 +913,10 @@ DECLARE_CONV_FUNC_IMPL(convert_y210_p210_sse4)
         }
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuy2_yv16_sse2)
+DECLARE_CONV_FUNC(convert_yuy2_yv16_sse2)
 {
     const ptrdiff_t inStride = srcStride[0];
     const ptrdiff_t outStride = dstStride[0];
@@ -740,5 +988,5 @@ DECLARE_CONV_FUNC_IMPL(convert_yuy2_yv16_sse2)
         }
     }
 
-    return S_OK;
+    return 0;
 }
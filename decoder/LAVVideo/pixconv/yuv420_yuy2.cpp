@@ -17,13 +17,11 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
-#include <ppl.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
+#include "pixconv_avx2_templates.h"
 
 #define DITHER_STEPS 2
 
@@ -124,7 +122,7 @@ __forceinline static int yuv420yuy2_convert_pixels(const uint8_t *&srcY, const u
     // Dither everything to 8-bit
 
     // Dithering
-    if (dithertype == LAVDither_Random)
+    if (dithertype == PixConvDither_Random)
     {
         /* Load random dithering coeffs from the dithers buffer */
         int offset = (pos % (DITHER_STEPS * 8 * 2)) * 2;
@@ -182,10 +180,171 @@ __forceinline static int yuv420yuy2_convert_pixels(const uint8_t *&srcY, const u
     return 0;
 }
 
+// This function converts 16x2 pixels from the source into 16x2 YUY2 pixels in the destination
+// Each 128-bit lane performs the same operations as the SSE2 version on 8x2 pixels
+template <LAVPixelFormat inputFormat, int shift, int uyvy, int dithertype>
+PIXCONV_TARGET_AVX2 __forceinline static int yuv420yuy2_convert_pixels_avx2(
+    const uint8_t *&srcY, const uint8_t *&srcU, const uint8_t *&srcV, uint8_t *&dst, ptrdiff_t srcStrideY,
+    ptrdiff_t srcStrideUV, ptrdiff_t dstStride, ptrdiff_t line, const uint16_t *&dithers, ptrdiff_t pos)
+{
+    __m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+    ymm7 = _mm256_setzero_si256();
+
+    // Number of bytes the source pointers advance for every 8x2 pixels
+    const ptrdiff_t uvStep = (shift > 0 || inputFormat == LAVPixFmt_NV12) ? 8 : 4;
+    const ptrdiff_t yStep = (shift > 0) ? 16 : 8;
+
+    // Shift > 0 is for 9/10 bit formats
+    if (shift > 0)
+    {
+        // Load 4 U/V values from line 0/1 into registers
+        PIXCONV_AVX2_LOAD_LANES_64(ymm1, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm3, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcV, srcV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm2, srcV + srcStrideUV, srcV + srcStrideUV + uvStep);
+
+        // Interleave U and V
+        ymm0 = _mm256_unpacklo_epi16(ymm1, ymm0); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi16(ymm3, ymm2); /* 0V0U0V0U */
+    }
+    else if (inputFormat == LAVPixFmt_NV12)
+    {
+        // Load 4 16-bit macro pixels, which contain 4 UV samples
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm2, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+
+        // Expand to 16-bit
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi8(ymm2, ymm7); /* 0V0U0V0U */
+    }
+    else
+    {
+        PIXCONV_AVX2_LOAD_LANES_32(ymm1, srcU, srcU + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm3, srcU + srcStrideUV, srcU + srcStrideUV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm0, srcV, srcV + uvStep);
+        PIXCONV_AVX2_LOAD_LANES_32(ymm2, srcV + srcStrideUV, srcV + srcStrideUV + uvStep);
+
+        // Interleave U and V
+        ymm0 = _mm256_unpacklo_epi8(ymm1, ymm0); /* VUVU0000 */
+        ymm2 = _mm256_unpacklo_epi8(ymm3, ymm2); /* VUVU0000 */
+
+        // Expand to 16-bit
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* 0V0U0V0U */
+        ymm2 = _mm256_unpacklo_epi8(ymm2, ymm7); /* 0V0U0V0U */
+    }
+
+    srcU += uvStep << 1;
+    srcV += uvStep << 1;
+
+    // Chroma upsampling
+    ymm1 = ymm0;
+    ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 2x line 0 */
+    ymm1 = _mm256_add_epi16(ymm1, ymm0); /* 3x line 0 */
+    ymm1 = _mm256_add_epi16(ymm1, ymm2); /* 3x line 0 + line 1 (10bit) */
+
+    ymm3 = ymm2;
+    ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 2x line 1 */
+    ymm3 = _mm256_add_epi16(ymm3, ymm2); /* 3x line 1 */
+    ymm3 = _mm256_add_epi16(ymm3, ymm0); /* 3x line 1 + line 0 (10bit) */
+
+    // Load Y
+    if (shift > 0)
+    {
+        // Load 8 Y values from line 0/1 into registers
+        PIXCONV_AVX2_LOAD_LANES(ymm0, srcY, srcY + yStep);
+        PIXCONV_AVX2_LOAD_LANES(ymm5, srcY + srcStrideY, srcY + srcStrideY + yStep);
+    }
+    else
+    {
+        PIXCONV_AVX2_LOAD_LANES_64(ymm0, srcY, srcY + yStep);
+        PIXCONV_AVX2_LOAD_LANES_64(ymm5, srcY + srcStrideY, srcY + srcStrideY + yStep);
+
+        ymm0 = _mm256_unpacklo_epi8(ymm0, ymm7); /* YYYYYYYY (16-bit fields)*/
+        ymm5 = _mm256_unpacklo_epi8(ymm5, ymm7); /* YYYYYYYY (16-bit fields) */
+    }
+    srcY += yStep << 1;
+
+    // Dithering
+    if (dithertype == PixConvDither_Random)
+    {
+        /* Load random dithering coeffs from the dithers buffer */
+        int offset1 = (pos % (DITHER_STEPS * 8 * 2)) * 2;
+        int offset2 = ((pos + 8) % (DITHER_STEPS * 8 * 2)) * 2;
+        PIXCONV_AVX2_LOAD_LANES(ymm6, dithers + 0 + offset1, dithers + 0 + offset2);
+        PIXCONV_AVX2_LOAD_LANES(ymm7, dithers + 8 + offset1, dithers + 8 + offset2);
+    }
+    else
+    {
+        PIXCONV_AVX2_LOAD_DITHER_COEFFS(ymm6, line + 0, shift + 2, odithers);
+        PIXCONV_AVX2_LOAD_DITHER_COEFFS(ymm7, line + 1, shift + 2, odithers2);
+    }
+
+    // Dither UV
+    ymm1 = _mm256_adds_epu16(ymm1, ymm6);
+    ymm3 = _mm256_adds_epu16(ymm3, ymm7);
+    ymm1 = _mm256_srai_epi16(ymm1, shift + 2);
+    ymm3 = _mm256_srai_epi16(ymm3, shift + 2);
+
+    if (shift)
+    {                                      /* Y only needs to be dithered if it was > 8 bit */
+        ymm6 = _mm256_srli_epi16(ymm6, 2); /* Shift dithering coeffs to proper strength */
+        ymm7 = _mm256_srli_epi16(ymm6, 2);
+
+        ymm0 = _mm256_adds_epu16(ymm0, ymm6);  /* Apply dithering coeffs */
+        ymm0 = _mm256_srai_epi16(ymm0, shift); /* Shift to 8 bit */
+
+        ymm5 = _mm256_adds_epu16(ymm5, ymm7);  /* Apply dithering coeffs */
+        ymm5 = _mm256_srai_epi16(ymm5, shift); /* Shift to 8 bit */
+    }
+
+    // Pack into 8-bit containers
+    ymm0 = _mm256_packus_epi16(ymm0, ymm5);
+    ymm1 = _mm256_packus_epi16(ymm1, ymm3);
+
+    // Interleave U/V with Y
+    if (uyvy)
+    {
+        ymm3 = _mm256_unpacklo_epi8(ymm1, ymm0);
+        ymm4 = _mm256_unpackhi_epi8(ymm1, ymm0);
+    }
+    else
+    {
+        ymm3 = _mm256_unpacklo_epi8(ymm0, ymm1);
+        ymm4 = _mm256_unpackhi_epi8(ymm0, ymm1);
+    }
+
+    // Write back into the target memory, the lanes hold consecutive pixels of the same line
+    PIXCONV_AVX2_PUT_STREAM(dst, ymm3);
+    PIXCONV_AVX2_PUT_STREAM(dst + dstStride, ymm4);
+
+    dst += 32;
+
+    return 0;
+}
+
+// Convert two lines in blocks of 16x2 pixels, up to the last 8 pixels which are left to the SSE2 version
+// Returns the position the SSE2 version continues at
 template <LAVPixelFormat inputFormat, int shift, int uyvy, int dithertype>
-static int __stdcall yuv420yuy2_process_lines(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
-                                              uint8_t *dst, int width, int height, ptrdiff_t srcStrideY,
-                                              ptrdiff_t srcStrideUV, ptrdiff_t dstStride, const uint16_t *dithers)
+PIXCONV_TARGET_AVX2 static ptrdiff_t yuv420yuy2_convert_line_avx2(const uint8_t *&srcY, const uint8_t *&srcU,
+                                                                  const uint8_t *&srcV, uint8_t *&dst,
+                                                                  ptrdiff_t srcStrideY, ptrdiff_t srcStrideUV,
+                                                                  ptrdiff_t dstStride, ptrdiff_t line,
+                                                                  const uint16_t *&dithers, int width)
+{
+    ptrdiff_t i = 0;
+    for (; i < (width - 8); i += 16)
+    {
+        yuv420yuy2_convert_pixels_avx2<inputFormat, shift, uyvy, dithertype>(
+            srcY, srcU, srcV, dst, srcStrideY, srcStrideUV, dstStride, line, dithers, i);
+    }
+    return i;
+}
+
+template <LAVPixelFormat inputFormat, int shift, int uyvy, int dithertype, int avx2>
+static int yuv420yuy2_process_lines(const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
+                                    uint8_t *dst, int width, int height, ptrdiff_t srcStrideY,
+                                    ptrdiff_t srcStrideUV, ptrdiff_t dstStride, ptrdiff_t sliceYStart,
+                                    ptrdiff_t sliceYEnd, const uint16_t *dithers)
 {
     const uint8_t *y = srcY;
     const uint8_t *u = srcU;
@@ -193,23 +352,34 @@ static int __stdcall yuv420yuy2_process_lines(const uint8_t *srcY, const uint8_t
     uint8_t *yuy2 = dst;
 
     // Processing starts at line 1, and ends at height - 1. The first and last line have special handling
-    ptrdiff_t line = 1;
-    const ptrdiff_t lastLine = height - 1;
+    // Slices always start on an even line, the line pair ending on the first line of a slice belongs to the previous
+    ptrdiff_t line = sliceYStart + 1;
+    const ptrdiff_t lastLine = FFMIN(sliceYEnd, (ptrdiff_t)height - 1);
 
     const uint16_t *lineDither = dithers;
+    ptrdiff_t i = 0;
 
     _mm_sfence();
 
     // Process first line
     // This needs special handling because of the chroma offset of YUV420
-    for (ptrdiff_t i = 0; i < width; i += 8)
+    if (sliceYStart == 0)
     {
-        yuv420yuy2_convert_pixels<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, 0, 0, 0, 0, lineDither, i);
+        if (avx2)
+        {
+            i = yuv420yuy2_convert_line_avx2<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, 0, 0, 0, 0,
+                                                                                   lineDither, width);
+        }
+        for (; i < width; i += 8)
+        {
+            yuv420yuy2_convert_pixels<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, 0, 0, 0, 0, lineDither,
+                                                                            i);
+        }
     }
 
     for (; line < lastLine; line += 2)
     {
-        if (dithertype == LAVDither_Random)
+        if (dithertype == PixConvDither_Random)
             lineDither = dithers + (line * 16 * DITHER_STEPS);
 
         y = srcY + line * srcStrideY;
@@ -219,16 +389,29 @@ static int __stdcall yuv420yuy2_process_lines(const uint8_t *srcY, const uint8_t
 
         yuy2 = dst + line * dstStride;
 
-        for (int i = 0; i < width; i += 8)
+        i = 0;
+        if (avx2)
+        {
+            i = yuv420yuy2_convert_line_avx2<inputFormat, shift, uyvy, dithertype>(
+                y, u, v, yuy2, srcStrideY, srcStrideUV, dstStride, line, lineDither, width);
+        }
+        for (; i < width; i += 8)
         {
             yuv420yuy2_convert_pixels<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, srcStrideY, srcStrideUV,
                                                                             dstStride, line, lineDither, i);
         }
     }
 
+    if (sliceYEnd < height)
+    {
+        if (avx2)
+            pixconv_avx2_zeroupper();
+        return 0;
+    }
+
     // Process last line
     // This needs special handling because of the chroma offset of YUV420
-    if (dithertype == LAVDither_Random)
+    if (dithertype == PixConvDither_Random)
         lineDither = dithers + ((height - 2) * 16 * DITHER_STEPS);
 
     y = srcY + (height - 1) * srcStrideY;
@@ -236,73 +419,134 @@ static int __stdcall yuv420yuy2_process_lines(const uint8_t *srcY, const uint8_t
     v = srcV + ((height >> 1) - 1) * srcStrideUV;
     yuy2 = dst + (height - 1) * dstStride;
 
-    for (ptrdiff_t i = 0; i < width; i += 8)
+    i = 0;
+    if (avx2)
+    {
+        i = yuv420yuy2_convert_line_avx2<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, 0, 0, 0, line,
+                                                                               lineDither, width);
+        pixconv_avx2_zeroupper();
+    }
+    for (; i < width; i += 8)
     {
         yuv420yuy2_convert_pixels<inputFormat, shift, uyvy, dithertype>(y, u, v, yuy2, 0, 0, 0, line, lineDither, i);
     }
     return 0;
 }
 
-template <int uyvy, int dithertype>
-static int __stdcall yuv420yuy2_dispatch(LAVPixelFormat inputFormat, int bpp, const uint8_t *srcY, const uint8_t *srcU,
-                                         const uint8_t *srcV, uint8_t *dst, int width, int height, ptrdiff_t srcStrideY,
-                                         ptrdiff_t srcStrideUV, ptrdiff_t dstStride, const uint16_t *dithers)
+template <int uyvy, int dithertype, int avx2>
+static int yuv420yuy2_dispatch(LAVPixelFormat inputFormat, int bpp, const uint8_t *srcY, const uint8_t *srcU,
+                               const uint8_t *srcV, uint8_t *dst, int width, int height, ptrdiff_t srcStrideY,
+                               ptrdiff_t srcStrideUV, ptrdiff_t dstStride, ptrdiff_t sliceYStart,
+                               ptrdiff_t sliceYEnd, const uint16_t *dithers)
 {
     // Wrap the input format into template args
     switch (inputFormat)
     {
     case LAVPixFmt_YUV420:
-        return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 0, uyvy, dithertype>(
-            srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+        return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 0, uyvy, dithertype, avx2>(
+            srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd, dithers);
     case LAVPixFmt_NV12:
-        return yuv420yuy2_process_lines<LAVPixFmt_NV12, 0, uyvy, dithertype>(
-            srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+        return yuv420yuy2_process_lines<LAVPixFmt_NV12, 0, uyvy, dithertype, avx2>(
+            srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd, dithers);
     case LAVPixFmt_YUV420bX:
         if (bpp == 9)
-            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 1, uyvy, dithertype>(
-                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 1, uyvy, dithertype, avx2>(
+                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd,
+                dithers);
         else if (bpp == 10)
-            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 2, uyvy, dithertype>(
-                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 2, uyvy, dithertype, avx2>(
+                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd,
+                dithers);
         /*else if (bpp == 11)
-          return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 3, uyvy, dithertype>(srcY, srcU, srcV, dst, width, height,
-          srcStrideY, srcStrideUV, dstStride, dithers);*/
+          return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 3, uyvy, dithertype, avx2>(srcY, srcU, srcV, dst, width,
+          height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd, dithers);*/
         else if (bpp == 12)
-            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 4, uyvy, dithertype>(
-                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 4, uyvy, dithertype, avx2>(
+                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd,
+                dithers);
         /*else if (bpp == 13)
-          return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 5, uyvy, dithertype>(srcY, srcU, srcV, dst, width, height,
-          srcStrideY, srcStrideUV, dstStride, dithers);*/
+          return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 5, uyvy, dithertype, avx2>(srcY, srcU, srcV, dst, width,
+          height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd, dithers);*/
         else if (bpp == 14)
-            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 6, uyvy, dithertype>(
-                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, dithers);
+            return yuv420yuy2_process_lines<LAVPixFmt_YUV420, 6, uyvy, dithertype, avx2>(
+                srcY, srcU, srcV, dst, width, height, srcStrideY, srcStrideUV, dstStride, sliceYStart, sliceYEnd,
+                dithers);
         else
-            ASSERT(0);
+            assert(0);
         break;
-    default: ASSERT(0);
+    default: assert(0);
     }
     return 0;
 }
 
-template <int uyvy> DECLARE_CONV_FUNC_IMPL(convert_yuv420_yuy2)
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv420_yuy2)
 {
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers =
-        (ditherMode == LAVDither_Random) ? GetRandomDitherCoeffs(height, DITHER_STEPS * 2, bpp - 8 + 2, 0) : nullptr;
-    if (ditherMode == LAVDither_Random && dithers != nullptr)
-    {
-        yuv420yuy2_dispatch<uyvy, 1>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height, srcStride[0],
-                                     srcStride[1], dstStride[0], dithers);
-    }
-    else
-    {
-        yuv420yuy2_dispatch<uyvy, 0>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height, srcStride[0],
-                                     srcStride[1], dstStride[0], nullptr);
-    }
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = (ditherMode == PixConvDither_Random)
+                                  ? pixconv_random_dither_coeffs(ctx, height, DITHER_STEPS * 2, bpp - 8 + 2, 0)
+                                  : nullptr;
+
+    // run conversion, threaded
+    const int threads = pixconv_num_bands(ctx, width, height);
+    const ptrdiff_t lines_per_thread = (height / threads) & ~1;
+
+    ctx->threadPool.Run(threads, [&](int i) {
+        const ptrdiff_t starty = (i * lines_per_thread);
+        const ptrdiff_t endy = (i == (threads - 1)) ? height : starty + lines_per_thread;
+        if (ditherMode == PixConvDither_Random && dithers != nullptr)
+        {
+            yuv420yuy2_dispatch<uyvy, 1, 0>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height,
+                                            srcStride[0], srcStride[1], dstStride[0], starty, endy, dithers);
+        }
+        else
+        {
+            yuv420yuy2_dispatch<uyvy, 0, 0>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height,
+                                            srcStride[0], srcStride[1], dstStride[0], starty, endy, nullptr);
+        }
+        _mm_sfence();
+    });
 
-    return S_OK;
+    return 0;
+}
+
+// Force creation of these two variants
+template int convert_yuv420_yuy2<0> CONV_FUNC_PARAMS;
+template int convert_yuv420_yuy2<1> CONV_FUNC_PARAMS;
+
+template <int uyvy> DECLARE_CONV_FUNC(convert_yuv420_yuy2_avx2)
+{
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, 1))
+        return convert_yuv420_yuy2<uyvy>(ctx, src, srcStride, dst, dstStride, width, height, inputFormat, bpp,
+                                         outputFormat);
+
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = (ditherMode == PixConvDither_Random)
+                                  ? pixconv_random_dither_coeffs(ctx, height, DITHER_STEPS * 2, bpp - 8 + 2, 0)
+                                  : nullptr;
+
+    // run conversion, threaded
+    const int threads = pixconv_num_bands(ctx, width, height);
+    const ptrdiff_t lines_per_thread = (height / threads) & ~1;
+
+    ctx->threadPool.Run(threads, [&](int i) {
+        const ptrdiff_t starty = (i * lines_per_thread);
+        const ptrdiff_t endy = (i == (threads - 1)) ? height : starty + lines_per_thread;
+        if (ditherMode == PixConvDither_Random && dithers != nullptr)
+        {
+            yuv420yuy2_dispatch<uyvy, 1, 1>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height,
+                                            srcStride[0], srcStride[1], dstStride[0], starty, endy, dithers);
+        }
+        else
+        {
+            yuv420yuy2_dispatch<uyvy, 0, 1>(inputFormat, bpp, src[0], src[1], src[2], dst[0], width, height,
+                                            srcStride[0], srcStride[1], dstStride[0], starty, endy, nullptr);
+        }
+        _mm_sfence();
+    });
+
+    return 0;
 }
 
 // Force creation of these two variants
-template HRESULT CLAVPixFmtConverter::convert_yuv420_yuy2<0> CONV_FUNC_PARAMS;
-template HRESULT CLAVPixFmtConverter::convert_yuv420_yuy2<1> CONV_FUNC_PARAMS;
+template int convert_yuv420_yuy2_avx2<0> CONV_FUNC_PARAMS;
+template int convert_yuv420_yuy2_avx2<1> CONV_FUNC_PARAMS;
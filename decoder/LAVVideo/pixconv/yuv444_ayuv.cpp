@@ -17,12 +17,11 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-
 #include <emmintrin.h>
 
 #include "pixconv_internal.h"
 #include "pixconv_sse2_templates.h"
+#include "pixconv_avx2_templates.h"
 
 #define PIXCONV_INTERLEAVE_AYUV(regY, regU, regV, regA, regOut1, regOut2) \
     regY = _mm_unpacklo_epi8(regY, regA);     /* YAYAYAYA */              \
@@ -32,7 +31,7 @@
 
 #define YUV444_PACK_AYUV(dst) *idst++ = v[i] | (u[i] << 8) | (y[i] << 16) | (0xff << 24);
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv)
+DECLARE_CONV_FUNC(convert_yuv444_ayuv)
 {
     const uint8_t *y = (const uint8_t *)src[0];
     const uint8_t *u = (const uint8_t *)src[1];
@@ -87,10 +86,10 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv)
         v += inStride;
     }
 
-    return S_OK;
+    return 0;
 }
 
-DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv_dither_le)
+DECLARE_CONV_FUNC(convert_yuv444_ayuv_dither_le)
 {
     const uint16_t *y = (const uint16_t *)src[0];
     const uint16_t *u = (const uint16_t *)src[1];
@@ -99,10 +98,10 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv_dither_le)
     const ptrdiff_t inStride = srcStride[0] >> 1;
     const ptrdiff_t outStride = dstStride[0];
 
-    LAVDitherMode ditherMode = m_pSettings->GetDitherMode();
-    const uint16_t *dithers = GetRandomDitherCoeffs(height, 3, 8, 0);
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 3, 8, 0);
     if (dithers == nullptr)
-        ditherMode = LAVDither_Ordered;
+        ditherMode = PixConvDither_Ordered;
 
     ptrdiff_t line, i;
 
@@ -115,7 +114,7 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv_dither_le)
     for (line = 0; line < height; ++line)
     {
         // Load dithering coefficients for this line
-        if (ditherMode == LAVDither_Random)
+        if (ditherMode == PixConvDither_Random)
         {
             xmm4 = _mm_load_si128((const __m128i *)(dithers + (line * 24) + 0));
             xmm5 = _mm_load_si128((const __m128i *)(dithers + (line * 24) + 8));
@@ -155,5 +154,101 @@ DECLARE_CONV_FUNC_IMPL(convert_yuv444_ayuv_dither_le)
         v += inStride;
     }
 
-    return S_OK;
+    return 0;
+}
+
+// Interleave 16 dithered Y/U/V pixels into AYUV
+// The result is split over two registers, which hold the pixels 0-3/8-11 and 4-7/12-15 respectively
+PIXCONV_TARGET_AVX2 __forceinline static void yuv444_ayuv_interleave_avx2(const __m256i &y, const __m256i &u,
+                                                                          const __m256i &v, const __m256i &alpha,
+                                                                          __m256i &out1, __m256i &out2)
+{
+    const __m256i ya = _mm256_or_si256(y, alpha);                      /* YAYAYAYA */
+    const __m256i vu = _mm256_or_si256(v, _mm256_and_si256(u, alpha)); /* VUVUVUVU */
+
+    out1 = _mm256_unpacklo_epi16(vu, ya); /* VUYAVUYA */
+    out2 = _mm256_unpackhi_epi16(vu, ya); /* VUYAVUYA */
+}
+
+PIXCONV_TARGET_AVX2 DECLARE_CONV_FUNC(convert_yuv444_ayuv_dither_le_avx2)
+{
+    if (!pixconv_avx2_dst_aligned(dst, dstStride, 1))
+        return convert_yuv444_ayuv_dither_le(ctx, src, srcStride, dst, dstStride, width, height, inputFormat, bpp,
+                                             outputFormat);
+
+    const uint16_t *y = (const uint16_t *)src[0];
+    const uint16_t *u = (const uint16_t *)src[1];
+    const uint16_t *v = (const uint16_t *)src[2];
+
+    const ptrdiff_t inStride = srcStride[0] >> 1;
+    const ptrdiff_t outStride = dstStride[0];
+
+    PixConvDitherMode ditherMode = ctx->ditherMode;
+    const uint16_t *dithers = pixconv_random_dither_coeffs(ctx, height, 3, 8, 0);
+    if (dithers == nullptr)
+        ditherMode = PixConvDither_Ordered;
+
+    ptrdiff_t line, i;
+
+    const __m128i shift = _mm_cvtsi32_si128(16 - bpp);
+    __m256i ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7;
+
+    ymm7 = _mm256_set1_epi16(-256); /* 0xFF00 - 0A0A0A0A */
+
+    _mm_sfence();
+
+    for (line = 0; line < height; ++line)
+    {
+        // Load dithering coefficients for this line
+        if (ditherMode == PixConvDither_Random)
+        {
+            ymm4 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(dithers + (line * 24) + 0)));
+            ymm5 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(dithers + (line * 24) + 8)));
+            ymm6 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(dithers + (line * 24) + 16)));
+        }
+        else
+        {
+            PIXCONV_AVX2_LOAD_DITHER_COEFFS(ymm6, line, 8, dithers);
+            ymm4 = ymm5 = ymm6;
+        }
+
+        uint8_t *const d = dst[0] + line * outStride;
+
+        for (i = 0; i < (width - 15); i += 16)
+        {
+            // Load pixels into registers, and apply dithering
+            PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm0, ymm4, (y + i), shift); /* Y0Y0Y0Y0 */
+            PIXCONV_AVX2_LOAD(ymm1, (u + i));                             /* U0U0U0U0 */
+            ymm1 = _mm256_adds_epu16(_mm256_sll_epi16(ymm1, shift), ymm5);
+            PIXCONV_AVX2_LOAD_PIXEL16_DITHER(ymm2, ymm6, (v + i), shift); /* V0V0V0V0 */
+
+            yuv444_ayuv_interleave_avx2(ymm0, ymm1, ymm2, ymm7, ymm2, ymm3);
+
+            // Write data back
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2) + 0, _mm256_permute2x128_si256(ymm2, ymm3, 0x20));
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2) + 32, _mm256_permute2x128_si256(ymm2, ymm3, 0x31));
+        }
+        for (; i < width; i += 8)
+        {
+            // Only the low lane carries valid pixels here
+            ymm0 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(y + i)));
+            ymm1 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(u + i)));
+            ymm2 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(v + i)));
+            ymm0 = _mm256_srli_epi16(_mm256_adds_epu16(_mm256_sll_epi16(ymm0, shift), ymm4), 8);
+            ymm1 = _mm256_adds_epu16(_mm256_sll_epi16(ymm1, shift), ymm5);
+            ymm2 = _mm256_srli_epi16(_mm256_adds_epu16(_mm256_sll_epi16(ymm2, shift), ymm6), 8);
+
+            yuv444_ayuv_interleave_avx2(ymm0, ymm1, ymm2, ymm7, ymm2, ymm3);
+
+            PIXCONV_AVX2_PUT_STREAM(d + (i << 2), _mm256_permute2x128_si256(ymm2, ymm3, 0x20));
+        }
+
+        y += inStride;
+        u += inStride;
+        v += inStride;
+    }
+
+    _mm256_zeroupper();
+
+    return 0;
 }
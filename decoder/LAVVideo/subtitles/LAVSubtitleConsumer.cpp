@@ -33,7 +33,12 @@ static const SubRenderOption options[] = {
 };
 // clang-format on
 
-#define FAST_DIV255(x) ((((x) + 128) * 257) >> 16)
+// Number of converted subtitle bitmaps to keep around
+#define SUBTITLE_BITMAP_CACHE_SIZE 8
+// Memory the converted subtitle bitmaps can use, roughly 6 full-screen 1080p YUVA 4:2:0 bitmaps
+#define SUBTITLE_BITMAP_CACHE_BYTES (32 * 1024 * 1024)
+// Line alignment of the band copied from read-only frames, matches the band alignment of the pixel converter
+#define SUBTITLE_BAND_ALIGN 16
 
 CLAVSubtitleConsumer::CLAVSubtitleConsumer(CLAVVideo *pLAVVideo)
     : CSubRenderOptionsImpl(::options, &context)
@@ -53,6 +58,8 @@ CLAVSubtitleConsumer::~CLAVSubtitleConsumer(void)
         m_pProvider->Disconnect();
     }
     Disconnect();
+    FlushBitmapCache();
+    av_freep(&m_pBandBuffer);
 }
 
 STDMETHODIMP CLAVSubtitleConsumer::NonDelegatingQueryInterface(REFIID riid, void **ppv)
@@ -68,17 +75,23 @@ STDMETHODIMP CLAVSubtitleConsumer::Connect(ISubRenderProvider *subtitleRenderer)
 {
     SafeRelease(&m_pProvider);
     m_pProvider = subtitleRenderer;
+    // Bitmap ids are only unique per provider
+    FlushBitmapCache();
     return S_OK;
 }
 
 STDMETHODIMP CLAVSubtitleConsumer::Disconnect(void)
 {
     SafeRelease(&m_pProvider);
+
+    // The scaler is used with the cache lock held, see ProcessSubtitleBitmap
+    CAutoLock lock(&m_csBitmapCache);
     if (m_pSwsContext)
     {
         sws_freeContext(m_pSwsContext);
         m_pSwsContext = nullptr;
     }
+    FlushBitmapCache();
     return S_OK;
 }
 
@@ -89,6 +102,8 @@ STDMETHODIMP CLAVSubtitleConsumer::DeliverFrame(REFERENCE_TIME start, REFERENCE_
     if (subtitleFrame)
         subtitleFrame->AddRef();
     m_SubtitleFrame = subtitleFrame;
+    m_rtFrameStart = start;
+    m_rtFrameStop = stop;
     m_evFrame.Set();
 
     return S_OK;
@@ -106,12 +121,135 @@ STDMETHODIMP CLAVSubtitleConsumer::RequestFrame(REFERENCE_TIME rtStart, REFERENC
     return m_pProvider->RequestFrame(rtStart, rtStop, nullptr);
 }
 
-STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame)
+// We need scaling if the width is not the same, or the subtitle rect is higher then the video rect
+// Anything but RGB additionally needs a pixel format conversion
+static BOOL NeedSubtitleScaling(LAVPixelFormat pixFmt, RECT videoRect, RECT subRect)
+{
+    return subRect.right != videoRect.right || subRect.bottom > videoRect.bottom ||
+           (pixFmt != LAVPixFmt_RGB32 && pixFmt != LAVPixFmt_RGB24);
+}
+
+// Calculate the position and size of a scaled subtitle bitmap on the video
+static void ScaleSubtitleRect(RECT videoRect, RECT subRect, POINT *pPosition, SIZE *pSize)
+{
+    // Calculate scaled size
+    // We must ensure that the scaled subs still fit into the video
+
+    // HACK: Scale to video size. In the future, we should take AR and the likes into account
+    RECT newRect = videoRect;
+    /*
+    float subAR = (float)subRect.right / (float)subRect.bottom;
+    if (newRect.right != videoRect.right) {
+      newRect.right = videoRect.right;
+      newRect.bottom = (LONG)(newRect.right / subAR);
+    }
+    if (newRect.bottom > videoRect.bottom) {
+      newRect.bottom = videoRect.bottom;
+      newRect.right = (LONG)(newRect.bottom * subAR);
+    }*/
+
+    SIZE newSize;
+    newSize.cx = (LONG)av_rescale(pSize->cx, newRect.right, subRect.right);
+    newSize.cy = (LONG)av_rescale(pSize->cy, newRect.bottom, subRect.bottom);
+
+    // And scaled position
+    pPosition->x = (LONG)av_rescale(pPosition->x, newSize.cx, pSize->cx);
+    pPosition->y = (LONG)av_rescale(pPosition->y, newSize.cy, pSize->cy);
+
+    *pSize = newSize;
+}
+
+HRESULT CLAVSubtitleConsumer::GetDirtyRect(LAVPixelFormat pixFmt, RECT videoRect, RECT subRect, int count,
+                                           RECT *pDirtyRect)
+{
+    const BOOL bNeedScaling = NeedSubtitleScaling(pixFmt, videoRect, subRect);
+    ::SetRectEmpty(pDirtyRect);
+
+    ULONGLONG id;
+    POINT position;
+    SIZE size;
+    LPCVOID rgbData;
+    int pitch;
+    for (int i = 0; i < count; i++)
+    {
+        if (FAILED(m_SubtitleFrame->GetBitmap(i, &id, &position, &size, &rgbData, &pitch)))
+            break;
+
+        if (bNeedScaling)
+            ScaleSubtitleRect(videoRect, subRect, &position, &size);
+
+        RECT bitmapRect;
+        ::SetRect(&bitmapRect, position.x, position.y, position.x + size.cx, position.y + size.cy);
+        ::UnionRect(pDirtyRect, pDirtyRect, &bitmapRect);
+    }
+
+    ::IntersectRect(pDirtyRect, pDirtyRect, &videoRect);
+    return S_OK;
+}
+
+HRESULT CLAVSubtitleConsumer::CopyFrameBand(LAVFrame *pFrame, int top, int bottom, LAVFrameBand *pBand)
+{
+    const LAVPixFmtDesc desc = getPixelFormatDesc(pFrame->format);
+
+    top = top & ~(SUBTITLE_BAND_ALIGN - 1);
+    bottom = min(FFALIGN(bottom, SUBTITLE_BAND_ALIGN), pFrame->height);
+
+    const ptrdiff_t stride = FFALIGN(pFrame->width, 64) * desc.codedbytes;
+
+    // Lay out all planes in one block, re-used for every frame
+    size_t planeOffset[4] = {0};
+    size_t size = 0;
+    for (int plane = 0; plane < desc.planes; plane++)
+    {
+        const int lines = (bottom + desc.planeHeight[plane] - 1) / desc.planeHeight[plane] -
+                          top / desc.planeHeight[plane];
+        planeOffset[plane] = size;
+        size += FFALIGN((stride / desc.planeWidth[plane]) * lines + AV_INPUT_BUFFER_PADDING_SIZE, 64);
+    }
+
+    if (size > m_nBandBufferSize)
+    {
+        av_freep(&m_pBandBuffer);
+        m_nBandBufferSize = 0;
+        m_pBandBuffer = (BYTE *)av_malloc(size);
+        if (m_pBandBuffer == nullptr)
+            return E_OUTOFMEMORY;
+        m_nBandBufferSize = size;
+    }
+
+    pBand->top = top;
+    pBand->height = bottom - top;
+    for (int plane = 0; plane < desc.planes; plane++)
+    {
+        const size_t linesize = (pFrame->width / desc.planeWidth[plane]) * desc.codedbytes;
+        const int firstLine = top / desc.planeHeight[plane];
+        const int lines = (bottom + desc.planeHeight[plane] - 1) / desc.planeHeight[plane] - firstLine;
+
+        pBand->data[plane] = m_pBandBuffer + planeOffset[plane];
+        pBand->stride[plane] = stride / desc.planeWidth[plane];
+
+        BYTE *dst = pBand->data[plane];
+        const BYTE *src = pFrame->data[plane] + firstLine * pFrame->stride[plane];
+        for (int i = 0; i < lines; i++)
+        {
+            memcpy(dst, src, linesize);
+            dst += pBand->stride[plane];
+            src += pFrame->stride[plane];
+        }
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame, LAVFrameBand *pBand)
 {
     CheckPointer(m_pProvider, E_FAIL);
     HRESULT hr = S_OK;
     LPDIRECT3DSURFACE9 pSurface = nullptr;
 
+    if (pBand)
+        pBand->height = 0;
+
     // Wait for the requested frame
     m_evFrame.Wait();
 
@@ -131,6 +269,7 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame)
 
         BYTE *data[4] = {0};
         ptrdiff_t stride[4] = {0};
+        LONG lineOffset = 0;
         LAVPixelFormat format = pFrame->format;
         int bpp = pFrame->bpp;
 
@@ -144,22 +283,49 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame)
             SafeRelease(&m_SubtitleFrame);
             return E_FAIL;
         }
-        else
+
+        RECT videoRect;
+        ::SetRect(&videoRect, 0, 0, pFrame->width, pFrame->height);
+
+        RECT subRect;
+        m_SubtitleFrame->GetOutputRect(&subRect);
+
+        if (!(pFrame->flags & LAV_FRAME_FLAG_BUFFER_MODIFY))
         {
-            if (!(pFrame->flags & LAV_FRAME_FLAG_BUFFER_MODIFY))
+            // Only copy the lines touched by the subtitles, if the caller can take them separately from the frame
+            RECT dirtyRect;
+            if (pBand && SUCCEEDED(GetDirtyRect(format, videoRect, subRect, count, &dirtyRect)))
+            {
+                if (::IsRectEmpty(&dirtyRect))
+                {
+                    SafeRelease(&m_SubtitleFrame);
+                    return S_FALSE;
+                }
+
+                hr = CopyFrameBand(pFrame, dirtyRect.top, dirtyRect.bottom, pBand);
+                if (FAILED(hr))
+                {
+                    pBand->height = 0;
+                    SafeRelease(&m_SubtitleFrame);
+                    return hr;
+                }
+
+                memcpy(&data, &pBand->data, sizeof(pBand->data));
+                memcpy(&stride, &pBand->stride, sizeof(pBand->stride));
+                lineOffset = pBand->top;
+            }
+            else
             {
                 CopyLAVFrameInPlace(pFrame);
             }
+        }
+
+        if (data[0] == nullptr)
+        {
             memcpy(&data, &pFrame->data, sizeof(pFrame->data));
             memcpy(&stride, &pFrame->stride, sizeof(pFrame->stride));
         }
 
-        RECT videoRect;
-        ::SetRect(&videoRect, 0, 0, pFrame->width, pFrame->height);
-
-        RECT subRect;
-        m_SubtitleFrame->GetOutputRect(&subRect);
-
         ULONGLONG id;
         POINT position;
         SIZE size;
@@ -172,9 +338,15 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame)
                 DbgLog((LOG_TRACE, 10, L"GetBitmap() failed on index %d", i));
                 break;
             }
-            ProcessSubtitleBitmap(format, bpp, videoRect, data, stride, subRect, position, size, rgbData, pitch);
+            ProcessSubtitleBitmap(format, bpp, videoRect, data, stride, lineOffset, subRect, id, position, size,
+                                  rgbData, pitch);
         }
 
+        // Bitmaps that were not part of this frame and ended before it will not be shown again
+        // Without valid timestamps, only the size limits of the cache apply
+        if (m_rtFrameStop > m_rtFrameStart)
+            ExpireBitmapCache(m_rtFrameStart);
+
         if (pSurface)
             pSurface->UnlockRect();
 
@@ -185,6 +357,67 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessFrame(LAVFrame *pFrame)
     return S_FALSE;
 }
 
+CLAVSubtitleConsumer::SubtitleBitmap *CLAVSubtitleConsumer::GetCachedBitmap(ULONGLONG id, LAVPixelFormat pixFmt,
+                                                                           SIZE srcSize, SIZE size)
+{
+    for (auto it = m_BitmapCache.begin(); it != m_BitmapCache.end(); it++)
+    {
+        if (it->id == id && it->pixFmt == pixFmt && it->srcSize.cx == srcSize.cx && it->srcSize.cy == srcSize.cy &&
+            it->size.cx == size.cx && it->size.cy == size.cy)
+        {
+            // Move to the front, so the least recently used bitmap is always at the back
+            if (it != m_BitmapCache.begin())
+                m_BitmapCache.splice(m_BitmapCache.begin(), m_BitmapCache, it);
+            return &m_BitmapCache.front();
+        }
+    }
+    return nullptr;
+}
+
+void CLAVSubtitleConsumer::FreeCachedBitmap(std::list<SubtitleBitmap>::iterator it)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        av_freep(&it->data[i]);
+    }
+    m_nBitmapCacheBytes -= it->bytes;
+    m_BitmapCache.erase(it);
+}
+
+// Evict the least recently used bitmaps, until a new bitmap of the given size fits into the cache
+void CLAVSubtitleConsumer::TrimBitmapCache(size_t bytes)
+{
+    while (!m_BitmapCache.empty() && (m_BitmapCache.size() >= SUBTITLE_BITMAP_CACHE_SIZE ||
+                                      m_nBitmapCacheBytes + bytes > SUBTITLE_BITMAP_CACHE_BYTES))
+    {
+        FreeCachedBitmap(std::prev(m_BitmapCache.end()));
+    }
+}
+
+void CLAVSubtitleConsumer::ExpireBitmapCache(REFERENCE_TIME rtStart)
+{
+    CAutoLock lock(&m_csBitmapCache);
+
+    for (auto it = m_BitmapCache.begin(); it != m_BitmapCache.end();)
+    {
+        auto next = std::next(it);
+        if (it->rtStop <= rtStart)
+            FreeCachedBitmap(it);
+        it = next;
+    }
+}
+
+void CLAVSubtitleConsumer::FlushBitmapCache()
+{
+    CAutoLock lock(&m_csBitmapCache);
+
+    while (!m_BitmapCache.empty())
+    {
+        FreeCachedBitmap(m_BitmapCache.begin());
+    }
+    ASSERT(m_nBitmapCacheBytes == 0);
+}
+
 static struct
 {
     LAVPixelFormat pixfmt;
@@ -235,26 +468,90 @@ static AVPixelFormat getFFPixFmtForSubtitle(LAVPixelFormat pixFmt)
 
 STDMETHODIMP CLAVSubtitleConsumer::SelectBlendFunction()
 {
-    switch (m_PixFmt)
+    blend = blend_select_function(m_PixFmt, av_get_cpu_flags());
+    if (!blend)
+        DbgLog((LOG_ERROR, 10, L"ProcessSubtitleBitmap(): No Blend function available"));
+
+    return S_OK;
+}
+
+HRESULT CLAVSubtitleConsumer::ConvertSubtitleBitmap(SubtitleBitmap &bitmap, AVPixelFormat avPixFmt,
+                                                    const uint8_t *rgbData, ptrdiff_t pitch)
+{
+    uint8_t *tmpBuf = nullptr;
+    const SIZE subSize = bitmap.srcSize;
+    const SIZE newSize = bitmap.size;
+
+    m_pSwsContext = sws_getCachedContext(m_pSwsContext, subSize.cx, subSize.cy, AV_PIX_FMT_BGRA, newSize.cx,
+                                         newSize.cy, avPixFmt, SWS_BILINEAR | SWS_FULL_CHR_H_INP, nullptr, nullptr,
+                                         nullptr);
+    if (m_pSwsContext == nullptr)
+    {
+        DbgLog((LOG_ERROR, 10, L"ConvertSubtitleBitmap(): Failed to create the scaler"));
+        return E_FAIL;
+    }
+
+    const uint8_t *src[4] = {(const uint8_t *)rgbData, nullptr, nullptr, nullptr};
+    const ptrdiff_t srcStride[4] = {pitch, 0, 0, 0};
+
+    const LAVPixFmtDesc desc = getFFSubPixelFormatDesc(avPixFmt);
+    const ptrdiff_t stride = FFALIGN(newSize.cx, 64) * desc.codedbytes;
+
+    bitmap.bytes = 0;
+    for (int plane = 0; plane < desc.planes; plane++)
     {
-    case LAVPixFmt_RGB32:
-    case LAVPixFmt_RGB24: blend = &CLAVSubtitleConsumer::blend_rgb_c; break;
-    case LAVPixFmt_NV12: blend = &CLAVSubtitleConsumer::blend_yuv_c<uint8_t, 1>; break;
-    case LAVPixFmt_P016: blend = &CLAVSubtitleConsumer::blend_yuv_c<uint16_t, 1>; break;
-    case LAVPixFmt_YUV420:
-    case LAVPixFmt_YUV422:
-    case LAVPixFmt_YUV444: blend = &CLAVSubtitleConsumer::blend_yuv_c<uint8_t, 0>; break;
-    case LAVPixFmt_YUV420bX:
-    case LAVPixFmt_YUV422bX:
-    case LAVPixFmt_YUV444bX: blend = &CLAVSubtitleConsumer::blend_yuv_c<uint16_t, 0>; break;
-    default: DbgLog((LOG_ERROR, 10, L"ProcessSubtitleBitmap(): No Blend function available")); blend = nullptr;
+        bitmap.stride[plane] = stride / desc.planeWidth[plane];
+        const size_t size = bitmap.stride[plane] * FFALIGN(newSize.cy, 2) / desc.planeHeight[plane];
+        bitmap.data[plane] = (BYTE *)av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (bitmap.data[plane] == nullptr)
+            goto fail;
+        bitmap.bytes += size + AV_INPUT_BUFFER_PADDING_SIZE;
     }
 
+    // Un-pre-multiply alpha for YUV formats
+    // TODO: Can we SIMD this? See ARGBUnattenuateRow_C/SSE2 in libyuv
+    if (avPixFmt != AV_PIX_FMT_BGRA)
+    {
+        tmpBuf = (uint8_t *)av_malloc(pitch * subSize.cy);
+        if (tmpBuf == nullptr)
+            goto fail;
+
+        memcpy(tmpBuf, rgbData, pitch * subSize.cy);
+        for (int line = 0; line < subSize.cy; line++)
+        {
+            uint8_t *p = tmpBuf + line * pitch;
+            for (int col = 0; col < subSize.cx; col++)
+            {
+                if (p[3] != 0 && p[3] != 255)
+                {
+                    p[0] = av_clip_uint8(p[0] * 255 / p[3]);
+                    p[1] = av_clip_uint8(p[1] * 255 / p[3]);
+                    p[2] = av_clip_uint8(p[2] * 255 / p[3]);
+                }
+                p += 4;
+            }
+        }
+        src[0] = tmpBuf;
+    }
+
+    sws_scale2(m_pSwsContext, src, srcStride, 0, subSize.cy, bitmap.data, bitmap.stride);
+
+    if (tmpBuf)
+        av_free(tmpBuf);
+
     return S_OK;
+
+fail:
+    for (int i = 0; i < 4; i++)
+    {
+        av_freep(&bitmap.data[i]);
+    }
+    return E_OUTOFMEMORY;
 }
 
 STDMETHODIMP CLAVSubtitleConsumer::ProcessSubtitleBitmap(LAVPixelFormat pixFmt, int bpp, RECT videoRect,
-                                                         BYTE *videoData[4], ptrdiff_t videoStride[4], RECT subRect,
+                                                         BYTE *videoData[4], ptrdiff_t videoStride[4],
+                                                         LONG lineOffset, RECT subRect, ULONGLONG id,
                                                          POINT subPosition, SIZE subSize, const uint8_t *rgbData,
                                                          ptrdiff_t pitch)
 {
@@ -263,18 +560,7 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessSubtitleBitmap(LAVPixelFormat pixFmt,
         DbgLog((LOG_ERROR, 10, L"ProcessSubtitleBitmap(): Left/Top in SubRect non-zero"));
     }
 
-    BOOL bNeedScaling = FALSE;
-
-    // We need scaling if the width is not the same, or the subtitle rect is higher then the video rect
-    if (subRect.right != videoRect.right || subRect.bottom > videoRect.bottom)
-    {
-        bNeedScaling = TRUE;
-    }
-
-    if (pixFmt != LAVPixFmt_RGB32 && pixFmt != LAVPixFmt_RGB24)
-    {
-        bNeedScaling = TRUE;
-    }
+    const BOOL bNeedScaling = NeedSubtitleScaling(pixFmt, videoRect, subRect);
 
     if (m_PixFmt != pixFmt)
     {
@@ -289,86 +575,35 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessSubtitleBitmap(LAVPixelFormat pixFmt,
     BYTE *subData[4] = {nullptr, nullptr, nullptr, nullptr};
     ptrdiff_t subStride[4] = {0, 0, 0, 0};
 
+    // The cached bitmap is used until the blending is done
+    CAutoLock lock(&m_csBitmapCache);
+
     // If we need scaling (either scaling or pixel conversion), do it here before starting the blend process
+    // The result is cached, subtitles usually stay unchanged for many frames and only need to be blended again
     if (bNeedScaling)
     {
-        uint8_t *tmpBuf = nullptr;
-        const AVPixelFormat avPixFmt = getFFPixFmtForSubtitle(pixFmt);
-
-        // Calculate scaled size
-        // We must ensure that the scaled subs still fit into the video
-
-        // HACK: Scale to video size. In the future, we should take AR and the likes into account
-        RECT newRect = videoRect;
-        /*
-        float subAR = (float)subRect.right / (float)subRect.bottom;
-        if (newRect.right != videoRect.right) {
-          newRect.right = videoRect.right;
-          newRect.bottom = (LONG)(newRect.right / subAR);
-        }
-        if (newRect.bottom > videoRect.bottom) {
-          newRect.bottom = videoRect.bottom;
-          newRect.right = (LONG)(newRect.bottom * subAR);
-        }*/
-
-        SIZE newSize;
-        newSize.cx = (LONG)av_rescale(subSize.cx, newRect.right, subRect.right);
-        newSize.cy = (LONG)av_rescale(subSize.cy, newRect.bottom, subRect.bottom);
+        SIZE newSize = subSize;
+        ScaleSubtitleRect(videoRect, subRect, &subPosition, &newSize);
 
-        // And scaled position
-        subPosition.x = (LONG)av_rescale(subPosition.x, newSize.cx, subSize.cx);
-        subPosition.y = (LONG)av_rescale(subPosition.y, newSize.cy, subSize.cy);
-
-        m_pSwsContext =
-            sws_getCachedContext(m_pSwsContext, subSize.cx, subSize.cy, AV_PIX_FMT_BGRA, newSize.cx, newSize.cy,
-                                 avPixFmt, SWS_BILINEAR | SWS_FULL_CHR_H_INP, nullptr, nullptr, nullptr);
-
-        const uint8_t *src[4] = {(const uint8_t *)rgbData, nullptr, nullptr, nullptr};
-        const ptrdiff_t srcStride[4] = {pitch, 0, 0, 0};
-
-        const LAVPixFmtDesc desc = getFFSubPixelFormatDesc(avPixFmt);
-        const ptrdiff_t stride = FFALIGN(newSize.cx, 64) * desc.codedbytes;
-
-        for (int plane = 0; plane < desc.planes; plane++)
+        SubtitleBitmap *pBitmap = GetCachedBitmap(id, pixFmt, subSize, newSize);
+        if (pBitmap == nullptr)
         {
-            subStride[plane] = stride / desc.planeWidth[plane];
-            const size_t size = subStride[plane] * FFALIGN(newSize.cy, 2) / desc.planeHeight[plane];
-            subData[plane] = (BYTE *)av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
-            if (subData[plane] == nullptr)
-                goto fail;
-        }
+            SubtitleBitmap bitmap = {id, pixFmt, subSize, newSize};
+            HRESULT hr = ConvertSubtitleBitmap(bitmap, getFFPixFmtForSubtitle(pixFmt), rgbData, pitch);
+            if (FAILED(hr))
+                return hr;
 
-        // Un-pre-multiply alpha for YUV formats
-        // TODO: Can we SIMD this? See ARGBUnattenuateRow_C/SSE2 in libyuv
-        if (avPixFmt != AV_PIX_FMT_BGRA)
-        {
-            tmpBuf = (uint8_t *)av_malloc(pitch * subSize.cy);
-            if (tmpBuf == nullptr)
-                goto fail;
+            TrimBitmapCache(bitmap.bytes);
 
-            memcpy(tmpBuf, rgbData, pitch * subSize.cy);
-            for (int line = 0; line < subSize.cy; line++)
-            {
-                uint8_t *p = tmpBuf + line * pitch;
-                for (int col = 0; col < subSize.cx; col++)
-                {
-                    if (p[3] != 0 && p[3] != 255)
-                    {
-                        p[0] = av_clip_uint8(p[0] * 255 / p[3]);
-                        p[1] = av_clip_uint8(p[1] * 255 / p[3]);
-                        p[2] = av_clip_uint8(p[2] * 255 / p[3]);
-                    }
-                    p += 4;
-                }
-            }
-            src[0] = tmpBuf;
+            m_BitmapCache.push_front(bitmap);
+            m_nBitmapCacheBytes += bitmap.bytes;
+            pBitmap = &m_BitmapCache.front();
         }
+        pBitmap->rtStop = m_rtFrameStop;
 
-        int ret = sws_scale2(m_pSwsContext, src, srcStride, 0, subSize.cy, subData, subStride);
+        memcpy(subData, pBitmap->data, sizeof(subData));
+        memcpy(subStride, pBitmap->stride, sizeof(subStride));
         subSize = newSize;
-
-        if (tmpBuf)
-            av_free(tmpBuf);
     }
     else
     {
@@ -379,23 +614,13 @@ STDMETHODIMP CLAVSubtitleConsumer::ProcessSubtitleBitmap(LAVPixelFormat pixFmt,
     ASSERT((subPosition.x + subSize.cx) <= videoRect.right);
     ASSERT((subPosition.y + subSize.cy) <= videoRect.bottom);
 
-    if (blend)
-        (this->*blend)(videoData, videoStride, videoRect, subData, subStride, subPosition, subSize, pixFmt, bpp);
+    // The video data might only contain some lines of the frame
+    subPosition.y -= lineOffset;
+    ASSERT(subPosition.y >= 0);
 
-    if (bNeedScaling)
-    {
-        for (int i = 0; i < 4; i++)
-        {
-            av_freep(&subData[i]);
-        }
-    }
+    if (blend)
+        blend(videoData, videoStride, subData, subStride, subPosition.x, subPosition.y, subSize.cx, subSize.cy, pixFmt,
+              bpp);
 
     return S_OK;
-
-fail:
-    for (int i = 0; i < 4; i++)
-    {
-        av_freep(&subData[i]);
-    }
-    return E_OUTOFMEMORY;
 }
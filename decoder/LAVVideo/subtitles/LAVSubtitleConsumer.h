@@ -19,18 +19,13 @@
 
 #pragma once
 
+#include <list>
+
 #include "SubRenderOptionsImpl.h"
 #include "LAVSubtitleFrame.h"
 
 #include "../decoders/ILAVDecoder.h"
-
-#define BLEND_FUNC_PARAMS                                                                                \
-    (BYTE * video[4], ptrdiff_t videoStride[4], RECT vidRect, BYTE * subData[4], ptrdiff_t subStride[4], \
-     POINT position, SIZE size, LAVPixelFormat pixFmt, int bpp)
-
-#define DECLARE_BLEND_FUNC(name) HRESULT name BLEND_FUNC_PARAMS
-
-#define DECLARE_BLEND_FUNC_IMPL(name) DECLARE_BLEND_FUNC(CLAVSubtitleConsumer::name)
+#include "blend/blend.h"
 
 typedef struct LAVSubtitleConsumerContext
 {
@@ -69,7 +64,10 @@ class CLAVSubtitleConsumer
 
     // LAV Internal methods
     STDMETHODIMP RequestFrame(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop);
-    STDMETHODIMP ProcessFrame(LAVFrame *pFrame);
+    // Blend the subtitles onto the frame
+    // If the frame buffers are not writable and pBand is given, the changed lines are stored in the band instead of
+    // copying the whole frame. The band stays valid until the next call.
+    STDMETHODIMP ProcessFrame(LAVFrame *pFrame, LAVFrameBand *pBand = nullptr);
 
     STDMETHODIMP DisconnectProvider()
     {
@@ -89,16 +87,36 @@ class CLAVSubtitleConsumer
 
   private:
     STDMETHODIMP ProcessSubtitleBitmap(LAVPixelFormat pixFmt, int bpp, RECT videoRect, BYTE *videoData[4],
-                                       ptrdiff_t videoStride[4], RECT subRect, POINT subPosition, SIZE subSize,
-                                       const uint8_t *rgbData, ptrdiff_t pitch);
+                                       ptrdiff_t videoStride[4], LONG lineOffset, RECT subRect, ULONGLONG id,
+                                       POINT subPosition, SIZE subSize, const uint8_t *rgbData, ptrdiff_t pitch);
+
+    HRESULT GetDirtyRect(LAVPixelFormat pixFmt, RECT videoRect, RECT subRect, int count, RECT *pDirtyRect);
+    HRESULT CopyFrameBand(LAVFrame *pFrame, int top, int bottom, LAVFrameBand *pBand);
+
+    // Converted subtitle bitmap, kept around for as long as the subtitle is shown
+    typedef struct
+    {
+        ULONGLONG id;          ///< bitmap id as reported by the subtitle renderer
+        LAVPixelFormat pixFmt; ///< video format the bitmap was converted for
+        SIZE srcSize;          ///< size of the bitmap as delivered
+        SIZE size;             ///< size of the converted bitmap
+        BYTE *data[4];
+        ptrdiff_t stride[4];
+        size_t bytes;          ///< memory used by the planes
+        REFERENCE_TIME rtStop; ///< end of the last subtitle frame the bitmap was used in
+    } SubtitleBitmap;
+
+    HRESULT ConvertSubtitleBitmap(SubtitleBitmap &bitmap, AVPixelFormat avPixFmt, const uint8_t *rgbData,
+                                  ptrdiff_t pitch);
+    SubtitleBitmap *GetCachedBitmap(ULONGLONG id, LAVPixelFormat pixFmt, SIZE srcSize, SIZE size);
+    void TrimBitmapCache(size_t bytes);
+    void ExpireBitmapCache(REFERENCE_TIME rtStart);
+    void FreeCachedBitmap(std::list<SubtitleBitmap>::iterator it);
+    void FlushBitmapCache();
 
     STDMETHODIMP SelectBlendFunction();
-    typedef HRESULT(CLAVSubtitleConsumer::*BlendFn) BLEND_FUNC_PARAMS;
     BlendFn blend = nullptr;
 
-    DECLARE_BLEND_FUNC(blend_rgb_c);
-    template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_c);
-
   private:
     ISubRenderProvider *m_pProvider = nullptr;
     ISubRenderFrame *m_SubtitleFrame = nullptr;
@@ -107,6 +125,16 @@ class CLAVSubtitleConsumer
     SwsContext *m_pSwsContext = nullptr;
     LAVPixelFormat m_PixFmt = LAVPixFmt_None;
 
+    REFERENCE_TIME m_rtFrameStart = 0; // validity of the current subtitle frame
+    REFERENCE_TIME m_rtFrameStop = 0;
+
+    CCritSec m_csBitmapCache;
+    std::list<SubtitleBitmap> m_BitmapCache; // most recently used first
+    size_t m_nBitmapCacheBytes = 0;
+
+    BYTE *m_pBandBuffer = nullptr; // lines copied out of read-only frames
+    size_t m_nBandBufferSize = 0;
+
     LAVSubtitleConsumerContext context;
 
     CLAVVideo *m_pLAVVideo = nullptr;
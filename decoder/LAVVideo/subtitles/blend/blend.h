@@ -0,0 +1,53 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../decoders/LAVPixelFormat.h"
+
+// Subtitle blending kernels
+// They don't need any Windows or DirectShow headers, so they can be built and tested on their own (see tests/)
+//
+// video/videoStride - planes of the video
+// subData/subStride - BGRA subtitle for RGB video, or 8-bit Y/U/V/A planes with the subsampling of the video
+// posX/posY - position of the subtitle on the video, width/height - size of the subtitle
+// pixFmt/bpp - format and bit depth of the video
+#define BLEND_FUNC_PARAMS                                                                                  \
+    (uint8_t * video[4], ptrdiff_t videoStride[4], uint8_t * subData[4], ptrdiff_t subStride[4], int posX, \
+     int posY, int width, int height, LAVPixelFormat pixFmt, int bpp)
+
+#define DECLARE_BLEND_FUNC(name) void name BLEND_FUNC_PARAMS
+
+typedef void(*BlendFn) BLEND_FUNC_PARAMS;
+
+DECLARE_BLEND_FUNC(blend_rgb_c);
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_c);
+
+DECLARE_BLEND_FUNC(blend_rgb_sse4);
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_sse4);
+
+DECLARE_BLEND_FUNC(blend_rgb32_avx2);
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_avx2);
+
+// Select the fastest blend function for the pixel format and the CPU flags (AV_CPU_FLAG_*)
+// Returns nullptr if the format cannot be blended onto
+BlendFn blend_select_function(LAVPixelFormat pixFmt, int cpuFlags);
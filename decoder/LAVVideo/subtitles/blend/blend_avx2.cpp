@@ -0,0 +1,153 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "blend.h"
+#include "blend_internal.h"
+
+#include <immintrin.h>
+
+// AVX2 versions of the SSE4 blend kernels, see blend_sse4.cpp for details
+// All operations work within the 128-bit lanes, so unpacking and packing again keeps the sample order
+
+static inline __m256i blend_avx2_epu16(__m256i d, __m256i s, __m256i a)
+{
+    const __m256i bias = _mm256_set1_epi16(-32768);
+    const __m256i rounding = _mm256_set1_epi32(32768 * 255 + 128);
+    const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+    const __m256i dx = _mm256_xor_si256(d, bias);
+    const __m256i sx = _mm256_xor_si256(s, bias);
+
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(dx, sx), _mm256_unpacklo_epi16(ia, a));
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(dx, sx), _mm256_unpackhi_epi16(ia, a));
+    lo = _mm256_add_epi32(lo, rounding);
+    hi = _mm256_add_epi32(hi, rounding);
+
+    lo = _mm256_srli_epi32(_mm256_add_epi32(lo, _mm256_srli_epi32(lo, 8)), 8);
+    hi = _mm256_srli_epi32(_mm256_add_epi32(hi, _mm256_srli_epi32(hi, 8)), 8);
+    __m256i r = _mm256_packus_epi32(lo, hi);
+
+    r = _mm256_blendv_epi8(r, s, _mm256_cmpeq_epi16(a, _mm256_set1_epi16(255)));
+    return _mm256_blendv_epi8(r, d, _mm256_cmpeq_epi16(a, _mm256_setzero_si256()));
+}
+
+static inline __m256i blend_avx2_epu8(__m256i d, __m256i s, __m256i a)
+{
+    const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(d, ia), _mm256_mullo_epi16(s, a));
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_mulhi_epu16(x, _mm256_set1_epi16(257));
+}
+
+struct BlendKernelAVX2
+{
+    static void blend_line(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift)
+    {
+        int x = 0;
+        for (; x + 32 <= n; x += 32)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+            const __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+            const __m256i a = _mm256_loadu_si256((const __m256i *)(alpha + x));
+
+            __m256i lo = blend_avx2_epu8(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero),
+                                         _mm256_unpacklo_epi8(a, zero));
+            __m256i hi = blend_avx2_epu8(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero),
+                                         _mm256_unpackhi_epi8(a, zero));
+            _mm256_storeu_si256((__m256i *)(dst + x), _mm256_packus_epi16(lo, hi));
+        }
+        blend_line_c(dst + x, src + x, alpha + x, n - x, shift);
+    }
+
+    static void blend_line(uint16_t *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift)
+    {
+        const __m128i xmmShift = _mm_cvtsi32_si128(shift);
+
+        int x = 0;
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+            const __m256i s =
+                _mm256_sll_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + x))), xmmShift);
+            const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(alpha + x)));
+            _mm256_storeu_si256((__m256i *)(dst + x), blend_avx2_epu16(d, s, a));
+        }
+        blend_line_c(dst + x, src + x, alpha + x, n - x, shift);
+    }
+};
+
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_avx2)
+{
+    assert(pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_NV12 || pixFmt == LAVPixFmt_YUV422 ||
+           pixFmt == LAVPixFmt_YUV444 || pixFmt == LAVPixFmt_YUV420bX || pixFmt == LAVPixFmt_YUV422bX ||
+           pixFmt == LAVPixFmt_YUV444bX || pixFmt == LAVPixFmt_P016);
+
+    blend_yuv_simd<BlendKernelAVX2, pixT, nv12>(video, videoStride, subData, subStride, posX, posY, width, height,
+                                              pixFmt, bpp);
+}
+
+template void blend_yuv_avx2<uint8_t, 1> BLEND_FUNC_PARAMS;
+template void blend_yuv_avx2<uint8_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_avx2<uint16_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_avx2<uint16_t, 1> BLEND_FUNC_PARAMS;
+
+DECLARE_BLEND_FUNC(blend_rgb32_avx2)
+{
+    assert(pixFmt == LAVPixFmt_RGB32);
+
+    uint8_t *rgbOut = video[0];
+    const uint8_t *subIn = subData[0];
+
+    const ptrdiff_t outStride = videoStride[0];
+    const ptrdiff_t inStride = subStride[0];
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaShuf = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15, 3, 3, 3, 3, 7,
+                                               7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    const __m256i xMask = _mm256_set1_epi32(0xFF000000);
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *dstLine = rgbOut + ((y + posY) * outStride) + (posX * 4);
+        const uint8_t *srcLine = subIn + (y * inStride);
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const __m256i d = _mm256_loadu_si256((const __m256i *)(dstLine + x * 4));
+            const __m256i s = _mm256_loadu_si256((const __m256i *)(srcLine + x * 4));
+
+            const __m256i a = _mm256_shuffle_epi8(s, alphaShuf);
+            const __m256i ia = _mm256_xor_si256(a, _mm256_set1_epi8(-1));
+
+            __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(ia, zero));
+            __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(ia, zero));
+            lo = _mm256_mulhi_epu16(_mm256_add_epi16(lo, _mm256_set1_epi16(128)), _mm256_set1_epi16(257));
+            hi = _mm256_mulhi_epu16(_mm256_add_epi16(hi, _mm256_set1_epi16(128)), _mm256_set1_epi16(257));
+
+            __m256i r = _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s);
+            r = _mm256_blendv_epi8(r, d, _mm256_or_si256(_mm256_cmpeq_epi8(a, zero), xMask));
+            _mm256_storeu_si256((__m256i *)(dstLine + x * 4), r);
+        }
+
+        for (; x < width; x++)
+            blend_rgb_px_c(dstLine + x * 4, srcLine + x * 4);
+    }
+}
@@ -17,30 +17,33 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include "stdafx.h"
-#include "../LAVSubtitleConsumer.h"
+#include "blend.h"
+#include "blend_internal.h"
 
-#define FAST_DIV255(x) ((((x) + 128) * 257) >> 16)
+extern "C"
+{
+#include "libavutil/cpu.h"
+};
 
-DECLARE_BLEND_FUNC_IMPL(blend_rgb_c)
+DECLARE_BLEND_FUNC(blend_rgb_c)
 {
-    ASSERT(pixFmt == LAVPixFmt_RGB32 || pixFmt == LAVPixFmt_RGB24);
+    assert(pixFmt == LAVPixFmt_RGB32 || pixFmt == LAVPixFmt_RGB24);
 
-    BYTE *rgbOut = video[0];
-    const BYTE *subIn = subData[0];
+    uint8_t *rgbOut = video[0];
+    const uint8_t *subIn = subData[0];
 
     const ptrdiff_t outStride = videoStride[0];
     const ptrdiff_t inStride = subStride[0];
 
     const ptrdiff_t dstep = (pixFmt == LAVPixFmt_RGB24) ? 3 : 4;
 
-    for (int y = 0; y < size.cy; y++)
+    for (int y = 0; y < height; y++)
     {
-        BYTE *dstLine = rgbOut + ((y + position.y) * outStride) + (position.x * dstep);
-        const BYTE *srcLine = subIn + (y * inStride);
-        for (int x = 0; x < size.cx; x++)
+        uint8_t *dstLine = rgbOut + ((y + posY) * outStride) + (posX * dstep);
+        const uint8_t *srcLine = subIn + (y * inStride);
+        for (int x = 0; x < width; x++)
         {
-            const BYTE a = srcLine[3];
+            const uint8_t a = srcLine[3];
             switch (a)
             {
             case 0: break;
@@ -59,24 +62,22 @@ DECLARE_BLEND_FUNC_IMPL(blend_rgb_c)
             srcLine += 4;
         }
     }
-
-    return S_OK;
 }
 
-template <class pixT, int nv12> DECLARE_BLEND_FUNC_IMPL(blend_yuv_c)
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_c)
 {
-    ASSERT(pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_NV12 || pixFmt == LAVPixFmt_YUV422 ||
+    assert(pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_NV12 || pixFmt == LAVPixFmt_YUV422 ||
            pixFmt == LAVPixFmt_YUV444 || pixFmt == LAVPixFmt_YUV420bX || pixFmt == LAVPixFmt_YUV422bX ||
            pixFmt == LAVPixFmt_YUV444bX || pixFmt == LAVPixFmt_P016);
 
-    BYTE *y = video[0];
-    BYTE *u = video[1];
-    BYTE *v = video[2];
+    uint8_t *y = video[0];
+    uint8_t *u = video[1];
+    uint8_t *v = video[2];
 
-    const BYTE *subY = subData[0];
-    const BYTE *subU = subData[1];
-    const BYTE *subV = subData[2];
-    const BYTE *subA = subData[3];
+    const uint8_t *subY = subData[0];
+    const uint8_t *subU = subData[1];
+    const uint8_t *subV = subData[2];
+    const uint8_t *subA = subData[3];
 
     const ptrdiff_t outStride = videoStride[0];
     const ptrdiff_t outStrideUV = videoStride[1];
@@ -84,9 +85,9 @@ template <class pixT, int nv12> DECLARE_BLEND_FUNC_IMPL(blend_yuv_c)
     const ptrdiff_t inStrideUV = subStride[1];
 
     int line, col;
-    int w = size.cx, h = size.cy;
-    int yPos = position.y;
-    int xPos = position.x;
+    int w = width, h = height;
+    int yPos = posY;
+    int xPos = posX;
 
     const int hsub = nv12 || (pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_YUV420bX || pixFmt == LAVPixFmt_NV12);
     const int vsub = nv12 || (pixFmt != LAVPixFmt_YUV444 && pixFmt != LAVPixFmt_YUV444bX);
@@ -95,8 +96,8 @@ template <class pixT, int nv12> DECLARE_BLEND_FUNC_IMPL(blend_yuv_c)
     for (line = 0; line < h; line++)
     {
         pixT *dstY = (pixT *)(y + ((line + yPos) * outStride)) + xPos;
-        const BYTE *srcY = subY + (line * inStride);
-        const BYTE *srcA = subA + (line * inStride);
+        const uint8_t *srcY = subY + (line * inStride);
+        const uint8_t *srcA = subA + (line * inStride);
         for (col = 0; col < w; col++)
         {
             switch (srcA[col])
@@ -124,12 +125,12 @@ template <class pixT, int nv12> DECLARE_BLEND_FUNC_IMPL(blend_yuv_c)
         pixT *dstUV = (pixT *)(u + (line + yPos) * outStrideUV) + (xPos << 1);
 
         pixT *dstU = (pixT *)(u + (line + yPos) * outStrideUV) + xPos;
-        const BYTE *srcU = subU + line * inStrideUV;
+        const uint8_t *srcU = subU + line * inStrideUV;
 
         pixT *dstV = (pixT *)(v + (line + yPos) * outStrideUV) + xPos;
-        const BYTE *srcV = subV + line * inStrideUV;
+        const uint8_t *srcV = subV + line * inStrideUV;
 
-        const BYTE *srcA = subA + (line * inStride * (ptrdiff_t(1) << hsub));
+        const uint8_t *srcA = subA + (line * inStride * (ptrdiff_t(1) << hsub));
         for (col = 0; col < w; col++)
         {
             // Average Alpha
@@ -183,11 +184,34 @@ template <class pixT, int nv12> DECLARE_BLEND_FUNC_IMPL(blend_yuv_c)
             srcA += ptrdiff_t(1) << vsub;
         }
     }
-
-    return S_OK;
 }
 
-template HRESULT CLAVSubtitleConsumer::blend_yuv_c<uint8_t, 1> BLEND_FUNC_PARAMS;
-template HRESULT CLAVSubtitleConsumer::blend_yuv_c<uint8_t, 0> BLEND_FUNC_PARAMS;
-template HRESULT CLAVSubtitleConsumer::blend_yuv_c<uint16_t, 0> BLEND_FUNC_PARAMS;
-template HRESULT CLAVSubtitleConsumer::blend_yuv_c<uint16_t, 1> BLEND_FUNC_PARAMS;
+template void blend_yuv_c<uint8_t, 1> BLEND_FUNC_PARAMS;
+template void blend_yuv_c<uint8_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_c<uint16_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_c<uint16_t, 1> BLEND_FUNC_PARAMS;
+
+BlendFn blend_select_function(LAVPixelFormat pixFmt, int cpuFlags)
+{
+    const bool avx2 = (cpuFlags & AV_CPU_FLAG_AVX2) != 0;
+    const bool sse4 = (cpuFlags & AV_CPU_FLAG_SSE4) != 0;
+
+    switch (pixFmt)
+    {
+    case LAVPixFmt_RGB32: return avx2 ? blend_rgb32_avx2 : sse4 ? blend_rgb_sse4 : blend_rgb_c;
+    case LAVPixFmt_RGB24: return sse4 ? blend_rgb_sse4 : blend_rgb_c;
+    case LAVPixFmt_NV12:
+        return avx2 ? blend_yuv_avx2<uint8_t, 1> : sse4 ? blend_yuv_sse4<uint8_t, 1> : blend_yuv_c<uint8_t, 1>;
+    case LAVPixFmt_P016:
+        return avx2 ? blend_yuv_avx2<uint16_t, 1> : sse4 ? blend_yuv_sse4<uint16_t, 1> : blend_yuv_c<uint16_t, 1>;
+    case LAVPixFmt_YUV420:
+    case LAVPixFmt_YUV422:
+    case LAVPixFmt_YUV444:
+        return avx2 ? blend_yuv_avx2<uint8_t, 0> : sse4 ? blend_yuv_sse4<uint8_t, 0> : blend_yuv_c<uint8_t, 0>;
+    case LAVPixFmt_YUV420bX:
+    case LAVPixFmt_YUV422bX:
+    case LAVPixFmt_YUV444bX:
+        return avx2 ? blend_yuv_avx2<uint16_t, 0> : sse4 ? blend_yuv_sse4<uint16_t, 0> : blend_yuv_c<uint16_t, 0>;
+    default: return nullptr;
+    }
+}
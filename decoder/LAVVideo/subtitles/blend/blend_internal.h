@@ -0,0 +1,242 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+extern "C"
+{
+#include "libavutil/common.h"
+};
+
+#include <assert.h>
+#include <smmintrin.h>
+
+#define FAST_DIV255(x) ((((x) + 128) * 257) >> 16)
+
+// Number of chroma samples prepared at once by the SIMD blenders
+#define BLEND_CHROMA_CHUNK 256
+
+// Blend one line of 8-bit subtitle samples onto the video, in the same way as blend_yuv_c
+// Used for the samples left over by the SIMD kernels
+template <class pixT>
+static inline void blend_line_c(pixT *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift)
+{
+    for (int x = 0; x < n; x++)
+    {
+        switch (alpha[x])
+        {
+        case 0: break;
+        case 255: dst[x] = src[x] << shift; break;
+        default: dst[x] = FAST_DIV255(dst[x] * (255 - alpha[x]) + (src[x] << shift) * alpha[x]); break;
+        }
+    }
+}
+
+// Blend one BGRA subtitle pixel onto the video, in the same way as blend_rgb_c
+static inline void blend_rgb_px_c(uint8_t *dst, const uint8_t *src)
+{
+    const uint8_t a = src[3];
+    switch (a)
+    {
+    case 0: break;
+    case 255:
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        break;
+    default:
+        dst[0] = av_clip_uint8(FAST_DIV255(dst[0] * (255 - a)) + src[0]);
+        dst[1] = av_clip_uint8(FAST_DIV255(dst[1] * (255 - a)) + src[1]);
+        dst[2] = av_clip_uint8(FAST_DIV255(dst[2] * (255 - a)) + src[2]);
+        break;
+    }
+}
+
+// Calculate the alpha of n chroma samples, starting at col, from the alpha of the luma samples they cover
+// srcA points to the first alpha sample of the line, and the averaging matches blend_yuv_c exactly
+// bLastLine - there is no further chroma line below this one
+static inline void blend_chroma_alpha_sse4(uint8_t *alpha, const uint8_t *srcA, ptrdiff_t inStride, int col, int n,
+                                           int w, bool bLastLine, int hsub, int vsub)
+{
+    const uint8_t *a = srcA + ((ptrdiff_t)col << vsub);
+    int x = 0;
+
+    // 2x2 average for all samples that have a right and a lower neighbour
+    if (hsub && vsub && !bLastLine)
+    {
+        const __m128i ones = _mm_set1_epi8(1);
+        const int end = FFMIN(n, w - col - 1);
+        for (; x + 8 <= end; x += 8)
+        {
+            __m128i row0 = _mm_loadu_si128((const __m128i *)(a + (x << 1)));
+            __m128i row1 = _mm_loadu_si128((const __m128i *)(a + (x << 1) + inStride));
+            row0 = _mm_maddubs_epi16(row0, ones); // horizontal pair sums
+            row1 = _mm_maddubs_epi16(row1, ones);
+            row0 = _mm_srli_epi16(_mm_add_epi16(row0, row1), 2);
+            _mm_storel_epi64((__m128i *)(alpha + x), _mm_packus_epi16(row0, row0));
+        }
+    }
+    // 4:2:2 only uses every second sample, averaged half-way with the sample below
+    // Stops one chunk early so the unused odd sample at the end of the line is never read
+    else if (vsub && !hsub)
+    {
+        const __m128i mask = _mm_set1_epi16(0x00ff);
+        for (; x + 9 <= n; x += 8)
+        {
+            __m128i row0 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(a + (x << 1))), mask);
+            if (!bLastLine)
+            {
+                __m128i row1 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(a + (x << 1) + inStride)), mask);
+                row1 = _mm_srli_epi16(_mm_add_epi16(row0, row1), 1);
+                row0 = _mm_srli_epi16(_mm_add_epi16(row0, row1), 1);
+            }
+            _mm_storel_epi64((__m128i *)(alpha + x), _mm_packus_epi16(row0, row0));
+        }
+    }
+
+    for (; x < n; x++)
+    {
+        const uint8_t *p = a + ((ptrdiff_t)x << vsub);
+        const int c = col + x;
+        if (hsub && vsub && c + 1 < w && !bLastLine)
+        {
+            alpha[x] = (p[0] + p[inStride] + p[1] + p[inStride + 1]) >> 2;
+        }
+        else if (hsub || vsub)
+        {
+            int alpha_h = hsub && c + 1 < w ? (p[0] + p[1]) >> 1 : p[0];
+            int alpha_v = vsub && !bLastLine ? (p[0] + p[inStride]) >> 1 : p[0];
+            alpha[x] = (alpha_h + alpha_v) >> 1;
+        }
+        else
+        {
+            alpha[x] = p[0];
+        }
+    }
+}
+
+// Interleave the U and V samples and duplicate their alpha, for blending onto a NV12/P016 chroma plane
+static inline void blend_interleave_uv_sse4(uint8_t *uv, uint8_t *alphaUV, const uint8_t *u, const uint8_t *v,
+                                            const uint8_t *alpha, int n)
+{
+    int x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        const __m128i xmmU = _mm_loadu_si128((const __m128i *)(u + x));
+        const __m128i xmmV = _mm_loadu_si128((const __m128i *)(v + x));
+        const __m128i xmmA = _mm_loadu_si128((const __m128i *)(alpha + x));
+        _mm_storeu_si128((__m128i *)(uv + 2 * x), _mm_unpacklo_epi8(xmmU, xmmV));
+        _mm_storeu_si128((__m128i *)(uv + 2 * x + 16), _mm_unpackhi_epi8(xmmU, xmmV));
+        _mm_storeu_si128((__m128i *)(alphaUV + 2 * x), _mm_unpacklo_epi8(xmmA, xmmA));
+        _mm_storeu_si128((__m128i *)(alphaUV + 2 * x + 16), _mm_unpackhi_epi8(xmmA, xmmA));
+    }
+    for (; x < n; x++)
+    {
+        uv[2 * x + 0] = u[x];
+        uv[2 * x + 1] = v[x];
+        alphaUV[2 * x + 0] = alphaUV[2 * x + 1] = alpha[x];
+    }
+}
+
+// YUV blending on top of a line kernel
+// Kernel::blend_line(pixT *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift) has to produce the same
+// result as blend_line_c
+template <class Kernel, class pixT, int nv12>
+static void blend_yuv_simd(uint8_t *video[4], ptrdiff_t videoStride[4], uint8_t *subData[4], ptrdiff_t subStride[4],
+                              int posX, int posY, int width, int height, LAVPixelFormat pixFmt, int bpp)
+{
+    uint8_t *y = video[0];
+    uint8_t *u = video[1];
+    uint8_t *v = video[2];
+
+    const uint8_t *subY = subData[0];
+    const uint8_t *subU = subData[1];
+    const uint8_t *subV = subData[2];
+    const uint8_t *subA = subData[3];
+
+    const ptrdiff_t outStride = videoStride[0];
+    const ptrdiff_t outStrideUV = videoStride[1];
+    const ptrdiff_t inStride = subStride[0];
+    const ptrdiff_t inStrideUV = subStride[1];
+
+    int line, col;
+    int w = width, h = height;
+    int yPos = posY;
+    int xPos = posX;
+
+    const int hsub = nv12 || (pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_YUV420bX || pixFmt == LAVPixFmt_NV12);
+    const int vsub = nv12 || (pixFmt != LAVPixFmt_YUV444 && pixFmt != LAVPixFmt_YUV444bX);
+    const int shift = sizeof(pixT) > 1 ? bpp - 8 : 0;
+
+    for (line = 0; line < h; line++)
+    {
+        pixT *dstY = (pixT *)(y + ((line + yPos) * outStride)) + xPos;
+        Kernel::blend_line(dstY, subY + (line * inStride), subA + (line * inStride), w, shift);
+    }
+
+    if (hsub)
+    {
+        w >>= 1;
+        xPos >>= 1;
+    }
+    if (vsub)
+    {
+        h >>= 1;
+        yPos >>= 1;
+    }
+
+    alignas(16) uint8_t alpha[BLEND_CHROMA_CHUNK];
+    alignas(16) uint8_t srcUV[BLEND_CHROMA_CHUNK * 2];
+    alignas(16) uint8_t alphaUV[BLEND_CHROMA_CHUNK * 2];
+
+    for (line = 0; line < h; line++)
+    {
+        pixT *dstUV = (pixT *)(u + (line + yPos) * outStrideUV) + (xPos << 1);
+        pixT *dstU = (pixT *)(u + (line + yPos) * outStrideUV) + xPos;
+        pixT *dstV = (pixT *)(v + (line + yPos) * outStrideUV) + xPos;
+
+        const uint8_t *srcU = subU + line * inStrideUV;
+        const uint8_t *srcV = subV + line * inStrideUV;
+        const uint8_t *srcA = subA + (line * inStride * (ptrdiff_t(1) << hsub));
+
+        for (col = 0; col < w; col += BLEND_CHROMA_CHUNK)
+        {
+            const int n = FFMIN(BLEND_CHROMA_CHUNK, w - col);
+
+            // Without subsampling, the luma alpha can be used directly
+            const uint8_t *a = srcA + col;
+            if (hsub || vsub)
+            {
+                blend_chroma_alpha_sse4(alpha, srcA, inStride, col, n, w, line + 1 >= h, hsub, vsub);
+                a = alpha;
+            }
+
+            if (nv12)
+            {
+                blend_interleave_uv_sse4(srcUV, alphaUV, srcU + col, srcV + col, a, n);
+                Kernel::blend_line(dstUV + (col << 1), srcUV, alphaUV, n << 1, shift);
+            }
+            else
+            {
+                Kernel::blend_line(dstU + col, srcU + col, a, n, shift);
+                Kernel::blend_line(dstV + col, srcV + col, a, n, shift);
+            }
+        }
+    }
+}
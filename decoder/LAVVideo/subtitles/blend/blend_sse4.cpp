@@ -0,0 +1,185 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "blend.h"
+#include "blend_internal.h"
+
+// Blend 8 samples, with 16-bit video and 16-bit subtitle values (already shifted to the video bit depth)
+// The products need 32-bit, so the values are biased into the signed range to be able to use pmaddwd:
+// (d - 32768) * (255 - a) + (s - 32768) * a = d * (255 - a) + s * a - 32768 * 255
+static inline __m128i blend_sse4_epu16(__m128i d, __m128i s, __m128i a)
+{
+    const __m128i bias = _mm_set1_epi16(-32768);
+    const __m128i rounding = _mm_set1_epi32(32768 * 255 + 128);
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+    const __m128i dx = _mm_xor_si128(d, bias);
+    const __m128i sx = _mm_xor_si128(s, bias);
+
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(dx, sx), _mm_unpacklo_epi16(ia, a));
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(dx, sx), _mm_unpackhi_epi16(ia, a));
+    lo = _mm_add_epi32(lo, rounding);
+    hi = _mm_add_epi32(hi, rounding);
+
+    // (x * 257) >> 16 == (x + (x >> 8)) >> 8
+    lo = _mm_srli_epi32(_mm_add_epi32(lo, _mm_srli_epi32(lo, 8)), 8);
+    hi = _mm_srli_epi32(_mm_add_epi32(hi, _mm_srli_epi32(hi, 8)), 8);
+    __m128i r = _mm_packus_epi32(lo, hi);
+
+    // Fully transparent and opaque samples are copied, the rounding of the formula is off by one for them
+    r = _mm_blendv_epi8(r, s, _mm_cmpeq_epi16(a, _mm_set1_epi16(255)));
+    return _mm_blendv_epi8(r, d, _mm_cmpeq_epi16(a, _mm_setzero_si128()));
+}
+
+// Blend 8 samples with 8-bit values in 16-bit lanes
+// With 8-bit values the formula is exact for fully transparent and opaque samples
+static inline __m128i blend_sse4_epu8(__m128i d, __m128i s, __m128i a)
+{
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_mullo_epi16(s, a));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_mulhi_epu16(x, _mm_set1_epi16(257));
+}
+
+struct BlendKernelSSE4
+{
+    static void blend_line(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift)
+    {
+        int x = 0;
+        for (; x + 16 <= n; x += 16)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+            const __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+            const __m128i a = _mm_loadu_si128((const __m128i *)(alpha + x));
+
+            __m128i lo = blend_sse4_epu8(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero),
+                                         _mm_unpacklo_epi8(a, zero));
+            __m128i hi = blend_sse4_epu8(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero),
+                                         _mm_unpackhi_epi8(a, zero));
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+        blend_line_c(dst + x, src + x, alpha + x, n - x, shift);
+    }
+
+    static void blend_line(uint16_t *dst, const uint8_t *src, const uint8_t *alpha, int n, int shift)
+    {
+        const __m128i xmmShift = _mm_cvtsi32_si128(shift);
+
+        int x = 0;
+        for (; x + 8 <= n; x += 8)
+        {
+            const __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+            const __m128i s = _mm_sll_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(src + x))), xmmShift);
+            const __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(alpha + x)));
+            _mm_storeu_si128((__m128i *)(dst + x), blend_sse4_epu16(d, s, a));
+        }
+        blend_line_c(dst + x, src + x, alpha + x, n - x, shift);
+    }
+};
+
+template <class pixT, int nv12> DECLARE_BLEND_FUNC(blend_yuv_sse4)
+{
+    assert(pixFmt == LAVPixFmt_YUV420 || pixFmt == LAVPixFmt_NV12 || pixFmt == LAVPixFmt_YUV422 ||
+           pixFmt == LAVPixFmt_YUV444 || pixFmt == LAVPixFmt_YUV420bX || pixFmt == LAVPixFmt_YUV422bX ||
+           pixFmt == LAVPixFmt_YUV444bX || pixFmt == LAVPixFmt_P016);
+
+    blend_yuv_simd<BlendKernelSSE4, pixT, nv12>(video, videoStride, subData, subStride, posX, posY, width, height,
+                                              pixFmt, bpp);
+}
+
+template void blend_yuv_sse4<uint8_t, 1> BLEND_FUNC_PARAMS;
+template void blend_yuv_sse4<uint8_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_sse4<uint16_t, 0> BLEND_FUNC_PARAMS;
+template void blend_yuv_sse4<uint16_t, 1> BLEND_FUNC_PARAMS;
+
+// Blend 4 BGRA subtitle pixels onto 4 BGRX video pixels, the X byte of the video is preserved
+static inline __m128i blend_rgb_sse4_px4(__m128i d, __m128i s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaShuf = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    const __m128i xMask = _mm_set1_epi32(0xFF000000);
+
+    const __m128i a = _mm_shuffle_epi8(s, alphaShuf);
+    const __m128i ia = _mm_xor_si128(a, _mm_set1_epi8(-1));
+
+    // FAST_DIV255(d * (255 - a))
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(ia, zero));
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(ia, zero));
+    lo = _mm_mulhi_epu16(_mm_add_epi16(lo, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+    hi = _mm_mulhi_epu16(_mm_add_epi16(hi, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+
+    // av_clip_uint8(... + src)
+    __m128i r = _mm_adds_epu8(_mm_packus_epi16(lo, hi), s);
+
+    // Fully transparent pixels are left alone
+    return _mm_blendv_epi8(r, d, _mm_or_si128(_mm_cmpeq_epi8(a, zero), xMask));
+}
+
+DECLARE_BLEND_FUNC(blend_rgb_sse4)
+{
+    assert(pixFmt == LAVPixFmt_RGB32 || pixFmt == LAVPixFmt_RGB24);
+
+    uint8_t *rgbOut = video[0];
+    const uint8_t *subIn = subData[0];
+
+    const ptrdiff_t outStride = videoStride[0];
+    const ptrdiff_t inStride = subStride[0];
+
+    const ptrdiff_t dstep = (pixFmt == LAVPixFmt_RGB24) ? 3 : 4;
+
+    // Expand 4 packed RGB24 pixels to RGB32 and back
+    const __m128i expand24 = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack24 = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *dstLine = rgbOut + ((y + posY) * outStride) + (posX * dstep);
+        const uint8_t *srcLine = subIn + (y * inStride);
+
+        int x = 0;
+        if (dstep == 4)
+        {
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i d = _mm_loadu_si128((const __m128i *)(dstLine + x * 4));
+                const __m128i s = _mm_loadu_si128((const __m128i *)(srcLine + x * 4));
+                _mm_storeu_si128((__m128i *)(dstLine + x * 4), blend_rgb_sse4_px4(d, s));
+            }
+        }
+        else
+        {
+            for (; x + 4 <= width; x += 4)
+            {
+                uint8_t *dst = dstLine + x * 3;
+                __m128i d = _mm_loadl_epi64((const __m128i *)dst);
+                d = _mm_insert_epi32(d, *(const int *)(dst + 8), 2);
+                d = _mm_shuffle_epi8(d, expand24);
+
+                const __m128i s = _mm_loadu_si128((const __m128i *)(srcLine + x * 4));
+                const __m128i r = _mm_shuffle_epi8(blend_rgb_sse4_px4(d, s), pack24);
+                _mm_storel_epi64((__m128i *)dst, r);
+                *(int *)(dst + 8) = _mm_extract_epi32(r, 2);
+            }
+        }
+
+        for (; x < width; x++)
+            blend_rgb_px_c(dstLine + x * dstep, srcLine + x * 4);
+    }
+}
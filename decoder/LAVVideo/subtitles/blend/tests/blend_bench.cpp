@@ -0,0 +1,77 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Speed of the blend kernels
+//
+//   blend_bench [repeats]
+//
+// Blends a 1920x300 subtitle area at the bottom of a 1080p frame, as with a typical two-line subtitle, with every
+// kernel the CPU supports. Reports the time per blend, the throughput in MPix/s and the speedup over the C kernel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "blend_test_utils.h"
+
+int main(int argc, char *argv[])
+{
+    const int repeats = argc > 1 ? atoi(argv[1]) : 200;
+    const int cpuFlags = av_get_cpu_flags();
+    const int width = 1920, height = 1080;
+    const int subWidth = 1920, subHeight = 300;
+    std::mt19937 rng(1);
+
+    printf("%-10s %-5s %10s %10s %8s\n", "format", "cpu", "ms/blend", "MPix/s", "speedup");
+    for (const BlendFormat &fmt : blend_formats)
+    {
+        BlendSubtitle sub(fmt, subWidth, subHeight, BlendAlpha_Random, rng);
+        uint8_t *subData[4];
+        sub.GetData(subData);
+
+        double ref = 0.0;
+        for (int i = 0; i < 3; i++)
+        {
+            if ((cpuFlags & blend_cpus[i].flags) != blend_cpus[i].flags)
+                continue;
+
+            BlendFn fn = blend_select_function(fmt.pixFmt, blend_cpus[i].flags);
+            if (i > 0 && fn == blend_select_function(fmt.pixFmt, blend_cpus[i - 1].flags))
+                continue;
+
+            // blending onto the same frame over and over doesn't change the amount of work
+            BlendVideo video(fmt, width, height, rng);
+            uint8_t *videoData[4];
+            video.GetData(videoData);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int n = 0; n < repeats; n++)
+                fn(videoData, video.stride, subData, sub.stride, 0, height - subHeight, subWidth, subHeight,
+                   fmt.pixFmt, fmt.bpp);
+            const double ms =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+            if (i == 0)
+                ref = ms;
+            printf("%-10s %-5s %10.3f %10.1f %7.2fx\n", fmt.name, blend_cpus[i].name, ms,
+                   subWidth * subHeight / (ms * 1000.0), ref / ms);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Bit-exactness test of the SIMD blend kernels against the C kernels
+//
+//   blend_test [iterations]
+//
+// Blends random subtitles of random sizes at random positions onto random video with every kernel the CPU supports,
+// and compares the result with the C kernel. The sizes cover all the remainders the SIMD loops leave for the C code.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blend_test_utils.h"
+
+int main(int argc, char *argv[])
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 300;
+    const int cpuFlags = av_get_cpu_flags();
+    std::mt19937 rng(1);
+
+    int failures = 0;
+    for (const BlendFormat &fmt : blend_formats)
+    {
+        int tested[3] = {0, 0, 0};
+        for (int n = 0; n < iterations; n++)
+        {
+            const int width = 64 + rng() % 300, height = 64 + rng() % 200;
+            const int subWidth = 1 + rng() % (width - 1), subHeight = 1 + rng() % (height - 1);
+            const int posX = rng() % (width - subWidth + 1), posY = rng() % (height - subHeight + 1);
+
+            BlendSubtitle sub(fmt, subWidth, subHeight, (BlendAlpha)(rng() % 4), rng);
+            uint8_t *subData[4];
+            sub.GetData(subData);
+
+            const BlendVideo video(fmt, width, height, rng);
+            BlendVideo ref = video;
+            uint8_t *refData[4];
+            ref.GetData(refData);
+
+            BlendFn ref_fn = blend_select_function(fmt.pixFmt, blend_cpus[0].flags);
+            ref_fn(refData, ref.stride, subData, sub.stride, posX, posY, subWidth, subHeight, fmt.pixFmt, fmt.bpp);
+
+            for (int i = 1; i < 3; i++)
+            {
+                if ((cpuFlags & blend_cpus[i].flags) != blend_cpus[i].flags)
+                    continue;
+
+                // formats without a kernel for this instruction set get the one of the previous set
+                BlendFn fn = blend_select_function(fmt.pixFmt, blend_cpus[i].flags);
+                if (fn == blend_select_function(fmt.pixFmt, blend_cpus[i - 1].flags))
+                    continue;
+
+                BlendVideo out = video;
+                uint8_t *outData[4];
+                out.GetData(outData);
+                fn(outData, out.stride, subData, sub.stride, posX, posY, subWidth, subHeight, fmt.pixFmt, fmt.bpp);
+                tested[i]++;
+
+                for (int p = 0; p < 3; p++)
+                {
+                    if (out.planes[p] != ref.planes[p])
+                    {
+                        if (failures < 20)
+                            printf("%s %s: plane %d differs, video %dx%d, subtitle %dx%d at %d,%d\n", fmt.name,
+                                   blend_cpus[i].name, p, width, height, subWidth, subHeight, posX, posY);
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+        printf("%s: %d SSE4 and %d AVX2 blends compared\n", fmt.name, tested[1], tested[2]);
+    }
+
+    if (failures)
+    {
+        printf("FAILED, %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// Helpers shared by the blend test and benchmark
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+#include "blend.h"
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+};
+
+struct BlendFormat
+{
+    LAVPixelFormat pixFmt;
+    int bpp;
+    const char *name;
+};
+
+// Every format the consumer blends onto, the high bit-depth ones with a few different depths
+static const BlendFormat blend_formats[] = {
+    {LAVPixFmt_RGB32, 8, "RGB32"},           {LAVPixFmt_RGB24, 8, "RGB24"},
+    {LAVPixFmt_NV12, 8, "NV12"},             {LAVPixFmt_P016, 16, "P016"},
+    {LAVPixFmt_YUV420, 8, "YUV420"},         {LAVPixFmt_YUV422, 8, "YUV422"},
+    {LAVPixFmt_YUV444, 8, "YUV444"},         {LAVPixFmt_YUV420bX, 10, "YUV420P10"},
+    {LAVPixFmt_YUV422bX, 12, "YUV422P12"},   {LAVPixFmt_YUV444bX, 16, "YUV444P16"},
+};
+
+// Instruction sets the kernels are selected with, the first one is the C reference
+struct BlendCpu
+{
+    int flags;
+    const char *name;
+};
+
+static const BlendCpu blend_cpus[] = {
+    {0, "C"},
+    {AV_CPU_FLAG_SSE4, "SSE4"},
+    {AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_AVX2, "AVX2"},
+};
+
+// Alpha distribution of the generated subtitles
+enum BlendAlpha
+{
+    BlendAlpha_Mixed,       ///< mostly fully transparent or opaque, like real subtitles
+    BlendAlpha_Transparent, ///< only 0
+    BlendAlpha_Opaque,      ///< only 255
+    BlendAlpha_Random,      ///< uniformly random
+};
+
+static inline bool blend_is_rgb(LAVPixelFormat pixFmt)
+{
+    return pixFmt == LAVPixFmt_RGB32 || pixFmt == LAVPixFmt_RGB24;
+}
+
+static inline bool blend_is_nv12(LAVPixelFormat pixFmt)
+{
+    return pixFmt == LAVPixFmt_NV12 || pixFmt == LAVPixFmt_P016;
+}
+
+// Video planes with random content, the strides are padded to catch stride mixups
+struct BlendVideo
+{
+    std::vector<uint8_t> planes[3];
+    ptrdiff_t stride[4] = {0, 0, 0, 0};
+
+    BlendVideo(const BlendFormat &fmt, int width, int height, std::mt19937 &rng)
+    {
+        if (blend_is_rgb(fmt.pixFmt))
+        {
+            stride[0] = width * (fmt.pixFmt == LAVPixFmt_RGB24 ? 3 : 4) + 7;
+            planes[0].resize(stride[0] * height);
+        }
+        else
+        {
+            const int bps = fmt.bpp > 8 ? 2 : 1;
+            const bool nv12 = blend_is_nv12(fmt.pixFmt);
+            const bool hsub = nv12 || fmt.pixFmt == LAVPixFmt_YUV420 || fmt.pixFmt == LAVPixFmt_YUV420bX;
+            stride[0] = width * bps + 9;
+            stride[1] = stride[2] = (nv12 || !hsub ? width : width >> 1) * bps + 11;
+            for (int i = 0; i < (nv12 ? 2 : 3); i++)
+                planes[i].resize(stride[i] * height);
+        }
+
+        // high bit-depth samples stay within their bit depth
+        const int hiMask = fmt.bpp > 8 ? (1 << (fmt.bpp - 8)) - 1 : 0xff;
+        for (std::vector<uint8_t> &plane : planes)
+        {
+            for (size_t i = 0; i < plane.size(); i++)
+                plane[i] = (fmt.bpp > 8 && (i & 1)) ? rng() & hiMask : rng();
+        }
+    }
+
+    void GetData(uint8_t *data[4])
+    {
+        for (int i = 0; i < 3; i++)
+            data[i] = planes[i].empty() ? nullptr : planes[i].data();
+        data[3] = nullptr;
+    }
+};
+
+// Subtitle planes as prepared by the consumer: premultiplied BGRA for RGB video, Y/U/V/A planes for YUV video
+struct BlendSubtitle
+{
+    std::vector<uint8_t> planes[4];
+    ptrdiff_t stride[4] = {0, 0, 0, 0};
+
+    BlendSubtitle(const BlendFormat &fmt, int width, int height, BlendAlpha alphaMode, std::mt19937 &rng)
+    {
+        auto alpha = [&]() -> uint8_t {
+            switch (alphaMode)
+            {
+            case BlendAlpha_Transparent: return 0;
+            case BlendAlpha_Opaque: return 255;
+            case BlendAlpha_Mixed: {
+                const unsigned r = rng() % 8;
+                return r < 2 ? 0 : r < 4 ? 255 : rng();
+            }
+            default: return rng();
+            }
+        };
+
+        if (blend_is_rgb(fmt.pixFmt))
+        {
+            stride[0] = width * 4 + 5;
+            planes[0].resize(stride[0] * height);
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    uint8_t *p = &planes[0][y * stride[0] + x * 4];
+                    p[3] = alpha();
+                    for (int c = 0; c < 3; c++)
+                        p[c] = (rng() & 0xff) * p[3] / 255;
+                    // not properly premultiplied, to test the clipping
+                    if (rng() % 16 == 0)
+                        p[0] = rng();
+                }
+            }
+        }
+        else
+        {
+            // the chroma planes are larger than needed for any subsampling
+            stride[0] = stride[3] = width + 13;
+            stride[1] = stride[2] = width + 3;
+            for (int i = 0; i < 4; i++)
+            {
+                planes[i].resize(stride[i] * height);
+                for (uint8_t &v : planes[i])
+                    v = i == 3 ? alpha() : rng();
+            }
+        }
+    }
+
+    void GetData(uint8_t *data[4])
+    {
+        for (int i = 0; i < 4; i++)
+            data[i] = planes[i].empty() ? nullptr : planes[i].data();
+    }
+};
@@ -508,7 +508,7 @@ STDMETHODIMP CBDDemuxer::FillMVCExtensionQueue(REFERENCE_TIME rtBase)
                 found = true;
             }
 
-            Packet *pPacket = new Packet();
+            Packet *pPacket = Packet::Create(m_lavfDemuxer->GetPacketArena());
             if (!pPacket)
             {
                 av_packet_free(&pMVCPacket);
@@ -99,6 +99,12 @@ class CBDDemuxer
             return m_lavfDemuxer->GetHasBFrames(dwStream);
         return -1;
     }
+    CPacketArena *GetPacketArena()
+    {
+        if (m_lavfDemuxer)
+            return m_lavfDemuxer->GetPacketArena();
+        return nullptr;
+    }
 
     const stream *SelectVideoStream() { return m_lavfDemuxer->SelectVideoStream(); }
     const stream *SelectVideoELStream(DWORD dwVideoStreamPID)
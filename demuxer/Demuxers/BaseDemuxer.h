@@ -23,6 +23,7 @@
 
 #include "StreamInfo.h"
 #include "Packet.h"
+#include "PacketArena.h"
 #include "IMediaSideDataFFmpeg.h"
 
 #define DSHOW_TIME_BASE 10000000 // DirectShow times are in 100ns units
@@ -137,6 +138,9 @@ class CBaseDemuxer : public CUnknown
         return E_NOTIMPL;
     }
 
+    // Get the arena the packets of this demuxer are allocated from, if any
+    virtual CPacketArena *GetPacketArena() { return nullptr; }
+
   public:
     class CStreamList : public std::deque<stream>
     {
@@ -20,6 +20,8 @@
 #include "stdafx.h"
 #include "ExtradataParser.h"
 
+#include "StartCode.h"
+
 #define MARKER           \
     if (BitRead(1) != 1) \
     {                    \
@@ -39,14 +41,18 @@ CExtradataParser::~CExtradataParser()
 bool CExtradataParser::NextMPEGStartCode(BYTE &code)
 {
     BitByteAlign();
-    DWORD dw = (DWORD)-1;
-    do
+
+    const BYTE *pStart = Start() + Pos();
+    const BYTE *pStartCode = find_sync_word(pStart, End(), 0x00000100, 0xffffff00);
+    if (pStartCode == End())
     {
-        if (!Remaining())
-            return false;
-        dw = (dw << 8) | (BYTE)BitRead(8);
-    } while ((dw & 0xffffff00) != 0x00000100);
-    code = (BYTE)(dw & 0xff);
+        BitSkip((unsigned int)(Remaining() << 3));
+        return false;
+    }
+
+    // Skip past the start code, including its code byte
+    BitSkip((unsigned int)((pStartCode + 4 - pStart) << 3));
+    code = pStartCode[3];
     return true;
 }
 
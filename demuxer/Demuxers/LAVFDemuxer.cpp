@@ -88,6 +88,8 @@ CLAVFDemuxer::CLAVFDemuxer(CCritSec *pLock, ILAVFSettingsInternal *settings)
     av_log_set_callback(nullptr);
 #endif
 
+    m_pPacketArena = new CPacketArena();
+
     m_bSubStreams = settings->GetSubstreamsEnabled();
 
     m_pSettings = settings;
@@ -129,6 +131,7 @@ CLAVFDemuxer::~CLAVFDemuxer()
 {
     CleanupAVFormat();
     SAFE_DELETE(m_pFontInstaller);
+    SafeRelease(&m_pPacketArena);
 }
 
 STDMETHODIMP CLAVFDemuxer::NonDelegatingQueryInterface(REFIID riid, void **ppv)
@@ -1577,7 +1580,7 @@ STDMETHODIMP CLAVFDemuxer::GetNextPacket(Packet **ppPacket)
             }
         }
 
-        pPacket = new Packet();
+        pPacket = Packet::Create(m_pPacketArena);
         if (!pPacket)
             return E_OUTOFMEMORY;
 
@@ -2009,7 +2012,9 @@ Packet* CLAVFDemuxer::CreateRPUPacketFromEL(Packet* pPacketEL)
         {
             int nDataSize = (int)Nalu.GetDataLength();
 
-            Packet *pRPUPacket = new Packet();
+            Packet *pRPUPacket = Packet::Create(m_pPacketArena);
+            if (!pRPUPacket)
+                return NULL;
 
             pRPUPacket->SetDataSize(nDataSize + nBLHeaderSize);
             BYTE *dst = pRPUPacket->GetData();
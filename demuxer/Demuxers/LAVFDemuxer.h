@@ -101,6 +101,7 @@ class CLAVFDemuxer
     STDMETHODIMP_(int) GetPixelFormat(DWORD dwStream);
     STDMETHODIMP_(int) GetHasBFrames(DWORD dwStream);
     STDMETHODIMP GetSideData(DWORD dwStream, GUID guidType, const BYTE **pData, size_t *pSize);
+    CPacketArena *GetPacketArena() { return m_pPacketArena; }
 
     // IAMExtendedSeeking
     STDMETHODIMP get_ExSeekCapabilities(long *pExCapabilities);
@@ -212,6 +213,8 @@ class CLAVFDemuxer
     AVFormatContext *m_avFormat = nullptr;
     const char *m_pszInputFormat = nullptr;
 
+    CPacketArena *m_pPacketArena = nullptr;
+
     BOOL m_bMatroska = FALSE;
     BOOL m_bOgg = FALSE;
     BOOL m_bAVI = FALSE;
@@ -20,6 +20,18 @@
 #include <stdafx.h>
 #include "Packet.h"
 
+#include "PacketArena.h"
+
+#include <new>
+
+// Every packet is preceded by a header remembering the arena it belongs to
+// The header size keeps the packet itself aligned like any other heap allocation
+struct PacketHeader
+{
+    CPacketArena *pArena;
+};
+#define PACKET_HEADER_SIZE 16
+
 Packet::Packet()
 {
 }
@@ -27,32 +39,109 @@ Packet::Packet()
 Packet::~Packet()
 {
     DeleteMediaType(pmt);
-    av_packet_free(&m_Packet);
+    if (m_pArena)
+        m_pArena->FreeAVPacket(&m_Packet);
+    else
+        av_packet_free(&m_Packet);
 }
 
-int Packet::SetDataSize(int len)
+Packet *Packet::Create(CPacketArena *pArena)
 {
-    if (len < 0)
-        return -1;
+    if (!pArena)
+        return new Packet();
 
-    if (len <= GetDataSize())
+    BYTE *ptr = (BYTE *)pArena->AllocPacketMemory(PACKET_HEADER_SIZE + sizeof(Packet));
+    if (!ptr)
+        return nullptr;
+
+    pArena->AddRef();
+    ((PacketHeader *)ptr)->pArena = pArena;
+
+    Packet *pPacket = ::new (ptr + PACKET_HEADER_SIZE) Packet();
+    pPacket->m_pArena = pArena;
+    return pPacket;
+}
+
+void *Packet::operator new(size_t size)
+{
+    BYTE *ptr = (BYTE *)malloc(PACKET_HEADER_SIZE + size);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    ((PacketHeader *)ptr)->pArena = nullptr;
+    return ptr + PACKET_HEADER_SIZE;
+}
+
+void Packet::operator delete(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    BYTE *block = (BYTE *)ptr - PACKET_HEADER_SIZE;
+    CPacketArena *pArena = ((PacketHeader *)block)->pArena;
+    if (pArena)
     {
-        av_shrink_packet(m_Packet, len);
-        return 0;
+        pArena->FreePacketMemory(block);
+        pArena->Release();
+    }
+    else
+    {
+        free(block);
     }
+}
 
+int Packet::Reserve(int len)
+{
     if (!m_Packet)
     {
-        m_Packet = av_packet_alloc();
-        if (av_new_packet(m_Packet, len) < 0)
+        m_Packet = m_pArena ? m_pArena->AllocAVPacket() : av_packet_alloc();
+        if (!m_Packet)
             return -1;
     }
-    else
+
+    if (len < 0 || len > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return -1;
+
+    const size_t required = (size_t)len + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (m_Packet->buf && av_buffer_is_writable(m_Packet->buf) &&
+        (size_t)m_Packet->buf->size - (m_Packet->data - m_Packet->buf->data) >= required)
+        return 0;
+
+    // Grow at least by a factor of two, so that appending data repeatedly is amortized linear
+    int capacity = len;
+    if (m_Packet->size > 0 && capacity < (INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE) / 2)
+        capacity = max(capacity, m_Packet->size * 2);
+
+    AVBufferRef *buf = m_pArena ? m_pArena->AllocBuffer(capacity)
+                                : av_buffer_alloc((size_t)capacity + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return -1;
+
+    if (m_Packet->size > 0)
+        memcpy(buf->data, m_Packet->data, m_Packet->size);
+
+    av_buffer_unref(&m_Packet->buf);
+    m_Packet->buf = buf;
+    m_Packet->data = buf->data;
+    return 0;
+}
+
+int Packet::SetDataSize(int len)
+{
+    if (len < 0)
+        return -1;
+
+    if (len <= GetDataSize())
     {
-        if (av_grow_packet(m_Packet, (len - m_Packet->size)) < 0)
-            return -1;
+        av_shrink_packet(m_Packet, len);
+        return 0;
     }
 
+    if (Reserve(len) < 0)
+        return -1;
+
+    m_Packet->size = len;
+    memset(m_Packet->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
     return 0;
 }
 
@@ -72,7 +161,7 @@ int Packet::SetPacket(AVPacket *pkt)
 {
     ASSERT(!m_Packet);
 
-    m_Packet = av_packet_alloc();
+    m_Packet = m_pArena ? m_pArena->AllocAVPacket() : av_packet_alloc();
     if (!m_Packet)
         return -1;
 
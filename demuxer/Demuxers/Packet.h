@@ -19,6 +19,8 @@
 
 #pragma once
 
+class CPacketArena;
+
 // Data Packet for queue storage
 class Packet
 {
@@ -28,6 +30,16 @@ class Packet
     Packet();
     ~Packet();
 
+    // Create a packet from the given arena, its payload will then be allocated from the arena as well
+    // Without an arena, this is equivalent to new Packet()
+    static Packet *Create(CPacketArena *pArena);
+
+    // Packets are always allocated through these, to return the memory to the arena they were created from
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
+    CPacketArena *GetArena() const { return m_pArena; }
+
     int GetDataSize() const { return m_Packet ? m_Packet->size : 0; }
     BYTE *GetData() { return m_Packet ? m_Packet->data : nullptr; }
 
@@ -69,5 +81,10 @@ class Packet
     DWORD dwFlags = 0;
 
   private:
+    // Make sure the payload buffer is writable and can hold len bytes
+    int Reserve(int len);
+
+  private:
+    CPacketArena *m_pArena = nullptr;
     AVPacket *m_Packet = nullptr;
 };
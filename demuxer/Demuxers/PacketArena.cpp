@@ -0,0 +1,151 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "PacketArena.h"
+
+CPacketArena::CPacketArena()
+{
+    for (int i = 0; i < PACKET_ARENA_SLAB_CLASSES; i++)
+        m_pSlabs[i] = av_buffer_pool_init2(1 << (PACKET_ARENA_MIN_SLAB_SHIFT + i), this, SlabAlloc, nullptr);
+}
+
+CPacketArena::~CPacketArena()
+{
+    // Buffers that are still referenced are freed once they are released
+    for (int i = 0; i < PACKET_ARENA_SLAB_CLASSES; i++)
+        av_buffer_pool_uninit(&m_pSlabs[i]);
+
+    for (void *ptr : m_IdlePackets)
+        free(ptr);
+
+    for (AVPacket *pkt : m_IdleAVPackets)
+        av_packet_free(&pkt);
+}
+
+ULONG CPacketArena::AddRef()
+{
+    return ++m_cRef;
+}
+
+ULONG CPacketArena::Release()
+{
+    ULONG cRef = --m_cRef;
+    if (cRef == 0)
+        delete this;
+    return cRef;
+}
+
+AVBufferRef *CPacketArena::SlabAlloc(void *opaque, size_t size)
+{
+    CPacketArena *pArena = (CPacketArena *)opaque;
+    pArena->m_llAllocations++;
+    return av_buffer_alloc(size);
+}
+
+AVBufferRef *CPacketArena::AllocBuffer(int size)
+{
+    if (size < 0 || size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return nullptr;
+
+    const size_t total = (size_t)size + AV_INPUT_BUFFER_PADDING_SIZE;
+    for (int i = 0; i < PACKET_ARENA_SLAB_CLASSES; i++)
+    {
+        if (total <= ((size_t)1 << (PACKET_ARENA_MIN_SLAB_SHIFT + i)) && m_pSlabs[i])
+            return av_buffer_pool_get(m_pSlabs[i]);
+    }
+
+    m_llAllocations++;
+    return av_buffer_alloc(total);
+}
+
+void *CPacketArena::AllocPacketMemory(size_t size)
+{
+    {
+        CAutoLock lock(&m_csArena);
+        if (!m_IdlePackets.empty())
+        {
+            void *ptr = m_IdlePackets.back();
+            m_IdlePackets.pop_back();
+            m_llRecycled++;
+            return ptr;
+        }
+    }
+
+    m_llAllocations++;
+    return malloc(size);
+}
+
+void CPacketArena::FreePacketMemory(void *ptr)
+{
+    {
+        CAutoLock lock(&m_csArena);
+        if (m_IdlePackets.size() < PACKET_ARENA_MAX_IDLE)
+        {
+            m_IdlePackets.push_back(ptr);
+            return;
+        }
+    }
+
+    free(ptr);
+}
+
+AVPacket *CPacketArena::AllocAVPacket()
+{
+    {
+        CAutoLock lock(&m_csArena);
+        if (!m_IdleAVPackets.empty())
+        {
+            AVPacket *pkt = m_IdleAVPackets.back();
+            m_IdleAVPackets.pop_back();
+            return pkt;
+        }
+    }
+
+    m_llAllocations++;
+    return av_packet_alloc();
+}
+
+void CPacketArena::FreeAVPacket(AVPacket **ppPacket)
+{
+    if (!*ppPacket)
+        return;
+
+    av_packet_unref(*ppPacket);
+    {
+        CAutoLock lock(&m_csArena);
+        if (m_IdleAVPackets.size() < PACKET_ARENA_MAX_IDLE)
+        {
+            m_IdleAVPackets.push_back(*ppPacket);
+            *ppPacket = nullptr;
+            return;
+        }
+    }
+
+    av_packet_free(ppPacket);
+}
+
+void CPacketArena::GetStats(LONGLONG *pAllocations, LONGLONG *pRecycled)
+{
+    CAutoLock lock(&m_csArena);
+    if (pAllocations)
+        *pAllocations = m_llAllocations;
+    if (pRecycled)
+        *pRecycled = m_llRecycled;
+}
@@ -0,0 +1,74 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#define PACKET_ARENA_MAX_IDLE 256      // Number of deleted packets kept for re-use
+#define PACKET_ARENA_MIN_SLAB_SHIFT 10 // Smallest payload slab, 1 KiB
+#define PACKET_ARENA_MAX_SLAB_SHIFT 22 // Largest payload slab, 4 MiB, anything above is allocated directly
+#define PACKET_ARENA_SLAB_CLASSES (PACKET_ARENA_MAX_SLAB_SHIFT - PACKET_ARENA_MIN_SLAB_SHIFT + 1)
+
+class Packet;
+
+// Memory arena for the packets of one demuxer
+//
+// Deleted packets are kept on a free list to be re-used for the next packets, and their payloads
+// are allocated from refcounted buffer pools in power-of-two size classes.
+// Every packet holds a reference on the arena, so it stays valid until the last of its packets is
+// deleted, even if the demuxer is destroyed before that.
+class CPacketArena
+{
+  public:
+    CPacketArena();
+
+    ULONG AddRef();
+    ULONG Release();
+
+    // Allocate a payload buffer for at least size bytes, plus the input padding
+    AVBufferRef *AllocBuffer(int size);
+
+    // Number of heap allocations for packets and payloads, and the number of packets that were recycled
+    void GetStats(LONGLONG *pAllocations, LONGLONG *pRecycled);
+
+  private:
+    ~CPacketArena();
+
+    friend class Packet;
+    void *AllocPacketMemory(size_t size);
+    void FreePacketMemory(void *ptr);
+    AVPacket *AllocAVPacket();
+    void FreeAVPacket(AVPacket **ppPacket);
+
+    static AVBufferRef *SlabAlloc(void *opaque, size_t size);
+
+  private:
+    std::atomic<ULONG> m_cRef{1};
+
+    CCritSec m_csArena;
+    std::vector<void *> m_IdlePackets;
+    std::vector<AVPacket *> m_IdleAVPackets;
+
+    AVBufferPool *m_pSlabs[PACKET_ARENA_SLAB_CLASSES] = {0};
+
+    std::atomic<LONGLONG> m_llAllocations{0};
+    LONGLONG m_llRecycled = 0;
+};
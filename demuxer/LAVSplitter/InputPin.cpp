@@ -31,6 +31,9 @@ CLAVInputPin::CLAVInputPin(TCHAR *pName, CLAVSplitter *pFilter, CCritSec *pLock,
 
 CLAVInputPin::~CLAVInputPin(void)
 {
+    SAFE_DELETE(m_pReadAhead);
+    SAFE_DELETE(m_pSource);
+
     if (m_pAVIOContext)
     {
         av_free(m_pAVIOContext->buffer);
@@ -85,6 +88,8 @@ HRESULT CLAVInputPin::BreakConnect()
         return hr;
     }
 
+    SAFE_DELETE(m_pReadAhead);
+    SAFE_DELETE(m_pSource);
     SafeRelease(&m_pAsyncReader);
     SafeRelease(&m_pStreamControl);
 
@@ -113,6 +118,9 @@ HRESULT CLAVInputPin::CompleteConnect(IPin *pPin)
         return E_FAIL;
     }
 
+    // All reads go through the source, so the demuxer and the prefetch worker don't use the reader concurrently
+    m_pSource = new CAsyncReaderSource(m_pAsyncReader);
+
     m_llPos = 0;
     m_bURLSource = false;
 
@@ -135,6 +143,12 @@ HRESULT CLAVInputPin::CompleteConnect(IPin *pPin)
         SafeRelease(&(pinInfo.pFilter));
     }
 
+    // Prefetch ahead of the demuxer on sources with a known length
+    // The URL source is excluded, its read semantics at the end of the stream are handled in Read
+    LONGLONG total = 0, available = 0;
+    if (!m_bURLSource && S_OK == m_pSource->Length(&total, &available) && total > 0)
+        m_pReadAhead = new CReadAheadCache(m_pSource);
+
     if (FAILED(hr = (static_cast<CLAVSplitter *>(m_pFilter))->CompleteInputConnection()))
     {
         return hr;
@@ -146,13 +160,30 @@ HRESULT CLAVInputPin::CompleteConnect(IPin *pPin)
 int CLAVInputPin::Read(void *opaque, uint8_t *buf, int buf_size)
 {
     CLAVInputPin *pin = static_cast<CLAVInputPin *>(opaque);
+
+    // The cache can wait for a block to arrive, don't hold the pin lock while it does
+    if (pin->m_pReadAhead)
+    {
+        LONGLONG llPos = 0;
+        {
+            CAutoLock lock(pin);
+            llPos = pin->m_llPos;
+        }
+        if (pin->m_pReadAhead->Read(llPos, buf_size, buf) == S_OK)
+        {
+            CAutoLock lock(pin);
+            pin->m_llPos = llPos + buf_size;
+            return buf_size;
+        }
+    }
+
     CAutoLock lock(pin);
 
     // The URL source doesn't properly signal EOF in all cases, so make sure no stale data is in the buffer
     if (pin->m_bURLSource)
         memset(buf, 0, buf_size);
 
-    HRESULT hr = pin->m_pAsyncReader->SyncRead(pin->m_llPos, buf_size, buf);
+    HRESULT hr = pin->m_pSource->SyncRead(pin->m_llPos, buf_size, buf);
     if (FAILED(hr))
     {
         DbgLog((LOG_TRACE, 10, L"Read failed at pos: %I64d, hr: 0x%X", pin->m_llPos, hr));
@@ -164,7 +195,7 @@ int CLAVInputPin::Read(void *opaque, uint8_t *buf, int buf_size)
     {
         LONGLONG total = 0, available = 0;
         int read = buf_size;
-        if (S_OK == pin->m_pAsyncReader->Length(&total, &available) && total >= pin->m_llPos &&
+        if (S_OK == pin->m_pSource->Length(&total, &available) && total >= pin->m_llPos &&
             total <= (pin->m_llPos + buf_size))
         {
             read = (int)(total - pin->m_llPos);
@@ -178,7 +209,7 @@ int CLAVInputPin::Read(void *opaque, uint8_t *buf, int buf_size)
     {
         LONGLONG total = 0, available = 0;
         int read = 0;
-        if (S_OK == pin->m_pAsyncReader->Length(&total, &available) && total >= pin->m_llPos &&
+        if (S_OK == pin->m_pSource->Length(&total, &available) && total >= pin->m_llPos &&
             total <= (pin->m_llPos + buf_size))
         {
             read = (int)(total - pin->m_llPos);
@@ -190,7 +221,7 @@ int CLAVInputPin::Read(void *opaque, uint8_t *buf, int buf_size)
                     pin->m_llPos));
             do
             {
-                hr = pin->m_pAsyncReader->SyncRead(pin->m_llPos, 1, buf + read);
+                hr = pin->m_pSource->SyncRead(pin->m_llPos, 1, buf + read);
             } while (hr == S_OK && (++read) < buf_size);
             DbgLog((LOG_TRACE, 10, L"-> Read %d bytes", read));
         }
@@ -208,7 +239,7 @@ int64_t CLAVInputPin::Seek(void *opaque, int64_t offset, int whence)
 
     LONGLONG total = 0;
     LONGLONG available = 0;
-    pin->m_pAsyncReader->Length(&total, &available);
+    pin->m_pSource->Length(&total, &available);
 
     if (whence == SEEK_SET)
     {
@@ -239,7 +270,7 @@ int64_t CLAVInputPin::Seek(void *opaque, int64_t offset, int whence)
 
 HRESULT CLAVInputPin::GetAVIOContext(AVIOContext **ppContext)
 {
-    CheckPointer(m_pAsyncReader, E_UNEXPECTED);
+    CheckPointer(m_pSource, E_UNEXPECTED);
     CheckPointer(ppContext, E_POINTER);
 
     if (!m_pAVIOContext)
@@ -249,7 +280,7 @@ HRESULT CLAVInputPin::GetAVIOContext(AVIOContext **ppContext)
 
         LONGLONG total = 0;
         LONGLONG available = 0;
-        HRESULT hr = m_pAsyncReader->Length(&total, &available);
+        HRESULT hr = m_pSource->Length(&total, &available);
         if (FAILED(hr) || total == 0)
         {
             DbgLog((LOG_TRACE, 10, L"CLAVInputPin::GetAVIOContext(): getting file length failed, disabling seeking"));
@@ -279,6 +310,10 @@ STDMETHODIMP CLAVInputPin::SeekStream(REFERENCE_TIME rtPosition)
     HRESULT hr = m_pStreamControl->SeekStream(rtPosition);
     if (SUCCEEDED(hr))
     {
+        // drop any prefetched data, the source has a new position
+        if (m_pReadAhead)
+            m_pReadAhead->Invalidate();
+
         // flush the avio context to remove any buffered data
         if (m_pAVIOContext)
         {
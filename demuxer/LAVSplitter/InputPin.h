@@ -20,6 +20,7 @@
 #pragma once
 
 #include "IStreamSourceControl.h"
+#include "ReadAhead.h"
 
 class CLAVSplitter;
 
@@ -63,7 +64,9 @@ class CLAVInputPin
 
   private:
     IAsyncReader *m_pAsyncReader = nullptr;
+    CAsyncReaderSource *m_pSource = nullptr;
     AVIOContext *m_pAVIOContext = nullptr;
+    CReadAheadCache *m_pReadAhead = nullptr;
 
     IStreamSourceControl *m_pStreamControl = nullptr;
 
@@ -30,6 +30,7 @@
 #include "BDDemuxer.h"
 
 #include <Shlwapi.h>
+#include <Psapi.h>
 #include <string>
 #include <regex>
 #include <algorithm>
@@ -334,7 +335,7 @@ STDMETHODIMP CLAVSplitter::NonDelegatingQueryInterface(REFIID riid, void **ppv)
     }
 
     return QI(IMediaSeeking) QI(IAMStreamSelect) QI(ISpecifyPropertyPages) QI(ISpecifyPropertyPages2) QI2(ILAVFSettings)
-        QI2(ILAVFSettingsInternal) QI2(ILAVFSettingsEnhancementLayers) QI(IObjectWithSite) QI(IBufferInfo) __super::NonDelegatingQueryInterface(riid, ppv);
+        QI2(ILAVFSettingsInternal) QI2(ILAVFSettingsEnhancementLayers) QI(IObjectWithSite) QI(IBufferInfo) QI(ILAVFPacketStats) __super::NonDelegatingQueryInterface(riid, ppv);
 }
 
 // ISpecifyPropertyPages2
@@ -436,6 +437,53 @@ STDMETHODIMP_(DWORD) CLAVSplitter::GetPriority()
     return 0;
 }
 
+// ILAVFPacketStats
+STDMETHODIMP CLAVSplitter::GetPacketStats(LONGLONG *pllAllocations, LONGLONG *pllRecycled, double *pdAllocationsPerSec,
+                                          SIZE_T *pPeakRSS)
+{
+    // Hold a reference on the arena, the demuxer can be closed at any time
+    CPacketArena *pArena = nullptr;
+    {
+        CAutoLock cAutoLock(this);
+        if (m_pDemuxer && (pArena = m_pDemuxer->GetPacketArena()) != nullptr)
+            pArena->AddRef();
+    }
+
+    LONGLONG llAllocations = 0, llRecycled = 0;
+    if (pArena)
+    {
+        pArena->GetStats(&llAllocations, &llRecycled);
+        pArena->Release();
+    }
+
+    CAutoLock statsLock(&m_csPacketStats);
+
+    if (pllAllocations)
+        *pllAllocations = llAllocations;
+    if (pllRecycled)
+        *pllRecycled = llRecycled;
+
+    // The rate is measured over the interval since the previous call
+    const ULONGLONG ullNow = GetTickCount64();
+    if (pdAllocationsPerSec)
+    {
+        *pdAllocationsPerSec = 0.0;
+        if (m_ullPacketStatsTime != 0 && ullNow > m_ullPacketStatsTime && llAllocations >= m_llPacketStatsAllocations)
+            *pdAllocationsPerSec =
+                (llAllocations - m_llPacketStatsAllocations) * 1000.0 / (double)(ullNow - m_ullPacketStatsTime);
+    }
+    m_llPacketStatsAllocations = llAllocations;
+    m_ullPacketStatsTime = ullNow;
+
+    if (pPeakRSS)
+    {
+        PROCESS_MEMORY_COUNTERS pmc = {sizeof(pmc)};
+        *pPeakRSS = GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) ? pmc.PeakWorkingSetSize : 0;
+    }
+
+    return S_OK;
+}
+
 // IAMOpenProgress
 
 STDMETHODIMP CLAVSplitter::QueryProgress(LONGLONG *pllTotal, LONGLONG *pllCurrent)
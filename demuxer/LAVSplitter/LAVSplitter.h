@@ -23,6 +23,7 @@
 #pragma once
 
 #include <string>
+#include <deque>
 #include <list>
 #include <set>
 #include <vector>
@@ -34,6 +35,7 @@
 #include "LAVSplitterSettingsInternal.h"
 #include "SettingsProp.h"
 #include "IBufferInfo.h"
+#include "ILAVFPacketStats.h"
 #include "IURLSourceFilterLAV.h"
 
 #include "ISpecifyPropertyPages2.h"
@@ -67,6 +69,7 @@ class __declspec(uuid("171252A0-8820-4AFE-9DF8-5C92B2D66B04")) CLAVSplitter
     , public ISpecifyPropertyPages2
     , public IObjectWithSite
     , public IBufferInfo
+    , public ILAVFPacketStats
 {
   public:
     CLAVSplitter(LPUNKNOWN pUnk, HRESULT *phr);
@@ -137,6 +140,10 @@ class __declspec(uuid("171252A0-8820-4AFE-9DF8-5C92B2D66B04")) CLAVSplitter
     STDMETHODIMP GetStatus(int i, int &samples, int &size);
     STDMETHODIMP_(DWORD) GetPriority();
 
+    // ILAVFPacketStats
+    STDMETHODIMP GetPacketStats(LONGLONG *pllAllocations, LONGLONG *pllRecycled, double *pdAllocationsPerSec,
+                                SIZE_T *pPeakRSS);
+
     // ILAVFSettings
     STDMETHODIMP SetRuntimeConfig(BOOL bRuntimeConfig);
     STDMETHODIMP GetPreferredLanguages(LPWSTR *ppLanguages);
@@ -297,6 +304,10 @@ class __declspec(uuid("171252A0-8820-4AFE-9DF8-5C92B2D66B04")) CLAVSplitter
 
     CBaseDemuxer *m_pDemuxer = nullptr;
 
+    CCritSec m_csPacketStats;
+    LONGLONG m_llPacketStatsAllocations = 0; // allocations at the previous GetPacketStats call
+    ULONGLONG m_ullPacketStatsTime = 0;
+
     BOOL m_bPlaybackStarted = FALSE;
     BOOL m_bFakeASFReader = FALSE;
 
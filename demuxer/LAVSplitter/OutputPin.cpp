@@ -83,7 +83,6 @@ void CLAVOutputPin::SetQueueSizes()
 
 HRESULT CLAVOutputPin::GetQueueSize(int &samples, int &size)
 {
-    CAutoLock lock(&m_queue);
     samples = (int)m_queue.Size();
     size = (int)m_queue.DataSize();
     return S_OK;
@@ -411,32 +410,35 @@ DWORD CLAVOutputPin::ThreadProc()
     m_eEndFlush.Set();
     bool bFailFlush = false;
 
+    HANDLE hWaitEvents[2] = {GetRequestHandle(), m_queue.GetQueuedEvent()};
+
     while (1)
     {
-        Sleep(1);
-
-        DWORD cmd;
-        if (CheckRequest(&cmd))
+        // Sleep until packets are queued or a command arrives, commands take precedence
+        DWORD dwWait = WaitForMultipleObjects(countof(hWaitEvents), hWaitEvents, FALSE, INFINITE);
+        if (dwWait == WAIT_OBJECT_0)
         {
-            cmd = GetRequest();
+            // the wait consumed the request event, so fetch the command directly
+            DWORD cmd = GetRequestParam();
             Reply(S_OK);
             ASSERT(cmd == CMD_EXIT);
             return 0;
         }
+        else if (dwWait != WAIT_OBJECT_0 + 1)
+        {
+            DbgLog((LOG_ERROR, 10, L"OutputPin::ThreadProc(): Waiting for packets failed on %s pin",
+                    CBaseDemuxer::CStreamList::ToStringW(GetPinType())));
+            Sleep(1);
+            continue;
+        }
 
         size_t cnt = 0;
         do
         {
             Packet *pPacket = nullptr;
 
-            // Get a packet from the queue (scoped for lock)
-            {
-                CAutoLock cAutoLock(&m_queue);
-                if ((cnt = m_queue.Size()) > 0)
-                {
-                    pPacket = m_queue.Get();
-                }
-            }
+            // Get a packet from the queue, cnt is the number of packets that were queued
+            cnt = m_queue.Get(&pPacket);
 
             // We need to check cnt instead of pPacket, since it can be nullptr for EndOfStream
             if (m_hrDeliver == S_OK && cnt > 0)
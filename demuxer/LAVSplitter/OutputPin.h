@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <deque>
 #include <vector>
 #include <string>
 #include "PacketQueue.h"
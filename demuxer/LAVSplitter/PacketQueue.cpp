@@ -21,63 +21,77 @@
 #include "PacketQueue.h"
 #include "BaseDemuxer.h"
 
+CPacketQueue::CPacketQueue()
+{
+}
+
+CPacketQueue::~CPacketQueue()
+{
+    Clear();
+}
+
 // Queue a new packet at the end of the list
 void CPacketQueue::Queue(Packet *pPacket)
 {
-    CAutoLock cAutoLock(this);
-
     if (pPacket)
         m_dataSize += (size_t)pPacket->GetDataSize();
 
-    m_queue.push_back(pPacket);
+    if (!m_Ring.Push(pPacket))
+    {
+        DbgLog((LOG_ERROR, 10, L"CPacketQueue::Queue() - ring is at its maximum size, waiting for the consumer"));
+        while (!m_Ring.Push(pPacket))
+            Sleep(1);
+    }
+
+    m_eQueued.Set();
 }
 
-// Get a packet from the beginning of the list
-Packet *CPacketQueue::Get()
+// Reset the queued event once the queue is empty
+void CPacketQueue::ResetQueuedEvent()
 {
-    CAutoLock cAutoLock(this);
+    m_eQueued.Reset();
 
-    if (m_queue.size() == 0)
-    {
-        return nullptr;
-    }
-    Packet *pPacket = m_queue.front();
-    m_queue.pop_front();
-
-    if (pPacket)
-        m_dataSize -= (size_t)pPacket->GetDataSize();
+    // The producer may have queued a packet in the meantime, make sure its signal is not lost
+    if (!IsEmpty())
+        m_eQueued.Set();
+}
 
+// Get a packet from the beginning of the list
+Packet *CPacketQueue::Get()
+{
+    Packet *pPacket = nullptr;
+    Get(&pPacket);
     return pPacket;
 }
 
-// Get the size of the queue
-size_t CPacketQueue::Size()
+size_t CPacketQueue::Get(Packet **ppPacket)
 {
-    CAutoLock cAutoLock(this);
+    *ppPacket = nullptr;
 
-    return m_queue.size();
-}
+    const size_t count = m_Ring.Pop(ppPacket);
 
-// Get the size of the queue
-size_t CPacketQueue::DataSize()
-{
-    CAutoLock cAutoLock(this);
+    // A concurrent Clear can leave the event set on an empty queue, so it is reset here as well
+    if (count <= 1)
+        ResetQueuedEvent();
 
-    return m_dataSize;
+    if (*ppPacket)
+        m_dataSize -= (size_t)(*ppPacket)->GetDataSize();
+
+    return count;
 }
 
 // Clear the List (all elements are free'ed)
 void CPacketQueue::Clear()
 {
-    CAutoLock cAutoLock(this);
-
-    DbgLog((LOG_TRACE, 10, L"CPacketQueue::Clear() - clearing queue with %d entries", m_queue.size()));
+    DbgLog((LOG_TRACE, 10, L"CPacketQueue::Clear() - clearing queue with %d entries", Size()));
 
-    std::deque<Packet *>::iterator it;
-    for (it = m_queue.begin(); it != m_queue.end(); ++it)
+    Packet *pPacket = nullptr;
+    while (m_Ring.Pop(&pPacket))
     {
-        delete *it;
+        if (pPacket)
+            m_dataSize -= (size_t)pPacket->GetDataSize();
+        SAFE_DELETE(pPacket);
     }
-    m_queue.clear();
-    m_dataSize = 0;
+
+    ResetQueuedEvent();
 }
@@ -19,46 +19,61 @@
 
 #pragma once
 
-#include <deque>
+#include <atomic>
+#include "PacketRing.h"
 
 #define MIN_PACKETS_IN_QUEUE 50 // Below this is considered "drying pin"
 
+#define PACKET_QUEUE_INITIAL_SIZE 256   // Initial ring size, has to be a power of two
+#define PACKET_QUEUE_MAX_SIZE (1 << 20) // Maximum ring size, has to be a power of two
+
 class Packet;
 
 // FIFO Packet Queue
-class CPacketQueue : public CCritSec
+//
+// Ring buffer for one producer and one consumer thread, see CPacketRing. No operation takes a lock, and
+// Clear can be called from a third thread while the consumer is running.
+// The output pins limit the queue by packet count and memory long before the ring reaches its maximum size,
+// if it does anyway, Queue waits for the consumer.
+class CPacketQueue
 {
   public:
-    CPacketQueue(){};
+    CPacketQueue();
+    ~CPacketQueue();
 
-    // Queue a new packet at the end of the list
+    // Queue a new packet at the end of the list (producer)
     void Queue(Packet *pPacket);
 
-    // Get a packet from the beginning of the list
+    // Get a packet from the beginning of the list (consumer)
     Packet *Get();
 
+    // Get a packet from the beginning of the list (consumer)
+    // Returns the number of packets in the queue before the call, or 0 if nothing was retrieved
+    size_t Get(Packet **ppPacket);
+
     // Get the size of the queue
-    size_t Size();
+    size_t Size() const { return m_Ring.Size(); }
 
     // Get the size of the queue in bytes
-    size_t DataSize();
+    size_t DataSize() const { return m_dataSize.load(std::memory_order_relaxed); }
 
     // Clear the List (all elements are free'ed)
     void Clear();
 
-    // Get access to the internal queue
-    std::deque<Packet *> *GetQueue() { return &m_queue; }
+    bool IsEmpty() const { return Size() == 0; }
 
-    bool IsEmpty()
-    {
-        CAutoLock cAutoLock(this);
-        return m_queue.empty();
-    }
+    // Get the event that is signaled while packets are in the queue
+    HANDLE GetQueuedEvent() { return m_eQueued; }
 
   private:
-    // The actual storage class
-    std::deque<Packet *> m_queue;
-    size_t m_dataSize = 0;
+    void ResetQueuedEvent();
+
+  private:
+    CPacketRing<Packet> m_Ring{PACKET_QUEUE_INITIAL_SIZE, PACKET_QUEUE_MAX_SIZE};
+    std::atomic<size_t> m_dataSize{0};
+
+    // Manual-reset event, set on Queue and reset when the queue runs empty
+    CAMEvent m_eQueued{TRUE};
 
 #ifdef DEBUG
     bool m_bWarnedFull = false;
@@ -0,0 +1,155 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+// Lock-free ring of pointers, for one producer thread and any number of consumer threads
+//
+// The ring starts with nInitialSize slots and doubles when full, up to nMaxSize slots (both powers of two).
+// Replaced rings are kept until the ring is destroyed, because a consumer may still be reading from them,
+// so the memory used never exceeds twice the largest ring.
+//
+// Consumers claim the head slot with a compare-and-swap, which lets Clear run on a third thread while the
+// regular consumer is popping, without any lock.
+template <class T> class CPacketRing
+{
+  public:
+    CPacketRing(size_t nInitialSize, size_t nMaxSize) : m_nMaxSize(nMaxSize)
+    {
+        m_pRing.store(AllocRing(nInitialSize), std::memory_order_relaxed);
+    }
+
+    ~CPacketRing()
+    {
+        FreeRing(m_pRing.load(std::memory_order_relaxed));
+        for (Ring *pRing : m_RetiredRings)
+            FreeRing(pRing);
+    }
+
+    CPacketRing(const CPacketRing &) = delete;
+    CPacketRing &operator=(const CPacketRing &) = delete;
+
+    // Add an element at the end (producer)
+    // Fails if the ring is full and already has its maximum size
+    bool Push(T *pElement)
+    {
+        const size_t tail = m_nTail.load(std::memory_order_relaxed);
+        Ring *pRing = m_pRing.load(std::memory_order_relaxed);
+        if (tail - m_nHead.load(std::memory_order_acquire) > pRing->nMask)
+        {
+            pRing = Grow(pRing, tail);
+            if (pRing == nullptr)
+                return false;
+        }
+
+        pRing->pSlots[tail & pRing->nMask].store(pElement, std::memory_order_relaxed);
+        m_nTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Remove the first element (consumer)
+    // Returns the number of elements before the call, or 0 if the ring was empty
+    size_t Pop(T **ppElement)
+    {
+        size_t head = m_nHead.load(std::memory_order_acquire);
+        for (;;)
+        {
+            const size_t tail = m_nTail.load(std::memory_order_acquire);
+            if (head == tail)
+                return 0;
+
+            // loaded after the tail, so the ring contains every slot up to it, either written by the producer
+            // or copied by Grow
+            const Ring *pRing = m_pRing.load(std::memory_order_acquire);
+            T *pElement = pRing->pSlots[head & pRing->nMask].load(std::memory_order_relaxed);
+
+            // on failure, another consumer took the slot and head is reloaded
+            if (m_nHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                *ppElement = pElement;
+                return tail - head;
+            }
+        }
+    }
+
+    // Number of elements, callable from any thread
+    // The head is loaded first, so a concurrent Pop can never make the result wrap around
+    size_t Size() const
+    {
+        const size_t head = m_nHead.load(std::memory_order_acquire);
+        return m_nTail.load(std::memory_order_acquire) - head;
+    }
+
+    // Current number of slots, only meaningful on the producer thread
+    size_t Capacity() const { return m_pRing.load(std::memory_order_relaxed)->nMask + 1; }
+
+  private:
+    struct Ring
+    {
+        size_t nMask;
+        std::atomic<T *> *pSlots;
+    };
+
+    static Ring *AllocRing(size_t nSize)
+    {
+        Ring *pRing = new Ring;
+        pRing->nMask = nSize - 1;
+        pRing->pSlots = new std::atomic<T *>[nSize];
+        return pRing;
+    }
+
+    static void FreeRing(Ring *pRing)
+    {
+        delete[] pRing->pSlots;
+        delete pRing;
+    }
+
+    // Double the size of the full ring, called by the producer
+    Ring *Grow(Ring *pRing, size_t tail)
+    {
+        const size_t nSize = pRing->nMask + 1;
+        if (nSize >= m_nMaxSize)
+            return nullptr;
+
+        Ring *pNewRing = AllocRing(nSize * 2);
+
+        // slots a consumer pops in the meantime are copied as well, but never read from the new ring
+        for (size_t i = m_nHead.load(std::memory_order_acquire); i != tail; i++)
+            pNewRing->pSlots[i & pNewRing->nMask].store(pRing->pSlots[i & pRing->nMask].load(std::memory_order_relaxed),
+                                                        std::memory_order_relaxed);
+
+        m_pRing.store(pNewRing, std::memory_order_release);
+        m_RetiredRings.push_back(pRing);
+        return pNewRing;
+    }
+
+  private:
+    std::atomic<Ring *> m_pRing{nullptr};
+    const size_t m_nMaxSize;
+
+    std::atomic<size_t> m_nHead{0}; // advanced by the consumers
+    std::atomic<size_t> m_nTail{0}; // advanced by the producer
+
+    // only touched by the producer and the destructor
+    std::vector<Ring *> m_RetiredRings;
+};
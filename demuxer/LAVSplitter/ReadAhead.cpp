@@ -0,0 +1,468 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stdafx.h"
+#include "ReadAhead.h"
+
+// Number of consecutive sequential reads before the prefetching starts
+#define READ_AHEAD_MIN_SEQUENTIAL 2
+
+/////////////////////////////////////////////////////////////////////////////
+// CAsyncReaderSource
+
+CAsyncReaderSource::CAsyncReaderSource(IAsyncReader *pReader, int nRequests)
+    : m_pReader(pReader)
+    , m_nRequests(max(nRequests, 1))
+{
+    m_pReader->AddRef();
+}
+
+CAsyncReaderSource::~CAsyncReaderSource()
+{
+    if (m_pAllocator)
+        m_pAllocator->Decommit();
+    SafeRelease(&m_pAllocator);
+    SafeRelease(&m_pReader);
+}
+
+HRESULT CAsyncReaderSource::InitAllocator()
+{
+    ALLOCATOR_PROPERTIES props = {m_nRequests, READ_AHEAD_BLOCK_SIZE, 1, 0};
+    ALLOCATOR_PROPERTIES actual = {0};
+
+    CAutoLock lock(&m_csReader);
+    HRESULT hr = m_pReader->RequestAllocator(nullptr, &props, &m_pAllocator);
+    if (SUCCEEDED(hr))
+        hr = m_pAllocator->GetProperties(&actual);
+    if (SUCCEEDED(hr) && (actual.cbBuffer < READ_AHEAD_BLOCK_SIZE || actual.cbAlign <= 0 ||
+                          (READ_AHEAD_BLOCK_SIZE % actual.cbAlign) != 0))
+        hr = E_FAIL;
+    if (SUCCEEDED(hr))
+        hr = m_pAllocator->Commit();
+
+    if (FAILED(hr))
+    {
+        DbgLog((LOG_TRACE, 10, L"CAsyncReaderSource: Reader does not support queued requests, hr: 0x%X", hr));
+        SafeRelease(&m_pAllocator);
+        m_bAsyncFailed = TRUE;
+        return hr;
+    }
+
+    m_lAlign = actual.cbAlign;
+    m_lBufferSize = actual.cbBuffer;
+    return S_OK;
+}
+
+STDMETHODIMP CAsyncReaderSource::Length(LONGLONG *pTotal, LONGLONG *pAvailable)
+{
+    CAutoLock lock(&m_csReader);
+    return m_pReader->Length(pTotal, pAvailable);
+}
+
+STDMETHODIMP CAsyncReaderSource::SyncRead(LONGLONG llPos, LONG lLength, BYTE *pBuffer)
+{
+    CAutoLock lock(&m_csReader);
+    return m_pReader->SyncRead(llPos, lLength, pBuffer);
+}
+
+STDMETHODIMP CAsyncReaderSource::Request(LONGLONG llPos, LONG lLength, BYTE *pBuffer, DWORD_PTR dwUser)
+{
+    if (!m_pAllocator && !m_bAsyncFailed)
+        InitAllocator();
+
+    // The reader only queues aligned requests, anything else is read right away
+    if (m_pAllocator && lLength <= m_lBufferSize && (llPos % m_lAlign) == 0 && (lLength % m_lAlign) == 0)
+    {
+        // Never wait for a sample, the reader might have handed out fewer than were requested
+        IMediaSample *pSample = nullptr;
+        HRESULT hr = m_pAllocator->GetBuffer(&pSample, nullptr, nullptr, AM_GBF_NOWAIT);
+        if (SUCCEEDED(hr))
+        {
+            REFERENCE_TIME rtStart = llPos * UNITS;
+            REFERENCE_TIME rtStop = (llPos + lLength) * UNITS;
+            pSample->SetTime(&rtStart, &rtStop);
+
+            RequestContext *pContext = new RequestContext{pBuffer, lLength, dwUser};
+            {
+                CAutoLock lock(&m_csReader);
+                hr = m_pReader->Request(pSample, (DWORD_PTR)pContext);
+            }
+            if (SUCCEEDED(hr))
+                return S_OK;
+
+            delete pContext;
+            SafeRelease(&pSample);
+        }
+    }
+
+    HRESULT hr = SyncRead(llPos, lLength, pBuffer);
+    m_Completed.push_back({dwUser, hr == S_OK ? lLength : 0, hr});
+    return S_OK;
+}
+
+STDMETHODIMP CAsyncReaderSource::WaitForNext(DWORD dwTimeout, DWORD_PTR *pdwUser, LONG *plRead, HRESULT *phrRead)
+{
+    if (!m_Completed.empty())
+    {
+        const Completion &completion = m_Completed.front();
+        *pdwUser = completion.dwUser;
+        *plRead = completion.lRead;
+        *phrRead = completion.hr;
+        m_Completed.pop_front();
+        return S_OK;
+    }
+
+    if (!m_pAllocator)
+        return VFW_E_TIMEOUT;
+
+    // Waiting is not serialized with the other calls, the reader completes the requests on its own
+    IMediaSample *pSample = nullptr;
+    DWORD_PTR dwContext = 0;
+    HRESULT hr = m_pReader->WaitForNext(dwTimeout, &pSample, &dwContext);
+    if (pSample == nullptr)
+        return VFW_E_TIMEOUT;
+
+    RequestContext *pContext = (RequestContext *)dwContext;
+    LONG lRead = 0;
+
+    BYTE *pData = nullptr;
+    if (SUCCEEDED(hr) && SUCCEEDED(pSample->GetPointer(&pData)))
+    {
+        lRead = min(pSample->GetActualDataLength(), pContext->lLength);
+        memcpy(pContext->pBuffer, pData, lRead);
+    }
+
+    *pdwUser = pContext->dwUser;
+    *plRead = lRead;
+    *phrRead = hr;
+
+    delete pContext;
+    SafeRelease(&pSample);
+
+    return S_OK;
+}
+
+STDMETHODIMP CAsyncReaderSource::BeginFlush()
+{
+    if (!m_pAllocator)
+        return S_OK;
+
+    CAutoLock lock(&m_csReader);
+    return m_pReader->BeginFlush();
+}
+
+STDMETHODIMP CAsyncReaderSource::EndFlush()
+{
+    if (!m_pAllocator)
+        return S_OK;
+
+    CAutoLock lock(&m_csReader);
+    return m_pReader->EndFlush();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CReadAheadCache
+
+CReadAheadCache::CReadAheadCache(IReadAheadSource *pSource, int nBlocks, int nRequests)
+    : m_pSource(pSource)
+{
+    // A read of one block can span two blocks if its not aligned
+    m_Blocks.resize(max(nBlocks, 2));
+    for (Block &block : m_Blocks)
+    {
+        block.pData = (BYTE *)av_malloc(READ_AHEAD_BLOCK_SIZE);
+        if (block.pData == nullptr)
+            return;
+    }
+
+    m_nMaxRequests = min(max(nRequests, 1), (int)m_Blocks.size());
+
+    Create();
+}
+
+CReadAheadCache::~CReadAheadCache()
+{
+    if (ThreadExists())
+    {
+        // Abort the queued reads, so the worker does not need to wait for them to finish
+        m_pSource->BeginFlush();
+        CallWorker(CMD_EXIT);
+        Close();
+        m_pSource->EndFlush();
+    }
+
+    for (Block &block : m_Blocks)
+        av_freep(&block.pData);
+}
+
+HRESULT CReadAheadCache::Read(LONGLONG pos, LONG len, BYTE *pBuffer)
+{
+    CAutoLock lock(&m_csCache);
+
+    // Any jump in the read position is a seek, which stops the prefetching until the pattern is sequential again
+    if (pos != m_llLastReadEnd)
+        m_nSequentialReads = 0;
+    else
+        m_nSequentialReads++;
+    m_llLastReadEnd = pos + len;
+
+    if (m_nSequentialReads < READ_AHEAD_MIN_SEQUENTIAL || len <= 0 || !ThreadExists())
+        return S_FALSE;
+
+    const LONGLONG llFirstBlock = pos / READ_AHEAD_BLOCK_SIZE;
+    const LONGLONG llLastBlock = (pos + len - 1) / READ_AHEAD_BLOCK_SIZE;
+    if (llLastBlock - llFirstBlock >= (LONGLONG)m_Blocks.size())
+        return S_FALSE;
+
+    // Move the window along with the read position
+    if (m_nSequentialReads == READ_AHEAD_MIN_SEQUENTIAL || m_llWindowStart != llFirstBlock)
+    {
+        m_llWindowStart = llFirstBlock;
+        m_evWork.Set();
+    }
+
+    for (LONGLONG llBlock = llFirstBlock; llBlock <= llLastBlock; llBlock++)
+    {
+        Block &block = m_Blocks[llBlock % m_Blocks.size()];
+
+        // Wait for the worker if the block is being read right now
+        while (block.llBlock == llBlock && block.state == BlockPending)
+        {
+            m_csCache.Unlock();
+            m_evBlockDone.Wait();
+            m_csCache.Lock();
+        }
+
+        if (block.llBlock != llBlock || block.state != BlockReady)
+            return S_FALSE;
+
+        const LONGLONG llBlockPos = llBlock * READ_AHEAD_BLOCK_SIZE;
+        const LONGLONG llStart = max(pos, llBlockPos);
+        const LONGLONG llEnd = min(pos + len, llBlockPos + READ_AHEAD_BLOCK_SIZE);
+
+        // Short blocks only occur at the end of the available data, leave that to the caller
+        if (llEnd > llBlockPos + block.lLength)
+            return S_FALSE;
+
+        memcpy(pBuffer + (llStart - pos), block.pData + (llStart - llBlockPos), (size_t)(llEnd - llStart));
+    }
+
+    return S_OK;
+}
+
+void CReadAheadCache::Invalidate()
+{
+    CAutoLock lock(&m_csCache);
+
+    // Blocks that are still being read are discarded by the worker once the read finishes
+    m_dwGeneration++;
+    for (Block &block : m_Blocks)
+    {
+        if (block.state != BlockPending)
+        {
+            block.llBlock = -1;
+            block.state = BlockEmpty;
+        }
+    }
+
+    m_llLastReadEnd = -1;
+    m_nSequentialReads = 0;
+}
+
+int CReadAheadCache::GetNextBlockToFetch(LONGLONG llAvailable)
+{
+    if (m_nSequentialReads < READ_AHEAD_MIN_SEQUENTIAL)
+        return -1;
+
+    for (size_t i = 0; i < m_Blocks.size(); i++)
+    {
+        const LONGLONG llBlock = m_llWindowStart + i;
+        if (llBlock * READ_AHEAD_BLOCK_SIZE >= llAvailable)
+            break;
+
+        const int index = (int)(llBlock % m_Blocks.size());
+        Block &block = m_Blocks[index];
+        if (block.state == BlockPending)
+            continue;
+
+        if (block.llBlock == llBlock)
+        {
+            // Retry failed reads a few times, and read short blocks again if the source has grown since
+            if (block.state == BlockFailed && block.nRetries > READ_AHEAD_RETRIES)
+                continue;
+            if (block.state == BlockReady &&
+                (block.lLength == READ_AHEAD_BLOCK_SIZE || llAvailable <= block.llAvailable))
+                continue;
+        }
+        else
+        {
+            block.llBlock = llBlock;
+            block.nRetries = 0;
+        }
+
+        block.state = BlockPending;
+        block.lLength = 0;
+        block.llAvailable = llAvailable;
+        block.dwGeneration = m_dwGeneration;
+        return index;
+    }
+
+    return -1;
+}
+
+void CReadAheadCache::RequestBlocks()
+{
+    while (m_nRequests < m_nMaxRequests)
+    {
+        LONGLONG llTotal = 0, llAvailable = 0;
+        if (FAILED(m_pSource->Length(&llTotal, &llAvailable)))
+            return;
+
+        LONGLONG llPos = 0;
+        LONG lLength = 0;
+        BYTE *pData = nullptr;
+        int index = -1;
+        {
+            CAutoLock lock(&m_csCache);
+            index = GetNextBlockToFetch(llAvailable);
+            if (index < 0)
+                return;
+
+            const Block &block = m_Blocks[index];
+            llPos = block.llBlock * READ_AHEAD_BLOCK_SIZE;
+            lLength = (LONG)min(llAvailable - llPos, (LONGLONG)READ_AHEAD_BLOCK_SIZE);
+            pData = block.pData;
+        }
+
+        HRESULT hr = m_pSource->Request(llPos, lLength, pData, (DWORD_PTR)index);
+        if (FAILED(hr))
+        {
+            CompleteBlock(index, 0, hr);
+            return;
+        }
+        m_nRequests++;
+    }
+}
+
+void CReadAheadCache::CompleteBlock(int index, LONG lRead, HRESULT hr)
+{
+    {
+        CAutoLock lock(&m_csCache);
+        Block &block = m_Blocks[index];
+        ASSERT(block.state == BlockPending);
+
+        if (block.dwGeneration != m_dwGeneration)
+        {
+            block.llBlock = -1;
+            block.state = BlockEmpty;
+        }
+        else if (SUCCEEDED(hr) && lRead > 0)
+        {
+            // Short reads keep the data that was read, the block is read again once more data is available
+            block.state = BlockReady;
+            block.lLength = lRead;
+        }
+        else
+        {
+            DbgLog((LOG_TRACE, 10, L"CReadAheadCache: Read failed at block: %I64d, hr: 0x%X", block.llBlock, hr));
+            block.state = BlockFailed;
+            block.nRetries++;
+        }
+    }
+    m_evBlockDone.Set();
+}
+
+void CReadAheadCache::DropPendingBlocks()
+{
+    DbgLog((LOG_TRACE, 10, L"CReadAheadCache: Source returned no read, %d reads are lost", m_nRequests));
+
+    {
+        CAutoLock lock(&m_csCache);
+        for (Block &block : m_Blocks)
+        {
+            if (block.state == BlockPending)
+            {
+                block.llBlock = -1;
+                block.state = BlockEmpty;
+            }
+        }
+    }
+    m_nRequests = 0;
+    m_evBlockDone.Set();
+}
+
+DWORD CReadAheadCache::ThreadProc()
+{
+    SetThreadName(-1, "CReadAheadCache");
+
+    HANDLE hWaitEvents[2] = {GetRequestHandle(), m_evWork};
+
+    while (1)
+    {
+        RequestBlocks();
+
+        DWORD cmd;
+        if (m_nRequests == 0)
+        {
+            DWORD dwWait = WaitForMultipleObjects(countof(hWaitEvents), hWaitEvents, FALSE, INFINITE);
+            if (dwWait != WAIT_OBJECT_0)
+                continue;
+
+            // the wait consumed the request event, so fetch the command directly
+            cmd = GetRequestParam();
+        }
+        else
+        {
+            // Wait for the next read to finish, and queue more for the window
+            DWORD_PTR dwUser = 0;
+            LONG lRead = 0;
+            HRESULT hrRead = S_OK;
+            if (m_pSource->WaitForNext(INFINITE, &dwUser, &lRead, &hrRead) == S_OK)
+            {
+                m_nRequests--;
+                CompleteBlock((int)dwUser, lRead, hrRead);
+            }
+            else
+            {
+                DropPendingBlocks();
+            }
+
+            if (!CheckRequest(&cmd))
+                continue;
+        }
+
+        ASSERT(cmd == CMD_EXIT);
+
+        // Collect the outstanding reads before the buffers are released, they were aborted by the caller
+        while (m_nRequests > 0)
+        {
+            DWORD_PTR dwUser = 0;
+            LONG lRead = 0;
+            HRESULT hrRead = S_OK;
+            if (m_pSource->WaitForNext(INFINITE, &dwUser, &lRead, &hrRead) != S_OK)
+                break;
+            m_nRequests--;
+        }
+
+        Reply(S_OK);
+        return 0;
+    }
+
+    return 0;
+}
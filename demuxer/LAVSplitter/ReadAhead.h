@@ -0,0 +1,174 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#define READ_AHEAD_BLOCK_SIZE 131072 // Size of one prefetched block, reads are issued aligned to this
+#define READ_AHEAD_BLOCKS 8          // Default size of the prefetch window, in blocks
+#define READ_AHEAD_REQUESTS 4        // Default number of block reads in flight at the same time
+#define READ_AHEAD_RETRIES 2         // Number of times a failed block read is retried
+
+// Byte source of the read-ahead cache
+//
+// Block reads are queued with Request and are returned by WaitForNext once they finished, in any order.
+// Length and SyncRead can be called from any thread, all other functions are only called by the cache worker.
+interface IReadAheadSource
+{
+    virtual ~IReadAheadSource(void){};
+
+    STDMETHOD(Length)(LONGLONG * pTotal, LONGLONG * pAvailable) PURE;
+    STDMETHOD(SyncRead)(LONGLONG llPos, LONG lLength, BYTE * pBuffer) PURE;
+
+    // Queue a read of lLength bytes at llPos into pBuffer
+    // A source that cannot queue the read can also perform it right away, and return it from the next WaitForNext
+    STDMETHOD(Request)(LONGLONG llPos, LONG lLength, BYTE * pBuffer, DWORD_PTR dwUser) PURE;
+
+    // Wait for the next queued read to finish
+    // Returns S_OK and the result of the read, or VFW_E_TIMEOUT if no read finished in time
+    STDMETHOD(WaitForNext)(DWORD dwTimeout, DWORD_PTR * pdwUser, LONG * plRead, HRESULT * phrRead) PURE;
+
+    // Abort all queued reads, they are still returned by WaitForNext, but fail
+    STDMETHOD(BeginFlush)() PURE;
+    STDMETHOD(EndFlush)() PURE;
+};
+
+// Read-ahead source on top of an IAsyncReader
+//
+// Block reads are queued on the reader as asynchronous requests, if it supports them. All calls into the reader,
+// except for waiting on the queued requests, are serialized, so the demuxer and the cache worker can share it.
+class CAsyncReaderSource : public IReadAheadSource
+{
+  public:
+    CAsyncReaderSource(IAsyncReader *pReader, int nRequests = READ_AHEAD_REQUESTS);
+    ~CAsyncReaderSource();
+
+    STDMETHODIMP Length(LONGLONG *pTotal, LONGLONG *pAvailable);
+    STDMETHODIMP SyncRead(LONGLONG llPos, LONG lLength, BYTE *pBuffer);
+    STDMETHODIMP Request(LONGLONG llPos, LONG lLength, BYTE *pBuffer, DWORD_PTR dwUser);
+    STDMETHODIMP WaitForNext(DWORD dwTimeout, DWORD_PTR *pdwUser, LONG *plRead, HRESULT *phrRead);
+    STDMETHODIMP BeginFlush();
+    STDMETHODIMP EndFlush();
+
+  private:
+    HRESULT InitAllocator();
+
+    struct RequestContext
+    {
+        BYTE *pBuffer;
+        LONG lLength;
+        DWORD_PTR dwUser;
+    };
+
+    struct Completion
+    {
+        DWORD_PTR dwUser;
+        LONG lRead;
+        HRESULT hr;
+    };
+
+  private:
+    IAsyncReader *m_pReader = nullptr;
+    CCritSec m_csReader;
+
+    int m_nRequests = 0;
+    IMemAllocator *m_pAllocator = nullptr;
+    BOOL m_bAsyncFailed = FALSE; // the reader cannot queue requests, read synchronously instead
+    LONG m_lAlign = 1;
+    LONG m_lBufferSize = 0;
+
+    std::deque<Completion> m_Completed; // reads that were performed synchronously in Request
+};
+
+// Read-ahead cache on top of an IReadAheadSource
+//
+// Once a sequential read pattern is detected, the blocks following the current read position are requested
+// from the source into a window of block-aligned buffers, with several requests in flight at the same time,
+// so the caller no longer stalls on every read. Any non-sequential read is considered a seek, and discards all
+// outstanding prefetches.
+//
+// Failed blocks are retried a few times, and short blocks are read again once the source has more data
+// available. The cache only serves complete reads from data that was read successfully. Anything else,
+// including reads at the end of the stream, is left to the caller to read directly from the source.
+class CReadAheadCache : protected CAMThread
+{
+  public:
+    CReadAheadCache(IReadAheadSource *pSource, int nBlocks = READ_AHEAD_BLOCKS, int nRequests = READ_AHEAD_REQUESTS);
+    ~CReadAheadCache();
+
+    // Read len bytes at pos from the cache
+    // Returns S_OK if the read was served completely, S_FALSE if the caller has to read the data itself
+    HRESULT Read(LONGLONG pos, LONG len, BYTE *pBuffer);
+
+    // Drop all cached data, ie. because the underlying source changed its position
+    void Invalidate();
+
+  private:
+    enum
+    {
+        CMD_EXIT
+    };
+    DWORD ThreadProc();
+
+    // Find the next block in the window that needs to be read, called with the lock held
+    int GetNextBlockToFetch(LONGLONG llAvailable);
+    // Queue reads for the window until the maximum number of requests is in flight
+    void RequestBlocks();
+    // Store the result of a finished read
+    void CompleteBlock(int index, LONG lRead, HRESULT hr);
+    // Give up on all reads in flight, if the source no longer returns them
+    void DropPendingBlocks();
+
+    enum BlockState
+    {
+        BlockEmpty,
+        BlockPending,
+        BlockReady,
+        BlockFailed,
+    };
+
+    struct Block
+    {
+        LONGLONG llBlock = -1; // index of the block in the stream
+        BlockState state = BlockEmpty;
+        LONG lLength = 0;          // number of valid bytes
+        LONGLONG llAvailable = 0;  // available size of the source when the block was requested
+        int nRetries = 0;          // number of failed reads of this block
+        DWORD dwGeneration = 0;    // generation the block was requested in
+        BYTE *pData = nullptr;
+    };
+
+  private:
+    IReadAheadSource *m_pSource = nullptr;
+    int m_nMaxRequests = READ_AHEAD_REQUESTS;
+    int m_nRequests = 0; // number of reads in flight, only accessed by the worker
+
+    CCritSec m_csCache;
+    std::vector<Block> m_Blocks;
+
+    LONGLONG m_llWindowStart = 0; // first block of the prefetch window
+    LONGLONG m_llLastReadEnd = -1;
+    int m_nSequentialReads = 0;
+    DWORD m_dwGeneration = 0; // incremented on every seek to discard outdated reads
+
+    CAMEvent m_evWork;      // signaled when the window moved
+    CAMEvent m_evBlockDone; // signaled when the worker finished a block
+};
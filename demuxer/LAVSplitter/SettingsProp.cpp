@@ -535,6 +535,7 @@ CLAVSplitterFormatsProp::~CLAVSplitterFormatsProp(void)
 {
     SAFE_CO_FREE(m_bFormats);
     SafeRelease(&m_pLAVF);
+    SafeRelease(&m_pPacketStats);
 }
 
 HRESULT CLAVSplitterFormatsProp::OnConnect(IUnknown *pUnk)
@@ -544,12 +545,16 @@ HRESULT CLAVSplitterFormatsProp::OnConnect(IUnknown *pUnk)
         return E_POINTER;
     }
     ASSERT(m_pLAVF == nullptr);
-    return pUnk->QueryInterface(&m_pLAVF);
+    HRESULT hr = pUnk->QueryInterface(&m_pLAVF);
+    if (SUCCEEDED(hr) && FAILED(pUnk->QueryInterface(&m_pPacketStats)))
+        m_pPacketStats = nullptr;
+    return hr;
 }
 
 HRESULT CLAVSplitterFormatsProp::OnDisconnect()
 {
     SafeRelease(&m_pLAVF);
+    SafeRelease(&m_pPacketStats);
     return S_OK;
 }
 
@@ -594,6 +599,18 @@ HRESULT CLAVSplitterFormatsProp::OnActivate()
     }
     SendDlgItemMessage(m_Dlg, IDC_CUR_INPUT, WM_SETTEXT, 0, (LPARAM)stringBuffer);
 
+    memset(stringBuffer, 0, sizeof(stringBuffer));
+
+    LONGLONG llAllocations = 0, llRecycled = 0;
+    SIZE_T peakRSS = 0;
+    if (m_pPacketStats && pszInput &&
+        SUCCEEDED(m_pPacketStats->GetPacketStats(&llAllocations, &llRecycled, nullptr, &peakRSS)))
+    {
+        _snwprintf_s(stringBuffer, _TRUNCATE, L"%I64d, %I64d recycled (Peak Memory: %Iu MB)", llAllocations,
+                     llRecycled, peakRSS >> 20);
+    }
+    SendDlgItemMessage(m_Dlg, IDC_PACKET_STATS, WM_SETTEXT, 0, (LPARAM)stringBuffer);
+
     m_Formats = m_pLAVF->GetInputFormats();
 
     // Setup ListView control for format configuration
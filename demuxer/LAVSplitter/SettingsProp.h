@@ -21,6 +21,7 @@
 
 #include "BaseDSPropPage.h"
 #include "LAVSplitterSettingsInternal.h"
+#include "ILAVFPacketStats.h"
 
 // GUID: a19de2f2-2f74-4927-8436-61129d26c141
 DEFINE_GUID(CLSID_LAVSplitterSettingsProp, 0xa19de2f2, 0x2f74, 0x4927, 0x84, 0x36, 0x61, 0x12, 0x9d, 0x26, 0xc1, 0x41);
@@ -112,6 +113,7 @@ class CLAVSplitterFormatsProp : public CBaseDSPropPage
 
   private:
     ILAVFSettingsInternal *m_pLAVF = nullptr;
+    ILAVFPacketStats *m_pPacketStats = nullptr;
 
     std::set<FormatInfo> m_Formats;
     BOOL *m_bFormats = nullptr;
@@ -24,6 +24,7 @@
 
 #include "OutputPin.h"
 #include "H264Nalu.h"
+#include "StartCode.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4101)
@@ -110,7 +111,10 @@ HRESULT CStreamParser::Flush()
 {
     DbgLog((LOG_TRACE, 10, L"CStreamParser::Flush()"));
     SAFE_DELETE(m_pPacketBuffer);
-    m_queue.Clear();
+    SAFE_DELETE(m_pH264AU);
+    m_H264Nalus.clear();
+    m_nH264ParsePos = 0;
+    m_rtH264NextStart = m_rtH264NextStop = Packet::INVALID_TIME;
     m_bPGSDropState = FALSE;
     m_bHasAccessUnitDelimiters = false;
 
@@ -126,7 +130,10 @@ static Packet *InitPacket(Packet *pSource)
 {
     Packet *pNew = nullptr;
 
-    pNew = new Packet();
+    pNew = Packet::Create(pSource->GetArena());
+    if (!pNew)
+        return nullptr;
+
     pNew->StreamId = pSource->StreamId;
     pNew->bDiscontinuity = pSource->bDiscontinuity;
     pSource->bDiscontinuity = FALSE;
@@ -146,23 +153,34 @@ static Packet *InitPacket(Packet *pSource)
     return pNew;
 }
 
-#define MOVE_TO_H264_START_CODE(b, e)                                                                  \
-    while (b <= e - 4 && !((*(DWORD *)b == 0x01000000) || ((*(DWORD *)b & 0x00FFFFFF) == 0x00010000))) \
-        b++;                                                                                           \
-    if ((b <= e - 4) && *(DWORD *)b == 0x01000000)                                                     \
-        b++;
+// Move b to the 00 00 01 part of the next start code that is followed by at least one byte,
+// or to e - 3 if there is none
+#define MOVE_TO_H264_START_CODE(b, e)                       \
+    if (e - b >= 4)                                         \
+    {                                                       \
+        BYTE *sc = (BYTE *)find_start_code(b, e - 1);       \
+        b = (sc != e - 1) ? sc : e - 3;                     \
+    }
 
 HRESULT CStreamParser::ParseH264AnnexB(Packet *pPacket)
 {
     if (!m_pPacketBuffer)
     {
         m_pPacketBuffer = InitPacket(pPacket);
+        if (!m_pPacketBuffer)
+        {
+            SAFE_DELETE(pPacket);
+            return E_OUTOFMEMORY;
+        }
     }
 
     m_pPacketBuffer->Append(pPacket);
 
-    BYTE *start = m_pPacketBuffer->GetData();
-    BYTE *end = start + m_pPacketBuffer->GetDataSize();
+    // The data of the pending access unit stays in the packet buffer, only its NALUs are recorded
+    // Once the next access unit starts, the pending one is written into a single packet in length-prefixed format
+    BYTE *base = m_pPacketBuffer->GetData();
+    BYTE *start = base + m_nH264ParsePos;
+    BYTE *end = base + m_pPacketBuffer->GetDataSize();
 
     MOVE_TO_H264_START_CODE(start, end);
 
@@ -183,47 +201,59 @@ HRESULT CStreamParser::ParseH264AnnexB(Packet *pPacket)
         CH264Nalu Nalu;
         Nalu.SetBuffer(start, (int)size, 0);
 
-        Packet *p2 = nullptr;
-
+        bool bFirstNalu = true;
         while (Nalu.ReadNext())
         {
-            Packet *p3 = new Packet();
-            p3->SetDataSize((int)Nalu.GetDataLength() + 4);
-
-            // Write size of the NALU (Big Endian)
-            AV_WB32(p3->GetData(), (uint32_t)Nalu.GetDataLength());
-            memcpy(p3->GetData() + 4, Nalu.GetDataBuffer(), Nalu.GetDataLength());
-
-            if (!p2)
+            if (bFirstNalu)
             {
-                p2 = p3;
-            }
-            else
-            {
-                p2->Append(p3);
-                SAFE_DELETE(p3);
-            }
-        }
+                // The first NALU decides if a new access unit starts, and takes the packet properties
+                Packet *p = InitPacket(m_pPacketBuffer);
+                if (!p)
+                {
+                    // Leave the NALU in the buffer, it is parsed again with the next packet
+                    break;
+                }
 
-        if (!p2)
-            break;
+                if ((*Nalu.GetDataBuffer() & 0x1f) == 0x09)
+                {
+                    m_bHasAccessUnitDelimiters = true;
+                }
 
-        p2->StreamId = m_pPacketBuffer->StreamId;
-        p2->bDiscontinuity = m_pPacketBuffer->bDiscontinuity;
-        m_pPacketBuffer->bDiscontinuity = FALSE;
+                if (m_pH264AU && ((*Nalu.GetDataBuffer() & 0x1f) == 0x09 ||
+                                  (!m_bHasAccessUnitDelimiters && p->rtStart != Packet::INVALID_TIME)))
+                {
+                    DeliverH264AccessUnit();
+                }
 
-        p2->bSyncPoint = m_pPacketBuffer->bSyncPoint;
-        m_pPacketBuffer->bSyncPoint = FALSE;
+                if (!m_pH264AU)
+                {
+                    if (p->rtStart == Packet::INVALID_TIME && m_rtH264NextStart != Packet::INVALID_TIME)
+                    {
+                        p->rtStart = m_rtH264NextStart;
+                        p->rtStop = m_rtH264NextStop;
+                    }
+                    m_rtH264NextStart = m_rtH264NextStop = Packet::INVALID_TIME;
+                    m_pH264AU = p;
+                }
+                else
+                {
+                    // Timestamps inside an access unit belong to the next one
+                    if (m_rtH264NextStart == Packet::INVALID_TIME)
+                    {
+                        m_rtH264NextStart = p->rtStart;
+                        m_rtH264NextStop = p->rtStop;
+                    }
+                    SAFE_DELETE(p);
+                }
 
-        p2->rtStart = m_pPacketBuffer->rtStart;
-        m_pPacketBuffer->rtStart = Packet::INVALID_TIME;
-        p2->rtStop = m_pPacketBuffer->rtStop;
-        m_pPacketBuffer->rtStop = Packet::INVALID_TIME;
+                bFirstNalu = false;
+            }
 
-        p2->pmt = m_pPacketBuffer->pmt;
-        m_pPacketBuffer->pmt = nullptr;
+            m_H264Nalus.push_back({(size_t)(Nalu.GetDataBuffer() - base), Nalu.GetDataLength()});
+        }
 
-        m_queue.Queue(p2);
+        if (bFirstNalu)
+            break;
 
         if (pPacket->rtStart != Packet::INVALID_TIME)
         {
@@ -252,71 +282,48 @@ HRESULT CStreamParser::ParseH264AnnexB(Packet *pPacket)
         start = next;
     }
 
-    if (start > m_pPacketBuffer->GetData())
+    // Drop everything before the pending access unit
+    size_t consumed = m_H264Nalus.empty() ? (size_t)(start - base) : m_H264Nalus.front().offset;
+    if (consumed > 0)
     {
-        m_pPacketBuffer->RemoveHead((int)(start - m_pPacketBuffer->GetData()));
+        m_pPacketBuffer->RemoveHead((int)consumed);
+        for (H264NaluRef &nalu : m_H264Nalus)
+            nalu.offset -= consumed;
     }
+    m_nH264ParsePos = (start - base) - consumed;
 
     SAFE_DELETE(pPacket);
 
-    do
-    {
-        pPacket = nullptr;
+    return S_OK;
+}
 
-        REFERENCE_TIME rtStart = Packet::INVALID_TIME, rtStop = rtStart = Packet::INVALID_TIME;
+void CStreamParser::DeliverH264AccessUnit()
+{
+    size_t size = 0;
+    for (const H264NaluRef &nalu : m_H264Nalus)
+        size += nalu.length + 4;
 
-        std::deque<Packet *>::iterator it;
-        for (it = m_queue.GetQueue()->begin(); it != m_queue.GetQueue()->end(); ++it)
+    if (m_pH264AU->SetDataSize((int)size) == 0)
+    {
+        const BYTE *src = m_pPacketBuffer->GetData();
+        BYTE *dst = m_pH264AU->GetData();
+        for (const H264NaluRef &nalu : m_H264Nalus)
         {
-            // Skip the first
-            if (it == m_queue.GetQueue()->begin())
-            {
-                continue;
-            }
-
-            Packet *p = *it;
-            BYTE *pData = p->GetData();
-
-            if ((pData[4] & 0x1f) == 0x09)
-            {
-                m_bHasAccessUnitDelimiters = true;
-            }
-
-            if ((pData[4] & 0x1f) == 0x09 || (!m_bHasAccessUnitDelimiters && p->rtStart != Packet::INVALID_TIME))
-            {
-                pPacket = p;
-                if (p->rtStart == Packet::INVALID_TIME && rtStart != Packet::INVALID_TIME)
-                {
-                    p->rtStart = rtStart;
-                    p->rtStop = rtStop;
-                }
-                break;
-            }
-
-            if (rtStart == Packet::INVALID_TIME)
-            {
-                rtStart = p->rtStart;
-                rtStop = p->rtStop;
-            }
+            // Write size of the NALU (Big Endian)
+            AV_WB32(dst, (uint32_t)nalu.length);
+            memcpy(dst + 4, src + nalu.offset, nalu.length);
+            dst += nalu.length + 4;
         }
 
-        if (pPacket)
-        {
-            Packet *p = m_queue.Get();
-            Packet *p2 = nullptr;
-            while ((p2 = m_queue.Get()) != pPacket)
-            {
-                p->Append(p2);
-                SAFE_DELETE(p2);
-            }
-            // Return
-            m_queue.GetQueue()->push_front(pPacket);
-
-            Queue(p);
-        }
-    } while (pPacket != nullptr);
+        Queue(m_pH264AU);
+    }
+    else
+    {
+        delete m_pH264AU;
+    }
 
-    return S_OK;
+    m_pH264AU = nullptr;
+    m_H264Nalus.clear();
 }
 
 HRESULT CStreamParser::ParsePGS(Packet *pPacket)
@@ -498,7 +505,10 @@ HRESULT CStreamParser::ParseSRT(Packet *pPacket)
             }
             size_t size = ptr - linestart;
 
-            Packet *p = new Packet();
+            Packet *p = Packet::Create(pPacket->GetArena());
+            if (!p)
+                break;
+
             p->pmt = pPacket->pmt;
             pPacket->pmt = nullptr;
             p->bDiscontinuity = pPacket->bDiscontinuity;
@@ -526,7 +536,13 @@ HRESULT CStreamParser::ParsePlanarPCM(Packet *pPacket)
     if (nChannels == 1)
         return Queue(pPacket);
 
-    Packet *out = new Packet();
+    Packet *out = Packet::Create(pPacket->GetArena());
+    if (!out)
+    {
+        SAFE_DELETE(pPacket);
+        return E_OUTOFMEMORY;
+    }
+
     out->CopyProperties(pPacket);
     out->SetDataSize(pPacket->GetDataSize());
 
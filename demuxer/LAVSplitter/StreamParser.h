@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "PacketQueue.h"
 #include "growarray.h"
 
@@ -45,6 +47,8 @@ class CStreamParser
 
     HRESULT Queue(Packet *pPacket) const;
 
+    void DeliverH264AccessUnit();
+
   private:
     CLAVOutputPin *const m_pPin = nullptr;
     std::string m_strContainer;
@@ -56,7 +60,17 @@ class CStreamParser
     BOOL m_bPGSDropState = FALSE;
     GrowableArray<BYTE> m_pgsBuffer;
 
-    CPacketQueue m_queue;
+    // H264 Annex B access unit assembly
+    struct H264NaluRef
+    {
+        size_t offset; // offset of the NALU data in m_pPacketBuffer
+        size_t length;
+    };
+    std::vector<H264NaluRef> m_H264Nalus; // NALUs of the pending access unit
+    Packet *m_pH264AU = nullptr;          // properties of the pending access unit
+    size_t m_nH264ParsePos = 0;           // offset in m_pPacketBuffer where parsing continues
+    REFERENCE_TIME m_rtH264NextStart = Packet::INVALID_TIME;
+    REFERENCE_TIME m_rtH264NextStop = Packet::INVALID_TIME;
 
     bool m_bHasAccessUnitDelimiters = false;
 };
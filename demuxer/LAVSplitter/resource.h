@@ -48,6 +48,8 @@
 #define IDC_QUEUE_PACKETS               1040
 #define IDC_QUEUE_PACKETS_SPIN          1041
 #define IDC_STREAM_SWITCH_RESELECT_SUBS 1042
+#define IDC_LBL_PACKET_STATS            1043
+#define IDC_PACKET_STATS                1044
 
 // Next default values for new objects
 // 
@@ -55,7 +57,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        108
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1043
+#define _APS_NEXT_CONTROL_VALUE         1045
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,152 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Contention benchmark for the packet queue
+//
+// Moves packets from a producer to a consumer thread. For every packet, the producer checks the queue size
+// against the limit like CLAVOutputPin::QueuePacket, and polls it once per pin like CLAVSplitter::IsAnyPinDrying.
+// The lock-free CPacketRing is compared with the previous queue, a std::deque behind a lock (std::mutex here,
+// instead of CCritSec).
+
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "PacketRing.h"
+
+#define BENCH_PACKETS 2000000
+
+struct Packet
+{
+    int nData;
+};
+
+class CLockedQueue
+{
+  public:
+    void Queue(Packet *pPacket)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_queue.push_back(pPacket);
+    }
+
+    size_t Get(Packet **ppPacket)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        const size_t count = m_queue.size();
+        if (count)
+        {
+            *ppPacket = m_queue.front();
+            m_queue.pop_front();
+        }
+        return count;
+    }
+
+    size_t Size()
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        return m_queue.size();
+    }
+
+  private:
+    std::mutex m_Lock;
+    std::deque<Packet *> m_queue;
+};
+
+class CRingQueue
+{
+  public:
+    void Queue(Packet *pPacket)
+    {
+        while (!m_Ring.Push(pPacket))
+            std::this_thread::yield();
+    }
+
+    size_t Get(Packet **ppPacket) { return m_Ring.Pop(ppPacket); }
+
+    size_t Size() { return m_Ring.Size(); }
+
+  private:
+    CPacketRing<Packet> m_Ring{256, 1 << 20};
+};
+
+// Returns the throughput in million packets per second
+template <class Q> static double Run(int nPins, size_t nMaxQueued)
+{
+    Q queue;
+    Packet packet = {0};
+    size_t nDrying = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (int i = 0; i < BENCH_PACKETS; i++)
+        {
+            while (nMaxQueued && queue.Size() > nMaxQueued)
+                std::this_thread::yield();
+            for (int pin = 0; pin < nPins; pin++)
+                nDrying += queue.Size() < 50;
+            queue.Queue(&packet);
+        }
+    });
+
+    // the delivery thread sleeps on an event when the queue is empty
+    int nReceived = 0;
+    while (nReceived < BENCH_PACKETS)
+    {
+        Packet *pPacket = nullptr;
+        if (queue.Get(&pPacket))
+            nReceived++;
+        else
+            std::this_thread::yield();
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    producer.join();
+
+    return BENCH_PACKETS / std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+int main()
+{
+    printf("%-24s %12s %12s\n", "scenario", "locked", "ring");
+    printf("%-24s %12s %12s\n", "", "Mpkt/s", "Mpkt/s");
+
+    const struct
+    {
+        const char *name;
+        int nPins;
+        size_t nMaxQueued;
+    } scenarios[] = {
+        {"no limit, 1 pin", 1, 0},
+        {"limit 350, 1 pin", 1, 350},
+        {"limit 350, 3 pins", 3, 350},
+        {"limit 350, 8 pins", 8, 350},
+    };
+
+    for (const auto &s : scenarios)
+    {
+        const double locked = Run<CLockedQueue>(s.nPins, s.nMaxQueued);
+        const double ring = Run<CRingQueue>(s.nPins, s.nMaxQueued);
+        printf("%-24s %12.2f %12.2f\n", s.name, locked, ring);
+    }
+    return 0;
+}
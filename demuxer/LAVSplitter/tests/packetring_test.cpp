@@ -0,0 +1,148 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Stress test for CPacketRing
+//
+// One producer queues a running sequence while the consumer pops it and a third thread clears the ring from
+// time to time, like a flush does. Every element has to come out exactly once, the consumer has to see its
+// elements in order, and Size must never wrap around.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "PacketRing.h"
+
+#define TEST_ELEMENTS 2000000
+#define TEST_MAX_RING 1024
+
+struct Element
+{
+    size_t nIndex;
+};
+
+int main()
+{
+    std::vector<Element> elements(TEST_ELEMENTS);
+    std::vector<std::atomic<int>> popped(TEST_ELEMENTS);
+    for (size_t i = 0; i < elements.size(); i++)
+    {
+        elements[i].nIndex = i;
+        popped[i] = 0;
+    }
+
+    CPacketRing<Element> ring(4, TEST_MAX_RING);
+    std::atomic<bool> bDone{false};
+    std::atomic<int> nErrors{0};
+
+    // the first Push past the maximum size has to fail instead of growing
+    {
+        CPacketRing<Element> small(2, 4);
+        int nPushed = 0;
+        while (nPushed < 8 && small.Push(&elements[nPushed]))
+            nPushed++;
+        if (nPushed != 4 || small.Size() != 4 || small.Capacity() != 4)
+        {
+            fprintf(stderr, "maximum size not enforced: %d pushed\n", nPushed);
+            nErrors++;
+        }
+    }
+
+    std::thread producer([&]() {
+        for (size_t i = 0; i < TEST_ELEMENTS; i++)
+        {
+            while (!ring.Push(&elements[i]))
+                std::this_thread::yield();
+        }
+    });
+
+    auto take = [&](Element *pElement) {
+        if (popped[pElement->nIndex]++ != 0)
+        {
+            fprintf(stderr, "element %zu popped twice\n", pElement->nIndex);
+            nErrors++;
+        }
+    };
+
+    std::thread consumer([&]() {
+        size_t nLast = 0;
+        bool bFirst = true;
+        while (!bDone)
+        {
+            Element *pElement = nullptr;
+            if (ring.Pop(&pElement) == 0)
+                continue;
+            if (!bFirst && pElement->nIndex <= nLast)
+            {
+                fprintf(stderr, "element %zu popped after %zu\n", pElement->nIndex, nLast);
+                nErrors++;
+            }
+            bFirst = false;
+            nLast = pElement->nIndex;
+            take(pElement);
+        }
+    });
+
+    std::thread flusher([&]() {
+        while (!bDone)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            Element *pElement = nullptr;
+            while (ring.Pop(&pElement))
+                take(pElement);
+        }
+    });
+
+    std::thread monitor([&]() {
+        while (!bDone)
+        {
+            // with a pop and a push in between the loads, Size can exceed the ring, but never the element count
+            const size_t nSize = ring.Size();
+            if (nSize > TEST_ELEMENTS)
+            {
+                fprintf(stderr, "size wrapped around: %zu\n", nSize);
+                nErrors++;
+            }
+        }
+    });
+
+    producer.join();
+    while (ring.Size() > 0)
+        std::this_thread::yield();
+    bDone = true;
+    consumer.join();
+    flusher.join();
+    monitor.join();
+
+    for (size_t i = 0; i < TEST_ELEMENTS; i++)
+    {
+        if (popped[i] != 1)
+        {
+            fprintf(stderr, "element %zu popped %d times\n", i, (int)popped[i]);
+            nErrors++;
+            break;
+        }
+    }
+
+    printf("CPacketRing: %d elements, ring grew to %zu slots, %s\n", TEST_ELEMENTS, ring.Capacity(),
+           nErrors ? "FAILED" : "OK");
+    return nErrors ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+/*
+ *      Copyright (C) 2010-2021 Hendrik Leppkes
+ *      http://www.1f0.de
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#pragma once
+
+// {257136D8-253C-4EBA-B0FB-FA9F1724A2A9}
+DEFINE_GUID(IID_ILAVFPacketStats, 0x257136d8, 0x253c, 0x4eba, 0xb0, 0xfb, 0xfa, 0x9f, 0x17, 0x24, 0xa2, 0xa9);
+
+interface __declspec(uuid("257136D8-253C-4EBA-B0FB-FA9F1724A2A9")) ILAVFPacketStats : public IUnknown
+{
+    // Get statistics about the memory used by the demuxed packets
+    // pllAllocations: total number of heap allocations for packets and their payload
+    // pllRecycled: number of packets that re-used the memory of an earlier packet
+    // pdAllocationsPerSec: heap allocations per second since the previous call
+    // pPeakRSS: peak working set size of the process, in bytes
+    STDMETHOD(GetPacketStats)(LONGLONG * pllAllocations, LONGLONG * pllRecycled, double *pdAllocationsPerSec,
+                              SIZE_T *pPeakRSS) PURE;
+};
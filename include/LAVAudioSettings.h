@@ -201,6 +201,12 @@ interface __declspec(uuid("4158A22B-6553-45D0-8069-24716F8FF171")) ILAVAudioSett
     // Fallback to audio decoding if bitstreaming is not supported by the audio renderer/hardware
     STDMETHOD_(BOOL, GetBitstreamingFallback)() = 0;
     STDMETHOD(SetBitstreamingFallback)(BOOL bBitstreamingFallback) = 0;
+
+    // Batch decoding: collect input packets for up to dwMaxLatency milliseconds, and decode and deliver them in one go
+    // This reduces the per-packet overhead for codecs with very small packets, at the cost of additional latency.
+    // 0 disables batch decoding (default), the maximum latency is 500 ms.
+    STDMETHOD(SetBatchDecoding)(DWORD dwMaxLatency) = 0;
+    STDMETHOD_(DWORD, GetBatchDecoding)() = 0;
 };
 
 // LAV Audio Status Interface
@@ -225,4 +231,16 @@ interface __declspec(uuid("A668B8F2-BA87-4F63-9D41-768F7DE9C50E")) ILAVAudioStat
 
     // Get Volume Average for the given channel
     STDMETHOD(GetChannelVolumeAverage)(WORD nChannel, float *pfDb) = 0;
+
+    // Get the number of heap allocations done for PCM buffers since the filter was created
+    // Once the audio format is stable, this should no longer increase.
+    STDMETHOD(GetBufferAllocations)(LONGLONG * pllAllocations) = 0;
+
+    // Get the peak level in dB of the given channel since the previous call
+    STDMETHOD(GetChannelVolumePeak)(WORD nChannel, float *pfDb) = 0;
+
+    // Get a histogram of the timestamp jitter over the window used for the A/V sync correction
+    // The nBins bins are rtBinWidth wide (in 100ns units) and centered around zero. The outermost bins also count all
+    // values beyond them.
+    STDMETHOD(GetJitterHistogram)(LONGLONG rtBinWidth, DWORD *pBins, DWORD nBins) = 0;
 };
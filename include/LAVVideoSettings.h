@@ -406,6 +406,13 @@ interface __declspec(uuid("FA40D6E9-4D38-4761-ADD2-71A9EC5FD32F")) ILAVVideoSett
 
     //  Enable the creation of the Closed Caption output pin
     STDMETHOD(SetEnableCCOutputPin)(BOOL bEnabled) = 0;
+
+    // Output queue: number of decoded frames that can wait for a separate output thread, which performs software
+    // deinterlacing, pixel format conversion and delivery while the next frame is being decoded.
+    // 0 keeps everything on the streaming thread (default), the maximum is 8. Only used for software decoding,
+    // and takes effect the next time playback is started.
+    STDMETHOD(SetOutputQueueDepth)(DWORD dwDepth) = 0;
+    STDMETHOD_(DWORD, GetOutputQueueDepth)() = 0;
 };
 
 // LAV Video status interface
@@ -416,4 +423,13 @@ interface __declspec(uuid("1CC2385F-36FA-41B1-9942-5024CE0235DC")) ILAVVideoStat
 
     // Get the name of the currently active hwaccel device
     STDMETHOD(GetHWAccelActiveDevice)(BSTR * pstrDeviceName) = 0;
+
+    // Get the latency of the software deinterlacer per output field (or frame, when outputting one frame per frame),
+    // from the source frame being handed to the deinterlacer until the field is ready for delivery, in 100ns units.
+    // Averaged over the last 64 fields, and the maximum of those. Returns S_FALSE if no field was deinterlaced yet.
+    STDMETHOD(GetSWDeintLatency)(REFERENCE_TIME * prtAverage, REFERENCE_TIME * prtMaximum) = 0;
+
+    // Get the number of frame buffer requests served from the buffer pool (hits), and the number that needed a new
+    // allocation (misses). Each decoder instance has its own pool.
+    STDMETHOD(GetFrameBufferPoolStats)(LONGLONG * pllHits, LONGLONG * pllMisses) = 0;
 };